@@ -197,7 +197,7 @@ static bool tb_lookup_cmp(const void *p, const void *d)
         tb_page_addr0(tb) == desc->page_addr0 &&
         tb->cs_base == desc->cs_base &&
         tb->flags == desc->flags &&
-        tb_cflags(tb) == desc->cflags) {
+        (tb_cflags(tb) & ~CF_TIER2) == desc->cflags) {
         /* check next page if needed */
         tb_page_addr_t tb_phys_page1 = tb_page_addr1(tb);
         if (tb_phys_page1 == -1) {
@@ -248,6 +248,150 @@ static TranslationBlock *tb_htable_lookup(CPUState *cpu, vaddr pc,
     return qht_lookup_custom(&tb_ctx.htable, &desc, h, tb_lookup_cmp);
 }
 
+static CPUJumpCache *tb_jmp_cache_new(unsigned bits, bool l2)
+{
+    unsigned size = 1u << bits;
+    unsigned n_entries = l2 ? 2 * size : size;
+    CPUJumpCache *jc;
+
+    jc = g_malloc0(sizeof(*jc) + n_entries * sizeof(CPUJumpCacheEntry));
+    jc->bits = bits;
+    jc->n_entries = n_entries;
+    jc->l2 = l2 ? &jc->array[size] : NULL;
+    return jc;
+}
+
+/*
+ * Called by the vCPU thread at the end of each window of misses.  As
+ * in tlb_mmu_resize_locked, a larger cache replaces the current one if
+ * the miss rate shows that the guest's working set does not fit.  The
+ * new cache starts empty, because entries copied from the old one could
+ * miss concurrent invalidations.
+ */
+static CPUJumpCache *tb_jmp_cache_adapt(CPUState *cpu, CPUJumpCache *jc)
+{
+    bool grow = jc->window_lookups <
+                (uint64_t)jc->window_misses * TB_JMP_CACHE_GROW_RATE;
+    CPUJumpCache *new_jc;
+
+    qatomic_set(&jc->lookups, jc->lookups + jc->window_lookups);
+    qatomic_set(&jc->misses, jc->misses + jc->window_misses);
+    jc->window_lookups = 0;
+    jc->window_misses = 0;
+
+    if (!grow || jc->bits >= TB_JMP_CACHE_MAX_BITS) {
+        return jc;
+    }
+
+    new_jc = tb_jmp_cache_new(jc->bits + 1, jc->l2 != NULL);
+    new_jc->lookups = jc->lookups;
+    new_jc->misses = jc->misses;
+    new_jc->l2_hits = jc->l2_hits;
+    new_jc->resizes = jc->resizes + 1;
+
+    qatomic_rcu_set(&cpu->tb_jmp_cache, new_jc);
+    g_free_rcu(jc, rcu);
+    return new_jc;
+}
+
+static inline bool tb_jmp_cache_match(TranslationBlock *tb, vaddr entry_pc,
+                                      vaddr pc, uint64_t cs_base,
+                                      uint32_t flags, uint32_t cflags)
+{
+    return tb &&
+           entry_pc == pc &&
+           tb->cs_base == cs_base &&
+           tb->flags == flags &&
+           (tb_cflags(tb) & ~CF_TIER2) == cflags;
+}
+
+/*
+ * Copy @src to @dst, unless its TB was invalidated.  Entries for
+ * invalidated TBs must not be moved around: tb_evict_rcu may be
+ * clearing them concurrently.
+ */
+static inline void tb_jmp_cache_move(CPUJumpCacheEntry *dst,
+                                     vaddr pc, TranslationBlock *tb)
+{
+    if (tb && (tb_cflags(tb) & CF_INVALID)) {
+        tb = NULL;
+    }
+    dst->pc = pc;
+    qatomic_set(&dst->tb, tb);
+}
+
+/* Install @tb in entry @hash, moving the previous entry to the second level */
+static void tb_jmp_cache_insert(CPUJumpCache *jc, uint32_t hash,
+                                vaddr pc, TranslationBlock *tb)
+{
+    CPUJumpCacheEntry *e = &jc->array[hash];
+
+    if (jc->l2) {
+        CPUJumpCacheEntry *set = tb_jmp_cache_l2_set(jc, hash);
+        TranslationBlock *victim = qatomic_read(&e->tb);
+        int i;
+
+        if (victim) {
+            for (i = TB_JMP_CACHE_WAYS - 1; i > 0; i--) {
+                tb_jmp_cache_move(&set[i], set[i - 1].pc,
+                                  qatomic_read(&set[i - 1].tb));
+            }
+            tb_jmp_cache_move(&set[0], e->pc, victim);
+        }
+    }
+
+    e->pc = pc;
+    qatomic_set(&e->tb, tb);
+}
+
+/*
+ * Look up @pc after a miss in entry @hash of the first level of the jump
+ * cache: first in the second level, then in the hash table.
+ */
+static TranslationBlock *tb_jmp_cache_miss(CPUState *cpu, CPUJumpCache *jc,
+                                           uint32_t hash, vaddr pc,
+                                           uint64_t cs_base, uint32_t flags,
+                                           uint32_t cflags)
+{
+    TranslationBlock *tb;
+    int i;
+
+    if (jc->l2) {
+        CPUJumpCacheEntry *set = tb_jmp_cache_l2_set(jc, hash);
+
+        for (i = 0; i < TB_JMP_CACHE_WAYS; i++) {
+            tb = qatomic_read(&set[i].tb);
+            if (tb_jmp_cache_match(tb, set[i].pc, pc, cs_base, flags,
+                                   cflags)) {
+                /* Swap with the first level entry */
+                tb_jmp_cache_move(&set[i], jc->array[hash].pc,
+                                  qatomic_read(&jc->array[hash].tb));
+                jc->array[hash].pc = pc;
+                qatomic_set(&jc->array[hash].tb, tb);
+                qatomic_set(&jc->l2_hits, jc->l2_hits + 1);
+                return tb;
+            }
+        }
+    }
+
+    tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
+    if (tb == NULL) {
+        /* Not translated yet; the cache could not have helped */
+        return NULL;
+    }
+
+    if (++jc->window_misses == TB_JMP_CACHE_WINDOW) {
+        CPUJumpCache *new_jc = tb_jmp_cache_adapt(cpu, jc);
+
+        if (new_jc != jc) {
+            jc = new_jc;
+            hash = tb_jmp_cache_hash_func(jc, pc);
+        }
+    }
+    tb_jmp_cache_insert(jc, hash, pc, tb);
+    return tb;
+}
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
                                           uint64_t cs_base, uint32_t flags,
@@ -260,26 +404,21 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
     /* we should never be trying to look up an INVALID tb */
     tcg_debug_assert(!(cflags & CF_INVALID));
 
-    hash = tb_jmp_cache_hash_func(pc);
     jc = cpu->tb_jmp_cache;
+    hash = tb_jmp_cache_hash_func(jc, pc);
+    jc->window_lookups++;
 
     tb = qatomic_read(&jc->array[hash].tb);
-    if (likely(tb &&
-               jc->array[hash].pc == pc &&
-               tb->cs_base == cs_base &&
-               tb->flags == flags &&
-               tb_cflags(tb) == cflags)) {
+    if (likely(tb_jmp_cache_match(tb, jc->array[hash].pc, pc,
+                                  cs_base, flags, cflags))) {
         goto hit;
     }
 
-    tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
+    tb = tb_jmp_cache_miss(cpu, jc, hash, pc, cs_base, flags, cflags);
     if (tb == NULL) {
         return NULL;
     }
 
-    jc->array[hash].pc = pc;
-    qatomic_set(&jc->array[hash].tb, tb);
-
 hit:
     /*
      * As long as tb is not NULL, the contents are consistent.  Therefore,
@@ -926,8 +1065,16 @@ static inline void cpu_loop_exec_tb(CPUState *cpu, TranslationBlock *tb,
         return;
     }
 
+    /*
+     * Without icount, the only other reason for the exit is that the
+     * tier_count of @tb ran out: cpu_exec_loop will find it and
+     * retranslate it.
+     */
+    if (!icount_enabled()) {
+        return;
+    }
+
     /* Instruction counter expired.  */
-    assert(icount_enabled());
 #ifndef CONFIG_USER_ONLY
     /* Ensure global icount has gone forward */
     icount_update(cpu);
@@ -988,22 +1135,25 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
             }
 
             tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
-            if (tb == NULL) {
+            if (tb == NULL || unlikely(qatomic_read(&tb->tier_count) <= 0)) {
                 CPUJumpCache *jc;
                 uint32_t h;
 
                 mmap_lock();
-                tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
+                if (tb == NULL) {
+                    tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
+                } else {
+                    tb = tb_tier_up(cpu, tb, pc, cs_base, flags, cflags);
+                }
                 mmap_unlock();
 
                 /*
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
                  */
-                h = tb_jmp_cache_hash_func(pc);
                 jc = cpu->tb_jmp_cache;
-                jc->array[h].pc = pc;
-                qatomic_set(&jc->array[h].tb, tb);
+                h = tb_jmp_cache_hash_func(jc, pc);
+                tb_jmp_cache_insert(jc, h, pc, tb);
             }
 
 #ifndef CONFIG_USER_ONLY
@@ -1085,7 +1235,7 @@ bool tcg_exec_realizefn(CPUState *cpu, Error **errp)
         tcg_target_initialized = true;
     }
 
-    cpu->tb_jmp_cache = g_new0(CPUJumpCache, 1);
+    cpu->tb_jmp_cache = tb_jmp_cache_new(TB_JMP_CACHE_BITS, tb_jmp_cache_l2);
     tlb_init(cpu);
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_init_notifier_list(cpu);
@@ -89,14 +89,16 @@ QEMU_BUILD_BUG_ON(sizeof(vaddr) > sizeof(run_on_cpu_data));
 QEMU_BUILD_BUG_ON(NB_MMU_MODES > 16);
 #define ALL_MMUIDX_BITS ((1 << NB_MMU_MODES) - 1)
 
+/* The number of entries in each way of the tlb */
 static inline size_t tlb_n_entries(CPUTLBDescFast *fast)
 {
     return (fast->mask >> CPU_TLB_ENTRY_BITS) + 1;
 }
 
+/* The size of the table, including all the ways */
 static inline size_t sizeof_tlb(CPUTLBDescFast *fast)
 {
-    return fast->mask + (1 << CPU_TLB_ENTRY_BITS);
+    return (fast->mask + (1 << CPU_TLB_ENTRY_BITS)) * tlb_ways;
 }
 
 static inline uint64_t tlb_read_idx(const CPUTLBEntry *entry,
@@ -163,9 +165,13 @@ static void tb_jmp_cache_clear_page(CPUState *cpu, vaddr page_addr)
         return;
     }
 
-    i0 = tb_jmp_cache_hash_page(page_addr);
+    /* The second level sets for a page are at the same indexes */
+    i0 = tb_jmp_cache_hash_page(jc, page_addr);
     for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
         qatomic_set(&jc->array[i0 + i].tb, NULL);
+        if (jc->l2) {
+            qatomic_set(&jc->l2[i0 + i].tb, NULL);
+        }
     }
 }
 
@@ -205,9 +211,12 @@ static void tb_jmp_cache_clear_page(CPUState *cpu, vaddr page_addr)
  *
  * 3. Try to keep the maximum use rate in a time window in the 30-70% range,
  * since in that range performance is likely near-optimal. Recall that the TLB
- * is direct mapped, so we want the use rate to be low (or at least not too
- * high), since otherwise we are likely to have a significant amount of
- * conflict misses.
+ * is direct mapped (or has few ways), so we want the use rate to be low (or
+ * at least not too high), since otherwise we are likely to have a significant
+ * amount of conflict misses.
+ *
+ * The use rate is computed over all the ways, while the size is that of
+ * each way.
  */
 static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
                                   int64_t now)
@@ -222,13 +231,14 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
     if (desc->n_used_entries > desc->window_max_entries) {
         desc->window_max_entries = desc->n_used_entries;
     }
-    rate = desc->window_max_entries * 100 / old_size;
+    rate = desc->window_max_entries * 100 / (old_size * tlb_ways);
 
     if (rate > 70) {
         new_size = MIN(old_size << 1, 1 << CPU_TLB_DYN_MAX_BITS);
     } else if (rate < 30 && window_expired) {
-        size_t ceil = pow2ceil(desc->window_max_entries);
-        size_t expected_rate = desc->window_max_entries * 100 / ceil;
+        size_t per_way = DIV_ROUND_UP(desc->window_max_entries, tlb_ways);
+        size_t ceil = pow2ceil(per_way);
+        size_t expected_rate = per_way * 100 / ceil;
 
         /*
          * Avoid undersizing when the max number of entries seen is just below
@@ -259,8 +269,8 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
     tlb_window_reset(desc, now, 0);
     /* desc->n_used_entries is cleared by the caller */
     fast->mask = (new_size - 1) << CPU_TLB_ENTRY_BITS;
-    fast->table = g_try_new(CPUTLBEntry, new_size);
-    desc->fulltlb = g_try_new(CPUTLBEntryFull, new_size);
+    fast->table = g_try_new(CPUTLBEntry, new_size * tlb_ways);
+    desc->fulltlb = g_try_new(CPUTLBEntryFull, new_size * tlb_ways);
 
     /*
      * If the allocations fail, try smaller sizes. We just freed some
@@ -279,8 +289,8 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
 
         g_free(fast->table);
         g_free(desc->fulltlb);
-        fast->table = g_try_new(CPUTLBEntry, new_size);
-        desc->fulltlb = g_try_new(CPUTLBEntryFull, new_size);
+        fast->table = g_try_new(CPUTLBEntry, new_size * tlb_ways);
+        desc->fulltlb = g_try_new(CPUTLBEntryFull, new_size * tlb_ways);
     }
 }
 
@@ -311,8 +321,8 @@ static void tlb_mmu_init(CPUTLBDesc *desc, CPUTLBDescFast *fast, int64_t now)
     tlb_window_reset(desc, now, 0);
     desc->n_used_entries = 0;
     fast->mask = (n_entries - 1) << CPU_TLB_ENTRY_BITS;
-    fast->table = g_new(CPUTLBEntry, n_entries);
-    desc->fulltlb = g_new(CPUTLBEntryFull, n_entries);
+    fast->table = g_new(CPUTLBEntry, n_entries * tlb_ways);
+    desc->fulltlb = g_new(CPUTLBEntryFull, n_entries * tlb_ways);
     tlb_mmu_flush_locked(desc, fast);
 }
 
@@ -355,25 +365,6 @@ void tlb_destroy(CPUState *cpu)
     }
 }
 
-/* flush_all_helper: run fn across all cpus
- *
- * If the wait flag is set then the src cpu's helper will be queued as
- * "safe" work and the loop exited creating a synchronisation point
- * where all queued work will be finished before execution starts
- * again.
- */
-static void flush_all_helper(CPUState *src, run_on_cpu_func fn,
-                             run_on_cpu_data d)
-{
-    CPUState *cpu;
-
-    CPU_FOREACH(cpu) {
-        if (cpu != src) {
-            async_run_on_cpu(cpu, fn, d);
-        }
-    }
-}
-
 static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 {
     uint16_t asked = data.host_int;
@@ -428,21 +419,6 @@ void tlb_flush(CPUState *cpu)
     tlb_flush_by_mmuidx(cpu, ALL_MMUIDX_BITS);
 }
 
-void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *src_cpu, uint16_t idxmap)
-{
-    const run_on_cpu_func fn = tlb_flush_by_mmuidx_async_work;
-
-    tlb_debug("mmu_idx: 0x%"PRIx16"\n", idxmap);
-
-    flush_all_helper(src_cpu, fn, RUN_ON_CPU_HOST_INT(idxmap));
-    async_safe_run_on_cpu(src_cpu, fn, RUN_ON_CPU_HOST_INT(idxmap));
-}
-
-void tlb_flush_all_cpus_synced(CPUState *src_cpu)
-{
-    tlb_flush_by_mmuidx_all_cpus_synced(src_cpu, ALL_MMUIDX_BITS);
-}
-
 static bool tlb_hit_page_mask_anyprot(CPUTLBEntry *tlb_entry,
                                       vaddr page, vaddr mask)
 {
@@ -507,6 +483,23 @@ static inline void tlb_flush_vtlb_page_locked(CPUState *cpu, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(cpu, mmu_idx, page, -1);
 }
 
+/* Called with tlb_c.lock held */
+static void tlb_flush_set_page_mask_locked(CPUState *cpu, int mmu_idx,
+                                           vaddr page, vaddr mask)
+{
+    CPUTLBDescFast *fast = &cpu->neg.tlb.f[mmu_idx];
+    size_t n = tlb_n_entries(fast);
+    uintptr_t index = tlb_index(cpu, mmu_idx, page);
+    unsigned way;
+
+    for (way = 0; way < tlb_ways; way++) {
+        if (tlb_flush_entry_mask_locked(&fast->table[index + way * n],
+                                        page, mask)) {
+            tlb_n_used_entries_dec(cpu, mmu_idx);
+        }
+    }
+}
+
 static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
 {
     vaddr lp_addr = cpu->neg.tlb.d[midx].large_page_addr;
@@ -519,9 +512,7 @@ static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
                   midx, lp_addr, lp_mask);
         tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
     } else {
-        if (tlb_flush_entry_locked(tlb_entry(cpu, midx, page), page)) {
-            tlb_n_used_entries_dec(cpu, midx);
-        }
+        tlb_flush_set_page_mask_locked(cpu, midx, page, -1);
         tlb_flush_vtlb_page_locked(cpu, midx, page);
     }
 }
@@ -561,50 +552,6 @@ static void tlb_flush_page_by_mmuidx_async_0(CPUState *cpu,
     tb_jmp_cache_clear_page(cpu, addr);
 }
 
-/**
- * tlb_flush_page_by_mmuidx_async_1:
- * @cpu: cpu on which to flush
- * @data: encoded addr + idxmap
- *
- * Helper for tlb_flush_page_by_mmuidx and friends, called through
- * async_run_on_cpu.  The idxmap parameter is encoded in the page
- * offset of the target_ptr field.  This limits the set of mmu_idx
- * that can be passed via this method.
- */
-static void tlb_flush_page_by_mmuidx_async_1(CPUState *cpu,
-                                             run_on_cpu_data data)
-{
-    vaddr addr_and_idxmap = data.target_ptr;
-    vaddr addr = addr_and_idxmap & TARGET_PAGE_MASK;
-    uint16_t idxmap = addr_and_idxmap & ~TARGET_PAGE_MASK;
-
-    tlb_flush_page_by_mmuidx_async_0(cpu, addr, idxmap);
-}
-
-typedef struct {
-    vaddr addr;
-    uint16_t idxmap;
-} TLBFlushPageByMMUIdxData;
-
-/**
- * tlb_flush_page_by_mmuidx_async_2:
- * @cpu: cpu on which to flush
- * @data: allocated addr + idxmap
- *
- * Helper for tlb_flush_page_by_mmuidx and friends, called through
- * async_run_on_cpu.  The addr+idxmap parameters are stored in a
- * TLBFlushPageByMMUIdxData structure that has been allocated
- * specifically for this helper.  Free the structure when done.
- */
-static void tlb_flush_page_by_mmuidx_async_2(CPUState *cpu,
-                                             run_on_cpu_data data)
-{
-    TLBFlushPageByMMUIdxData *d = data.host_ptr;
-
-    tlb_flush_page_by_mmuidx_async_0(cpu, d->addr, d->idxmap);
-    g_free(d);
-}
-
 void tlb_flush_page_by_mmuidx(CPUState *cpu, vaddr addr, uint16_t idxmap)
 {
     tlb_debug("addr: %016" VADDR_PRIx " mmu_idx:%" PRIx16 "\n", addr, idxmap);
@@ -622,47 +569,6 @@ void tlb_flush_page(CPUState *cpu, vaddr addr)
     tlb_flush_page_by_mmuidx(cpu, addr, ALL_MMUIDX_BITS);
 }
 
-void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
-                                              vaddr addr,
-                                              uint16_t idxmap)
-{
-    tlb_debug("addr: %016" VADDR_PRIx " mmu_idx:%"PRIx16"\n", addr, idxmap);
-
-    /* This should already be page aligned */
-    addr &= TARGET_PAGE_MASK;
-
-    /*
-     * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
-     */
-    if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
-        async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                              RUN_ON_CPU_TARGET_PTR(addr | idxmap));
-    } else {
-        CPUState *dst_cpu;
-        TLBFlushPageByMMUIdxData *d;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                d = g_new(TLBFlushPageByMMUIdxData, 1);
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
-        }
-
-        d = g_new(TLBFlushPageByMMUIdxData, 1);
-        d->addr = addr;
-        d->idxmap = idxmap;
-        async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_2,
-                              RUN_ON_CPU_HOST_PTR(d));
-    }
-}
-
 void tlb_flush_page_all_cpus_synced(CPUState *src, vaddr addr)
 {
     tlb_flush_page_by_mmuidx_all_cpus_synced(src, addr, ALL_MMUIDX_BITS);
@@ -709,24 +615,14 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
 
     for (vaddr i = 0; i < len; i += TARGET_PAGE_SIZE) {
         vaddr page = addr + i;
-        CPUTLBEntry *entry = tlb_entry(cpu, midx, page);
 
-        if (tlb_flush_entry_mask_locked(entry, page, mask)) {
-            tlb_n_used_entries_dec(cpu, midx);
-        }
+        tlb_flush_set_page_mask_locked(cpu, midx, page, mask);
         tlb_flush_vtlb_page_mask_locked(cpu, midx, page, mask);
     }
 }
 
-typedef struct {
-    vaddr addr;
-    vaddr len;
-    uint16_t idxmap;
-    uint16_t bits;
-} TLBFlushRangeData;
-
 static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
-                                              TLBFlushRangeData d)
+                                              CPUTLBFlushRange d)
 {
     int mmu_idx;
 
@@ -747,7 +643,8 @@ static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
      * If the length is larger than the jump cache size, then it will take
      * longer to clear each entry individually than it will to clear it all.
      */
-    if (d.len >= (TARGET_PAGE_SIZE * TB_JMP_CACHE_SIZE)) {
+    if (d.len >= ((vaddr)TARGET_PAGE_SIZE *
+                  tb_jmp_cache_size(cpu->tb_jmp_cache))) {
         tcg_flush_jmp_cache(cpu);
         return;
     }
@@ -763,19 +660,182 @@ static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
     }
 }
 
-static void tlb_flush_range_by_mmuidx_async_1(CPUState *cpu,
-                                              run_on_cpu_data data)
+/*
+ * The *_all_cpus_synced functions do not queue one work item per flush
+ * and per vCPU.  As long as a vCPU has not processed the flushes queued
+ * for it, new flushes are merged into the same batch, so that a guest
+ * issuing a long sequence of TLB invalidations makes each vCPU exit once
+ * per sequence rather than once per invalidation.  Pages and ranges are
+ * merged when they overlap or are adjacent, and once a batch holds too
+ * many ranges their mmu_idx are flushed completely instead.
+ *
+ * The batch of the source vCPU is separate, because it runs as "safe"
+ * work: this creates a synchronisation point where all queued work will
+ * be finished before execution starts again.  Merging into a pending
+ * batch keeps this guarantee, since the batch has not run yet.
+ */
+
+/* Called with tlb_c.lock held */
+static void tlb_flush_batch_merge(CPUTLBFlushBatch *b, uint16_t full_idxmap,
+                                  const CPUTLBFlushRange *d)
 {
-    TLBFlushRangeData *d = data.host_ptr;
-    tlb_flush_range_by_mmuidx_async_0(cpu, *d);
-    g_free(d);
+    CPUTLBFlushRange *r;
+    uint16_t idxmap;
+    unsigned i, j;
+
+    if (full_idxmap & ~b->full_idxmap) {
+        b->full_idxmap |= full_idxmap;
+
+        /* Drop what the full flush covers from the ranges */
+        for (i = j = 0; i < b->n_ranges; i++) {
+            b->ranges[i].idxmap &= ~b->full_idxmap;
+            if (b->ranges[i].idxmap) {
+                b->ranges[j++] = b->ranges[i];
+            }
+        }
+        b->n_ranges = j;
+    }
+
+    if (!d) {
+        return;
+    }
+    idxmap = d->idxmap & ~b->full_idxmap;
+    if (!idxmap) {
+        return;
+    }
+
+    for (i = 0; i < b->n_ranges; i++) {
+        r = &b->ranges[i];
+        if (r->idxmap == idxmap && r->bits == d->bits &&
+            d->addr <= r->addr + r->len && r->addr <= d->addr + d->len) {
+            vaddr end = MAX(r->addr + r->len, d->addr + d->len);
+
+            r->addr = MIN(r->addr, d->addr);
+            r->len = end - r->addr;
+            return;
+        }
+    }
+
+    if (b->n_ranges == CPU_TLB_FLUSH_BATCH_SIZE) {
+        for (i = 0; i < b->n_ranges; i++) {
+            idxmap |= b->ranges[i].idxmap;
+        }
+        b->full_idxmap |= idxmap;
+        b->n_ranges = 0;
+        return;
+    }
+
+    r = &b->ranges[b->n_ranges++];
+    *r = *d;
+    r->idxmap = idxmap;
+}
+
+static void tlb_flush_batch_async_work(CPUState *cpu, run_on_cpu_data data)
+{
+    CPUTLBCommon *c = &cpu->neg.tlb.c;
+    CPUTLBFlushBatch *pending = data.host_int ? &c->safe_batch : &c->batch;
+    CPUTLBFlushBatch b;
+    unsigned i;
+
+    assert_cpu_is_self(cpu);
+
+    qemu_spin_lock(&c->lock);
+    b = *pending;
+    pending->queued = false;
+    pending->full_idxmap = 0;
+    pending->n_ranges = 0;
+    qemu_spin_unlock(&c->lock);
+
+    if (b.full_idxmap) {
+        tlb_flush_by_mmuidx_async_work(cpu,
+                                       RUN_ON_CPU_HOST_INT(b.full_idxmap));
+    }
+    for (i = 0; i < b.n_ranges; i++) {
+        tlb_flush_range_by_mmuidx_async_0(cpu, b.ranges[i]);
+    }
+}
+
+static void tlb_flush_batch_add(CPUState *cpu, bool safe,
+                                uint16_t full_idxmap,
+                                const CPUTLBFlushRange *d)
+{
+    CPUTLBCommon *c = &cpu->neg.tlb.c;
+    CPUTLBFlushBatch *pending = safe ? &c->safe_batch : &c->batch;
+    bool queue;
+
+    qemu_spin_lock(&c->lock);
+    queue = !pending->queued;
+    pending->queued = true;
+    tlb_flush_batch_merge(pending, full_idxmap, d);
+    if (!queue) {
+        qatomic_set(&c->batch_flush_count, c->batch_flush_count + 1);
+    }
+    qemu_spin_unlock(&c->lock);
+
+    if (!queue) {
+        return;
+    }
+    if (safe) {
+        async_safe_run_on_cpu(cpu, tlb_flush_batch_async_work,
+                              RUN_ON_CPU_HOST_INT(true));
+    } else {
+        async_run_on_cpu(cpu, tlb_flush_batch_async_work,
+                         RUN_ON_CPU_HOST_INT(false));
+    }
+}
+
+/*
+ * Flush @full_idxmap completely and, if @d is not NULL, the range it
+ * describes, on all cpus.
+ */
+static void tlb_flush_batch_all_cpus_synced(CPUState *src_cpu,
+                                            uint16_t full_idxmap,
+                                            const CPUTLBFlushRange *d)
+{
+    CPUState *dst_cpu;
+
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_flush_batch_add(dst_cpu, false, full_idxmap, d);
+        }
+    }
+    tlb_flush_batch_add(src_cpu, true, full_idxmap, d);
+}
+
+void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *src_cpu, uint16_t idxmap)
+{
+    tlb_debug("mmu_idx: 0x%"PRIx16"\n", idxmap);
+
+    tlb_flush_batch_all_cpus_synced(src_cpu, idxmap, NULL);
+}
+
+void tlb_flush_all_cpus_synced(CPUState *src_cpu)
+{
+    tlb_flush_by_mmuidx_all_cpus_synced(src_cpu, ALL_MMUIDX_BITS);
+}
+
+void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
+                                              vaddr addr,
+                                              uint16_t idxmap)
+{
+    CPUTLBFlushRange d = {
+        /* This should already be page aligned */
+        .addr = addr & TARGET_PAGE_MASK,
+        .len = TARGET_PAGE_SIZE,
+        .idxmap = idxmap,
+        .bits = TARGET_LONG_BITS,
+    };
+
+    tlb_debug("addr: %016" VADDR_PRIx " mmu_idx:%"PRIx16"\n", addr, idxmap);
+
+    tlb_flush_batch_all_cpus_synced(src_cpu, 0, &d);
 }
 
 void tlb_flush_range_by_mmuidx(CPUState *cpu, vaddr addr,
                                vaddr len, uint16_t idxmap,
                                unsigned bits)
 {
-    TLBFlushRangeData d;
+    CPUTLBFlushRange d;
 
     assert_cpu_is_self(cpu);
 
@@ -814,8 +874,7 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                                uint16_t idxmap,
                                                unsigned bits)
 {
-    TLBFlushRangeData d, *p;
-    CPUState *dst_cpu;
+    CPUTLBFlushRange d;
 
     /*
      * If all bits are significant, and len is small,
@@ -837,18 +896,7 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
     d.idxmap = idxmap;
     d.bits = bits;
 
-    /* Allocate a separate data block for each destination cpu.  */
-    CPU_FOREACH(dst_cpu) {
-        if (dst_cpu != src_cpu) {
-            p = g_memdup(&d, sizeof(d));
-            async_run_on_cpu(dst_cpu, tlb_flush_range_by_mmuidx_async_1,
-                             RUN_ON_CPU_HOST_PTR(p));
-        }
-    }
-
-    p = g_memdup(&d, sizeof(d));
-    async_safe_run_on_cpu(src_cpu, tlb_flush_range_by_mmuidx_async_1,
-                          RUN_ON_CPU_HOST_PTR(p));
+    tlb_flush_batch_all_cpus_synced(src_cpu, 0, &d);
 }
 
 void tlb_flush_page_bits_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
@@ -938,7 +986,7 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
     qemu_spin_lock(&cpu->neg.tlb.c.lock);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         unsigned int i;
-        unsigned int n = tlb_n_entries(&cpu->neg.tlb.f[mmu_idx]);
+        unsigned int n = tlb_n_entries(&cpu->neg.tlb.f[mmu_idx]) * tlb_ways;
 
         for (i = 0; i < n; i++) {
             tlb_reset_dirty_range_locked(&cpu->neg.tlb.f[mmu_idx].table[i],
@@ -973,7 +1021,14 @@ static void tlb_set_dirty(CPUState *cpu, vaddr addr)
     addr &= TARGET_PAGE_MASK;
     qemu_spin_lock(&cpu->neg.tlb.c.lock);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        tlb_set_dirty1_locked(tlb_entry(cpu, mmu_idx, addr), addr);
+        CPUTLBDescFast *fast = &cpu->neg.tlb.f[mmu_idx];
+        size_t n = tlb_n_entries(fast);
+        uintptr_t index = tlb_index(cpu, mmu_idx, addr);
+        unsigned way;
+
+        for (way = 0; way < tlb_ways; way++) {
+            tlb_set_dirty1_locked(&fast->table[index + way * n], addr);
+        }
     }
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
@@ -1040,8 +1095,9 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
 {
     CPUTLB *tlb = &cpu->neg.tlb;
     CPUTLBDesc *desc = &tlb->d[mmu_idx];
+    size_t n = tlb_n_entries(&tlb->f[mmu_idx]);
     MemoryRegionSection *section;
-    unsigned int index, read_flags, write_flags;
+    unsigned int index, read_flags, write_flags, way;
     uintptr_t addend;
     CPUTLBEntry *te, tn;
     hwaddr iotlb, xlat, sz, paddr_page;
@@ -1136,19 +1192,40 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
 
     /* Make sure there's no cached translation for the new page.  */
     tlb_flush_vtlb_page_locked(cpu, mmu_idx, addr_page);
+    for (way = 1; way < tlb_ways; way++) {
+        if (tlb_flush_entry_locked(&te[way * n], addr_page)) {
+            tlb_n_used_entries_dec(cpu, mmu_idx);
+        }
+    }
 
     /*
-     * Only evict the old entry to the victim tlb if it's for a
-     * different page; otherwise just overwrite the stale data.
+     * Only evict the old entry if it's for a different page; otherwise
+     * just overwrite the stale data.  The new entry goes to way 0 and
+     * the others move down one way, up to the first empty one.  If all
+     * the ways are in use, the entry of the last way goes to the victim
+     * tlb.
      */
     if (!tlb_hit_page_anyprot(te, addr_page) && !tlb_entry_is_empty(te)) {
-        unsigned vidx = desc->vindex++ % CPU_VTLB_SIZE;
-        CPUTLBEntry *tv = &desc->vtable[vidx];
-
-        /* Evict the old entry into the victim tlb.  */
-        copy_tlb_helper_locked(tv, te);
-        desc->vfulltlb[vidx] = desc->fulltlb[index];
-        tlb_n_used_entries_dec(cpu, mmu_idx);
+        for (way = 1; way < tlb_ways; way++) {
+            if (tlb_entry_is_empty(&te[way * n])) {
+                break;
+            }
+        }
+        if (way == tlb_ways) {
+            unsigned vidx = desc->vindex++ % CPU_VTLB_SIZE;
+            CPUTLBEntry *tv = &desc->vtable[vidx];
+
+            /* Evict the old entry into the victim tlb.  */
+            way--;
+            copy_tlb_helper_locked(tv, &te[way * n]);
+            desc->vfulltlb[vidx] = desc->fulltlb[index + way * n];
+            tlb_n_used_entries_dec(cpu, mmu_idx);
+        }
+        for (; way > 0; way--) {
+            copy_tlb_helper_locked(&te[way * n], &te[(way - 1) * n]);
+            desc->fulltlb[index + way * n] =
+                desc->fulltlb[index + (way - 1) * n];
+        }
     }
 
     /* refill the tlb */
@@ -1195,6 +1272,8 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
     copy_tlb_helper_locked(te, &tn);
     tlb_n_used_entries_inc(cpu, mmu_idx);
     qemu_spin_unlock(&tlb->c.lock);
+
+    qatomic_set(&tlb->c.fill_count, tlb->c.fill_count + 1);
 }
 
 void tlb_set_page_with_attrs(CPUState *cpu, vaddr addr,
@@ -1279,14 +1358,54 @@ static void io_failed(CPUState *cpu, CPUTLBEntryFull *full, vaddr addr,
     }
 }
 
-/* Return true if ADDR is present in the victim tlb, and has been copied
-   back to the main tlb.  */
+/*
+ * Return true if ADDR is present in another way of the set at INDEX,
+ * and has been swapped with way 0.
+ */
+static bool tlb_way_hit(CPUState *cpu, size_t mmu_idx, size_t index,
+                        MMUAccessType access_type, vaddr page)
+{
+    CPUTLBDescFast *fast = &cpu->neg.tlb.f[mmu_idx];
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+    size_t n = tlb_n_entries(fast);
+    unsigned way;
+
+    for (way = 1; way < tlb_ways; way++) {
+        CPUTLBEntry *tw = &fast->table[index + way * n];
+
+        if (tlb_hit_page(tlb_read_idx(tw, access_type), page)) {
+            CPUTLBEntry tmptlb, *tlb = &fast->table[index];
+
+            qemu_spin_lock(&cpu->neg.tlb.c.lock);
+            copy_tlb_helper_locked(&tmptlb, tlb);
+            copy_tlb_helper_locked(tlb, tw);
+            copy_tlb_helper_locked(tw, &tmptlb);
+            qemu_spin_unlock(&cpu->neg.tlb.c.lock);
+
+            CPUTLBEntryFull *f1 = &desc->fulltlb[index];
+            CPUTLBEntryFull *f2 = &desc->fulltlb[index + way * n];
+            CPUTLBEntryFull tmpf;
+            tmpf = *f1; *f1 = *f2; *f2 = tmpf;
+
+            qatomic_set(&cpu->neg.tlb.c.way_hit_count,
+                        cpu->neg.tlb.c.way_hit_count + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Return true if ADDR is present in the other ways or in the victim tlb,
+   and has been copied back to way 0 of the main tlb.  */
 static bool victim_tlb_hit(CPUState *cpu, size_t mmu_idx, size_t index,
                            MMUAccessType access_type, vaddr page)
 {
     size_t vidx;
 
     assert_cpu_is_self(cpu);
+    if (tlb_way_hit(cpu, mmu_idx, index, access_type, page)) {
+        return true;
+    }
     for (vidx = 0; vidx < CPU_VTLB_SIZE; ++vidx) {
         CPUTLBEntry *vtlb = &cpu->neg.tlb.d[mmu_idx].vtable[vidx];
         uint64_t cmp = tlb_read_idx(vtlb, access_type);
@@ -1305,6 +1424,9 @@ static bool victim_tlb_hit(CPUState *cpu, size_t mmu_idx, size_t index,
             CPUTLBEntryFull *f2 = &cpu->neg.tlb.d[mmu_idx].vfulltlb[vidx];
             CPUTLBEntryFull tmpf;
             tmpf = *f1; *f1 = *f2; *f2 = tmpf;
+
+            qatomic_set(&cpu->neg.tlb.c.victim_hit_count,
+                        cpu->neg.tlb.c.victim_hit_count + 1);
             return true;
         }
     }
@@ -1545,8 +1667,9 @@ tb_page_addr_t get_page_addr_code_hostp(CPUArchState *env, vaddr addr,
 /*
  * Perform a TLB lookup and populate the qemu_plugin_hwaddr structure.
  * This should be a hot path as we will have just looked this path up
- * in the softmmu lookup code (or helper). We don't handle re-fills or
- * checking the victim table. This is purely informational.
+ * in the softmmu lookup code (or helper). We don't handle re-fills,
+ * checking the victim table, or moving a hit in another way to way 0.
+ * This is purely informational.
  *
  * The one corner case is i/o write, which can cause changes to the
  * address space.  Those changes, and the corresponding tlb flush,
@@ -1556,17 +1679,29 @@ tb_page_addr_t get_page_addr_code_hostp(CPUArchState *env, vaddr addr,
 bool tlb_plugin_lookup(CPUState *cpu, vaddr addr, int mmu_idx,
                        bool is_store, struct qemu_plugin_hwaddr *data)
 {
-    CPUTLBEntry *tlbe = tlb_entry(cpu, mmu_idx, addr);
+    CPUTLBDescFast *fast = &cpu->neg.tlb.f[mmu_idx];
     uintptr_t index = tlb_index(cpu, mmu_idx, addr);
+    size_t n = tlb_n_entries(fast);
     MMUAccessType access_type = is_store ? MMU_DATA_STORE : MMU_DATA_LOAD;
-    uint64_t tlb_addr = tlb_read_idx(tlbe, access_type);
+    uint64_t tlb_addr = 0;
     CPUTLBEntryFull *full;
+    unsigned way;
 
-    if (unlikely(!tlb_hit(tlb_addr, addr))) {
+    /*
+     * The inline fast path of some backends hits in way 1 without
+     * swapping it into way 0, so look at all the ways.
+     */
+    for (way = 0; way < tlb_ways; way++) {
+        tlb_addr = tlb_read_idx(&fast->table[index + way * n], access_type);
+        if (tlb_hit(tlb_addr, addr)) {
+            break;
+        }
+    }
+    if (unlikely(way == tlb_ways)) {
         return false;
     }
 
-    full = &cpu->neg.tlb.d[mmu_idx].fulltlb[index];
+    full = &cpu->neg.tlb.d[mmu_idx].fulltlb[index + way * n];
     data->phys_addr = full->phys_addr | (addr & ~TARGET_PAGE_MASK);
 
     /* We must have an iotlb entry for MMIO */
@@ -16,6 +16,9 @@ extern int64_t max_delay;
 extern int64_t max_advance;
 
 extern bool one_insn_per_tb;
+extern uint32_t tb_tier_threshold;
+extern bool tb_jmp_cache_l2;
+extern unsigned tlb_ways;
 
 /*
  * Return true if CS is not running in parallel with other cpus, either
@@ -46,10 +49,14 @@ static inline bool cpu_plugin_mem_cbs_enabled(const CPUState *cpu)
 TranslationBlock *tb_gen_code(CPUState *cpu, vaddr pc,
                               uint64_t cs_base, uint32_t flags,
                               int cflags);
+TranslationBlock *tb_tier_up(CPUState *cpu, TranslationBlock *tb,
+                             vaddr pc, uint64_t cs_base, uint32_t flags,
+                             uint32_t cflags);
 void page_init(void);
 void tb_htable_init(void);
 void tb_reset_jump(TranslationBlock *tb, int n);
 TranslationBlock *tb_link_page(TranslationBlock *tb);
+void tb_evict_region(void);
 void cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
                                uintptr_t host_pc);
 
@@ -71,6 +71,40 @@ G_NORETURN void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
 
 bool tb_invalidate_phys_page_unwind(tb_page_addr_t addr, uintptr_t pc);
 
+#ifdef CONFIG_USER_ONLY
+TranslationBlock *tb_cache_lookup(tb_page_addr_t phys_pc, vaddr pc,
+                                  uint64_t cs_base, uint32_t flags,
+                                  uint32_t cflags);
+void tb_cache_note(TranslationBlock *tb);
+#else
+static inline TranslationBlock *tb_cache_lookup(tb_page_addr_t phys_pc,
+                                                vaddr pc, uint64_t cs_base,
+                                                uint32_t flags,
+                                                uint32_t cflags)
+{
+    return NULL;
+}
+static inline void tb_cache_note(TranslationBlock *tb) { }
+#endif
+
+#ifdef CONFIG_USER_ONLY
+#define tb_prefetch_enabled false
+static inline void tb_prefetch_note(DisasContextBase *db, vaddr dest) { }
+static inline void tb_prefetch_pause(void) { }
+static inline void tb_prefetch_resume(void) { }
+#else
+extern bool tb_prefetch_enabled;
+void tb_prefetch_init(unsigned n_threads);
+void tb_prefetch_note(DisasContextBase *db, vaddr dest);
+void tb_prefetch_pause(void);
+void tb_prefetch_resume(void);
+TranslationBlock *tb_gen_code_speculative(CPUState *cpu,
+                                          vaddr pc, uint64_t cs_base,
+                                          uint32_t flags, int cflags,
+                                          tb_page_addr_t phys_pc,
+                                          void *host_pc);
+#endif
+
 /* Return the current PC from CPU, which may be cached in TB. */
 static inline vaddr log_pc(CPUState *cpu, const TranslationBlock *tb)
 {
@@ -19,6 +19,7 @@
 #include "tcg/tcg.h"
 #include "internal-common.h"
 #include "tb-context.h"
+#include "tb-jmp-cache.h"
 
 
 static void dump_drift_info(GString *buf)
@@ -48,8 +49,10 @@ static void dump_accel_info(GString *buf)
                                                     &error_fatal);
 
     g_string_append_printf(buf, "Accelerator settings:\n");
-    g_string_append_printf(buf, "one-insn-per-tb: %s\n\n",
+    g_string_append_printf(buf, "one-insn-per-tb: %s\n",
                            one_insn_per_tb ? "on" : "off");
+    g_string_append_printf(buf, "tier-threshold: %u\n\n",
+                           qatomic_read(&tb_tier_threshold));
 }
 
 static void print_qht_statistics(struct qht_stats hst, GString *buf)
@@ -126,19 +129,64 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
-static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
+static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide,
+                             size_t *pbatch)
 {
     CPUState *cpu;
-    size_t full = 0, part = 0, elide = 0;
+    size_t full = 0, part = 0, elide = 0, batch = 0;
 
     CPU_FOREACH(cpu) {
         full += qatomic_read(&cpu->neg.tlb.c.full_flush_count);
         part += qatomic_read(&cpu->neg.tlb.c.part_flush_count);
         elide += qatomic_read(&cpu->neg.tlb.c.elide_flush_count);
+        batch += qatomic_read(&cpu->neg.tlb.c.batch_flush_count);
     }
     *pfull = full;
     *ppart = part;
     *pelide = elide;
+    *pbatch = batch;
+}
+
+static void tlb_hit_counts(size_t *pway_hits, size_t *pvictim_hits,
+                           size_t *pfills)
+{
+    CPUState *cpu;
+    size_t way_hits = 0, victim_hits = 0, fills = 0;
+
+    CPU_FOREACH(cpu) {
+        way_hits += qatomic_read(&cpu->neg.tlb.c.way_hit_count);
+        victim_hits += qatomic_read(&cpu->neg.tlb.c.victim_hit_count);
+        fills += qatomic_read(&cpu->neg.tlb.c.fill_count);
+    }
+    *pway_hits = way_hits;
+    *pvictim_hits = victim_hits;
+    *pfills = fills;
+}
+
+static void tb_jmp_cache_counts(size_t *plookups, size_t *pmisses,
+                                size_t *pl2_hits, size_t *presizes,
+                                size_t *pentries)
+{
+    CPUState *cpu;
+    size_t lookups = 0, misses = 0, l2_hits = 0, resizes = 0, entries = 0;
+
+    RCU_READ_LOCK_GUARD();
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+
+        if (jc) {
+            lookups += qatomic_read(&jc->lookups);
+            misses += qatomic_read(&jc->misses);
+            l2_hits += qatomic_read(&jc->l2_hits);
+            resizes += qatomic_read(&jc->resizes);
+            entries += jc->n_entries;
+        }
+    }
+    *plookups = lookups;
+    *pmisses = misses;
+    *pl2_hits = l2_hits;
+    *presizes = resizes;
+    *pentries = entries;
 }
 
 static void tcg_dump_info(GString *buf)
@@ -150,7 +198,10 @@ static void dump_exec_info(GString *buf)
 {
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
-    size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t nb_tbs, flush_full, flush_part, flush_elide, flush_batch;
+    size_t tlb_way_hits, tlb_victim_hits, tlb_fills;
+    size_t jc_lookups, jc_misses, jc_l2_hits, jc_resizes, jc_entries;
+    size_t ra_loads, ra_stores, ra_spills;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -191,11 +242,35 @@ static void dump_exec_info(GString *buf)
                            qatomic_read(&tb_ctx.tb_flush_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
-
-    tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
+    g_string_append_printf(buf, "TB tier-up count    %u\n",
+                           qatomic_read(&tb_ctx.tb_tier_up_count));
+    g_string_append_printf(buf, "TB eviction count   %u\n",
+                           qatomic_read(&tb_ctx.tb_evict_count));
+    g_string_append_printf(buf, "TB prefetch count   %u\n",
+                           qatomic_read(&tb_ctx.tb_prefetch_count));
+
+    tlb_flush_counts(&flush_full, &flush_part, &flush_elide, &flush_batch);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+    g_string_append_printf(buf, "TLB batched flushes %zu\n", flush_batch);
+
+    tlb_hit_counts(&tlb_way_hits, &tlb_victim_hits, &tlb_fills);
+    g_string_append_printf(buf, "TLB way hits        %zu\n", tlb_way_hits);
+    g_string_append_printf(buf, "TLB victim hits     %zu\n", tlb_victim_hits);
+    g_string_append_printf(buf, "TLB fills           %zu\n", tlb_fills);
+
+    tb_jmp_cache_counts(&jc_lookups, &jc_misses, &jc_l2_hits, &jc_resizes,
+                        &jc_entries);
+    g_string_append_printf(buf, "jump cache entries  %zu (resized %zu times)\n",
+                           jc_entries, jc_resizes);
+    g_string_append_printf(buf, "jump cache misses   %zu/%zu lookups "
+                           "(%zu second level hits)\n",
+                           jc_misses, jc_lookups, jc_l2_hits);
+
+    tcg_regalloc_counts(&ra_loads, &ra_stores, &ra_spills);
+    g_string_append_printf(buf, "temp loads/stores   %zu/%zu (%zu spills)\n",
+                           ra_loads, ra_stores, ra_spills);
     tcg_dump_info(buf);
 }
 
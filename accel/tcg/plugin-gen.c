@@ -201,6 +201,51 @@ static void gen_inline_store_u64_cb(struct qemu_plugin_inline_cb *cb)
     tcg_temp_free_ptr(ptr);
 }
 
+/*
+ * Store an event in the ring of the current vCPU, and flush the ring
+ * once it is full.  @vaddr is NULL for instruction events.
+ */
+static void gen_ring_cb(struct qemu_plugin_ring_cb *cb,
+                        TCGv_i64 vaddr, uint64_t info)
+{
+    struct qemu_plugin_ring *ring = cb->ring;
+    qemu_plugin_u64 entry = { .score = ring->score, .offset = 0 };
+    TCGv_ptr ptr = gen_plugin_u64_ptr(entry);
+    TCGv_ptr slot = tcg_temp_ebb_new_ptr();
+    TCGv_i64 n = tcg_temp_ebb_new_i64();
+    TCGv_i32 ofs = tcg_temp_ebb_new_i32();
+    TCGLabel *after_flush = gen_new_label();
+    const intptr_t event = offsetof(struct qemu_plugin_ring_entry, events);
+
+    tcg_gen_ld_i64(n, ptr, offsetof(struct qemu_plugin_ring_entry, n));
+    tcg_gen_extrl_i64_i32(ofs, n);
+    tcg_gen_muli_i32(ofs, ofs, sizeof(struct qemu_plugin_ring_event));
+    tcg_gen_ext_i32_ptr(slot, ofs);
+    tcg_gen_add_ptr(slot, slot, ptr);
+    tcg_temp_free_i32(ofs);
+
+    tcg_gen_st_i64(tcg_constant_i64(cb->pc), slot,
+                   event + offsetof(struct qemu_plugin_ring_event, pc));
+    tcg_gen_st_i64(vaddr ? vaddr : tcg_constant_i64(0), slot,
+                   event + offsetof(struct qemu_plugin_ring_event, vaddr));
+    tcg_gen_st_i64(tcg_constant_i64(info), slot,
+                   event + offsetof(struct qemu_plugin_ring_event, info));
+    tcg_temp_free_ptr(slot);
+
+    tcg_gen_addi_i64(n, n, 1);
+    tcg_gen_st_i64(n, ptr, offsetof(struct qemu_plugin_ring_entry, n));
+    tcg_gen_brcondi_i64(TCG_COND_LTU, n, ring->n_events, after_flush);
+    TCGv_i32 cpu_index = gen_cpu_index();
+    tcg_gen_call2(plugin_ring_flush, cb->info, NULL,
+                  tcgv_i32_temp(cpu_index),
+                  tcgv_ptr_temp(tcg_constant_ptr(ring)));
+    tcg_temp_free_i32(cpu_index);
+    gen_set_label(after_flush);
+
+    tcg_temp_free_i64(n);
+    tcg_temp_free_ptr(ptr);
+}
+
 static void gen_mem_cb(struct qemu_plugin_regular_cb *cb,
                        qemu_plugin_meminfo_t meminfo, TCGv_i64 addr)
 {
@@ -229,6 +274,9 @@ static void inject_cb(struct qemu_plugin_dyn_cb *cb)
     case PLUGIN_CB_INLINE_STORE_U64:
         gen_inline_store_u64_cb(&cb->inline_insn);
         break;
+    case PLUGIN_CB_RING:
+        gen_ring_cb(&cb->ring, NULL, cb->ring.data);
+        break;
     default:
         g_assert_not_reached();
     }
@@ -250,6 +298,11 @@ static void inject_mem_cb(struct qemu_plugin_dyn_cb *cb,
             inject_cb(cb);
         }
         break;
+    case PLUGIN_CB_RING:
+        if (rw & cb->ring.rw) {
+            gen_ring_cb(&cb->ring, addr, meminfo);
+        }
+        break;
     default:
         g_assert_not_reached();
         break;
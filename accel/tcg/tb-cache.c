@@ -0,0 +1,386 @@
+/*
+ * Persistent cache of translated code for user-mode emulation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/*
+ * Short-lived processes spend much of their time translating the same
+ * code on every run.  With the cache enabled, the code buffer is saved
+ * when the guest exits, together with the list of TBs in it, to a file
+ * named after the device, inode, size and modification time of the guest
+ * binary.  The next run copies it
+ * back into the code buffer at startup and, whenever a lookup misses,
+ * looks for a saved TB for the same guest code before translating.
+ *
+ * The TCG backends do not record where generated code refers to host
+ * addresses, so the code cannot be relocated.  Instead, the cache file
+ * is only used if the code buffer, the QEMU binary and guest_base are at
+ * the same addresses as when it was written.  This is normally the case
+ * for a static build of QEMU run with address space randomization
+ * disabled (e.g. "setarch -R").  TBs whose code refers to other host
+ * data (see TCGContext.gen_host_ptr) are not saved.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/cacheflush.h"
+#include "qemu/crc32c.h"
+#include "qemu/error-report.h"
+#include "exec/exec-all.h"
+#include "exec/cpu_ldst.h"
+#include "exec/page-protection.h"
+#include "exec/tb-cache.h"
+#include "tcg/tcg.h"
+#include "host/cpuinfo.h"
+#include "tb-context.h"
+#include "internal-common.h"
+#include "internal-target.h"
+
+#define TB_CACHE_MAGIC      "QEMUTBC"
+#define TB_CACHE_VERSION    1
+
+typedef struct TBCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_tbs;
+
+    /* Everything the generated code may depend on */
+    uint64_t qemu_text;
+    uint64_t qemu_size;
+    uint64_t qemu_mtime;
+    uint64_t cpuinfo;
+    uint64_t guest_base;
+    uint64_t reserved_va;
+    uint64_t code_gen_buffer;
+    uint64_t splitwx_diff;
+    uint32_t prologue_crc;
+    uint32_t cpu_model_crc;
+
+    /* Size of the code that follows the TB entries */
+    uint64_t code_size;
+} TBCacheHeader;
+
+typedef struct TBCacheEntry {
+    uint64_t offset;    /* of the TranslationBlock in the code */
+    uint32_t crc;       /* of the guest code */
+    uint32_t reserved;
+} TBCacheEntry;
+
+/* A TB that was loaded, but not used yet */
+typedef struct TBCacheLoaded {
+    tb_page_addr_t phys_pc;
+    uint32_t crc;
+    TranslationBlock *tb;
+    struct TBCacheLoaded *next;
+} TBCacheLoaded;
+
+static struct {
+    char *dir;
+    char *path;
+    TBCacheHeader header;
+
+    /* Loaded TBs by phys_pc, or NULL once the loaded code is gone */
+    GHashTable *index;
+    TBCacheLoaded *loaded;
+    unsigned flush_count;
+
+    /* TBs to save, if nothing was loaded */
+    GHashTable *save;
+} tb_cache;
+
+void tb_cache_enable(const char *dir)
+{
+#ifdef CONFIG_TCG_INTERPRETER
+    warn_report("The TB cache is not supported with TCI");
+#else
+    g_free(tb_cache.dir);
+    tb_cache.dir = g_strdup(dir);
+#endif
+}
+
+static bool tb_cache_header_init(TBCacheHeader *hdr, const char *cpu_model)
+{
+    const void *prologue = tcg_splitwx_to_rw((const void *)tcg_qemu_tb_exec);
+    struct stat st;
+
+    if (stat("/proc/self/exe", &st) < 0) {
+        return false;
+    }
+
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, TB_CACHE_MAGIC, sizeof(TB_CACHE_MAGIC));
+    hdr->version = TB_CACHE_VERSION;
+    hdr->qemu_text = (uintptr_t)tb_cache_header_init;
+    hdr->qemu_size = st.st_size;
+    hdr->qemu_mtime = st.st_mtime;
+#ifdef CPUINFO_ALWAYS
+    hdr->cpuinfo = cpuinfo;
+#endif
+    hdr->guest_base = guest_base;
+    hdr->reserved_va = reserved_va;
+    hdr->code_gen_buffer = (uintptr_t)tcg_ctx->code_gen_buffer;
+    hdr->splitwx_diff = tcg_splitwx_diff;
+    hdr->prologue_crc = crc32c(0xffffffff, prologue,
+                               (void *)tcg_ctx->code_gen_buffer - prologue);
+    hdr->cpu_model_crc = crc32c(0xffffffff, cpu_model, strlen(cpu_model));
+    return true;
+}
+
+/*
+ * Compute the path of the cache file from the identity of @exec_path.
+ * Hashing its contents would cost more than the cache saves for small
+ * programs; a TB is only used if its guest code is unchanged anyway.
+ */
+static char *tb_cache_path(const char *exec_path)
+{
+    g_autofree char *sum = NULL;
+    uint64_t key[5];
+    struct stat st;
+
+    if (stat(exec_path, &st) < 0) {
+        return NULL;
+    }
+    key[0] = st.st_dev;
+    key[1] = st.st_ino;
+    key[2] = st.st_size;
+    key[3] = st.st_mtim.tv_sec;
+    key[4] = st.st_mtim.tv_nsec;
+    sum = g_compute_checksum_for_data(G_CHECKSUM_SHA256,
+                                      (const guchar *)key, sizeof(key));
+    return g_strdup_printf("%s/%s-%s.tbc", tb_cache.dir, sum, TARGET_NAME);
+}
+
+static bool tb_cache_load_file(const char *contents, gsize len)
+{
+    const TBCacheHeader *hdr = (const TBCacheHeader *)contents;
+    const TBCacheEntry *entries = (const TBCacheEntry *)(hdr + 1);
+    void *buf = tcg_ctx->code_gen_buffer;
+    const char *code;
+    uint32_t i;
+
+    if (len < sizeof(*hdr) ||
+        memcmp(hdr, &tb_cache.header,
+               offsetof(TBCacheHeader, n_tbs)) != 0 ||
+        memcmp(&hdr->qemu_text, &tb_cache.header.qemu_text,
+               offsetof(TBCacheHeader, code_size) -
+               offsetof(TBCacheHeader, qemu_text)) != 0) {
+        return false;
+    }
+
+    code = (const char *)(entries + hdr->n_tbs);
+    if (len - sizeof(*hdr) < (uint64_t)hdr->n_tbs * sizeof(*entries) ||
+        contents + len - code != hdr->code_size ||
+        hdr->code_size > (void *)tcg_ctx->code_gen_highwater - buf) {
+        return false;
+    }
+
+    if (hdr->code_size < sizeof(TranslationBlock)) {
+        return false;
+    }
+    for (i = 0; i < hdr->n_tbs; i++) {
+        if (entries[i].offset > hdr->code_size - sizeof(TranslationBlock) ||
+            !QEMU_IS_ALIGNED(entries[i].offset,
+                             __alignof__(TranslationBlock))) {
+            return false;
+        }
+    }
+
+    memcpy(buf, code, hdr->code_size);
+    flush_idcache_range((uintptr_t)tcg_splitwx_to_rx(buf), (uintptr_t)buf,
+                        hdr->code_size);
+    tcg_ctx->code_gen_ptr = buf + hdr->code_size;
+
+    tb_cache.index = g_hash_table_new(g_int64_hash, g_int64_equal);
+    tb_cache.loaded = g_new(TBCacheLoaded, hdr->n_tbs);
+    for (i = 0; i < hdr->n_tbs; i++) {
+        TBCacheLoaded *e = &tb_cache.loaded[i];
+
+        e->tb = buf + entries[i].offset;
+        e->phys_pc = tb_page_addr0(e->tb);
+        e->crc = entries[i].crc;
+        e->next = g_hash_table_lookup(tb_cache.index, &e->phys_pc);
+        g_hash_table_insert(tb_cache.index, &e->phys_pc, e);
+    }
+    tb_cache.flush_count = tb_ctx.tb_flush_count;
+    return true;
+}
+
+void tb_cache_load(const char *exec_path, const char *cpu_model)
+{
+    g_autofree char *contents = NULL;
+    gsize len;
+
+    if (!tb_cache.dir) {
+        return;
+    }
+
+    tb_cache.path = tb_cache_path(exec_path);
+    if (!tb_cache.path ||
+        !tb_cache_header_init(&tb_cache.header, cpu_model)) {
+        warn_report("Could not set up the TB cache for %s", exec_path);
+        return;
+    }
+
+    if (!g_file_get_contents(tb_cache.path, &contents, &len, NULL) ||
+        !tb_cache_load_file(contents, len)) {
+        tb_cache.save = g_hash_table_new(NULL, NULL);
+    }
+}
+
+/* Called with mmap_lock held */
+void tb_cache_note(TranslationBlock *tb)
+{
+    if (tb_cache.save && !tcg_ctx->gen_host_ptr) {
+        g_hash_table_add(tb_cache.save, tb);
+    }
+}
+
+static uint32_t tb_cache_guest_crc(TranslationBlock *tb)
+{
+    return crc32c(0xffffffff, g2h_untagged(tb_page_addr0(tb)), tb->size);
+}
+
+/* Make @tb, which was loaded from the cache file, available for execution */
+static TranslationBlock *tb_cache_activate(TranslationBlock *tb)
+{
+    TranslationBlock *existing_tb;
+
+    tb_lock_page0(tb_page_addr0(tb));
+    if (tb_page_addr1(tb) != -1) {
+        tb_lock_page1(tb_page_addr0(tb), tb_page_addr1(tb));
+    }
+    tb->tier_count = INT32_MAX;
+
+    qemu_spin_init(&tb->jmp_lock);
+    tb->jmp_list_head = (uintptr_t)NULL;
+    tb->jmp_list_next[0] = (uintptr_t)NULL;
+    tb->jmp_list_next[1] = (uintptr_t)NULL;
+    tb->jmp_dest[0] = (uintptr_t)NULL;
+    tb->jmp_dest[1] = (uintptr_t)NULL;
+
+    /* Undo any chaining done by the run that saved the code */
+    if (tb->jmp_reset_offset[0] != TB_JMP_OFFSET_INVALID) {
+        tb_reset_jump(tb, 0);
+    }
+    if (tb->jmp_reset_offset[1] != TB_JMP_OFFSET_INVALID) {
+        tb_reset_jump(tb, 1);
+    }
+
+    tcg_tb_insert(tb);
+    existing_tb = tb_link_page(tb);
+    if (unlikely(existing_tb != tb)) {
+        tcg_tb_remove(tb);
+    }
+    return existing_tb;
+}
+
+/*
+ * Return a loaded TB for the given lookup parameters, or NULL.
+ * Called with mmap_lock held, and with the jit buffer writable.
+ */
+TranslationBlock *tb_cache_lookup(tb_page_addr_t phys_pc, vaddr pc,
+                                  uint64_t cs_base, uint32_t flags,
+                                  uint32_t cflags)
+{
+    TBCacheLoaded *e;
+
+    if (likely(!tb_cache.index)) {
+        return NULL;
+    }
+
+    /* The loaded code is gone if the code buffer was flushed or reused */
+    if (tb_ctx.tb_flush_count != tb_cache.flush_count ||
+        tb_ctx.tb_evict_count) {
+        g_hash_table_destroy(tb_cache.index);
+        tb_cache.index = NULL;
+        g_free(tb_cache.loaded);
+        tb_cache.loaded = NULL;
+        return NULL;
+    }
+
+    for (e = g_hash_table_lookup(tb_cache.index, &phys_pc); e; e = e->next) {
+        TranslationBlock *tb = e->tb;
+        vaddr last;
+
+        if (!tb ||
+            !(tb_cflags(tb) & CF_PCREL || tb->pc == pc) ||
+            tb->cs_base != cs_base ||
+            tb->flags != flags ||
+            tb_cflags(tb) != cflags) {
+            continue;
+        }
+
+        last = tb_page_addr0(tb) + tb->size - 1;
+        if (!page_check_range(tb_page_addr0(tb), last, PAGE_EXEC) ||
+            tb_cache_guest_crc(tb) != e->crc) {
+            continue;
+        }
+
+        e->tb = NULL;
+        return tb_cache_activate(tb);
+    }
+    return NULL;
+}
+
+static void tb_cache_write(const TBCacheHeader *hdr, GArray *entries,
+                           const void *code)
+{
+    g_autofree char *tmp = g_strdup_printf("%s.XXXXXX", tb_cache.path);
+    int fd = g_mkstemp(tmp);
+
+    if (fd < 0) {
+        return;
+    }
+    if (qemu_write_full(fd, hdr, sizeof(*hdr)) != sizeof(*hdr) ||
+        qemu_write_full(fd, entries->data,
+                        entries->len * sizeof(TBCacheEntry)) !=
+            entries->len * sizeof(TBCacheEntry) ||
+        qemu_write_full(fd, code, hdr->code_size) != hdr->code_size ||
+        close(fd) < 0 ||
+        rename(tmp, tb_cache.path) < 0) {
+        unlink(tmp);
+    }
+}
+
+void tb_cache_save(void)
+{
+    void *buf = tcg_ctx->code_gen_buffer;
+    TBCacheHeader hdr = tb_cache.header;
+    g_autoptr(GArray) entries = NULL;
+    GHashTableIter iter;
+    TranslationBlock *tb;
+
+    if (!tb_cache.save) {
+        return;
+    }
+
+    mmap_lock();
+
+    /* Only the code in the first region is saved, as loaded */
+    if (tb_ctx.tb_flush_count || tb_ctx.tb_evict_count ||
+        (uintptr_t)buf != hdr.code_gen_buffer) {
+        goto out;
+    }
+
+    entries = g_array_new(false, false, sizeof(TBCacheEntry));
+    g_hash_table_iter_init(&iter, tb_cache.save);
+    while (g_hash_table_iter_next(&iter, (gpointer *)&tb, NULL)) {
+        TBCacheEntry e = { };
+
+        if (tb_cflags(tb) & CF_INVALID) {
+            continue;
+        }
+        e.offset = (void *)tb - buf;
+        e.crc = tb_cache_guest_crc(tb);
+        g_array_append_val(entries, e);
+    }
+
+    hdr.n_tbs = entries->len;
+    hdr.code_size = (void *)tcg_ctx->code_gen_ptr - buf;
+    tb_cache_write(&hdr, entries, buf);
+
+ out:
+    g_hash_table_destroy(tb_cache.save);
+    tb_cache.save = NULL;
+    mmap_unlock();
+}
@@ -33,29 +33,38 @@
 #define TB_JMP_PAGE_BITS (TB_JMP_CACHE_BITS / 2)
 #define TB_JMP_PAGE_SIZE (1 << TB_JMP_PAGE_BITS)
 #define TB_JMP_ADDR_MASK (TB_JMP_PAGE_SIZE - 1)
-#define TB_JMP_PAGE_MASK (TB_JMP_CACHE_SIZE - TB_JMP_PAGE_SIZE)
 
-static inline unsigned int tb_jmp_cache_hash_page(vaddr pc)
+static inline unsigned int tb_jmp_cache_page_mask(const CPUJumpCache *jc)
+{
+    return tb_jmp_cache_size(jc) - TB_JMP_PAGE_SIZE;
+}
+
+static inline unsigned int tb_jmp_cache_hash_page(const CPUJumpCache *jc,
+                                                  vaddr pc)
 {
     vaddr tmp;
     tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS));
-    return (tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK;
+    return (tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) &
+           tb_jmp_cache_page_mask(jc);
 }
 
-static inline unsigned int tb_jmp_cache_hash_func(vaddr pc)
+static inline unsigned int tb_jmp_cache_hash_func(const CPUJumpCache *jc,
+                                                  vaddr pc)
 {
     vaddr tmp;
     tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS));
-    return (((tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK)
+    return (((tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) &
+             tb_jmp_cache_page_mask(jc))
            | (tmp & TB_JMP_ADDR_MASK));
 }
 
 #else
 
 /* In user-mode we can get better hashing because we do not have a TLB */
-static inline unsigned int tb_jmp_cache_hash_func(vaddr pc)
+static inline unsigned int tb_jmp_cache_hash_func(const CPUJumpCache *jc,
+                                                  vaddr pc)
 {
-    return (pc ^ (pc >> TB_JMP_CACHE_BITS)) & (TB_JMP_CACHE_SIZE - 1);
+    return (pc ^ (pc >> jc->bits)) & (tb_jmp_cache_size(jc) - 1);
 }
 
 #endif /* CONFIG_SOFTMMU */
@@ -64,7 +73,8 @@ static inline
 uint32_t tb_hash_func(tb_page_addr_t phys_pc, vaddr pc,
                       uint32_t flags, uint64_t flags2, uint32_t cf_mask)
 {
-    return qemu_xxhash8(phys_pc, pc, flags2, flags, cf_mask);
+    /* A CF_TIER2 superblock stands in for the TB it was retranslated from */
+    return qemu_xxhash8(phys_pc, pc, flags2, flags, cf_mask & ~CF_TIER2);
 }
 
 #endif
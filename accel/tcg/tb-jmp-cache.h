@@ -12,8 +12,20 @@
 #include "qemu/rcu.h"
 #include "exec/cpu-common.h"
 
+/*
+ * The cache starts with 1 << TB_JMP_CACHE_BITS entries, and doubles in
+ * size up to 1 << TB_JMP_CACHE_MAX_BITS when more than one lookup in
+ * TB_JMP_CACHE_GROW_RATE misses a TB that was in the hash table.  The
+ * rate is measured over windows of TB_JMP_CACHE_WINDOW such misses.
+ */
 #define TB_JMP_CACHE_BITS 12
+#define TB_JMP_CACHE_MAX_BITS 16
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
+#define TB_JMP_CACHE_WINDOW 1024
+#define TB_JMP_CACHE_GROW_RATE 16
+
+/* Ways of each set of the optional second level */
+#define TB_JMP_CACHE_WAYS 4
 
 /*
  * Invalidated in parallel; all accesses to 'tb' must be atomic.
@@ -22,12 +34,48 @@
  * non-NULL value of 'tb'.  Strictly speaking pc is only needed for
  * CF_PCREL, but it's used always for simplicity.
  */
+typedef struct CPUJumpCacheEntry {
+    TranslationBlock *tb;
+    vaddr pc;
+} CPUJumpCacheEntry;
+
+/*
+ * The cache is replaced as a whole when it grows, so other threads must
+ * access cpu->tb_jmp_cache within an RCU read-side critical section.
+ *
+ * The second level, if present, holds the entries evicted from the first
+ * level.  Set i holds the victims of first-level entries 4i to 4i+3, so
+ * that the entries for a page are still contiguous on both levels.
+ */
 typedef struct CPUJumpCache {
     struct rcu_head rcu;
-    struct {
-        TranslationBlock *tb;
-        vaddr pc;
-    } array[TB_JMP_CACHE_SIZE];
+    unsigned bits;              /* log2 of the first level size */
+    unsigned n_entries;         /* in array[], including the second level */
+    CPUJumpCacheEntry *l2;      /* second level, or NULL */
+
+    /* Current window, only accessed by the vCPU thread */
+    uint64_t window_lookups;
+    unsigned window_misses;
+
+    /* Statistics, read by "info jit" */
+    size_t lookups;
+    size_t misses;
+    size_t l2_hits;
+    size_t resizes;
+
+    CPUJumpCacheEntry array[];
 } CPUJumpCache;
 
+static inline unsigned tb_jmp_cache_size(const CPUJumpCache *jc)
+{
+    return 1u << jc->bits;
+}
+
+/* Return the second level set that holds the victims of entry @hash */
+static inline CPUJumpCacheEntry *tb_jmp_cache_l2_set(CPUJumpCache *jc,
+                                                     unsigned hash)
+{
+    return &jc->l2[hash & -TB_JMP_CACHE_WAYS];
+}
+
 #endif /* ACCEL_TCG_TB_JMP_CACHE_H */
@@ -761,6 +761,7 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
     bool did_flush = false;
 
     mmap_lock();
+    tb_prefetch_pause();
     /* If it is already been done on request of another CPU, just retry. */
     if (tb_ctx.tb_flush_count != tb_flush_count.host_int) {
         goto done;
@@ -779,6 +780,7 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
     qatomic_inc(&tb_ctx.tb_flush_count);
 
 done:
+    tb_prefetch_resume();
     mmap_unlock();
     if (did_flush) {
         qemu_plugin_flush_cb();
@@ -885,14 +887,23 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
             tcg_flush_jmp_cache(cpu);
         }
     } else {
-        uint32_t h = tb_jmp_cache_hash_func(tb->pc);
-
+        RCU_READ_LOCK_GUARD();
         CPU_FOREACH(cpu) {
-            CPUJumpCache *jc = cpu->tb_jmp_cache;
+            CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+            uint32_t h = tb_jmp_cache_hash_func(jc, tb->pc);
 
             if (qatomic_read(&jc->array[h].tb) == tb) {
                 qatomic_set(&jc->array[h].tb, NULL);
             }
+            if (jc->l2) {
+                CPUJumpCacheEntry *set = tb_jmp_cache_l2_set(jc, h);
+
+                for (int i = 0; i < TB_JMP_CACHE_WAYS; i++) {
+                    if (qatomic_read(&set[i].tb) == tb) {
+                        qatomic_set(&set[i].tb, NULL);
+                    }
+                }
+            }
         }
     }
 }
@@ -901,8 +912,11 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
  * In user-mode, call with mmap_lock held.
  * In !user-mode, if @rm_from_page_list is set, call with the TB's pages'
  * locks held.
+ * If @inval_jmp_cache is false, the caller takes care of removing the TB
+ * from the jump caches.
  */
-static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
+static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list,
+                                  bool inval_jmp_cache)
 {
     uint32_t h;
     tb_page_addr_t phys_pc;
@@ -929,7 +943,9 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     }
 
     /* remove the TB from the hash list */
-    tb_jmp_cache_inval_tb(tb);
+    if (inval_jmp_cache) {
+        tb_jmp_cache_inval_tb(tb);
+    }
 
     /* suppress this TB from the two jump lists */
     tb_remove_from_jmp_list(tb, 0);
@@ -945,7 +961,7 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
 static void tb_phys_invalidate__locked(TranslationBlock *tb)
 {
     qemu_thread_jit_write();
-    do_tb_phys_invalidate(tb, true);
+    do_tb_phys_invalidate(tb, true, true);
     qemu_thread_jit_execute();
 }
 
@@ -957,13 +973,99 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 {
     if (page_addr == -1 && tb_page_addr0(tb) != -1) {
         tb_lock_pages(tb);
-        do_tb_phys_invalidate(tb, true);
+        do_tb_phys_invalidate(tb, true, true);
         tb_unlock_pages(tb);
     } else {
-        do_tb_phys_invalidate(tb, false);
+        do_tb_phys_invalidate(tb, false, true);
     }
 }
 
+typedef struct TBEvict {
+    struct rcu_head rcu;
+    size_t region;
+    unsigned epoch;
+} TBEvict;
+
+static gboolean tb_evict_collect(gpointer key, gpointer value, gpointer data)
+{
+    g_ptr_array_add(data, value);
+    return false;
+}
+
+static void tb_evict_rcu(TBEvict *e)
+{
+    CPUState *cpu;
+    int i;
+
+    /*
+     * The TBs cannot be found through the hash table anymore, but the
+     * jump caches may still point to them.  They were not cleaned up one
+     * TB at a time, because a vCPU could have filled its jump cache
+     * again until the end of the grace period.  CF_INVALID kept the
+     * stale entries from matching until now.
+     */
+    WITH_RCU_READ_LOCK_GUARD() {
+        CPU_FOREACH(cpu) {
+            CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+
+            if (unlikely(jc == NULL)) {
+                continue;
+            }
+            for (i = 0; i < jc->n_entries; i++) {
+                TranslationBlock *tb = qatomic_read(&jc->array[i].tb);
+
+                if (tb && tcg_region_contains(e->region, tb)) {
+                    qatomic_set(&jc->array[i].tb, NULL);
+                }
+            }
+        }
+    }
+
+    tcg_region_evict_end(e->region, e->epoch);
+    g_free(e);
+}
+
+/*
+ * If the code buffer is running out of regions, invalidate all TBs in
+ * the oldest one, and reuse it once no vCPU can be executing them.
+ * vCPUs are not stopped: they leave the RCU read-side critical section
+ * of cpu_exec() regularly.
+ *
+ * Called with mmap_lock held for user mode emulation, with no page locks
+ * held, and with the jit buffer writable.
+ */
+void tb_evict_region(void)
+{
+    GPtrArray *tbs;
+    TBEvict *e;
+    size_t region;
+    unsigned epoch;
+    guint i;
+
+    if (!tcg_region_evict_begin(&region, &epoch)) {
+        return;
+    }
+
+    tbs = g_ptr_array_new();
+    tcg_region_foreach_tb(region, tb_evict_collect, tbs);
+
+    for (i = 0; i < tbs->len; i++) {
+        TranslationBlock *tb = g_ptr_array_index(tbs, i);
+
+        tb_lock_pages(tb);
+        do_tb_phys_invalidate(tb, true, false);
+        tb_unlock_pages(tb);
+    }
+    g_ptr_array_free(tbs, true);
+
+    qatomic_inc(&tb_ctx.tb_evict_count);
+
+    e = g_new(TBEvict, 1);
+    e->region = region;
+    e->epoch = epoch;
+    call_rcu(e, tb_evict_rcu, rcu);
+}
+
 /*
  * Add a new TB and link it to the physical page tables.
  * Called with mmap_lock held for user-mode emulation.
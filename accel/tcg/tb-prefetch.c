@@ -0,0 +1,242 @@
+/*
+ * Speculative translation in background threads
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/*
+ * With MTTCG, a vCPU that misses in the TB lookup translates the code
+ * itself before it can continue.  With -accel tcg,translate-threads=N,
+ * the destinations of the direct jumps of each new TB (as seen by
+ * translator_use_goto_tb) are queued instead for a pool of translator
+ * threads, which translate them with their own TCGContext and insert
+ * them in the TB hash table ahead of demand.  When the vCPU gets there,
+ * tb_lookup finds the TB and chains to it as usual.  The successors of
+ * speculative TBs are queued too, up to TB_PREFETCH_DEPTH levels.
+ *
+ * The translator threads must not touch the softmmu TLB of the vCPU.
+ * The destinations are on the guest page of the TB that jumps to them,
+ * whose host address is already known, and a speculative translation
+ * that needs anything else from the TLB is abandoned (see
+ * translator_require_vcpu).  The flags and cs_base are taken from the
+ * jumping TB; if they turn out to differ at the destination, the
+ * speculative TB is simply never found.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "exec/exec-all.h"
+#include "exec/memory.h"
+#include "exec/translator.h"
+#include "tcg/startup.h"
+#include "tcg/tcg.h"
+#include "tb-context.h"
+#include "tb-hash.h"
+#include "internal-common.h"
+#include "internal-target.h"
+
+/* Pending requests beyond this drop the oldest ones */
+#define TB_PREFETCH_QUEUE_SIZE  256
+
+/* Levels of successors translated ahead of a TB translated on demand */
+#define TB_PREFETCH_DEPTH       2
+
+typedef struct TBPrefetchRequest {
+    CPUState *cpu;          /* holds a reference */
+    vaddr pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    tb_page_addr_t phys_pc;
+    void *host_pc;
+    unsigned depth;
+} TBPrefetchRequest;
+
+static struct {
+    QemuMutex lock;
+    QemuCond cond;          /* work queued, or resumed */
+    QemuCond idle_cond;     /* no translation running while paused */
+    TBPrefetchRequest queue[TB_PREFETCH_QUEUE_SIZE];
+    unsigned head, tail;    /* free running */
+    unsigned running;
+    bool paused;
+} tb_prefetch;
+
+bool tb_prefetch_enabled;
+
+/* Remaining depth of the speculative translation of this thread */
+static __thread unsigned tb_prefetch_depth;
+
+/* Called with tb_prefetch.lock held */
+static void tb_prefetch_drop(void)
+{
+    TBPrefetchRequest *req;
+
+    req = &tb_prefetch.queue[tb_prefetch.head++ % TB_PREFETCH_QUEUE_SIZE];
+    object_unref(OBJECT(req->cpu));
+}
+
+void tb_prefetch_note(DisasContextBase *db, vaddr dest)
+{
+    TranslationBlock *tb = db->tb;
+    uint32_t cflags = tb_cflags(tb) & ~CF_TIER2;
+    vaddr offset = dest - db->pc_first;
+    TBPrefetchRequest *req;
+    unsigned depth;
+
+    /* Only TBs with the default cflags are looked up by the vCPU */
+    if (tb_page_addr0(tb) == -1 || dest == db->pc_first ||
+        db->plugin_enabled ||
+        (cflags & (CF_COUNT_MASK | CF_NOIRQ | CF_SINGLE_STEP |
+                   CF_BP_PAGE | CF_USE_ICOUNT))) {
+        return;
+    }
+
+    depth = db->speculative ? tb_prefetch_depth - 1 : TB_PREFETCH_DEPTH;
+    if (depth == 0) {
+        return;
+    }
+
+    qemu_mutex_lock(&tb_prefetch.lock);
+    if (tb_prefetch.tail - tb_prefetch.head == TB_PREFETCH_QUEUE_SIZE) {
+        tb_prefetch_drop();
+    }
+    req = &tb_prefetch.queue[tb_prefetch.tail++ % TB_PREFETCH_QUEUE_SIZE];
+    *req = (TBPrefetchRequest) {
+        .cpu = tcg_ctx->cpu,
+        .pc = dest,
+        .cs_base = tb->cs_base,
+        .flags = tb->flags,
+        .cflags = cflags,
+        .phys_pc = tb_page_addr0(tb) + offset,
+        .host_pc = db->host_addr[0] + offset,
+        .depth = depth,
+    };
+    object_ref(OBJECT(req->cpu));
+    qemu_cond_signal(&tb_prefetch.cond);
+    qemu_mutex_unlock(&tb_prefetch.lock);
+}
+
+static bool tb_prefetch_cmp(const void *p, const void *d)
+{
+    const TranslationBlock *tb = p;
+    const TBPrefetchRequest *req = d;
+
+    return (req->cflags & CF_PCREL || tb->pc == req->pc) &&
+           tb_page_addr0(tb) == req->phys_pc &&
+           tb->cs_base == req->cs_base &&
+           tb->flags == req->flags &&
+           (tb_cflags(tb) & ~CF_TIER2) == req->cflags;
+}
+
+static void tb_prefetch_translate(TBPrefetchRequest *req)
+{
+    uint32_t h;
+
+    /* Keep the RAM block alive, if it is still there */
+    RCU_READ_LOCK_GUARD();
+
+    if (qemu_ram_addr_from_host(req->host_pc) != req->phys_pc) {
+        return;
+    }
+
+    h = tb_hash_func(req->phys_pc, (req->cflags & CF_PCREL ? 0 : req->pc),
+                     req->flags, req->cs_base, req->cflags);
+    if (qht_lookup_custom(&tb_ctx.htable, req, h, tb_prefetch_cmp)) {
+        return;
+    }
+
+    tb_prefetch_depth = req->depth;
+    if (tb_gen_code_speculative(req->cpu, req->pc, req->cs_base, req->flags,
+                                req->cflags, req->phys_pc, req->host_pc)) {
+        qatomic_inc(&tb_ctx.tb_prefetch_count);
+    }
+}
+
+static void *tb_prefetch_thread(void *arg)
+{
+    rcu_register_thread();
+    tcg_register_thread();
+    tcg_ctx->gen_speculative = true;
+
+    qemu_mutex_lock(&tb_prefetch.lock);
+    while (true) {
+        TBPrefetchRequest req;
+
+        while (tb_prefetch.paused || tb_prefetch.head == tb_prefetch.tail) {
+            qemu_cond_wait(&tb_prefetch.cond, &tb_prefetch.lock);
+        }
+        /* Translate the most recent request first */
+        req = tb_prefetch.queue[--tb_prefetch.tail % TB_PREFETCH_QUEUE_SIZE];
+        tb_prefetch.running++;
+        qemu_mutex_unlock(&tb_prefetch.lock);
+
+        tb_prefetch_translate(&req);
+        object_unref(OBJECT(req.cpu));
+
+        qemu_mutex_lock(&tb_prefetch.lock);
+        if (--tb_prefetch.running == 0 && tb_prefetch.paused) {
+            qemu_cond_broadcast(&tb_prefetch.idle_cond);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Wait for the translator threads to finish the current translations,
+ * stop them, and drop the queued requests.  Used by tb_flush, which
+ * must not reset the code buffer under their feet.
+ */
+void tb_prefetch_pause(void)
+{
+    if (!tb_prefetch_enabled) {
+        return;
+    }
+
+    qemu_mutex_lock(&tb_prefetch.lock);
+    tb_prefetch.paused = true;
+    while (tb_prefetch.running) {
+        qemu_cond_wait(&tb_prefetch.idle_cond, &tb_prefetch.lock);
+    }
+    while (tb_prefetch.head != tb_prefetch.tail) {
+        tb_prefetch_drop();
+    }
+    qemu_mutex_unlock(&tb_prefetch.lock);
+}
+
+void tb_prefetch_resume(void)
+{
+    if (!tb_prefetch_enabled) {
+        return;
+    }
+
+    qemu_mutex_lock(&tb_prefetch.lock);
+    tb_prefetch.paused = false;
+    qemu_cond_broadcast(&tb_prefetch.cond);
+    qemu_mutex_unlock(&tb_prefetch.lock);
+}
+
+void tb_prefetch_init(unsigned n_threads)
+{
+    unsigned i;
+
+    if (n_threads == 0) {
+        return;
+    }
+
+    qemu_mutex_init(&tb_prefetch.lock);
+    qemu_cond_init(&tb_prefetch.cond);
+    qemu_cond_init(&tb_prefetch.idle_cond);
+
+    for (i = 0; i < n_threads; i++) {
+        QemuThread thread;
+        char name[16];
+
+        snprintf(name, sizeof(name), "TCG translate %u", i);
+        qemu_thread_create(&thread, name, tb_prefetch_thread, NULL,
+                           QEMU_THREAD_DETACHED);
+    }
+    tb_prefetch_enabled = true;
+}
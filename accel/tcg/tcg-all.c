@@ -28,6 +28,7 @@
 #include "exec/replay-core.h"
 #include "sysemu/cpu-timers.h"
 #include "tcg/startup.h"
+#include "tcg/tcg.h"
 #include "tcg/oversized-guest.h"
 #include "qapi/error.h"
 #include "qemu/error-report.h"
@@ -39,6 +40,7 @@
 #include "hw/boards.h"
 #endif
 #include "internal-common.h"
+#include "internal-target.h"
 
 struct TCGState {
     AccelState parent_obj;
@@ -47,6 +49,12 @@ struct TCGState {
     bool one_insn_per_tb;
     int splitwx_enabled;
     unsigned long tb_size;
+    bool tb_evict;
+    uint32_t tier_threshold;
+    uint32_t translate_threads;
+    bool jmp_cache_l2;
+    uint32_t tlb_ways;
+    bool spill_lookahead;
 };
 typedef struct TCGState TCGState;
 
@@ -88,6 +96,7 @@ static void tcg_accel_instance_init(Object *obj)
     TCGState *s = TCG_STATE(obj);
 
     s->mttcg_enabled = default_mttcg_enabled();
+    s->tlb_ways = 1;
 
     /* If debugging enabled, default "auto on", otherwise off. */
 #if defined(CONFIG_DEBUG_TCG) && !defined(CONFIG_USER_ONLY)
@@ -99,10 +108,14 @@ static void tcg_accel_instance_init(Object *obj)
 
 bool mttcg_enabled;
 bool one_insn_per_tb;
+uint32_t tb_tier_threshold;
+bool tb_jmp_cache_l2;
+unsigned tlb_ways = 1;
 
 static int tcg_init_machine(MachineState *ms)
 {
     TCGState *s = TCG_STATE(current_accel());
+    unsigned translate_threads = 0;
 #ifdef CONFIG_USER_ONLY
     unsigned max_cpus = 1;
 #else
@@ -111,10 +124,32 @@ static int tcg_init_machine(MachineState *ms)
 
     tcg_allowed = true;
     mttcg_enabled = s->mttcg_enabled;
+    tb_jmp_cache_l2 = s->jmp_cache_l2;
+    tlb_ways = s->tlb_ways;
+    tcg_spill_lookahead = s->spill_lookahead;
+#ifdef CONFIG_USER_ONLY
+    if (tlb_ways != 1) {
+        warn_report("tlb-ways is not supported in user mode");
+    }
+#endif
+
+    if (s->translate_threads) {
+#ifdef CONFIG_USER_ONLY
+        warn_report("translate-threads is not supported in user mode");
+#else
+        if (!mttcg_enabled) {
+            warn_report("translate-threads requires thread=multi");
+        } else {
+            translate_threads = s->translate_threads;
+        }
+#endif
+    }
 
     page_init();
     tb_htable_init();
-    tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_cpus);
+    /* Each translator thread has a TCGContext of its own */
+    tcg_init(s->tb_size * MiB, s->splitwx_enabled,
+             max_cpus + translate_threads, s->tb_evict);
 
 #if defined(CONFIG_SOFTMMU)
     /*
@@ -122,6 +157,8 @@ static int tcg_init_machine(MachineState *ms)
      * initialize the prologue now.
      */
     tcg_prologue_init();
+
+    tb_prefetch_init(translate_threads);
 #endif
 
     return 0;
@@ -181,6 +218,18 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static bool tcg_get_tb_evict(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->tb_evict;
+}
+
+static void tcg_set_tb_evict(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->tb_evict = value;
+}
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -207,6 +256,116 @@ static void tcg_set_one_insn_per_tb(Object *obj, bool value, Error **errp)
     qatomic_set(&one_insn_per_tb, value);
 }
 
+static bool tcg_get_jmp_cache_l2(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->jmp_cache_l2;
+}
+
+static void tcg_set_jmp_cache_l2(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->jmp_cache_l2 = value;
+}
+
+static bool tcg_get_spill_lookahead(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->spill_lookahead;
+}
+
+static void tcg_set_spill_lookahead(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->spill_lookahead = value;
+}
+
+static void tcg_get_tier_threshold(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->tier_threshold;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_tier_threshold(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > INT32_MAX) {
+        error_setg(errp, "tier-threshold must be at most %d", INT32_MAX);
+        return;
+    }
+
+    s->tier_threshold = value;
+    /* Only affects TBs translated from now on */
+    qatomic_set(&tb_tier_threshold, value);
+}
+
+static void tcg_get_translate_threads(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->translate_threads;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_translate_threads(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > 64) {
+        error_setg(errp, "translate-threads must be at most 64");
+        return;
+    }
+
+    s->translate_threads = value;
+}
+
+static void tcg_get_tlb_ways(Object *obj, Visitor *v,
+                             const char *name, void *opaque,
+                             Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->tlb_ways;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_tlb_ways(Object *obj, Visitor *v,
+                             const char *name, void *opaque,
+                             Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value != 1 && value != 2 && value != CPU_TLB_MAX_WAYS) {
+        error_setg(errp, "tlb-ways must be 1, 2 or %d", CPU_TLB_MAX_WAYS);
+        return;
+    }
+
+    s->tlb_ways = value;
+}
+
 static int tcg_gdbstub_supported_sstep_flags(void)
 {
     /*
@@ -242,6 +401,12 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add_bool(oc, "tb-evict",
+        tcg_get_tb_evict, tcg_set_tb_evict);
+    object_class_property_set_description(oc, "tb-evict",
+        "Evict the oldest translations when the TCG translation block "
+        "cache fills up, instead of flushing it");
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
@@ -252,6 +417,40 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
                                    tcg_set_one_insn_per_tb);
     object_class_property_set_description(oc, "one-insn-per-tb",
         "Only put one guest insn in each translation block");
+
+    object_class_property_add_bool(oc, "jmp-cache-l2",
+                                   tcg_get_jmp_cache_l2,
+                                   tcg_set_jmp_cache_l2);
+    object_class_property_set_description(oc, "jmp-cache-l2",
+        "Add a set-associative second level to the per-vCPU translation "
+        "block jump cache");
+
+    object_class_property_add(oc, "tier-threshold", "uint32",
+        tcg_get_tier_threshold, tcg_set_tier_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "tier-threshold",
+        "Executions after which a translation block is retranslated "
+        "as a superblock (0 to disable)");
+
+    object_class_property_add(oc, "translate-threads", "uint32",
+        tcg_get_translate_threads, tcg_set_translate_threads,
+        NULL, NULL);
+    object_class_property_set_description(oc, "translate-threads",
+        "Number of threads translating the successors of new translation "
+        "blocks ahead of demand (requires thread=multi)");
+
+    object_class_property_add(oc, "tlb-ways", "uint32",
+        tcg_get_tlb_ways, tcg_set_tlb_ways,
+        NULL, NULL);
+    object_class_property_set_description(oc, "tlb-ways",
+        "Associativity of the softmmu TLB (1, 2 or 4)");
+
+    object_class_property_add_bool(oc, "x-spill-lookahead",
+                                   tcg_get_spill_lookahead,
+                                   tcg_set_spill_lookahead);
+    object_class_property_set_description(oc, "x-spill-lookahead",
+        "Experimental: when no host register is free, spill the one "
+        "whose value is needed last in the basic block");
 }
 
 static const TypeInfo tcg_accel_type = {
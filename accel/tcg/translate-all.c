@@ -283,28 +283,34 @@ static int setjmp_gen_code(CPUArchState *env, TranslationBlock *tb,
     return tcg_gen_code(tcg_ctx, tb, pc);
 }
 
-/* Called with mmap_lock held for user mode emulation.  */
-TranslationBlock *tb_gen_code(CPUState *cpu,
-                              vaddr pc, uint64_t cs_base,
-                              uint32_t flags, int cflags)
+/*
+ * Rewind the code buffer over @tb, the last TB allocated by tcg_tb_alloc,
+ * whose code started at @gen_code_buf.
+ */
+static void tb_discard(TranslationBlock *tb, tcg_insn_unit *gen_code_buf)
+{
+    uintptr_t orig_aligned = (uintptr_t)gen_code_buf;
+
+    orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
+    qatomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
+}
+
+/*
+ * Translate the guest code at @phys_pc, mapped at @host_pc.
+ * When called from a translator thread (tcg_ctx->gen_speculative),
+ * return NULL instead of involving @cpu if the translation fails.
+ */
+static TranslationBlock *tb_translate(CPUState *cpu,
+                                      vaddr pc, uint64_t cs_base,
+                                      uint32_t flags, int cflags,
+                                      tb_page_addr_t phys_pc, void *host_pc)
 {
     CPUArchState *env = cpu_env(cpu);
     TranslationBlock *tb, *existing_tb;
-    tb_page_addr_t phys_pc, phys_p2;
+    tb_page_addr_t phys_p2;
     tcg_insn_unit *gen_code_buf;
     int gen_code_size, search_size, max_insns;
     int64_t ti;
-    void *host_pc;
-
-    assert_memory_lock();
-    qemu_thread_jit_write();
-
-    phys_pc = get_page_addr_code_hostp(env, pc, &host_pc);
-
-    if (phys_pc == -1) {
-        /* Generate a one-shot TB with 1 insn in it */
-        cflags = (cflags & ~CF_COUNT_MASK) | 1;
-    }
 
     max_insns = cflags & CF_COUNT_MASK;
     if (max_insns == 0) {
@@ -314,8 +320,12 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
 
  buffer_overflow:
     assert_no_pages_locked();
+    tb_evict_region();
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
+        if (tcg_ctx->gen_speculative) {
+            return NULL;
+        }
         /* flush must be done */
         tb_flush(cpu);
         mmap_unlock();
@@ -332,6 +342,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->cs_base = cs_base;
     tb->flags = flags;
     tb->cflags = cflags;
+    tb->tier_count = INT32_MAX;
     tb_set_page_addr0(tb, phys_pc);
     tb_set_page_addr1(tb, -1);
     if (phys_pc != -1) {
@@ -344,6 +355,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tcg_ctx->page_bits = TARGET_PAGE_BITS;
     tcg_ctx->page_mask = TARGET_PAGE_MASK;
     tcg_ctx->tlb_dyn_max_bits = CPU_TLB_DYN_MAX_BITS;
+    tcg_ctx->tlb_ways = tlb_ways;
 #endif
     tcg_ctx->insn_start_words = TARGET_INSN_START_WORDS;
 #ifdef TCG_GUEST_DEFAULT_MO
@@ -415,6 +427,16 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
                           "Restarting code generation with re-locked pages");
             goto restart_translate;
 
+        case -4:
+            /*
+             * A speculative translation needed state that only the
+             * vCPU thread may access; see translator_require_vcpu.
+             */
+            tb_unlock_pages(tb);
+            tcg_ctx->gen_tb = NULL;
+            tb_discard(tb, gen_code_buf);
+            return NULL;
+
         default:
             g_assert_not_reached();
         }
@@ -553,16 +575,89 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
 
     /* if the TB already exists, discard what we just translated */
     if (unlikely(existing_tb != tb)) {
-        uintptr_t orig_aligned = (uintptr_t)gen_code_buf;
-
-        orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
-        qatomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
+        tb_discard(tb, gen_code_buf);
         tcg_tb_remove(tb);
         return existing_tb;
     }
+    tb_cache_note(tb);
     return tb;
 }
 
+/* Called with mmap_lock held for user mode emulation.  */
+TranslationBlock *tb_gen_code(CPUState *cpu,
+                              vaddr pc, uint64_t cs_base,
+                              uint32_t flags, int cflags)
+{
+    TranslationBlock *tb;
+    tb_page_addr_t phys_pc;
+    void *host_pc;
+
+    assert_memory_lock();
+    qemu_thread_jit_write();
+
+    phys_pc = get_page_addr_code_hostp(cpu_env(cpu), pc, &host_pc);
+
+    if (phys_pc == -1) {
+        /* Generate a one-shot TB with 1 insn in it */
+        cflags = (cflags & ~CF_COUNT_MASK) | 1;
+    } else {
+        /* Maybe it was translated by an earlier run */
+        tb = tb_cache_lookup(phys_pc, pc, cs_base, flags, cflags);
+        if (tb) {
+            return tb;
+        }
+    }
+
+    return tb_translate(cpu, pc, cs_base, flags, cflags, phys_pc, host_pc);
+}
+
+#ifndef CONFIG_USER_ONLY
+/*
+ * Translate the guest code at @phys_pc and @host_pc ahead of demand,
+ * from a translator thread.  @cpu is only used for state that does not
+ * change at run time.  Return NULL if the TB could not be translated
+ * without help from the vCPU thread.
+ */
+TranslationBlock *tb_gen_code_speculative(CPUState *cpu,
+                                          vaddr pc, uint64_t cs_base,
+                                          uint32_t flags, int cflags,
+                                          tb_page_addr_t phys_pc,
+                                          void *host_pc)
+{
+    assert(tcg_ctx->gen_speculative);
+    qemu_thread_jit_write();
+
+    return tb_translate(cpu, pc, cs_base, flags, cflags, phys_pc, host_pc);
+}
+#endif
+
+/*
+ * Retranslate @tb, whose tier_count has run out, as a CF_TIER2 superblock
+ * that follows direct jumps (see translator_follow_jump), and invalidate
+ * @tb so that lookups and chaining go to the superblock from now on.
+ * Return the TB to execute for @pc.
+ *
+ * Called with mmap_lock held for user mode emulation.
+ */
+TranslationBlock *tb_tier_up(CPUState *cpu, TranslationBlock *tb,
+                             vaddr pc, uint64_t cs_base, uint32_t flags,
+                             uint32_t cflags)
+{
+    TranslationBlock *sb;
+
+    /* Only one vCPU retranslates a given TB */
+    if (qatomic_xchg(&tb->tier_count, INT32_MAX) > 0) {
+        return tb;
+    }
+
+    sb = tb_gen_code(cpu, pc, cs_base, flags, cflags | CF_TIER2);
+    if (sb != tb && tb_page_addr0(sb) != -1) {
+        tb_phys_invalidate(tb, -1);
+        qatomic_inc(&tb_ctx.tb_tier_up_count);
+    }
+    return sb;
+}
+
 /* user-mode: call with mmap_lock held */
 void tb_check_watchpoint(CPUState *cpu, uintptr_t retaddr)
 {
@@ -652,14 +747,17 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
  */
 void tcg_flush_jmp_cache(CPUState *cpu)
 {
-    CPUJumpCache *jc = cpu->tb_jmp_cache;
+    CPUJumpCache *jc;
+
+    RCU_READ_LOCK_GUARD();
+    jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
 
     /* During early initialization, the cache may not yet be allocated. */
     if (unlikely(jc == NULL)) {
         return;
     }
 
-    for (int i = 0; i < TB_JMP_CACHE_SIZE; i++) {
+    for (int i = 0; i < jc->n_entries; i++) {
         qatomic_set(&jc->array[i].tb, NULL);
     }
 }
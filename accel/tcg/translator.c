@@ -16,6 +16,7 @@
 #include "exec/plugin-gen.h"
 #include "exec/cpu_ldst.h"
 #include "tcg/tcg-op-common.h"
+#include "internal-common.h"
 #include "internal-target.h"
 #include "disas/disas.h"
 
@@ -39,10 +40,36 @@ bool translator_io_start(DisasContextBase *db)
     return true;
 }
 
+/*
+ * Maximum number of direct jumps followed by translator_follow_jump
+ * in a single superblock.
+ */
+#define TB_TIER2_MAX_JUMPS 8
+
+/*
+ * Emit a countdown of the executions of a TB that is a candidate for
+ * retranslation as a superblock.  When it reaches zero the TB exits to
+ * the main loop, which calls tb_tier_up().  The decrement is not atomic,
+ * so vCPUs running the TB concurrently may step past zero: keep exiting
+ * until tb_tier_up() resets the count.
+ */
+static void gen_tb_tier_count(TranslationBlock *tb, uint32_t threshold)
+{
+    TCGv_ptr ptr = tcg_constant_ptr(&tb->tier_count);
+    TCGv_i32 count = tcg_temp_new_i32();
+
+    tb->tier_count = threshold;
+    tcg_gen_ld_i32(count, ptr, 0);
+    tcg_gen_subi_i32(count, count, 1);
+    tcg_gen_st_i32(count, ptr, 0);
+    tcg_gen_brcondi_i32(TCG_COND_LE, count, 0, tcg_ctx->exitreq_label);
+}
+
 static TCGOp *gen_tb_start(DisasContextBase *db, uint32_t cflags)
 {
     TCGv_i32 count = NULL;
     TCGOp *icount_start_insn = NULL;
+    uint32_t threshold = qatomic_read(&tb_tier_threshold);
 
     if ((cflags & CF_USE_ICOUNT) || !(cflags & CF_NOIRQ)) {
         count = tcg_temp_new_i32();
@@ -75,6 +102,16 @@ static TCGOp *gen_tb_start(DisasContextBase *db, uint32_t cflags)
         tcg_gen_brcondi_i32(TCG_COND_LT, count, 0, tcg_ctx->exitreq_label);
     }
 
+    /*
+     * Only TBs that are translated with the default instruction limit
+     * and can be interrupted are candidates for tiering up.
+     */
+    if (threshold &&
+        !(cflags & (CF_TIER2 | CF_USE_ICOUNT | CF_NOIRQ |
+                    CF_SINGLE_STEP | CF_BP_PAGE | CF_COUNT_MASK))) {
+        gen_tb_tier_count(db->tb, threshold);
+    }
+
     if (cflags & CF_USE_ICOUNT) {
         tcg_gen_st16_i32(count, tcg_env,
                          offsetof(ArchCPU, parent_obj.neg.icount_decr.u16.low)
@@ -102,6 +139,33 @@ static void gen_tb_end(const TranslationBlock *tb, uint32_t cflags,
     }
 }
 
+bool translator_follow_jump(DisasContextBase *db, vaddr dest)
+{
+    uint32_t cflags = tb_cflags(db->tb);
+
+    if (!(cflags & CF_TIER2) || (cflags & CF_BP_PAGE) ||
+        db->singlestep_enabled || db->plugin_enabled) {
+        return false;
+    }
+
+    /*
+     * Only follow forward jumps within the first page, so that the
+     * guest code covered by the TB remains [pc_first, pc_next).
+     */
+    if (dest < db->pc_next ||
+        ((db->pc_first ^ dest) & TARGET_PAGE_MASK) != 0) {
+        return false;
+    }
+
+    if (db->num_jumps >= TB_TIER2_MAX_JUMPS ||
+        db->num_insns >= db->max_insns || tcg_op_buf_full()) {
+        return false;
+    }
+
+    db->num_jumps++;
+    return true;
+}
+
 bool translator_use_goto_tb(DisasContextBase *db, vaddr dest)
 {
     /* Suppress goto_tb if requested. */
@@ -110,7 +174,21 @@ bool translator_use_goto_tb(DisasContextBase *db, vaddr dest)
     }
 
     /* Check for the dest on the same page as the start of the TB.  */
-    return ((db->pc_first ^ dest) & TARGET_PAGE_MASK) == 0;
+    if (((db->pc_first ^ dest) & TARGET_PAGE_MASK) != 0) {
+        return false;
+    }
+
+    if (unlikely(tb_prefetch_enabled)) {
+        tb_prefetch_note(db, dest);
+    }
+    return true;
+}
+
+void translator_require_vcpu(DisasContextBase *db)
+{
+    if (db->speculative) {
+        siglongjmp(tcg_ctx->jmp_trans, -4);
+    }
 }
 
 void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
@@ -128,8 +206,10 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
     db->pc_next = pc;
     db->is_jmp = DISAS_NEXT;
     db->num_insns = 0;
+    db->num_jumps = 0;
     db->max_insns = *max_insns;
     db->singlestep_enabled = cflags & CF_SINGLE_STEP;
+    db->speculative = tcg_ctx->gen_speculative;
     db->insn_start = NULL;
     db->fake_insn = false;
     db->host_addr[0] = host_pc;
@@ -147,6 +227,10 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
 
     plugin_enabled = plugin_gen_tb_start(cpu, db);
     db->plugin_enabled = plugin_enabled;
+    if (plugin_enabled) {
+        /* Callbacks are in the plugins, and get pointers to their data */
+        tcg_ctx->gen_host_ptr = true;
+    }
 
     while (true) {
         *max_insns = ++db->num_insns;
@@ -290,6 +374,7 @@ static bool translator_ld(CPUArchState *env, DisasContextBase *db,
     if (host == NULL) {
         tb_page_addr_t page0, old_page1, new_page1;
 
+        translator_require_vcpu(db);
         new_page1 = get_page_addr_code_hostp(env, base, &db->host_addr[1]);
 
         /*
@@ -161,6 +161,7 @@ typedef struct BDRVRawState {
     bool use_linux_aio:1;
     bool has_laio_fdsync:1;
     bool use_linux_io_uring:1;
+    bool use_fixed_buffers:1;
     int page_cache_inconsistent; /* errno from fdatasync failure */
     bool has_fallocate;
     bool needs_alignment;
@@ -561,6 +562,12 @@ static QemuOptsList raw_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "AIO max batch size (0 = auto handled by AIO backend, default: 0)",
         },
+        {
+            .name = "aio-fixed-buffers",
+            .type = QEMU_OPT_BOOL,
+            .help = "register guest RAM as io_uring fixed buffers "
+                    "(default: off)",
+        },
         {
             .name = "locking",
             .type = QEMU_OPT_STRING,
@@ -642,6 +649,13 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
 
     s->aio_max_batch = qemu_opt_get_number(opts, "aio-max-batch", 0);
 
+    s->use_fixed_buffers = qemu_opt_get_bool(opts, "aio-fixed-buffers", false);
+    if (s->use_fixed_buffers && !s->use_linux_io_uring) {
+        error_setg(errp, "aio-fixed-buffers requires aio=io_uring");
+        ret = -EINVAL;
+        goto fail;
+    }
+
     locking = qapi_enum_parse(&OnOffAuto_lookup,
                               qemu_opt_get(opts, "locking"),
                               ON_OFF_AUTO_AUTO, &local_err);
@@ -2453,6 +2467,26 @@ static inline bool raw_check_linux_io_uring(BDRVRawState *s)
     }
     return true;
 }
+
+static bool raw_register_buf(BlockDriverState *bs, void *host, size_t size,
+                             Error **errp)
+{
+    BDRVRawState *s = bs->opaque;
+
+    if (!s->use_fixed_buffers) {
+        return true;
+    }
+    return aio_register_fixed_buf(host, size, errp);
+}
+
+static void raw_unregister_buf(BlockDriverState *bs, void *host, size_t size)
+{
+    BDRVRawState *s = bs->opaque;
+
+    if (s->use_fixed_buffers) {
+        aio_unregister_fixed_buf(host, size);
+    }
+}
 #endif
 
 #ifdef CONFIG_LINUX_AIO
@@ -3906,6 +3940,10 @@ BlockDriver bdrv_file = {
     .bdrv_co_copy_range_from = raw_co_copy_range_from,
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
     .bdrv_refresh_limits = raw_refresh_limits,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_register_buf      = raw_register_buf,
+    .bdrv_unregister_buf    = raw_unregister_buf,
+#endif
 
     .bdrv_co_truncate                   = raw_co_truncate,
     .bdrv_co_getlength                  = raw_co_getlength,
@@ -4270,6 +4308,10 @@ static BlockDriver bdrv_host_device = {
     .bdrv_co_copy_range_from = raw_co_copy_range_from,
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
     .bdrv_refresh_limits = raw_refresh_limits,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_register_buf      = raw_register_buf,
+    .bdrv_unregister_buf    = raw_unregister_buf,
+#endif
 
     .bdrv_co_truncate                   = raw_co_truncate,
     .bdrv_co_getlength                  = raw_co_getlength,
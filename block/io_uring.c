@@ -28,12 +28,16 @@
 
 typedef struct LuringAIOCB {
     Coroutine *co;
+    LuringState *s;
     struct io_uring_sqe sqeq;
     ssize_t ret;
     QEMUIOVector *qiov;
     bool is_read;
     QSIMPLEQ_ENTRY(LuringAIOCB) next;
 
+    /* Used when the request goes through the AioContext's io_uring */
+    CqeHandler cqe_handler;
+
     /*
      * Buffered reads may require resubmission, see
      * luring_resubmit_short_read().
@@ -60,6 +64,26 @@ struct LuringState {
     QEMUBH *completion_bh;
 };
 
+static void luring_cqe_handler(CqeHandler *cqe_handler);
+
+static void luring_prep_sqe(struct io_uring_sqe *sqe, void *opaque)
+{
+    LuringAIOCB *luringcb = opaque;
+
+    *sqe = luringcb->sqeq;
+}
+
+/*
+ * Submit to the io_uring that the AioContext uses for file descriptor
+ * monitoring, which saves an io_uring_enter(2) per batch and may use fixed
+ * buffers and SQPOLL.
+ */
+static void luring_add_sqe(LuringAIOCB *luringcb)
+{
+    luringcb->cqe_handler.cb = luring_cqe_handler;
+    aio_add_sqe(luring_prep_sqe, luringcb, &luringcb->cqe_handler);
+}
+
 /**
  * luring_resubmit:
  *
@@ -68,6 +92,11 @@ struct LuringState {
  */
 static void luring_resubmit(LuringState *s, LuringAIOCB *luringcb)
 {
+    if (aio_has_io_uring(s->aio_context)) {
+        luring_add_sqe(luringcb);
+        return;
+    }
+
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
     s->io_q.in_queue++;
 }
@@ -100,14 +129,115 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
     qemu_iovec_concat(resubmit_qiov, luringcb->qiov, luringcb->total_read,
                       remaining);
 
-    /* Update sqe */
-    luringcb->sqeq.off += nread;
-    luringcb->sqeq.addr = (uintptr_t)luringcb->resubmit_qiov.iov;
-    luringcb->sqeq.len = luringcb->resubmit_qiov.niov;
+    /* Update sqe, the original request may have been a fixed buffer read */
+    io_uring_prep_readv(&luringcb->sqeq, luringcb->sqeq.fd,
+                        resubmit_qiov->iov, resubmit_qiov->niov,
+                        luringcb->sqeq.off + nread);
+    io_uring_sqe_set_data(&luringcb->sqeq, luringcb);
 
     luring_resubmit(s, luringcb);
 }
 
+static bool luring_is_fixed(LuringAIOCB *luringcb)
+{
+    return luringcb->sqeq.opcode == IORING_OP_READ_FIXED ||
+           luringcb->sqeq.opcode == IORING_OP_WRITE_FIXED;
+}
+
+/**
+ * luring_process_cqe:
+ * @s: AIO state
+ * @luringcb: the request
+ * @ret: the result of the request
+ *
+ * Complete a request and wake up its coroutine, or resubmit it if it needs
+ * to be retried.
+ */
+static void luring_process_cqe(LuringState *s, LuringAIOCB *luringcb, int ret)
+{
+    int total_bytes;
+
+    trace_luring_process_completion(s, luringcb, ret);
+
+    /* total_read is non-zero only for resubmitted read requests */
+    total_bytes = ret + luringcb->total_read;
+
+    if (ret < 0) {
+        /*
+         * Only writev/readv/fsync requests on regular files or host block
+         * devices are submitted. Therefore -EAGAIN is not expected but it's
+         * known to happen sometimes with Linux SCSI. Submit again and hope
+         * the request completes successfully.
+         *
+         * For more information, see:
+         * https://lore.kernel.org/io-uring/20210727165811.284510-3-axboe@kernel.dk/T/#u
+         *
+         * If the code is changed to submit other types of requests in the
+         * future, then this workaround may need to be extended to deal with
+         * genuine -EAGAIN results that should not be resubmitted
+         * immediately.
+         */
+        if (ret == -EINTR || ret == -EAGAIN) {
+            luring_resubmit(s, luringcb);
+            return;
+        }
+
+        /*
+         * The fixed buffer was unregistered after the request was prepared,
+         * or the request ended up in a ring without fixed buffers.  Retry
+         * with a normal buffer.
+         */
+        if (ret == -EFAULT && luring_is_fixed(luringcb)) {
+            if (luringcb->is_read) {
+                io_uring_prep_readv(&luringcb->sqeq, luringcb->sqeq.fd,
+                                    luringcb->qiov->iov, luringcb->qiov->niov,
+                                    luringcb->sqeq.off);
+            } else {
+                io_uring_prep_writev(&luringcb->sqeq, luringcb->sqeq.fd,
+                                     luringcb->qiov->iov, luringcb->qiov->niov,
+                                     luringcb->sqeq.off);
+            }
+            io_uring_sqe_set_data(&luringcb->sqeq, luringcb);
+            luring_resubmit(s, luringcb);
+            return;
+        }
+    } else if (!luringcb->qiov) {
+        goto end;
+    } else if (total_bytes == luringcb->qiov->size) {
+        ret = 0;
+    /* Only read/write */
+    } else {
+        /* Short Read/Write */
+        if (luringcb->is_read) {
+            if (ret > 0) {
+                luring_resubmit_short_read(s, luringcb, ret);
+                return;
+            } else {
+                /* Pad with zeroes */
+                qemu_iovec_memset(luringcb->qiov, total_bytes, 0,
+                                  luringcb->qiov->size - total_bytes);
+                ret = 0;
+            }
+        } else {
+            ret = -ENOSPC;
+        }
+    }
+end:
+    luringcb->ret = ret;
+    qemu_iovec_destroy(&luringcb->resubmit_qiov);
+
+    /*
+     * If the coroutine is already entered it must be in ioq_submit()
+     * and will notice luringcb->ret has been filled in when it
+     * eventually runs later. Coroutines cannot be entered recursively
+     * so avoid doing that!
+     */
+    assert(luringcb->co->ctx == s->aio_context);
+    if (!qemu_coroutine_entered(luringcb->co)) {
+        aio_co_wake(luringcb->co);
+    }
+}
+
 /**
  * luring_process_completions:
  * @s: AIO state
@@ -124,7 +254,6 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
 static void luring_process_completions(LuringState *s)
 {
     struct io_uring_cqe *cqes;
-    int total_bytes;
 
     defer_call_begin();
 
@@ -160,65 +289,7 @@ static void luring_process_completions(LuringState *s)
 
         /* Change counters one-by-one because we can be nested. */
         s->io_q.in_flight--;
-        trace_luring_process_completion(s, luringcb, ret);
-
-        /* total_read is non-zero only for resubmitted read requests */
-        total_bytes = ret + luringcb->total_read;
-
-        if (ret < 0) {
-            /*
-             * Only writev/readv/fsync requests on regular files or host block
-             * devices are submitted. Therefore -EAGAIN is not expected but it's
-             * known to happen sometimes with Linux SCSI. Submit again and hope
-             * the request completes successfully.
-             *
-             * For more information, see:
-             * https://lore.kernel.org/io-uring/20210727165811.284510-3-axboe@kernel.dk/T/#u
-             *
-             * If the code is changed to submit other types of requests in the
-             * future, then this workaround may need to be extended to deal with
-             * genuine -EAGAIN results that should not be resubmitted
-             * immediately.
-             */
-            if (ret == -EINTR || ret == -EAGAIN) {
-                luring_resubmit(s, luringcb);
-                continue;
-            }
-        } else if (!luringcb->qiov) {
-            goto end;
-        } else if (total_bytes == luringcb->qiov->size) {
-            ret = 0;
-        /* Only read/write */
-        } else {
-            /* Short Read/Write */
-            if (luringcb->is_read) {
-                if (ret > 0) {
-                    luring_resubmit_short_read(s, luringcb, ret);
-                    continue;
-                } else {
-                    /* Pad with zeroes */
-                    qemu_iovec_memset(luringcb->qiov, total_bytes, 0,
-                                      luringcb->qiov->size - total_bytes);
-                    ret = 0;
-                }
-            } else {
-                ret = -ENOSPC;
-            }
-        }
-end:
-        luringcb->ret = ret;
-        qemu_iovec_destroy(&luringcb->resubmit_qiov);
-
-        /*
-         * If the coroutine is already entered it must be in ioq_submit()
-         * and will notice luringcb->ret has been filled in when it
-         * eventually runs later. Coroutines cannot be entered recursively
-         * so avoid doing that!
-         */
-        assert(luringcb->co->ctx == s->aio_context);
-        if (!qemu_coroutine_entered(luringcb->co)) {
-            aio_co_wake(luringcb->co);
-        }
+        luring_process_cqe(s, luringcb, ret);
     }
 
     qemu_bh_cancel(s->completion_bh);
@@ -279,6 +350,22 @@ static void luring_process_completions_and_submit(LuringState *s)
     }
 }
 
+static void luring_cqe_handler(CqeHandler *cqe_handler)
+{
+    LuringAIOCB *luringcb = container_of(cqe_handler, LuringAIOCB,
+                                         cqe_handler);
+    LuringState *s = luringcb->s;
+
+    defer_call_begin();
+    luring_process_cqe(s, luringcb, cqe_handler->cqe.res);
+    defer_call_end();
+
+    /* Resubmitted to the own ring if the AioContext stopped using io_uring */
+    if (s->io_q.in_queue > 0) {
+        ioq_submit(s);
+    }
+}
+
 static void qemu_luring_completion_bh(void *opaque)
 {
     LuringState *s = opaque;
@@ -339,9 +426,25 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
 {
     int ret;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
+    bool use_ring = aio_has_io_uring(s->aio_context);
+    int buf_index = -1;
+
+    /* Fixed buffers can only describe a single iovec */
+    if (use_ring && luringcb->qiov && luringcb->qiov->niov == 1 &&
+        (type == QEMU_AIO_READ || type == QEMU_AIO_WRITE)) {
+        buf_index = aio_fixed_buf_index(s->aio_context,
+                                        luringcb->qiov->iov[0].iov_base,
+                                        luringcb->qiov->iov[0].iov_len);
+    }
 
     switch (type) {
     case QEMU_AIO_WRITE:
+        if (buf_index >= 0) {
+            io_uring_prep_write_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                      luringcb->qiov->iov[0].iov_len, offset,
+                                      buf_index);
+            break;
+        }
         io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
                              luringcb->qiov->niov, offset);
         break;
@@ -350,6 +453,12 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                              luringcb->qiov->niov, offset);
         break;
     case QEMU_AIO_READ:
+        if (buf_index >= 0) {
+            io_uring_prep_read_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                     luringcb->qiov->iov[0].iov_len, offset,
+                                     buf_index);
+            break;
+        }
         io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
                             luringcb->qiov->niov, offset);
         break;
@@ -363,6 +472,12 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
     }
     io_uring_sqe_set_data(sqes, luringcb);
 
+    if (use_ring) {
+        trace_luring_add_sqe(s, luringcb, buf_index);
+        luring_add_sqe(luringcb);
+        return 0;
+    }
+
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
     s->io_q.in_queue++;
     trace_luring_do_submit(s, s->io_q.blocked, s->io_q.in_queue,
@@ -387,6 +502,7 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
     LuringState *s = aio_get_linux_io_uring(ctx);
     LuringAIOCB luringcb = {
         .co         = qemu_coroutine_self(),
+        .s          = s,
         .ret        = -EINPROGRESS,
         .qiov       = qiov,
         .is_read    = (type == QEMU_AIO_READ),
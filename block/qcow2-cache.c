@@ -25,21 +25,54 @@
 #include "qemu/osdep.h"
 #include "block/block-io.h"
 #include "qemu/memalign.h"
+#include "qemu/seqlock.h"
+#include "qemu/xxhash.h"
 #include "qcow2.h"
 #include "trace.h"
 
+/*
+ * The cache is split into shards.  A table offset hashes to exactly one
+ * shard and can only be loaded into the entries that shard owns, so a
+ * lookup only walks one short hash chain and eviction only scans one
+ * shard.  Small caches use a single shard.
+ */
+#define QCOW2_CACHE_SHARD_MIN_TABLES 32
+#define QCOW2_CACHE_MAX_SHARDS       64
+
 typedef struct Qcow2CachedTable {
     int64_t  offset;
     uint64_t lru_counter;
     int      ref;
+    /* Pins taken by qcow2_cache_get_cached(), without s->lock */
+    int      readers;
+    /* Next entry in the shard's hash chain, or -1 */
+    int      next;
     bool     dirty;
+    /* Set by qcow2_cache_put_cached(), folded into lru_counter later */
+    bool     accessed;
 } Qcow2CachedTable;
 
+typedef struct Qcow2CacheShard {
+    /*
+     * Protects the hash chains and the offset of the entries owned by the
+     * shard.  Readers of qcow2_cache_get_cached() only use the sequence
+     * counter; writers additionally take the spinlock.
+     */
+    QemuSeqLock             sequence;
+    QemuSpin                lock;
+    int                     first;
+    int                     size;
+    unsigned                bucket_mask;
+    int                    *buckets;
+} Qcow2CacheShard;
+
 struct Qcow2Cache {
     Qcow2CachedTable       *entries;
+    Qcow2CacheShard        *shards;
     struct Qcow2Cache      *depends;
     int                     size;
     int                     table_size;
+    int                     nr_shards;
     bool                    depends_on_flush;
     void                   *table_array;
     uint64_t                lru_counter;
@@ -59,6 +92,134 @@ static inline int qcow2_cache_get_table_idx(Qcow2Cache *c, void *table)
     return idx;
 }
 
+static inline uint32_t qcow2_cache_hash(Qcow2Cache *c, uint64_t offset)
+{
+    return qemu_xxhash2(offset / c->table_size);
+}
+
+static inline Qcow2CacheShard *qcow2_cache_get_shard(Qcow2Cache *c,
+                                                     uint32_t hash)
+{
+    return &c->shards[hash & (c->nr_shards - 1)];
+}
+
+static inline int *qcow2_cache_get_bucket(Qcow2Cache *c, Qcow2CacheShard *sh,
+                                          uint32_t hash)
+{
+    return &sh->buckets[(hash / c->nr_shards) & sh->bucket_mask];
+}
+
+/*
+ * Walk a hash chain.  This may run concurrently with a writer, so indices
+ * are range checked and the walk is bounded; the caller validates the
+ * result with the shard's sequence counter.
+ */
+static int qcow2_cache_shard_find(Qcow2Cache *c, Qcow2CacheShard *sh,
+                                  uint32_t hash, uint64_t offset)
+{
+    int i = qatomic_read(qcow2_cache_get_bucket(c, sh, hash));
+    int n;
+
+    for (n = 0; i >= 0 && n < sh->size; n++) {
+        if (i < sh->first || i >= sh->first + sh->size) {
+            return -1;
+        }
+        if (c->entries[i].offset == offset) {
+            return i;
+        }
+        i = qatomic_read(&c->entries[i].next);
+    }
+    return -1;
+}
+
+/*
+ * Wait until the lockless readers of @t are gone.  A reader in another
+ * coroutine of this thread can only unpin the entry once we yield, so a
+ * coroutine waits by rescheduling itself.  Outside coroutine context,
+ * only readers on other threads can hold a pin, and they do not yield
+ * while they do.  Polling the event loop instead of spinning would let
+ * other code change the cache under our caller, which need not hold
+ * s->lock (see cache_clean_timer_cb()).
+ */
+static void qcow2_cache_wait_readers(Qcow2CachedTable *t)
+{
+    while (qatomic_read(&t->readers)) {
+        if (qemu_in_coroutine()) {
+            aio_co_schedule(qemu_get_current_aio_context(),
+                            qemu_coroutine_self());
+            qemu_coroutine_yield();
+        } else {
+            cpu_relax();
+        }
+    }
+}
+
+/*
+ * Change the table offset of entry @i.  The caller must hold s->lock, and
+ * @offset must either be 0 or hash to the shard that owns the entry.
+ *
+ * When the entry stops caching a table, wait until the lockless readers
+ * that may have found it are gone, so that its contents can be reused.
+ * In coroutine context, this may yield.
+ */
+static void qcow2_cache_entry_set_offset(Qcow2Cache *c, int i, int64_t offset)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+    int64_t old_offset = t->offset;
+    Qcow2CacheShard *sh;
+    int *pi;
+
+    if (old_offset == offset) {
+        return;
+    }
+
+    sh = qcow2_cache_get_shard(c, qcow2_cache_hash(c, old_offset ?: offset));
+    assert(i >= sh->first && i < sh->first + sh->size);
+
+    seqlock_write_lock(&sh->sequence, &sh->lock);
+    if (old_offset) {
+        pi = qcow2_cache_get_bucket(c, sh, qcow2_cache_hash(c, old_offset));
+        while (*pi != i) {
+            assert(*pi >= 0);
+            pi = &c->entries[*pi].next;
+        }
+        qatomic_set(pi, t->next);
+    }
+    t->offset = offset;
+    if (offset) {
+        assert(qcow2_cache_get_shard(c, qcow2_cache_hash(c, offset)) == sh);
+        pi = qcow2_cache_get_bucket(c, sh, qcow2_cache_hash(c, offset));
+        t->next = *pi;
+        qatomic_set(pi, i);
+    } else {
+        t->next = -1;
+    }
+    seqlock_write_unlock(&sh->sequence, &sh->lock);
+
+    if (old_offset) {
+        /* Pairs with the barrier in qcow2_cache_get_cached() */
+        smp_mb();
+        qcow2_cache_wait_readers(t);
+    }
+}
+
+/*
+ * Return the LRU counter of entry @i, accounting for hits that were served
+ * without s->lock since the last call.
+ */
+static uint64_t qcow2_cache_entry_lru(Qcow2Cache *c, int i)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+
+    if (qatomic_read(&t->accessed)) {
+        qatomic_set(&t->accessed, false);
+        if (t->ref == 0) {
+            t->lru_counter = ++c->lru_counter;
+        }
+    }
+    return t->lru_counter;
+}
+
 static inline const char *qcow2_cache_get_name(BDRVQcow2State *s, Qcow2Cache *c)
 {
     if (c == s->refcount_block_cache) {
@@ -90,7 +251,7 @@ static inline bool can_clean_entry(Qcow2Cache *c, int i)
 {
     Qcow2CachedTable *t = &c->entries[i];
     return t->ref == 0 && !t->dirty && t->offset != 0 &&
-        t->lru_counter <= c->cache_clean_lru_counter;
+        qcow2_cache_entry_lru(c, i) <= c->cache_clean_lru_counter;
 }
 
 void qcow2_cache_clean_unused(Qcow2Cache *c)
@@ -106,7 +267,7 @@ void qcow2_cache_clean_unused(Qcow2Cache *c)
 
         /* And count how many we can clean in a row */
         while (i < c->size && can_clean_entry(c, i)) {
-            c->entries[i].offset = 0;
+            qcow2_cache_entry_set_offset(c, i, 0);
             c->entries[i].lru_counter = 0;
             i++;
             to_clean++;
@@ -125,6 +286,7 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
 {
     BDRVQcow2State *s = bs->opaque;
     Qcow2Cache *c;
+    int i, j;
 
     assert(num_tables > 0);
     assert(is_power_of_2(table_size));
@@ -134,6 +296,9 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
     c = g_new0(Qcow2Cache, 1);
     c->size = num_tables;
     c->table_size = table_size;
+    c->nr_shards = MIN(pow2floor(MAX(num_tables / QCOW2_CACHE_SHARD_MIN_TABLES,
+                                     1)),
+                       QCOW2_CACHE_MAX_SHARDS);
     c->entries = g_try_new0(Qcow2CachedTable, num_tables);
     c->table_array = qemu_try_blockalign(bs->file->bs,
                                          (size_t) num_tables * c->table_size);
@@ -142,7 +307,28 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
         qemu_vfree(c->table_array);
         g_free(c->entries);
         g_free(c);
-        c = NULL;
+        return NULL;
+    }
+
+    for (i = 0; i < num_tables; i++) {
+        c->entries[i].next = -1;
+    }
+
+    c->shards = g_new0(Qcow2CacheShard, c->nr_shards);
+    for (i = 0; i < c->nr_shards; i++) {
+        Qcow2CacheShard *sh = &c->shards[i];
+        unsigned nr_buckets;
+
+        sh->first = (int64_t) num_tables * i / c->nr_shards;
+        sh->size = (int64_t) num_tables * (i + 1) / c->nr_shards - sh->first;
+        nr_buckets = pow2ceil(sh->size);
+        sh->bucket_mask = nr_buckets - 1;
+        sh->buckets = g_new(int, nr_buckets);
+        for (j = 0; j < nr_buckets; j++) {
+            sh->buckets[j] = -1;
+        }
+        seqlock_init(&sh->sequence);
+        qemu_spin_init(&sh->lock);
     }
 
     return c;
@@ -154,9 +340,16 @@ int qcow2_cache_destroy(Qcow2Cache *c)
 
     for (i = 0; i < c->size; i++) {
         assert(c->entries[i].ref == 0);
+        assert(c->entries[i].readers == 0);
+    }
+
+    for (i = 0; i < c->nr_shards; i++) {
+        qemu_spin_destroy(&c->shards[i].lock);
+        g_free(c->shards[i].buckets);
     }
 
     qemu_vfree(c->table_array);
+    g_free(c->shards);
     g_free(c->entries);
     g_free(c);
 
@@ -309,8 +502,9 @@ int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
 
     for (i = 0; i < c->size; i++) {
         assert(c->entries[i].ref == 0);
-        c->entries[i].offset = 0;
+        qcow2_cache_entry_set_offset(c, i, 0);
         c->entries[i].lru_counter = 0;
+        c->entries[i].accessed = false;
     }
 
     qcow2_cache_table_release(c, 0, c->size);
@@ -325,9 +519,10 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
                    void **table, bool read_from_disk)
 {
     BDRVQcow2State *s = bs->opaque;
+    Qcow2CacheShard *sh;
+    uint32_t hash;
     int i;
     int ret;
-    int lookup_index;
     uint64_t min_lru_counter = UINT64_MAX;
     int min_lru_index = -1;
 
@@ -344,20 +539,22 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     }
 
     /* Check if the table is already cached */
-    i = lookup_index = (offset / c->table_size * 4) % c->size;
-    do {
-        const Qcow2CachedTable *t = &c->entries[i];
-        if (t->offset == offset) {
-            goto found;
-        }
-        if (t->ref == 0 && t->lru_counter < min_lru_counter) {
-            min_lru_counter = t->lru_counter;
-            min_lru_index = i;
-        }
-        if (++i == c->size) {
-            i = 0;
+    hash = qcow2_cache_hash(c, offset);
+    sh = qcow2_cache_get_shard(c, hash);
+    i = qcow2_cache_shard_find(c, sh, hash, offset);
+    if (i >= 0) {
+        goto found;
+    }
+
+    for (i = sh->first; i < sh->first + sh->size; i++) {
+        if (c->entries[i].ref == 0) {
+            uint64_t lru_counter = qcow2_cache_entry_lru(c, i);
+            if (lru_counter < min_lru_counter) {
+                min_lru_counter = lru_counter;
+                min_lru_index = i;
+            }
         }
-    } while (i != lookup_index);
+    }
 
     if (min_lru_index == -1) {
         /* This can't happen in current synchronous code, but leave the check
@@ -377,7 +574,7 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 
     trace_qcow2_cache_get_read(qemu_coroutine_self(),
                                c == s->l2_table_cache, i);
-    c->entries[i].offset = 0;
+    qcow2_cache_entry_set_offset(c, i, 0);
     if (read_from_disk) {
         if (c == s->l2_table_cache) {
             BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
@@ -390,7 +587,7 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
         }
     }
 
-    c->entries[i].offset = offset;
+    qcow2_cache_entry_set_offset(c, i, offset);
 
     /* And return the right table */
 found:
@@ -429,6 +626,62 @@ void qcow2_cache_put(Qcow2Cache *c, void **table)
     assert(c->entries[i].ref >= 0);
 }
 
+/*
+ * Look up a cached table without s->lock.  This only succeeds if the table
+ * is already in the cache; on a miss the caller has to take s->lock and use
+ * qcow2_cache_get().  The table is pinned until qcow2_cache_put_cached() is
+ * called, which must happen before the caller yields: the table may only be
+ * read, and tables are not evicted while pinned.
+ */
+bool qcow2_cache_get_cached(Qcow2Cache *c, uint64_t offset, void **table)
+{
+    uint32_t hash = qcow2_cache_hash(c, offset);
+    Qcow2CacheShard *sh = qcow2_cache_get_shard(c, hash);
+    Qcow2CachedTable *t;
+    unsigned seq;
+    bool hit;
+    int i;
+
+    do {
+        seq = seqlock_read_begin(&sh->sequence);
+        i = qcow2_cache_shard_find(c, sh, hash, offset);
+    } while (seqlock_read_retry(&sh->sequence, seq));
+
+    if (i < 0) {
+        return false;
+    }
+
+    /*
+     * Pin the entry, then check that it still holds the table.  Either the
+     * writer in qcow2_cache_entry_set_offset() sees the pin, or we see the
+     * new offset.
+     */
+    t = &c->entries[i];
+    qatomic_inc(&t->readers);
+    smp_mb__after_rmw();
+    do {
+        seq = seqlock_read_begin(&sh->sequence);
+        hit = t->offset == offset;
+    } while (seqlock_read_retry(&sh->sequence, seq));
+
+    if (!hit) {
+        qatomic_dec(&t->readers);
+        return false;
+    }
+
+    *table = qcow2_cache_get_table_addr(c, i);
+    return true;
+}
+
+void qcow2_cache_put_cached(Qcow2Cache *c, void **table)
+{
+    int i = qcow2_cache_get_table_idx(c, *table);
+
+    qatomic_set(&c->entries[i].accessed, true);
+    qatomic_dec(&c->entries[i].readers);
+    *table = NULL;
+}
+
 void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
 {
     int i = qcow2_cache_get_table_idx(c, table);
@@ -438,14 +691,15 @@ void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
 
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset)
 {
+    uint32_t hash = qcow2_cache_hash(c, offset);
     int i;
 
-    for (i = 0; i < c->size; i++) {
-        if (c->entries[i].offset == offset) {
-            return qcow2_cache_get_table_addr(c, i);
-        }
+    if (!offset) {
+        return NULL;
     }
-    return NULL;
+
+    i = qcow2_cache_shard_find(c, qcow2_cache_get_shard(c, hash), hash, offset);
+    return i < 0 ? NULL : qcow2_cache_get_table_addr(c, i);
 }
 
 void qcow2_cache_discard(Qcow2Cache *c, void *table)
@@ -454,8 +708,9 @@ void qcow2_cache_discard(Qcow2Cache *c, void *table)
 
     assert(c->entries[i].ref == 0);
 
-    c->entries[i].offset = 0;
+    qcow2_cache_entry_set_offset(c, i, 0);
     c->entries[i].lru_counter = 0;
+    c->entries[i].accessed = false;
     c->entries[i].dirty = false;
 
     qcow2_cache_table_release(c, i, 1);
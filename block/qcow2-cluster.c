@@ -30,8 +30,52 @@
 #include "qcow2.h"
 #include "qemu/bswap.h"
 #include "qemu/memalign.h"
+#include "qemu/rcu.h"
 #include "trace.h"
 
+typedef struct Qcow2L1TableRCU {
+    struct rcu_head rcu;
+    uint64_t *l1_table;
+} Qcow2L1TableRCU;
+
+static void qcow2_l1_table_free_rcu(Qcow2L1TableRCU *old)
+{
+    qemu_vfree(old->l1_table);
+    g_free(old);
+}
+
+/*
+ * Replace the active L1 table.  qcow2_get_host_offset_cached() reads the
+ * L1 table without s->lock, so the old table is freed after a grace period
+ * and @l1_table must already be in host byte order.
+ *
+ * A lockless reader must never index a table with a size larger than
+ * that table.  When the table grows, it is published before its size;
+ * when it shrinks, the size is published first.  The reader checks the
+ * index against the size read both before and after the table pointer,
+ * which covers either order.
+ */
+void qcow2_set_l1_table(BDRVQcow2State *s, uint64_t *l1_table, int l1_size)
+{
+    uint64_t *old_l1_table = s->l1_table;
+
+    if (l1_size < s->l1_size) {
+        qatomic_set(&s->l1_size, l1_size);
+        /* Pairs with smp_rmb() in qcow2_get_host_offset_cached() */
+        qatomic_rcu_set(&s->l1_table, l1_table);
+    } else {
+        qatomic_rcu_set(&s->l1_table, l1_table);
+        /* Pairs with the first size check of the lockless reader */
+        qatomic_store_release(&s->l1_size, l1_size);
+    }
+
+    if (old_l1_table) {
+        Qcow2L1TableRCU *old = g_new(Qcow2L1TableRCU, 1);
+        old->l1_table = old_l1_table;
+        call_rcu(old, qcow2_l1_table_free_rcu, rcu);
+    }
+}
+
 int coroutine_fn qcow2_shrink_l1_table(BlockDriverState *bs,
                                        uint64_t exact_size)
 {
@@ -177,12 +221,10 @@ int qcow2_grow_l1_table(BlockDriverState *bs, uint64_t min_size,
     if (ret < 0) {
         goto fail;
     }
-    qemu_vfree(s->l1_table);
     old_l1_table_offset = s->l1_table_offset;
     s->l1_table_offset = new_l1_table_offset;
-    s->l1_table = new_l1_table;
     old_l1_size = s->l1_size;
-    s->l1_size = new_l1_size;
+    qcow2_set_l1_table(s, new_l1_table, new_l1_size);
     qcow2_free_clusters(bs, old_l1_table_offset, old_l1_size * L1E_SIZE,
                         QCOW2_DISCARD_OTHER);
     return 0;
@@ -742,6 +784,103 @@ fail:
     return ret;
 }
 
+/*
+ * Lockless fast path of qcow2_get_host_offset() for reads.
+ *
+ * This only resolves @offset if it is in a normal, uncompressed cluster
+ * whose L2 slice is already cached, and never reports errors: whenever it
+ * returns false, the caller must take s->lock and use
+ * qcow2_get_host_offset(), which also takes care of loading the L2 slice
+ * and of detecting corruption.
+ *
+ * On success *bytes is reduced to the number of bytes that are contiguous
+ * on the host, and *host_offset is set as in qcow2_get_host_offset().
+ */
+bool qcow2_get_host_offset_cached(BlockDriverState *bs, uint64_t offset,
+                                  unsigned int *bytes, uint64_t *host_offset)
+{
+#ifdef CONFIG_ATOMIC64
+    BDRVQcow2State *s = bs->opaque;
+    unsigned int l2_index, offset_in_cluster;
+    uint64_t l1_index, l2_offset, *l2_slice;
+    uint64_t bytes_needed, nb_clusters, host_cluster_offset;
+    uint64_t l2_entry;
+    int start_of_slice;
+    int i;
+
+    /*
+     * Subcluster bitmaps cannot be read atomically together with their L2
+     * entry, and external data files rely on QCOW_OFLAG_COPIED to tell
+     * offset 0 apart from unallocated clusters; leave both to the slow path.
+     */
+    if (has_subclusters(s) || has_data_file(bs)) {
+        return false;
+    }
+
+    offset_in_cluster = offset_into_cluster(s, offset);
+    bytes_needed = MIN((uint64_t) *bytes + offset_in_cluster,
+                       ((uint64_t) (s->l2_slice_size -
+                                    offset_to_l2_slice_index(s, offset)))
+                       << s->cluster_bits);
+
+    l1_index = offset_to_l1_index(s, offset);
+    WITH_RCU_READ_LOCK_GUARD() {
+        uint64_t *l1_table;
+
+        /* See qcow2_set_l1_table() for the two size checks */
+        if (l1_index >= qatomic_load_acquire(&s->l1_size)) {
+            return false;
+        }
+        l1_table = qatomic_rcu_read(&s->l1_table);
+        /* Pairs with qatomic_rcu_set() of a shrinking table */
+        smp_rmb();
+        if (l1_index >= qatomic_read(&s->l1_size)) {
+            return false;
+        }
+        l2_offset = qatomic_read(&l1_table[l1_index]) & L1E_OFFSET_MASK;
+    }
+
+    if (!l2_offset || offset_into_cluster(s, l2_offset)) {
+        return false;
+    }
+
+    start_of_slice = l2_entry_size(s) *
+        (offset_to_l2_index(s, offset) - offset_to_l2_slice_index(s, offset));
+    if (!qcow2_cache_get_cached(s->l2_table_cache, l2_offset + start_of_slice,
+                                (void **) &l2_slice)) {
+        return false;
+    }
+
+    l2_index = offset_to_l2_slice_index(s, offset);
+    l2_entry = be64_to_cpu(qatomic_read(&l2_slice[l2_index]));
+    host_cluster_offset = l2_entry & L2E_OFFSET_MASK;
+    if (qcow2_get_cluster_type(bs, l2_entry) != QCOW2_CLUSTER_NORMAL ||
+        offset_into_cluster(s, host_cluster_offset)) {
+        qcow2_cache_put_cached(s->l2_table_cache, (void **) &l2_slice);
+        return false;
+    }
+
+    nb_clusters = size_to_clusters(s, bytes_needed);
+    for (i = 1; i < nb_clusters; i++) {
+        l2_entry = be64_to_cpu(qatomic_read(&l2_slice[l2_index + i]));
+        if (qcow2_get_cluster_type(bs, l2_entry) != QCOW2_CLUSTER_NORMAL ||
+            (l2_entry & L2E_OFFSET_MASK) !=
+            host_cluster_offset + ((uint64_t) i << s->cluster_bits)) {
+            break;
+        }
+    }
+    qcow2_cache_put_cached(s->l2_table_cache, (void **) &l2_slice);
+
+    bytes_needed = MIN(bytes_needed, (uint64_t) i << s->cluster_bits);
+    *bytes = bytes_needed - offset_in_cluster;
+    *host_offset = host_cluster_offset + offset_in_cluster;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
 /*
  * get_cluster_table
  *
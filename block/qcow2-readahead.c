@@ -0,0 +1,375 @@
+/*
+ * Decompressed cluster cache and readahead for compressed qcow2 images
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * Without this, every read of a compressed cluster reads and decompresses
+ * the whole cluster, even if the guest only wants a few sectors of it, and
+ * sequential readers wait for one decompression at a time.
+ *
+ * When the image is opened read-only and compressed-readahead is set, the
+ * decompressed clusters are kept in a small LRU cache keyed by their L2
+ * entry, and sequential reads schedule the following clusters in the
+ * background, so that the decompression of several clusters overlaps on
+ * the thread pool.  Since the image is read-only, cached clusters can
+ * never become stale.
+ */
+
+#include "qemu/osdep.h"
+#include "block/block-io.h"
+#include "block/block_int-io.h"
+#include "qemu/coroutine.h"
+#include "qemu/memalign.h"
+#include "qcow2.h"
+#include "trace.h"
+
+typedef struct Qcow2DecompressedCluster {
+    uint64_t l2_entry;      /* 0 if the entry is unused */
+    uint64_t lru_counter;
+    int ref;
+    int ret;
+    bool ready;
+    CoQueue wait;           /* Waiting for ready */
+    uint8_t *data;
+} Qcow2DecompressedCluster;
+
+struct Qcow2Readahead {
+    /* Protects all fields below, and the entries */
+    QemuMutex lock;
+    Qcow2DecompressedCluster *entries;
+    int size;
+    int window;             /* in clusters */
+    uint64_t lru_counter;
+    uint64_t last_offset;   /* Last cluster read by the guest */
+    uint64_t end;           /* Readahead was scheduled up to here */
+    bool running;
+    void *data;
+};
+
+typedef struct Qcow2ReadaheadCo {
+    BlockDriverState *bs;
+    Qcow2Readahead *ra;
+    Qcow2DecompressedCluster *entry;
+    uint64_t start;
+    uint64_t end;
+} Qcow2ReadaheadCo;
+
+Qcow2Readahead *qcow2_readahead_create(BlockDriverState *bs, int window)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2Readahead *ra;
+    int i;
+
+    assert(window > 0);
+
+    ra = g_new0(Qcow2Readahead, 1);
+    ra->window = window;
+    /* Room for the window, the clusters being read and some history */
+    ra->size = 2 * window + QCOW2_MAX_WORKERS;
+    ra->entries = g_new0(Qcow2DecompressedCluster, ra->size);
+    ra->data = qemu_try_blockalign(bs->file->bs,
+                                   (size_t) ra->size * s->cluster_size);
+    if (!ra->data) {
+        g_free(ra->entries);
+        g_free(ra);
+        return NULL;
+    }
+
+    qemu_mutex_init(&ra->lock);
+    for (i = 0; i < ra->size; i++) {
+        ra->entries[i].data = (uint8_t *) ra->data +
+                              (size_t) i * s->cluster_size;
+        qemu_co_queue_init(&ra->entries[i].wait);
+    }
+
+    return ra;
+}
+
+void qcow2_readahead_destroy(Qcow2Readahead *ra)
+{
+    int i;
+
+    if (!ra) {
+        return;
+    }
+
+    assert(!ra->running);
+    for (i = 0; i < ra->size; i++) {
+        assert(ra->entries[i].ref == 0);
+    }
+
+    qemu_mutex_destroy(&ra->lock);
+    qemu_vfree(ra->data);
+    g_free(ra->entries);
+    g_free(ra);
+}
+
+/* Called with ra->lock held */
+static Qcow2DecompressedCluster *
+qcow2_readahead_find(Qcow2Readahead *ra, uint64_t l2_entry)
+{
+    int i;
+
+    for (i = 0; i < ra->size; i++) {
+        if (ra->entries[i].l2_entry == l2_entry) {
+            return &ra->entries[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Take over the least recently used entry for @l2_entry.  The caller must
+ * then call qcow2_readahead_load().  Returns NULL if
+ * all entries are in use.
+ *
+ * Called with ra->lock held.
+ */
+static Qcow2DecompressedCluster *
+qcow2_readahead_claim(Qcow2Readahead *ra, uint64_t l2_entry)
+{
+    Qcow2DecompressedCluster *e = NULL;
+    int i;
+
+    for (i = 0; i < ra->size; i++) {
+        Qcow2DecompressedCluster *t = &ra->entries[i];
+        if (t->ref == 0 && (!e || t->lru_counter < e->lru_counter)) {
+            e = t;
+        }
+    }
+
+    if (e) {
+        e->l2_entry = l2_entry;
+        e->ref = 1;
+        e->ret = 0;
+        e->ready = false;
+    }
+    return e;
+}
+
+/* Called with ra->lock held */
+static void qcow2_readahead_put(Qcow2Readahead *ra,
+                                Qcow2DecompressedCluster *e)
+{
+    assert(e->ref > 0);
+    if (--e->ref == 0) {
+        e->lru_counter = ++ra->lru_counter;
+    }
+}
+
+static void coroutine_fn GRAPH_RDLOCK
+qcow2_readahead_load(BlockDriverState *bs, Qcow2Readahead *ra,
+                     Qcow2DecompressedCluster *e)
+{
+    int ret = qcow2_co_read_compressed_cluster(bs, e->l2_entry, e->data);
+
+    qemu_mutex_lock(&ra->lock);
+    e->ret = ret;
+    e->ready = true;
+    if (ret < 0) {
+        /* Do not hand out the failed entry to future readers */
+        e->l2_entry = 0;
+    }
+    qemu_co_queue_restart_all(&e->wait);
+    qemu_mutex_unlock(&ra->lock);
+}
+
+static void coroutine_fn qcow2_readahead_load_entry(void *opaque)
+{
+    Qcow2ReadaheadCo *rc = opaque;
+    BlockDriverState *bs = rc->bs;
+
+    GRAPH_RDLOCK_GUARD();
+
+    qcow2_readahead_load(bs, rc->ra, rc->entry);
+
+    qemu_mutex_lock(&rc->ra->lock);
+    qcow2_readahead_put(rc->ra, rc->entry);
+    qemu_mutex_unlock(&rc->ra->lock);
+
+    g_free(rc);
+    bdrv_dec_in_flight(bs);
+}
+
+/*
+ * Look up the compressed clusters in [rc->start, rc->end) and start loading
+ * those that are not cached yet, each in its own coroutine.
+ */
+static void coroutine_fn qcow2_readahead_entry(void *opaque)
+{
+    Qcow2ReadaheadCo *rc = opaque;
+    BlockDriverState *bs = rc->bs;
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2Readahead *ra = rc->ra;
+    uint64_t offset;
+
+    GRAPH_RDLOCK_GUARD();
+
+    trace_qcow2_readahead(bs, rc->start, rc->end);
+
+    for (offset = rc->start; offset < rc->end; offset += s->cluster_size) {
+        unsigned int bytes = s->cluster_size;
+        QCow2SubclusterType type;
+        Qcow2DecompressedCluster *e;
+        Qcow2ReadaheadCo *load;
+        uint64_t l2_entry;
+        int ret;
+
+        qemu_co_mutex_lock(&s->lock);
+        ret = qcow2_get_host_offset(bs, offset, &bytes, &l2_entry, &type);
+        qemu_co_mutex_unlock(&s->lock);
+        if (ret < 0) {
+            break;
+        }
+        if (type != QCOW2_SUBCLUSTER_COMPRESSED) {
+            continue;
+        }
+
+        qemu_mutex_lock(&ra->lock);
+        e = qcow2_readahead_find(ra, l2_entry);
+        if (!e) {
+            e = qcow2_readahead_claim(ra, l2_entry);
+            if (!e) {
+                qemu_mutex_unlock(&ra->lock);
+                break;
+            }
+        } else {
+            e = NULL;
+        }
+        qemu_mutex_unlock(&ra->lock);
+
+        if (e) {
+            load = g_new0(Qcow2ReadaheadCo, 1);
+            *load = (Qcow2ReadaheadCo) {
+                .bs = bs,
+                .ra = ra,
+                .entry = e,
+            };
+            bdrv_inc_in_flight(bs);
+            aio_co_enter(bdrv_get_aio_context(bs),
+                         qemu_coroutine_create(qcow2_readahead_load_entry,
+                                               load));
+        }
+    }
+
+    qemu_mutex_lock(&ra->lock);
+    ra->running = false;
+    qemu_mutex_unlock(&ra->lock);
+
+    g_free(rc);
+    bdrv_dec_in_flight(bs);
+}
+
+/*
+ * Record a guest read of the cluster at @offset and, if the guest is
+ * reading sequentially and less than half of the window is scheduled,
+ * schedule readahead for the rest of the window.
+ *
+ * Called with ra->lock held.
+ */
+static void qcow2_readahead_kick(BlockDriverState *bs, Qcow2Readahead *ra,
+                                 uint64_t offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t cluster = start_of_cluster(s, offset);
+    uint64_t next = cluster + s->cluster_size;
+    uint64_t start, end;
+    Qcow2ReadaheadCo *rc;
+    bool sequential;
+
+    sequential = cluster == ra->last_offset ||
+                 cluster == ra->last_offset + s->cluster_size;
+    ra->last_offset = cluster;
+    if (!sequential) {
+        ra->end = next;
+        return;
+    }
+
+    if (ra->running ||
+        ra->end > next + ((uint64_t) ra->window / 2 << s->cluster_bits)) {
+        return;
+    }
+
+    start = MAX(ra->end, next);
+    end = MIN(next + ((uint64_t) ra->window << s->cluster_bits),
+              bs->total_sectors * BDRV_SECTOR_SIZE);
+    if (start >= end) {
+        return;
+    }
+
+    ra->end = end;
+    ra->running = true;
+
+    rc = g_new0(Qcow2ReadaheadCo, 1);
+    *rc = (Qcow2ReadaheadCo) {
+        .bs = bs,
+        .ra = ra,
+        .start = start,
+        .end = end,
+    };
+    bdrv_inc_in_flight(bs);
+    aio_co_enter(bdrv_get_aio_context(bs),
+                 qemu_coroutine_create(qcow2_readahead_entry, rc));
+}
+
+/*
+ * Read @bytes at guest @offset from the compressed cluster described by
+ * @l2_entry, going through the cache of decompressed clusters.
+ */
+int coroutine_fn GRAPH_RDLOCK
+qcow2_co_readahead_read(BlockDriverState *bs, uint64_t l2_entry,
+                        uint64_t offset, uint64_t bytes,
+                        QEMUIOVector *qiov, size_t qiov_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2Readahead *ra = s->readahead;
+    Qcow2DecompressedCluster *e;
+    int ret;
+
+    qemu_mutex_lock(&ra->lock);
+    qcow2_readahead_kick(bs, ra, offset);
+
+    e = qcow2_readahead_find(ra, l2_entry);
+    if (e) {
+        trace_qcow2_readahead_hit(bs, offset, e->ready);
+        e->ref++;
+        while (!e->ready) {
+            qemu_co_queue_wait(&e->wait, &ra->lock);
+        }
+        qemu_mutex_unlock(&ra->lock);
+    } else {
+        e = qcow2_readahead_claim(ra, l2_entry);
+        qemu_mutex_unlock(&ra->lock);
+
+        if (!e) {
+            /* Everything is in use, do not bother caching this one */
+            uint8_t *buf = qemu_blockalign(bs, s->cluster_size);
+
+            ret = qcow2_co_read_compressed_cluster(bs, l2_entry, buf);
+            if (ret == 0) {
+                qemu_iovec_from_buf(qiov, qiov_offset,
+                                    buf + offset_into_cluster(s, offset),
+                                    bytes);
+            }
+            qemu_vfree(buf);
+            return ret;
+        }
+
+        qcow2_readahead_load(bs, ra, e);
+    }
+
+    ret = e->ret;
+    if (ret == 0) {
+        qemu_iovec_from_buf(qiov, qiov_offset,
+                            e->data + offset_into_cluster(s, offset), bytes);
+    }
+
+    qemu_mutex_lock(&ra->lock);
+    qcow2_readahead_put(ra, e);
+    qemu_mutex_unlock(&ra->lock);
+
+    return ret;
+}
@@ -1061,16 +1061,13 @@ int qcow2_snapshot_load_tmp(BlockDriverState *bs,
         return ret;
     }
 
-    /* Switch the L1 table */
-    qemu_vfree(s->l1_table);
+    for(i = 0;i < sn->l1_size; i++) {
+        be64_to_cpus(&new_l1_table[i]);
+    }
 
-    s->l1_size = sn->l1_size;
+    /* Switch the L1 table */
     s->l1_table_offset = sn->l1_table_offset;
-    s->l1_table = new_l1_table;
-
-    for(i = 0;i < s->l1_size; i++) {
-        be64_to_cpus(&s->l1_table[i]);
-    }
+    qcow2_set_l1_table(s, new_l1_table, sn->l1_size);
 
     return 0;
 }
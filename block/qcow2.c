@@ -701,6 +701,7 @@ static const char *const mutable_opts[] = {
     QCOW2_OPT_L2_CACHE_ENTRY_SIZE,
     QCOW2_OPT_REFCOUNT_CACHE_SIZE,
     QCOW2_OPT_CACHE_CLEAN_INTERVAL,
+    QCOW2_OPT_COMPRESSED_READAHEAD,
     NULL
 };
 
@@ -817,6 +818,12 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "Clean unused cache entries after this time (in seconds)",
         },
+        {
+            .name = QCOW2_OPT_COMPRESSED_READAHEAD,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of compressed clusters to read ahead and cache "
+                    "for sequential reads of read-only images",
+        },
         BLOCK_CRYPTO_OPT_DEF_KEY_SECRET("encrypt.",
             "ID of secret providing qcow2 AES key or LUKS passphrase"),
         { /* end of list */ }
@@ -979,6 +986,7 @@ typedef struct Qcow2ReopenState {
     bool discard_passthrough[QCOW2_DISCARD_MAX];
     bool discard_no_unref;
     uint64_t cache_clean_interval;
+    uint64_t compressed_readahead;
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
 } Qcow2ReopenState;
 
@@ -1079,6 +1087,19 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
         goto fail;
     }
 
+    r->compressed_readahead =
+        qemu_opt_get_number(opts, QCOW2_OPT_COMPRESSED_READAHEAD, 0);
+    if (r->compressed_readahead > QCOW2_MAX_COMPRESSED_READAHEAD) {
+        error_setg(errp, QCOW2_OPT_COMPRESSED_READAHEAD " must not exceed %d",
+                   QCOW2_MAX_COMPRESSED_READAHEAD);
+        ret = -EINVAL;
+        goto fail;
+    }
+    /* Cached clusters are never invalidated, so writable images can't use it */
+    if (flags & BDRV_O_RDWR) {
+        r->compressed_readahead = 0;
+    }
+
     /* lazy-refcounts; flush if going from enabled to disabled */
     r->use_lazy_refcounts = qemu_opt_get_bool(opts, QCOW2_OPT_LAZY_REFCOUNTS,
         (s->compatible_features & QCOW2_COMPAT_LAZY_REFCOUNTS));
@@ -1245,6 +1266,16 @@ static void qcow2_update_options_commit(BlockDriverState *bs,
         cache_clean_timer_init(bs, bdrv_get_aio_context(bs));
     }
 
+    if (s->compressed_readahead != r->compressed_readahead) {
+        qcow2_readahead_destroy(s->readahead);
+        s->readahead = NULL;
+        s->compressed_readahead = r->compressed_readahead;
+        if (s->compressed_readahead) {
+            /* Not being able to allocate the cache is not fatal */
+            s->readahead = qcow2_readahead_create(bs, s->compressed_readahead);
+        }
+    }
+
     qapi_free_QCryptoBlockOpenOptions(s->crypto_opts);
     s->crypto_opts = r->crypto_opts;
 }
@@ -2403,12 +2434,17 @@ qcow2_co_preadv_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
                             QCOW_MAX_CRYPT_CLUSTERS * s->cluster_size);
         }
 
-        qemu_co_mutex_lock(&s->lock);
-        ret = qcow2_get_host_offset(bs, offset, &cur_bytes,
-                                    &host_offset, &type);
-        qemu_co_mutex_unlock(&s->lock);
-        if (ret < 0) {
-            goto out;
+        if (qcow2_get_host_offset_cached(bs, offset, &cur_bytes,
+                                         &host_offset)) {
+            type = QCOW2_SUBCLUSTER_NORMAL;
+        } else {
+            qemu_co_mutex_lock(&s->lock);
+            ret = qcow2_get_host_offset(bs, offset, &cur_bytes,
+                                        &host_offset, &type);
+            qemu_co_mutex_unlock(&s->lock);
+            if (ret < 0) {
+                goto out;
+            }
         }
 
         if (type == QCOW2_SUBCLUSTER_ZERO_PLAIN ||
@@ -2806,6 +2842,9 @@ qcow2_do_close(BlockDriverState *bs, bool close_data_file)
     cache_clean_timer_del(bs);
     qcow2_cache_destroy(s->l2_table_cache);
     qcow2_cache_destroy(s->refcount_block_cache);
+    qcow2_readahead_destroy(s->readahead);
+    s->readahead = NULL;
+    s->compressed_readahead = 0;
 
     qcrypto_block_free(s->crypto);
     s->crypto = NULL;
@@ -4818,19 +4857,18 @@ qcow2_co_pwritev_compressed_part(BlockDriverState *bs,
     return ret;
 }
 
-static int coroutine_fn GRAPH_RDLOCK
-qcow2_co_preadv_compressed(BlockDriverState *bs,
-                           uint64_t l2_entry,
-                           uint64_t offset,
-                           uint64_t bytes,
-                           QEMUIOVector *qiov,
-                           size_t qiov_offset)
+/*
+ * Read the compressed cluster described by @l2_entry and decompress it into
+ * @dest, which must be cluster_size bytes long.
+ */
+int coroutine_fn GRAPH_RDLOCK
+qcow2_co_read_compressed_cluster(BlockDriverState *bs, uint64_t l2_entry,
+                                 void *dest)
 {
     BDRVQcow2State *s = bs->opaque;
     int ret = 0, csize;
     uint64_t coffset;
-    uint8_t *buf, *out_buf;
-    int offset_in_cluster = offset_into_cluster(s, offset);
+    uint8_t *buf;
 
     qcow2_parse_compressed_l2_entry(bs, l2_entry, &coffset, &csize);
 
@@ -4839,28 +4877,54 @@ qcow2_co_preadv_compressed(BlockDriverState *bs,
         return -ENOMEM;
     }
 
-    out_buf = qemu_blockalign(bs, s->cluster_size);
-
     BLKDBG_CO_EVENT(bs->file, BLKDBG_READ_COMPRESSED);
     ret = bdrv_co_pread(bs->file, coffset, csize, buf, 0);
     if (ret < 0) {
         goto fail;
     }
 
-    if (qcow2_co_decompress(bs, out_buf, s->cluster_size, buf, csize) < 0) {
+    if (qcow2_co_decompress(bs, dest, s->cluster_size, buf, csize) < 0) {
         ret = -EIO;
         goto fail;
     }
 
-    qemu_iovec_from_buf(qiov, qiov_offset, out_buf + offset_in_cluster, bytes);
-
 fail:
-    qemu_vfree(out_buf);
     g_free(buf);
 
     return ret;
 }
 
+static int coroutine_fn GRAPH_RDLOCK
+qcow2_co_preadv_compressed(BlockDriverState *bs,
+                           uint64_t l2_entry,
+                           uint64_t offset,
+                           uint64_t bytes,
+                           QEMUIOVector *qiov,
+                           size_t qiov_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int ret;
+    uint8_t *out_buf;
+    int offset_in_cluster = offset_into_cluster(s, offset);
+
+    if (s->readahead) {
+        return qcow2_co_readahead_read(bs, l2_entry, offset, bytes,
+                                       qiov, qiov_offset);
+    }
+
+    out_buf = qemu_blockalign(bs, s->cluster_size);
+
+    ret = qcow2_co_read_compressed_cluster(bs, l2_entry, out_buf);
+    if (ret == 0) {
+        qemu_iovec_from_buf(qiov, qiov_offset, out_buf + offset_in_cluster,
+                            bytes);
+    }
+
+    qemu_vfree(out_buf);
+
+    return ret;
+}
+
 static int GRAPH_RDLOCK make_completely_empty(BlockDriverState *bs)
 {
     BDRVQcow2State *s = bs->opaque;
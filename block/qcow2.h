@@ -150,6 +150,7 @@
 #define QCOW2_OPT_L2_CACHE_ENTRY_SIZE "l2-cache-entry-size"
 #define QCOW2_OPT_REFCOUNT_CACHE_SIZE "refcount-cache-size"
 #define QCOW2_OPT_CACHE_CLEAN_INTERVAL "cache-clean-interval"
+#define QCOW2_OPT_COMPRESSED_READAHEAD "compressed-readahead"
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -324,6 +325,11 @@ typedef struct Qcow2BitmapHeaderExt {
 
 #define QCOW2_MAX_THREADS 4
 
+/* Upper limit for compressed-readahead, in clusters */
+#define QCOW2_MAX_COMPRESSED_READAHEAD 256
+
+typedef struct Qcow2Readahead Qcow2Readahead;
+
 typedef struct BDRVQcow2State {
     int cluster_bits;
     int cluster_size;
@@ -348,6 +354,10 @@ typedef struct BDRVQcow2State {
     QEMUTimer *cache_clean_timer;
     unsigned cache_clean_interval;
 
+    /* Decompressed cluster cache, only for read-only images */
+    Qcow2Readahead *readahead;
+    unsigned compressed_readahead;
+
     QLIST_HEAD(, QCowL2Meta) cluster_allocs;
 
     uint64_t *refcount_table;
@@ -917,6 +927,8 @@ int coroutine_fn GRAPH_RDLOCK
 qcow2_detect_metadata_preallocation(BlockDriverState *bs);
 
 /* qcow2-cluster.c functions */
+void qcow2_set_l1_table(BDRVQcow2State *s, uint64_t *l1_table, int l1_size);
+
 int GRAPH_RDLOCK
 qcow2_grow_l1_table(BlockDriverState *bs, uint64_t min_size, bool exact_size);
 
@@ -931,6 +943,8 @@ int GRAPH_RDLOCK
 qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
                       unsigned int *bytes, uint64_t *host_offset,
                       QCow2SubclusterType *subcluster_type);
+bool qcow2_get_host_offset_cached(BlockDriverState *bs, uint64_t offset,
+                                  unsigned int *bytes, uint64_t *host_offset);
 
 int coroutine_fn GRAPH_RDLOCK
 qcow2_alloc_host_offset(BlockDriverState *bs, uint64_t offset,
@@ -1019,6 +1033,8 @@ qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
                       void **table);
 
 void qcow2_cache_put(Qcow2Cache *c, void **table);
+bool qcow2_cache_get_cached(Qcow2Cache *c, uint64_t offset, void **table);
+void qcow2_cache_put_cached(Qcow2Cache *c, void **table);
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset);
 void qcow2_cache_discard(Qcow2Cache *c, void *table);
 
@@ -1058,6 +1074,18 @@ bool qcow2_supports_persistent_dirty_bitmap(BlockDriverState *bs);
 uint64_t qcow2_get_persistent_dirty_bitmap_size(BlockDriverState *bs,
                                                 uint32_t cluster_size);
 
+int coroutine_fn GRAPH_RDLOCK
+qcow2_co_read_compressed_cluster(BlockDriverState *bs, uint64_t l2_entry,
+                                 void *dest);
+
+/* qcow2-readahead.c functions */
+Qcow2Readahead *qcow2_readahead_create(BlockDriverState *bs, int window);
+void qcow2_readahead_destroy(Qcow2Readahead *ra);
+int coroutine_fn GRAPH_RDLOCK
+qcow2_co_readahead_read(BlockDriverState *bs, uint64_t l2_entry,
+                        uint64_t offset, uint64_t bytes,
+                        QEMUIOVector *qiov, size_t qiov_offset);
+
 ssize_t coroutine_fn
 qcow2_co_compress(BlockDriverState *bs, void *dest, size_t dest_size,
                   const void *src, size_t src_size);
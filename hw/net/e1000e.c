@@ -672,6 +672,8 @@ static Property e1000e_properties[] = {
                         e1000e_prop_subsys, uint16_t),
     DEFINE_PROP_BOOL("init-vet", E1000EState, init_vet, true),
     DEFINE_PROP_BOOL("migrate-timadj", E1000EState, timadj, true),
+    DEFINE_PROP_BOOL("gro", E1000EState, core.gro, false),
+    DEFINE_PROP_UINT32("gro-max-frame", E1000EState, core.gro_max_frame, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -1922,11 +1922,37 @@ e1000e_calc_rxdesclen(E1000ECore *core)
     trace_e1000e_rx_desc_len(core->rx_desc_len);
 }
 
+static void
+e1000e_update_gro(E1000ECore *core)
+{
+    size_t vnet_hdr_len = core->has_vnet ? sizeof(struct virtio_net_hdr) : 0;
+    size_t max_frame = 0;
+    int i;
+
+    if (core->gro) {
+        /*
+         * With LPE, frames of up to 16 KiB are accepted whatever the MTU
+         * of the guest is, and unlike igb there is no RLPML register that
+         * tells what the driver expects.  Merge up to a standard frame,
+         * unless the user gave the largest frame the guest takes.
+         */
+        max_frame = MIN(e1000x_max_frame_size(core->mac),
+                        core->gro_max_frame ?:
+                        sizeof(struct eth_header) + ETH_MTU);
+    }
+
+    for (i = 0; i <= core->max_queue_num; i++) {
+        qemu_set_gro(qemu_get_subqueue(core->owner_nic, i),
+                     vnet_hdr_len, max_frame);
+    }
+}
+
 static void
 e1000e_set_rx_control(E1000ECore *core, int index, uint32_t val)
 {
     core->mac[RCTL] = val;
     trace_e1000e_rx_set_rctl(core->mac[RCTL]);
+    e1000e_update_gro(core);
 
     if (val & E1000_RCTL_EN) {
         e1000e_parse_rxbufsize(core);
@@ -3343,6 +3369,7 @@ e1000e_core_pci_realize(E1000ECore     *core,
                                PCI_DEVICE_GET_CLASS(core->owner)->device_id,
                                macaddr);
     e1000e_update_rx_offloads(core);
+    e1000e_update_gro(core);
 }
 
 void
@@ -3482,6 +3509,8 @@ static void e1000e_reset(E1000ECore *core, bool sw)
         memset(&core->tx[i].props, 0, sizeof(core->tx[i].props));
         core->tx[i].skip_cp = false;
     }
+
+    e1000e_update_gro(core);
 }
 
 void
@@ -3529,6 +3558,7 @@ e1000e_core_post_load(E1000ECore *core)
      */
     e1000e_intrmgr_resume(core);
     e1000e_autoneg_resume(core);
+    e1000e_update_gro(core);
 
     return 0;
 }
@@ -82,6 +82,8 @@ struct E1000Core {
     struct NetRxPkt *rx_pkt;
 
     bool has_vnet;
+    bool gro;
+    uint32_t gro_max_frame;
     int max_queue_num;
 
     /* Interrupt moderation management */
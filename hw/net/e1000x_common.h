@@ -113,6 +113,8 @@ bool e1000x_rx_group_filter(uint32_t *mac, const struct eth_header *ehdr);
 
 bool e1000x_hw_rx_enabled(uint32_t *mac);
 
+size_t e1000x_max_frame_size(uint32_t *mac);
+
 bool e1000x_is_oversized(uint32_t *mac, size_t size);
 
 void e1000x_restart_autoneg(uint32_t *mac, uint16_t *phy, QEMUTimer *timer);
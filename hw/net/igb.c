@@ -601,6 +601,7 @@ static const VMStateDescription igb_vmstate = {
 static Property igb_properties[] = {
     DEFINE_NIC_PROPERTIES(IGBState, conf),
     DEFINE_PROP_BOOL("x-pcie-flr-init", IGBState, has_flr, true),
+    DEFINE_PROP_BOOL("gro", IGBState, core.gro, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -2222,11 +2222,57 @@ igb_calc_rxdesclen(IGBCore *core)
     trace_e1000e_rx_desc_len(core->rx_desc_len);
 }
 
+static size_t
+igb_max_frame_size(bool lpe, uint16_t rlpml)
+{
+    /* For untagged frames, see igb_rx_is_oversized() */
+    if (lpe) {
+        return rlpml > ETH_FCS_LEN ? rlpml - ETH_FCS_LEN : 0;
+    }
+    return sizeof(struct eth_header) + ETH_MTU;
+}
+
+static void
+igb_update_gro(IGBCore *core)
+{
+    size_t vnet_hdr_len = core->has_vnet ? sizeof(struct virtio_net_hdr) : 0;
+    size_t max_frame = 0;
+    int i;
+
+    if (core->gro) {
+        max_frame = igb_max_frame_size(core->mac[RCTL] & E1000_RCTL_LPE,
+                                       core->mac[RLPML]);
+        /* With VMDq, the frames must fit in any pool they may go to */
+        if (core->mac[MRQC] & 1) {
+            for (i = 0; i < IGB_NUM_VM_POOLS; i++) {
+                uint32_t vmolr = core->mac[VMOLR0 + i];
+
+                max_frame = MIN(max_frame, igb_max_frame_size(
+                                    vmolr & E1000_VMOLR_LPE,
+                                    vmolr & E1000_VMOLR_RLPML_MASK));
+            }
+        }
+    }
+
+    for (i = 0; i <= core->max_queue_num; i++) {
+        qemu_set_gro(qemu_get_subqueue(core->owner_nic, i),
+                     vnet_hdr_len, max_frame);
+    }
+}
+
+static void
+igb_set_rx_frame_limit(IGBCore *core, int index, uint32_t val)
+{
+    core->mac[index] = val;
+    igb_update_gro(core);
+}
+
 static void
 igb_set_rx_control(IGBCore *core, int index, uint32_t val)
 {
     core->mac[RCTL] = val;
     trace_e1000e_rx_set_rctl(core->mac[RCTL]);
+    igb_update_gro(core);
 
     if (val & E1000_RCTL_DTYP_MASK) {
         qemu_log_mask(LOG_GUEST_ERROR,
@@ -3776,7 +3822,6 @@ static const writeops igb_macreg_writeops[] = {
     igb_putreg(GSCN_1),
     igb_putreg(GSCN_2),
     igb_putreg(GSCN_3),
-    igb_putreg(MRQC),
     igb_putreg(FLOP),
     igb_putreg(FLA),
     igb_putreg(TXDCTL0),
@@ -3858,7 +3903,6 @@ static const writeops igb_macreg_writeops[] = {
     igb_putreg(EEMNGCTL),
     igb_putreg(GPIE),
     igb_putreg(TXPBS),
-    igb_putreg(RLPML),
     igb_putreg(VET),
 
     [TDH0]     = igb_set_16bit,
@@ -4068,7 +4112,9 @@ static const writeops igb_macreg_writeops[] = {
     igb_putreg(RPLOLR),
     [VLVF0 ... VLVF0 + E1000_VLVF_ARRAY_SIZE - 1] = igb_mac_writereg,
     [VMVIR0 ... VMVIR7] = igb_mac_writereg,
-    [VMOLR0 ... VMOLR7] = igb_mac_writereg,
+    [VMOLR0 ... VMOLR7] = igb_set_rx_frame_limit,
+    [MRQC]     = igb_set_rx_frame_limit,
+    [RLPML]    = igb_set_rx_frame_limit,
     [UTA ... UTA + E1000_MC_TBL_SIZE - 1] = igb_mac_writereg,
     [PVTCTRL0] = igb_set_vtctrl,
     [PVTCTRL1] = igb_set_vtctrl,
@@ -4307,6 +4353,7 @@ igb_core_pci_realize(IGBCore        *core,
                                PCI_DEVICE_GET_CLASS(core->owner)->device_id,
                                macaddr);
     igb_update_rx_offloads(core);
+    igb_update_gro(core);
 }
 
 void
@@ -4501,6 +4548,8 @@ static void igb_reset(IGBCore *core, bool sw)
         tx->first = true;
         tx->skip_cp = false;
     }
+
+    igb_update_gro(core);
 }
 
 void
@@ -4548,6 +4597,7 @@ igb_core_post_load(IGBCore *core)
      */
     igb_intrmgr_resume(core);
     igb_autoneg_resume(core);
+    igb_update_gro(core);
 
     return 0;
 }
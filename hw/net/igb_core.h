@@ -86,6 +86,7 @@ struct IGBCore {
     struct NetRxPkt *rx_pkt;
 
     bool has_vnet;
+    bool gro;
     int max_queue_num;
 
     IGBIntrDelayTimer eitr[IGB_INTR_NUM];
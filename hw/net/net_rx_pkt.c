@@ -17,6 +17,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/crc32c.h"
+#include "qemu/toeplitz.h"
 #include "trace.h"
 #include "net_rx_pkt.h"
 #include "net/checksum.h"
@@ -47,6 +48,10 @@ struct NetRxPkt {
     eth_ip6_hdr_info ip6hdr_info;
     eth_ip4_hdr_info ip4hdr_info;
     eth_l4_hdr_info  l4hdr_info;
+
+    /* The RSS key, as last prepared for rss_key_data */
+    uint8_t rss_key[TOEPLITZ_KEY_MAX_LEN];
+    ToeplitzKey rss_key_data;
 };
 
 void net_rx_pkt_init(struct NetRxPkt **pkt)
@@ -63,6 +68,7 @@ void net_rx_pkt_uninit(struct NetRxPkt *pkt)
         g_free(pkt->vec);
     }
 
+    toeplitz_key_destroy(&pkt->rss_key_data);
     g_free(pkt);
 }
 
@@ -313,8 +319,7 @@ net_rx_pkt_calc_rss_hash(struct NetRxPkt *pkt,
 {
     uint8_t rss_input[36];
     size_t rss_length = 0;
-    uint32_t rss_hash = 0;
-    net_toeplitz_key key_data;
+    uint32_t rss_hash;
 
     switch (type) {
     case NetPktRssIpV4:
@@ -379,8 +384,13 @@ net_rx_pkt_calc_rss_hash(struct NetRxPkt *pkt,
         break;
     }
 
-    net_toeplitz_key_init(&key_data, key);
-    net_toeplitz_add(&rss_hash, rss_input, rss_length, &key_data);
+    /* The key seldom changes, prepare it again only when it does */
+    if (!pkt->rss_key_data.max_input ||
+        memcmp(pkt->rss_key, key, sizeof(pkt->rss_key))) {
+        memcpy(pkt->rss_key, key, sizeof(pkt->rss_key));
+        toeplitz_key_init(&pkt->rss_key_data, key, sizeof(pkt->rss_key));
+    }
+    rss_hash = toeplitz_hash(&pkt->rss_key_data, rss_input, rss_length);
 
     trace_net_rx_pkt_rss_hash(rss_length, rss_hash);
 
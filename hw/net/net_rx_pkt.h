@@ -136,6 +136,7 @@ typedef enum {
 *
 * @pkt:            packet
 * @type:           RSS hash type
+* @key:            RSS key, 40 bytes
 *
 * Return:  Toeplitz RSS hash.
 *
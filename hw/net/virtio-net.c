@@ -17,6 +17,7 @@
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
 #include "qemu/module.h"
+#include "block/aio-wait.h"
 #include "hw/virtio/virtio.h"
 #include "net/net.h"
 #include "net/checksum.h"
@@ -31,6 +32,7 @@
 #include "net/vhost_net.h"
 #include "net/announce.h"
 #include "hw/virtio/virtio-bus.h"
+#include "hw/virtio/iothread-vq-mapping.h"
 #include "qapi/error.h"
 #include "qapi/qapi-events-net.h"
 #include "hw/qdev-properties.h"
@@ -40,6 +42,7 @@
 #include "migration/misc.h"
 #include "standard-headers/linux/ethtool.h"
 #include "sysemu/sysemu.h"
+#include "sysemu/iothread.h"
 #include "trace.h"
 #include "monitor/qdev.h"
 #include "monitor/monitor.h"
@@ -133,6 +136,30 @@ static void flush_or_purge_queued_packets(NetClientState *nc)
     assert(!virtio_net_get_subqueue(nc)->async_tx.elem);
 }
 
+/*
+ * Run @cb for queue pair @q in the IOThread that processes it, if any,
+ * and wait for it to complete.  Context: BQL held
+ */
+static void virtio_net_queue_run(VirtIONetQueue *q, QEMUBHFunc *cb,
+                                 void *opaque)
+{
+    if (q->ctx) {
+        aio_wait_bh_oneshot(q->ctx, cb, opaque);
+    } else {
+        cb(opaque);
+    }
+}
+
+static void virtio_net_notify(VirtIODevice *vdev, VirtQueue *vq)
+{
+    /* IOThreads cannot take the BQL to inject the interrupt */
+    if (qemu_in_iothread()) {
+        virtio_notify_irqfd(vdev, vq);
+    } else {
+        virtio_notify(vdev, vq);
+    }
+}
+
 /* TODO
  * - we could suppress RX interrupt if we were so inclined.
  */
@@ -259,6 +286,32 @@ static void virtio_net_announce(NetClientState *nc)
     }
 }
 
+typedef struct VirtIONetSendAnnounce {
+    NetClientState *nc;
+    const uint8_t *buf;
+    int len;
+} VirtIONetSendAnnounce;
+
+static void virtio_net_send_announce_bh(void *opaque)
+{
+    VirtIONetSendAnnounce *a = opaque;
+
+    qemu_send_packet_raw(a->nc, a->buf, a->len);
+}
+
+/*
+ * The RARP frame goes through the same NetQueue of the peer as the TX
+ * packets of the queue pair, so send it from the IOThread of the queue.
+ */
+static void virtio_net_send_announce(NetClientState *nc, const uint8_t *buf,
+                                     int len)
+{
+    VirtIONetSendAnnounce a = { .nc = nc, .buf = buf, .len = len };
+
+    virtio_net_queue_run(virtio_net_get_subqueue(nc),
+                         virtio_net_send_announce_bh, &a);
+}
+
 static void virtio_net_vhost_status(VirtIONet *n, uint8_t status)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
@@ -377,64 +430,79 @@ static void virtio_net_drop_tx_queue_data(VirtIODevice *vdev, VirtQueue *vq)
 {
     unsigned int dropped = virtqueue_drop_all(vq);
     if (dropped) {
-        virtio_notify(vdev, vq);
+        virtio_net_notify(vdev, vq);
+    }
+}
+
+typedef struct VirtIONetQueueStatus {
+    VirtIONetQueue *q;
+    uint8_t status;
+} VirtIONetQueueStatus;
+
+static void virtio_net_queue_set_status(void *opaque)
+{
+    VirtIONetQueueStatus *qs = opaque;
+    VirtIONetQueue *q = qs->q;
+    VirtIONet *n = q->n;
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    NetClientState *ncs = qemu_get_subqueue(n->nic, q - n->vqs);
+    uint8_t queue_status = qs->status;
+    bool queue_started;
+
+    queue_started = virtio_net_started(n, queue_status) && !n->vhost_started;
+
+    if (queue_started) {
+        qemu_flush_queued_packets(ncs);
+    }
+
+    if (!q->tx_waiting) {
+        return;
+    }
+
+    if (queue_started) {
+        if (q->tx_timer) {
+            timer_mod(q->tx_timer,
+                      qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + n->tx_timeout);
+        } else {
+            qemu_bh_schedule(q->tx_bh);
+        }
+    } else {
+        if (q->tx_timer) {
+            timer_del(q->tx_timer);
+        } else {
+            qemu_bh_cancel(q->tx_bh);
+        }
+        if ((n->status & VIRTIO_NET_S_LINK_UP) == 0 &&
+            (queue_status & VIRTIO_CONFIG_S_DRIVER_OK) &&
+            vdev->vm_running) {
+            /*
+             * if tx is waiting we are likely have some packets in tx queue
+             * and disabled notification
+             */
+            q->tx_waiting = 0;
+            virtio_queue_set_notification(q->tx_vq, 1);
+            virtio_net_drop_tx_queue_data(vdev, q->tx_vq);
+        }
     }
 }
 
 static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
-    VirtIONetQueue *q;
     int i;
-    uint8_t queue_status;
 
     virtio_net_vnet_endian_status(n, status);
     virtio_net_vhost_status(n, status);
 
     for (i = 0; i < n->max_queue_pairs; i++) {
-        NetClientState *ncs = qemu_get_subqueue(n->nic, i);
-        bool queue_started;
-        q = &n->vqs[i];
+        VirtIONetQueueStatus qs = { .q = &n->vqs[i] };
 
         if ((!n->multiqueue && i != 0) || i >= n->curr_queue_pairs) {
-            queue_status = 0;
+            qs.status = 0;
         } else {
-            queue_status = status;
-        }
-        queue_started =
-            virtio_net_started(n, queue_status) && !n->vhost_started;
-
-        if (queue_started) {
-            qemu_flush_queued_packets(ncs);
-        }
-
-        if (!q->tx_waiting) {
-            continue;
-        }
-
-        if (queue_started) {
-            if (q->tx_timer) {
-                timer_mod(q->tx_timer,
-                               qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + n->tx_timeout);
-            } else {
-                qemu_bh_schedule(q->tx_bh);
-            }
-        } else {
-            if (q->tx_timer) {
-                timer_del(q->tx_timer);
-            } else {
-                qemu_bh_cancel(q->tx_bh);
-            }
-            if ((n->status & VIRTIO_NET_S_LINK_UP) == 0 &&
-                (queue_status & VIRTIO_CONFIG_S_DRIVER_OK) &&
-                vdev->vm_running) {
-                /* if tx is waiting we are likely have some packets in tx queue
-                 * and disabled notification */
-                q->tx_waiting = 0;
-                virtio_queue_set_notification(q->tx_vq, 1);
-                virtio_net_drop_tx_queue_data(vdev, q->tx_vq);
-            }
+            qs.status = status;
         }
+        virtio_net_queue_run(qs.q, virtio_net_queue_set_status, &qs);
     }
 }
 
@@ -549,9 +617,22 @@ static RxFilterInfo *virtio_net_query_rxfilter(NetClientState *nc)
     return info;
 }
 
+static void virtio_net_queue_attach(VirtIONet *n, int index, AioContext *ctx);
+static void virtio_net_queue_detach(VirtIONet *n, int index);
+
+static bool virtio_net_queue_pair_enabled(VirtIONet *n, int index)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    VirtIONetQueue *q = &n->vqs[index];
+
+    return virtio_queue_enabled(vdev, virtio_get_queue_index(q->rx_vq)) &&
+           virtio_queue_enabled(vdev, virtio_get_queue_index(q->tx_vq));
+}
+
 static void virtio_net_queue_reset(VirtIODevice *vdev, uint32_t queue_index)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
+    VirtIONetQueue *q;
     NetClientState *nc;
 
     /* validate queue_index and skip for cvq */
@@ -560,6 +641,16 @@ static void virtio_net_queue_reset(VirtIODevice *vdev, uint32_t queue_index)
     }
 
     nc = qemu_get_subqueue(n->nic, vq2q(queue_index));
+    q = virtio_net_get_subqueue(nc);
+
+    /*
+     * The vring is cleared in the main loop once we return, so the queue
+     * pair must not be processed by its IOThread anymore.  It moves back
+     * when both of its virtqueues are enabled again.
+     */
+    if (q->ctx) {
+        virtio_net_queue_detach(n, vq2q(queue_index));
+    }
 
     if (!nc->peer) {
         return;
@@ -576,6 +667,7 @@ static void virtio_net_queue_reset(VirtIODevice *vdev, uint32_t queue_index)
 static void virtio_net_queue_enable(VirtIODevice *vdev, uint32_t queue_index)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
+    VirtIONetQueue *q;
     NetClientState *nc;
     int r;
 
@@ -585,6 +677,14 @@ static void virtio_net_queue_enable(VirtIODevice *vdev, uint32_t queue_index)
     }
 
     nc = qemu_get_subqueue(n->nic, vq2q(queue_index));
+    q = virtio_net_get_subqueue(nc);
+
+    if (n->iothread_datapath && !q->ctx &&
+        (n->multiqueue || vq2q(queue_index) == 0) &&
+        virtio_net_queue_pair_enabled(n, vq2q(queue_index))) {
+        virtio_net_queue_attach(n, vq2q(queue_index),
+                                n->vq_aio_context[vq2q(queue_index)]);
+    }
 
     if (!nc->peer || !vdev->vhost_started) {
         return;
@@ -1582,10 +1682,18 @@ size_t virtio_net_handle_ctrl_iov(VirtIODevice *vdev,
     return sizeof(status);
 }
 
+static void virtio_net_iothread_datapath_pause(VirtIONet *n);
+static void virtio_net_iothread_datapath_resume(VirtIONet *n);
+
 static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
 {
+    VirtIONet *n = VIRTIO_NET(vdev);
     VirtQueueElement *elem;
 
+    if (n->iothread_datapath) {
+        virtio_net_iothread_datapath_pause(n);
+    }
+
     for (;;) {
         size_t written;
         elem = virtqueue_pop(vq, sizeof(VirtQueueElement));
@@ -1605,6 +1713,10 @@ static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
             break;
         }
     }
+
+    if (n->iothread_datapath) {
+        virtio_net_iothread_datapath_resume(n);
+    }
 }
 
 /* RX */
@@ -1836,7 +1948,7 @@ static int virtio_net_process_rss(NetClientState *nc, const uint8_t *buf,
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
     unsigned int index = nc->queue_index, new_index = index;
-    struct NetRxPkt *pkt = n->rx_pkt;
+    struct NetRxPkt *pkt = virtio_net_get_subqueue(nc)->rx_pkt;
     uint8_t net_hash_type;
     uint32_t hash;
     bool hasip4, hasip6;
@@ -1904,7 +2016,9 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
 
     if (!no_rss && n->rss_data.enabled && n->rss_data.enabled_software_rss) {
         int index = virtio_net_process_rss(nc, buf, size, &extra_hdr);
-        if (index >= 0) {
+
+        /* Queue pairs processed by another thread cannot be touched here */
+        if (index >= 0 && n->vqs[index].ctx == q->ctx) {
             NetClientState *nc2 = qemu_get_subqueue(n->nic, index);
             return virtio_net_receive_rcu(nc2, buf, size, true);
         }
@@ -2017,7 +2131,7 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
     }
 
     virtqueue_flush(q->rx_vq, i);
-    virtio_notify(vdev, q->rx_vq);
+    virtio_net_notify(vdev, q->rx_vq);
 
     return size;
 
@@ -2652,7 +2766,7 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
     int ret;
 
     virtqueue_push(q->tx_vq, q->async_tx.elem, 0);
-    virtio_notify(vdev, q->tx_vq);
+    virtio_net_notify(vdev, q->tx_vq);
 
     g_free(q->async_tx.elem);
     q->async_tx.elem = NULL;
@@ -2764,7 +2878,7 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
 
 drop:
         virtqueue_push(q->tx_vq, elem, 0);
-        virtio_notify(vdev, q->tx_vq);
+        virtio_net_notify(vdev, q->tx_vq);
         g_free(elem);
 
         if (++num_packets >= n->tx_burst) {
@@ -2959,6 +3073,7 @@ static void virtio_net_add_queue(VirtIONet *n, int index)
 
     n->vqs[index].tx_waiting = 0;
     n->vqs[index].n = n;
+    net_rx_pkt_init(&n->vqs[index].rx_pkt);
 }
 
 static void virtio_net_del_queue(VirtIONet *n, int index)
@@ -2979,6 +3094,8 @@ static void virtio_net_del_queue(VirtIONet *n, int index)
     }
     q->tx_waiting = 0;
     virtio_del_queue(vdev, index * 2 + 1);
+    net_rx_pkt_uninit(q->rx_pkt);
+    q->rx_pkt = NULL;
 }
 
 static void virtio_net_change_num_queue_pairs(VirtIONet *n, int new_max_queue_pairs)
@@ -3026,6 +3143,221 @@ static void virtio_net_set_multiqueue(VirtIONet *n, int multiqueue)
     virtio_net_set_queue_pairs(n);
 }
 
+/*
+ * With iothread-vq-mapping, each queue pair moves to its IOThread while
+ * ioeventfd is started: the host notifiers of both virtqueues, the TX
+ * bottom half and the I/O handlers of the backend all run in the
+ * AioContext of the IOThread, so that RX and TX never need the BQL.
+ * Status changes stay in the main loop and use virtio_net_queue_run() for
+ * anything that touches the queue pair.  The queue pairs go back to the
+ * main loop while a control virtqueue request is processed, since most of
+ * them change state that RX and TX depend on, and while one of their
+ * virtqueues is reset by the guest.
+ *
+ * A queue pair stays in the main loop if its backend cannot run in an
+ * IOThread, or if network filters are attached to either side, because
+ * filters expect to run in the main loop.
+ */
+static void virtio_net_queue_attach(VirtIONet *n, int index, AioContext *ctx)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    VirtIONetQueue *q = &n->vqs[index];
+    NetClientState *nc = qemu_get_subqueue(n->nic, index);
+    NetClientState *peer = nc->peer;
+
+    if (!peer || !peer->info->set_aio_context ||
+        !QTAILQ_EMPTY(&nc->filters) || !QTAILQ_EMPTY(&peer->filters)) {
+        return;
+    }
+
+    q->ctx = ctx;
+    if (!peer->info->set_aio_context(peer, ctx)) {
+        q->ctx = NULL;
+        return;
+    }
+
+    qemu_bh_delete(q->tx_bh);
+    q->tx_bh = aio_bh_new_guarded(ctx, virtio_net_tx_bh, q,
+                                  &DEVICE(vdev)->mem_reentrancy_guard);
+    if (q->tx_waiting) {
+        qemu_bh_schedule(q->tx_bh);
+    }
+
+    event_notifier_set_handler(virtio_queue_get_host_notifier(q->rx_vq), NULL);
+    event_notifier_set_handler(virtio_queue_get_host_notifier(q->tx_vq), NULL);
+
+    /* Neither handler pops all elements, so do not poll */
+    virtio_queue_aio_attach_host_notifier_no_poll(q->rx_vq, ctx);
+    virtio_queue_aio_attach_host_notifier_no_poll(q->tx_vq, ctx);
+}
+
+/* Context: BH in IOThread */
+static void virtio_net_queue_detach_bh(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+    VirtIONet *n = q->n;
+    NetClientState *nc = qemu_get_subqueue(n->nic, q - n->vqs);
+
+    virtio_queue_aio_detach_host_notifier(q->rx_vq, q->ctx);
+    virtio_queue_aio_detach_host_notifier(q->tx_vq, q->ctx);
+
+    if (nc->peer) {
+        nc->peer->info->set_aio_context(nc->peer, NULL);
+    }
+
+    qemu_bh_delete(q->tx_bh);
+    q->tx_bh = NULL;
+}
+
+static void virtio_net_queue_detach(VirtIONet *n, int index)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    VirtIONetQueue *q = &n->vqs[index];
+
+    aio_wait_bh_oneshot(q->ctx, virtio_net_queue_detach_bh, q);
+    q->ctx = NULL;
+
+    q->tx_bh = qemu_bh_new_guarded(virtio_net_tx_bh, q,
+                                   &DEVICE(vdev)->mem_reentrancy_guard);
+    if (q->tx_waiting) {
+        qemu_bh_schedule(q->tx_bh);
+    }
+
+    /* Kicks that were not processed yet are seen by the main loop */
+    event_notifier_set_handler(virtio_queue_get_host_notifier(q->rx_vq),
+                               virtio_queue_host_notifier_read);
+    event_notifier_set_handler(virtio_queue_get_host_notifier(q->tx_vq),
+                               virtio_queue_host_notifier_read);
+}
+
+static void virtio_net_iothread_datapath_pause(VirtIONet *n)
+{
+    int queue_pairs = n->multiqueue ? n->max_queue_pairs : 1;
+    int i;
+
+    for (i = 0; i < queue_pairs; i++) {
+        if (n->vqs[i].ctx) {
+            virtio_net_queue_detach(n, i);
+        }
+    }
+}
+
+static void virtio_net_iothread_datapath_resume(VirtIONet *n)
+{
+    int queue_pairs = n->multiqueue ? n->max_queue_pairs : 1;
+    int i;
+
+    for (i = 0; i < queue_pairs; i++) {
+        if (virtio_net_queue_pair_enabled(n, i)) {
+            virtio_net_queue_attach(n, i, n->vq_aio_context[i]);
+        }
+    }
+}
+
+/* Context: BQL held */
+static int virtio_net_start_ioeventfd(VirtIODevice *vdev)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(vdev)));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int queue_pairs = n->multiqueue ? n->max_queue_pairs : 1;
+    int r;
+
+    r = virtio_device_start_ioeventfd_impl(vdev);
+    if (r < 0 || !n->vq_aio_context) {
+        return r;
+    }
+
+    /*
+     * The IOThreads notify the guest through the guest notifiers.  The
+     * masking callbacks of virtio-net are only implemented for vhost, so
+     * let the transport handle masking.
+     */
+    vdev->use_guest_notifier_mask = false;
+    r = k->set_guest_notifiers(qbus->parent, queue_pairs * 2, true);
+    if (r < 0) {
+        warn_report("virtio-net: failed to set guest notifiers (%d), "
+                    "processing all queues in the main loop", r);
+        vdev->use_guest_notifier_mask = true;
+        return 0;
+    }
+
+    virtio_net_iothread_datapath_resume(n);
+    n->iothread_datapath = true;
+    return 0;
+}
+
+/* Context: BQL held */
+static void virtio_net_stop_ioeventfd(VirtIODevice *vdev)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(vdev)));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int queue_pairs = n->multiqueue ? n->max_queue_pairs : 1;
+
+    if (n->iothread_datapath) {
+        virtio_net_iothread_datapath_pause(n);
+        k->set_guest_notifiers(qbus->parent, queue_pairs * 2, false);
+        vdev->use_guest_notifier_mask = true;
+        n->iothread_datapath = false;
+    }
+
+    virtio_device_stop_ioeventfd_impl(vdev);
+}
+
+/* Context: BQL held */
+static bool virtio_net_vq_aio_context_init(VirtIONet *n, Error **errp)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(vdev)));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int i;
+
+    if (n->net_conf.tx && !strcmp(n->net_conf.tx, "timer")) {
+        error_setg(errp, "iothread-vq-mapping requires tx=bh");
+        return false;
+    }
+    /* vhost processes the virtqueues itself, outside of QEMU */
+    for (i = 0; i < n->nic_conf.peers.queues; i++) {
+        NetClientState *peer = n->nic_conf.peers.ncs[i];
+
+        if (peer && (peer->info->type == NET_CLIENT_DRIVER_VHOST_USER ||
+                     peer->info->type == NET_CLIENT_DRIVER_VHOST_VDPA ||
+                     get_vhost_net(peer))) {
+            error_setg(errp, "iothread-vq-mapping is incompatible with "
+                       "vhost backends");
+            return false;
+        }
+    }
+    /* The coalescing timers run in the main loop */
+    if (virtio_has_feature(n->host_features, VIRTIO_NET_F_RSC_EXT)) {
+        error_setg(errp, "iothread-vq-mapping is incompatible with "
+                   "guest_rsc_ext");
+        return false;
+    }
+    if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
+        error_setg(errp,
+                   "device is incompatible with iothread-vq-mapping "
+                   "(transport does not support notifiers)");
+        return false;
+    }
+    if (!virtio_device_ioeventfd_enabled(vdev)) {
+        error_setg(errp, "ioeventfd is required for iothread-vq-mapping");
+        return false;
+    }
+
+    /* The vqs of the mapping are queue pair indices */
+    n->vq_aio_context = g_new0(AioContext *, n->max_queue_pairs);
+    if (!iothread_vq_mapping_apply(n->net_conf.iothread_vq_mapping_list,
+                                   n->vq_aio_context, n->max_queue_pairs,
+                                   errp)) {
+        g_free(n->vq_aio_context);
+        n->vq_aio_context = NULL;
+        return false;
+    }
+    return true;
+}
+
 static int virtio_net_post_load_device(void *opaque, int version_id)
 {
     VirtIONet *n = opaque;
@@ -3354,6 +3686,7 @@ static NetClientInfo net_virtio_info = {
     .link_status_changed = virtio_net_set_link_status,
     .query_rx_filter = virtio_net_query_rxfilter,
     .announce = virtio_net_announce,
+    .send_announce = virtio_net_send_announce,
 };
 
 static bool virtio_net_guest_notifier_pending(VirtIODevice *vdev, int idx)
@@ -3693,6 +4026,14 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
     n->net_conf.tx_queue_size = MIN(virtio_net_max_tx_queue_size(n),
                                     n->net_conf.tx_queue_size);
 
+    if (n->net_conf.iothread_vq_mapping_list &&
+        !virtio_net_vq_aio_context_init(n, errp)) {
+        g_free(n->vqs);
+        n->vqs = NULL;
+        virtio_cleanup(vdev);
+        return;
+    }
+
     virtio_net_add_queue(n, 0);
 
     n->ctrl_vq = virtio_add_queue(vdev, 64, virtio_net_handle_ctrl);
@@ -3751,8 +4092,6 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
     QTAILQ_INIT(&n->rsc_chains);
     n->qdev = dev;
 
-    net_rx_pkt_init(&n->rx_pkt);
-
     if (virtio_has_feature(n->host_features, VIRTIO_NET_F_RSS)) {
         virtio_net_load_ebpf(n);
     }
@@ -3798,7 +4137,11 @@ static void virtio_net_device_unrealize(DeviceState *dev)
     qemu_del_nic(n->nic);
     virtio_net_rsc_cleanup(n);
     g_free(n->rss_data.indirections_table);
-    net_rx_pkt_uninit(n->rx_pkt);
+    if (n->vq_aio_context) {
+        iothread_vq_mapping_cleanup(n->net_conf.iothread_vq_mapping_list);
+        g_free(n->vq_aio_context);
+        n->vq_aio_context = NULL;
+    }
     virtio_cleanup(vdev);
 }
 
@@ -3963,6 +4306,8 @@ static Property virtio_net_properties[] = {
                        TX_TIMER_INTERVAL),
     DEFINE_PROP_INT32("x-txburst", VirtIONet, net_conf.txburst, TX_BURST),
     DEFINE_PROP_STRING("tx", VirtIONet, net_conf.tx),
+    DEFINE_PROP_IOTHREAD_VQ_MAPPING_LIST("iothread-vq-mapping", VirtIONet,
+                                         net_conf.iothread_vq_mapping_list),
     DEFINE_PROP_UINT16("rx_queue_size", VirtIONet, net_conf.rx_queue_size,
                        VIRTIO_NET_RX_QUEUE_DEFAULT_SIZE),
     DEFINE_PROP_UINT16("tx_queue_size", VirtIONet, net_conf.tx_queue_size,
@@ -4001,6 +4346,8 @@ static void virtio_net_class_init(ObjectClass *klass, void *data)
     vdc->queue_reset = virtio_net_queue_reset;
     vdc->queue_enable = virtio_net_queue_enable;
     vdc->set_status = virtio_net_set_status;
+    vdc->start_ioeventfd = virtio_net_start_ioeventfd;
+    vdc->stop_ioeventfd = virtio_net_stop_ioeventfd;
     vdc->guest_notifier_mask = virtio_net_guest_notifier_mask;
     vdc->guest_notifier_pending = virtio_net_guest_notifier_pending;
     vdc->legacy_features |= (0x1 << VIRTIO_NET_F_GSO);
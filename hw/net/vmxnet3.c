@@ -1156,6 +1156,19 @@ static void vmxnet3_reset_mac(VMXNET3State *s)
     VMW_CFPRN("MAC address set to: " MAC_FMT, MAC_ARG(s->conf.macaddr.a));
 }
 
+static void vmxnet3_update_gro(VMXNET3State *s)
+{
+    size_t vnet_hdr_len = s->peer_has_vhdr ? sizeof(struct virtio_net_hdr) : 0;
+    size_t max_frame = 0;
+
+    /* Frames beyond the MTU are only expected with LRO */
+    if (s->gro && s->device_active) {
+        max_frame = ETH_HLEN +
+                    (s->lro_supported ? ETH_MAX_IP_DGRAM_LEN : s->mtu);
+    }
+    qemu_set_gro(qemu_get_queue(s->nic), vnet_hdr_len, max_frame);
+}
+
 static void vmxnet3_deactivate_device(VMXNET3State *s)
 {
     if (s->device_active) {
@@ -1163,6 +1176,7 @@ static void vmxnet3_deactivate_device(VMXNET3State *s)
         net_tx_pkt_uninit(s->tx_pkt);
         net_rx_pkt_uninit(s->rx_pkt);
         s->device_active = false;
+        vmxnet3_update_gro(s);
     }
 }
 
@@ -1579,6 +1593,7 @@ static void vmxnet3_activate_device(VMXNET3State *s)
     vmxnet3_reset_mac(s);
 
     s->device_active = true;
+    vmxnet3_update_gro(s);
 }
 
 static void vmxnet3_handle_command(VMXNET3State *s, uint64_t cmd)
@@ -1622,6 +1637,7 @@ static void vmxnet3_handle_command(VMXNET3State *s, uint64_t cmd)
     case VMXNET3_CMD_UPDATE_FEATURE:
         VMW_CBPRN("Set: Update features");
         vmxnet3_update_features(s);
+        vmxnet3_update_gro(s);
         break;
 
     case VMXNET3_CMD_UPDATE_PMCFG:
@@ -2409,6 +2425,7 @@ static int vmxnet3_post_load(void *opaque, int version_id)
         return -1;
     }
     vmxnet3_validate_interrupts(s);
+    vmxnet3_update_gro(s);
 
     return 0;
 }
@@ -2478,6 +2495,7 @@ static Property vmxnet3_properties[] = {
                     VMXNET3_COMPAT_FLAG_OLD_MSI_OFFSETS_BIT, false),
     DEFINE_PROP_BIT("x-disable-pcie", VMXNET3State, compat_flags,
                     VMXNET3_COMPAT_FLAG_DISABLE_PCIE_BIT, false),
+    DEFINE_PROP_BOOL("gro", VMXNET3State, gro, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -105,6 +105,9 @@ struct VMXNET3State {
 
         bool peer_has_vhdr;
 
+        /* Merge received TCP segments, see net/gro.c */
+        bool gro;
+
         /* TX packets to QEMU interface */
         struct NetTxPkt *tx_pkt;
         uint32_t offload_mode;
@@ -3829,7 +3829,7 @@ static Property virtio_properties[] = {
     DEFINE_PROP_END_OF_LIST(),
 };
 
-static int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev)
+int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev)
 {
     VirtioBusState *qbus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(vdev)));
     int i, n, r, err;
@@ -3899,7 +3899,7 @@ int virtio_device_start_ioeventfd(VirtIODevice *vdev)
     return virtio_bus_start_ioeventfd(vbus);
 }
 
-static void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev)
+void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev)
 {
     VirtioBusState *qbus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(vdev)));
     int n, r;
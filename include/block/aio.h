@@ -107,6 +107,24 @@ typedef struct {
     bool (*need_wait)(AioContext *ctx);
 } FDMonOps;
 
+#ifdef CONFIG_LINUX_IO_URING
+typedef struct CqeHandler CqeHandler;
+typedef void CqeHandlerFunc(CqeHandler *cqe_handler);
+
+/* A request submitted with aio_add_sqe() */
+struct CqeHandler {
+    /* Called by aio_poll() in the AioContext's home thread */
+    CqeHandlerFunc *cb;
+
+    /* The completion, filled in before @cb is called */
+    struct io_uring_cqe cqe;
+
+    QSIMPLEQ_ENTRY(CqeHandler) next;
+};
+
+typedef QSIMPLEQ_HEAD(, CqeHandler) CqeHandlerSimpleQ;
+#endif /* CONFIG_LINUX_IO_URING */
+
 /*
  * Each aio_bh_poll() call carves off a slice of the BH list, so that newly
  * scheduled BHs are not processed until the next aio_bh_poll() call.  All
@@ -217,6 +235,19 @@ struct AioContext {
     /* State for file descriptor monitoring using Linux io_uring */
     struct io_uring fdmon_io_uring;
     AioHandlerSList submit_list;
+
+    /* Requests added with aio_add_sqe() that have not completed yet */
+    unsigned cqe_handlers_in_flight;
+
+    /* Completed requests whose handler has not been called yet */
+    CqeHandlerSimpleQ cqe_handler_ready_list;
+
+    /* Is fdmon_io_uring polled by a kernel thread? */
+    bool fdmon_io_uring_sqpoll;
+
+    /* Is fdmon_io_uring on the list of rings with fixed buffers? */
+    bool fdmon_io_uring_fixed_bufs;
+    QLIST_ENTRY(AioContext) fdmon_io_uring_next;
 #endif
 
     /* TimerLists for calling timers - one per clock type.  Has its own
@@ -513,6 +544,68 @@ LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp);
 
 /* Return the LuringState bound to this AioContext */
 LuringState *aio_get_linux_io_uring(AioContext *ctx);
+
+#ifdef CONFIG_LINUX_IO_URING
+/**
+ * aio_has_io_uring:
+ * @ctx: the aio context
+ *
+ * Returns: true if @ctx monitors file descriptors with io_uring, so that
+ * aio_add_sqe() can be used.
+ */
+bool aio_has_io_uring(AioContext *ctx);
+
+/**
+ * aio_add_sqe:
+ * @prep_sqe: function that fills in the sqe
+ * @opaque: passed to @prep_sqe
+ * @cqe_handler: called when the request completes
+ *
+ * Add a request to the io_uring of the current AioContext.  It is submitted
+ * by the next aio_poll() together with other pending requests, so batching
+ * happens naturally.  The user_data field of the sqe is reserved.
+ *
+ * Must be called in the AioContext's home thread and only if
+ * aio_has_io_uring() is true.  @cqe_handler must remain valid until its
+ * callback has been invoked.
+ */
+void aio_add_sqe(void (*prep_sqe)(struct io_uring_sqe *sqe, void *opaque),
+                 void *opaque, CqeHandler *cqe_handler);
+
+/**
+ * aio_register_fixed_buf:
+ * @host: start of the memory
+ * @size: size of the memory in bytes
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Register memory (usually guest RAM) as io_uring fixed buffers in the rings
+ * of all AioContexts.  Calls are reference counted, so several users can
+ * register the same memory.
+ *
+ * Returns: true on success, false on failure
+ */
+bool aio_register_fixed_buf(void *host, size_t size, Error **errp);
+
+/**
+ * aio_unregister_fixed_buf:
+ * @host: start of the memory
+ * @size: size of the memory in bytes
+ *
+ * Undo aio_register_fixed_buf().
+ */
+void aio_unregister_fixed_buf(void *host, size_t size);
+
+/**
+ * aio_fixed_buf_index:
+ * @ctx: the aio context
+ * @buf: start of the buffer
+ * @len: length of the buffer in bytes
+ *
+ * Returns: the fixed buffer index to use for a request on @buf submitted
+ * with aio_add_sqe() in @ctx, or -1 if @buf is not inside a fixed buffer.
+ */
+int aio_fixed_buf_index(AioContext *ctx, const void *buf, size_t len);
+#endif /* CONFIG_LINUX_IO_URING */
 /**
  * aio_timer_new_with_attrs:
  * @ctx: the aio context
@@ -712,6 +805,16 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
  */
 void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch);
 
+/**
+ * aio_context_set_io_uring_params:
+ * @ctx: the aio context
+ * @sqpoll: whether a kernel thread should poll the io_uring submission queue
+ *
+ * Must be called before the event loop starts running.
+ */
+bool aio_context_set_io_uring_params(AioContext *ctx, bool sqpoll,
+                                     Error **errp);
+
 /**
  * aio_context_set_thread_pool_params:
  * @ctx: the aio context
@@ -24,6 +24,9 @@
 #include "qemu/rcu.h"
 #include "exec/ramlist.h"
 
+/* Number of sync periods kept in RAMBlock::dirty_history */
+#define RAMBLOCK_DIRTY_HISTORY 8
+
 struct RAMBlock {
     struct rcu_head rcu;
     struct MemoryRegion *mr;
@@ -89,6 +92,26 @@ struct RAMBlock {
      * could not have been valid on the source.
      */
     ram_addr_t postcopy_length;
+
+    /*
+     * Pages found dirty in the current bitmap sync period, and a ring
+     * of the counts for the last RAMBLOCK_DIRTY_HISTORY periods.  The
+     * ring position and period lengths live in the migration RAMState.
+     * Only used on the source side, by the migration thread.
+     */
+    uint64_t dirty_pages_period;
+    uint64_t dirty_history[RAMBLOCK_DIRTY_HISTORY];
+
+    /*
+     * Used by hot-page-deferral on the source side, protected by the
+     * global ram_state.bitmap_mutex.  For each chunk of 1 << heat_shift
+     * pages, @heat counts how many bitmap syncs in a row found it dirty
+     * again after it was sent, and @heat_sent tells whether any of its
+     * pages was sent since the last sync.
+     */
+    uint8_t *heat;
+    unsigned long *heat_sent;
+    uint8_t heat_shift;
 };
 #endif
 #endif
@@ -0,0 +1,39 @@
+/*
+ * Persistent cache of translated code for user-mode emulation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef EXEC_TB_CACHE_H
+#define EXEC_TB_CACHE_H
+
+/**
+ * tb_cache_enable:
+ * @dir: directory holding the cache files
+ *
+ * Enable the persistent TB cache.  Must be called before tb_cache_load().
+ */
+void tb_cache_enable(const char *dir);
+
+/**
+ * tb_cache_load:
+ * @exec_path: path of the guest binary
+ * @cpu_model: the guest CPU model, including any properties
+ *
+ * Copy the code saved by an earlier run of @exec_path into the code
+ * buffer.  The TBs are only used once a lookup for their guest code
+ * misses and the guest code is found unchanged.  If there is no usable
+ * cache file, tb_cache_save() will write one instead.
+ *
+ * Must be called after tcg_prologue_init(), and before any translation.
+ */
+void tb_cache_load(const char *exec_path, const char *cpu_model);
+
+/**
+ * tb_cache_save:
+ *
+ * Write the cache file, if tb_cache_load() did not find a usable one.
+ */
+void tb_cache_save(void);
+
+#endif
@@ -45,9 +45,14 @@ QEMU_BUILD_BUG_ON(sizeof(CPUTLBEntry) != (1 << CPU_TLB_ENTRY_BITS));
 /*
  * Data elements that are per MMU mode, accessed by the fast path.
  * The structure is aligned to aid loading the pair with one insn.
+ *
+ * With a set-associative tlb, the table holds the ways one after the
+ * other: way W of the set at index I is table[I + W * n_entries], i.e.
+ * (mask + (1 << CPU_TLB_ENTRY_BITS)) * W bytes after way 0.  Way 0 holds
+ * the most recently filled or used entry of each set.
  */
 typedef struct CPUTLBDescFast {
-    /* Contains (n_entries - 1) << CPU_TLB_ENTRY_BITS */
+    /* Contains (n_entries - 1) << CPU_TLB_ENTRY_BITS, for one way */
     uintptr_t mask;
     /* The array of tlb entries itself. */
     CPUTLBEntry *table;
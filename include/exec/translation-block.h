@@ -78,6 +78,7 @@ struct TranslationBlock {
 #define CF_NOIRQ         0x00010000 /* Generate an uninterruptible TB */
 #define CF_PCREL         0x00020000 /* Opcodes in TB are PC-relative */
 #define CF_BP_PAGE       0x00040000 /* Breakpoint present in code page */
+#define CF_TIER2         0x00080000 /* Hot TB, retranslated as a superblock */
 #define CF_CLUSTER_MASK  0xff000000 /* Top 8 bits are cluster ID */
 #define CF_CLUSTER_SHIFT 24
 
@@ -89,6 +90,12 @@ struct TranslationBlock {
     uint16_t size;
     uint16_t icount;
 
+    /*
+     * Executions left before the TB is retranslated with CF_TIER2,
+     * decremented by the generated code.  See tb_tier_up().
+     */
+    int32_t tier_count;
+
     struct tb_tc tc;
 
     /*
@@ -71,8 +71,10 @@ typedef enum DisasJumpType {
  * @is_jmp: What instruction to disassemble next.
  * @num_insns: Number of translated instructions (including current).
  * @max_insns: Maximum number of instructions to be translated in this TB.
+ * @num_jumps: Number of direct jumps followed by translator_follow_jump().
  * @singlestep_enabled: "Hardware" single stepping enabled.
  * @plugin_enabled: TCG plugin enabled in this TB.
+ * @speculative: Translated ahead of demand by a translator thread.
  * @fake_insn: True if translator_fake_ldb used.
  * @insn_start: The last op emitted by the insn_start hook,
  *              which is expected to be INDEX_op_insn_start.
@@ -86,8 +88,10 @@ struct DisasContextBase {
     DisasJumpType is_jmp;
     int num_insns;
     int max_insns;
+    int num_jumps;
     bool singlestep_enabled;
     bool plugin_enabled;
+    bool speculative;
     bool fake_insn;
     struct TCGOp *insn_start;
     void *host_addr[2];
@@ -174,6 +178,29 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
  */
 bool translator_use_goto_tb(DisasContextBase *db, vaddr dest);
 
+/**
+ * translator_follow_jump
+ * @db: Disassembly context
+ * @dest: target pc of an unconditional direct jump
+ *
+ * Return true if translation of a CF_TIER2 superblock may continue at
+ * @dest instead of ending the TB with the jump.  If so, the caller must
+ * emit any side effects of the jump other than the change of pc, and
+ * then set db->pc_next to @dest.
+ */
+bool translator_follow_jump(DisasContextBase *db, vaddr dest);
+
+/**
+ * translator_require_vcpu
+ * @db: Disassembly context
+ *
+ * Must be called before the translator uses state of the vCPU that only
+ * the vCPU thread may access, such as its softmmu TLB.  If the TB is
+ * being translated speculatively by a translator thread, abandon it;
+ * the vCPU will translate it on demand instead.
+ */
+void translator_require_vcpu(DisasContextBase *db);
+
 /**
  * translator_io_start
  * @db: Disassembly context
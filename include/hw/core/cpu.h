@@ -197,8 +197,11 @@ struct CPUClass {
  */
 #define NB_MMU_MODES 16
 
-/* Use a fully associative victim tlb of 8 entries. */
-#define CPU_VTLB_SIZE 8
+/* Use a fully associative victim tlb of 32 entries. */
+#define CPU_VTLB_SIZE 32
+
+/* Maximum number of ways of the set-associative tlb */
+#define CPU_TLB_MAX_WAYS 4
 
 /*
  * The full TLB entry, which is not accessed by generated TCG code,
@@ -280,15 +283,39 @@ typedef struct CPUTLBDesc {
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
     size_t window_max_entries;
+    /* Number of entries in use, in all the ways of the tlb */
     size_t n_used_entries;
     /* The next index to use in the tlb victim table.  */
     size_t vindex;
     /* The tlb victim table, in two parts.  */
     CPUTLBEntry vtable[CPU_VTLB_SIZE];
     CPUTLBEntryFull vfulltlb[CPU_VTLB_SIZE];
+    /* Parallel to CPUTLBDescFast.table, including all the ways. */
     CPUTLBEntryFull *fulltlb;
 } CPUTLBDesc;
 
+/* A range of pages to flush from the tlb of some MMU modes */
+typedef struct CPUTLBFlushRange {
+    vaddr addr;
+    vaddr len;
+    uint16_t idxmap;
+    uint16_t bits;
+} CPUTLBFlushRange;
+
+/* Ranges that a batch of pending tlb flushes can hold */
+#define CPU_TLB_FLUSH_BATCH_SIZE 16
+
+/*
+ * Flushes requested by the *_all_cpus_synced functions, merged while
+ * the vCPU has not processed them yet.
+ */
+typedef struct CPUTLBFlushBatch {
+    bool queued;
+    uint16_t full_idxmap;
+    unsigned n_ranges;
+    CPUTLBFlushRange ranges[CPU_TLB_FLUSH_BATCH_SIZE];
+} CPUTLBFlushBatch;
+
 /*
  * Data elements that are shared between all MMU modes.
  */
@@ -301,6 +328,12 @@ typedef struct CPUTLBCommon {
      * Protected by tlb_c.lock.
      */
     uint16_t dirty;
+    /*
+     * Pending flushes from other vCPUs, and from this vCPU as safe work.
+     * Protected by tlb_c.lock.
+     */
+    CPUTLBFlushBatch batch;
+    CPUTLBFlushBatch safe_batch;
     /*
      * Statistics.  These are not lock protected, but are read and
      * written atomically.  This allows the monitor to print a snapshot
@@ -309,6 +342,10 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    size_t batch_flush_count;
+    size_t way_hit_count;
+    size_t victim_hit_count;
+    size_t fill_count;
 } CPUTLBCommon;
 
 /*
@@ -20,6 +20,7 @@
 #include "net/announce.h"
 #include "qemu/option_int.h"
 #include "qom/object.h"
+#include "qapi/qapi-types-virtio.h"
 
 #include "ebpf/ebpf_rss.h"
 
@@ -56,6 +57,7 @@ typedef struct virtio_net_conf
     char *duplex_str;
     uint8_t duplex;
     char *primary_id_str;
+    IOThreadVirtQueueMappingList *iothread_vq_mapping_list;
 } virtio_net_conf;
 
 /* Coalesced packets type & status */
@@ -161,6 +163,9 @@ typedef struct VirtIONetQueue {
         VirtQueueElement *elem;
     } async_tx;
     struct VirtIONet *n;
+    /* The IOThread that processes the queue pair, or NULL for the main loop */
+    AioContext *ctx;
+    struct NetRxPkt *rx_pkt;
 } VirtIONetQueue;
 
 struct VirtIONet {
@@ -223,10 +228,12 @@ struct VirtIONet {
     bool primary_opts_from_json;
     NotifierWithReturn migration_state;
     VirtioNetRssData rss_data;
-    struct NetRxPkt *rx_pkt;
     struct EBPFRSSContext ebpf_rss;
     uint32_t nr_ebpf_rss_fds;
     char **ebpf_rss_fds;
+    /* From iothread-vq-mapping, indexed by queue pair */
+    AioContext **vq_aio_context;
+    bool iothread_datapath;
 };
 
 size_t virtio_net_handle_ctrl_iov(VirtIODevice *vdev,
@@ -393,6 +393,12 @@ EventNotifier *virtio_queue_get_guest_notifier(VirtQueue *vq);
 void virtio_queue_set_guest_notifier_fd_handler(VirtQueue *vq, bool assign,
                                                 bool with_irqfd);
 int virtio_device_start_ioeventfd(VirtIODevice *vdev);
+/*
+ * The default VirtioDeviceClass start_ioeventfd and stop_ioeventfd, which
+ * process all virtqueues in the main loop.
+ */
+int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev);
+void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev);
 int virtio_device_grab_ioeventfd(VirtIODevice *vdev);
 void virtio_device_release_ioeventfd(VirtIODevice *vdev);
 bool virtio_device_ioeventfd_enabled(VirtIODevice *vdev);
@@ -0,0 +1,78 @@
+/*
+ * Generic receive offload for emulated NICs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef QEMU_NET_GRO_H
+#define QEMU_NET_GRO_H
+
+#include "net/queue.h"
+
+typedef struct NetGro NetGro;
+
+/**
+ * net_gro_new:
+ * @deliver: function passing a frame to the receiver
+ * @opaque: argument of @deliver
+ *
+ * Create a GRO context, which merges consecutive TCP segments of a flow
+ * that are received in the same main loop iteration into larger frames.
+ * net_gro_set_params() must be called before the first frame.
+ */
+NetGro *net_gro_new(NetQueueDeliverFunc *deliver, void *opaque);
+
+/**
+ * net_gro_free:
+ * @gro: the GRO context
+ *
+ * Free @gro, dropping the frames that were not delivered yet.
+ */
+void net_gro_free(NetGro *gro);
+
+/**
+ * net_gro_set_params:
+ * @gro: the GRO context
+ * @vnet_hdr_len: length of the virtio-net header in front of each frame
+ * @max_frame: largest frame that the receiver accepts, in bytes
+ *
+ * Set the frame format of the receiver.  If it changes, the frames that
+ * were kept until now are flushed first.
+ */
+void net_gro_set_params(NetGro *gro, size_t vnet_hdr_len, size_t max_frame);
+
+/**
+ * net_gro_receive:
+ * @gro: the GRO context
+ * @sender: the sending client
+ * @iov: the frame, including the virtio-net header if there is one
+ * @iovcnt: number of elements of @iov
+ *
+ * Keep the frame to merge it with the following segments of its flow, or
+ * deliver it right away.
+ *
+ * Returns: as for #NetQueueDeliverFunc
+ */
+ssize_t net_gro_receive(NetGro *gro, NetClientState *sender,
+                        const struct iovec *iov, int iovcnt);
+
+/**
+ * net_gro_flush:
+ * @gro: the GRO context
+ *
+ * Deliver the frames kept by @gro.
+ *
+ * Returns: false if the receiver could not take all of them; the
+ * remaining frames are delivered by the next flush.
+ */
+bool net_gro_flush(NetGro *gro);
+
+/**
+ * net_gro_purge:
+ * @gro: the GRO context
+ *
+ * Drop the frames kept by @gro.
+ */
+void net_gro_purge(NetGro *gro);
+
+#endif
@@ -4,6 +4,7 @@
 #include "qemu/queue.h"
 #include "qapi/qapi-types-net.h"
 #include "net/queue.h"
+#include "net/gro.h"
 #include "hw/qdev-properties-system.h"
 
 #define MAC_FMT "%02X:%02X:%02X:%02X:%02X:%02X"
@@ -65,7 +66,9 @@ typedef int (SetVnetBE)(NetClientState *, bool);
 typedef struct SocketReadState SocketReadState;
 typedef void (SocketReadStateFinalize)(SocketReadState *rs);
 typedef void (NetAnnounce)(NetClientState *);
+typedef void (NetSendAnnounce)(NetClientState *, const uint8_t *, int);
 typedef bool (SetSteeringEBPF)(NetClientState *, int);
+typedef bool (NetSetAioContext)(NetClientState *, AioContext *);
 typedef bool (NetCheckPeerType)(NetClientState *, ObjectClass *, Error **);
 
 typedef struct NetClientInfo {
@@ -90,8 +93,20 @@ typedef struct NetClientInfo {
     SetVnetLE *set_vnet_le;
     SetVnetBE *set_vnet_be;
     NetAnnounce *announce;
+    /*
+     * Send the self-announcement frame through the client, for NICs whose
+     * queues are not processed in the main loop.  If NULL, the frame is
+     * sent with qemu_send_packet_raw().
+     */
+    NetSendAnnounce *send_announce;
     SetSteeringEBPF *set_steering_ebpf;
     NetCheckPeerType *check_peer_type;
+    /*
+     * Move the I/O handlers of the client to @ctx (NULL for the main loop),
+     * so that the packets it sends are delivered in that AioContext without
+     * the BQL.  Returns false if the client does not support it.
+     */
+    NetSetAioContext *set_aio_context;
 } NetClientInfo;
 
 struct NetClientState {
@@ -100,6 +115,7 @@ struct NetClientState {
     QTAILQ_ENTRY(NetClientState) next;
     NetClientState *peer;
     NetQueue *incoming_queue;
+    NetGro *gro;
     char *model;
     char *name;
     char info_str[256];
@@ -192,6 +208,7 @@ void qemu_set_offload(NetClientState *nc, int csum, int tso4, int tso6,
                       int ecn, int ufo, int uso4, int uso6);
 int qemu_get_vnet_hdr_len(NetClientState *nc);
 void qemu_set_vnet_hdr_len(NetClientState *nc, int len);
+void qemu_set_gro(NetClientState *nc, size_t vnet_hdr_len, size_t max_frame);
 int qemu_set_vnet_le(NetClientState *nc, bool is_le);
 int qemu_set_vnet_be(NetClientState *nc, bool is_be);
 void qemu_macaddr_default_if_unset(MACAddr *macaddr);
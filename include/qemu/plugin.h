@@ -72,6 +72,7 @@ enum plugin_dyn_cb_type {
     PLUGIN_CB_MEM_REGULAR,
     PLUGIN_CB_INLINE_ADD_U64,
     PLUGIN_CB_INLINE_STORE_U64,
+    PLUGIN_CB_RING,
 };
 
 struct qemu_plugin_regular_cb {
@@ -96,6 +97,14 @@ struct qemu_plugin_conditional_cb {
     uint64_t imm;
 };
 
+struct qemu_plugin_ring_cb {
+    struct qemu_plugin_ring *ring;
+    TCGHelperInfo *info;
+    uint64_t pc;
+    uint64_t data;
+    enum qemu_plugin_mem_rw rw;
+};
+
 /*
  * A dynamic callback has an insertion point that is determined at run-time.
  * Usually the insertion point is somewhere in the code cache; think for
@@ -107,6 +116,7 @@ struct qemu_plugin_dyn_cb {
         struct qemu_plugin_regular_cb regular;
         struct qemu_plugin_conditional_cb cond;
         struct qemu_plugin_inline_cb inline_insn;
+        struct qemu_plugin_ring_cb ring;
     };
 };
 
@@ -128,6 +138,23 @@ struct qemu_plugin_scoreboard {
     QLIST_ENTRY(qemu_plugin_scoreboard) entry;
 };
 
+/*
+ * An event ring is a scoreboard whose entries hold the number of pending
+ * events followed by the events themselves.  The events are stored by
+ * inline TCG code, and handed to the callback once n_events are pending.
+ */
+struct qemu_plugin_ring {
+    struct qemu_plugin_scoreboard *score;
+    size_t n_events;
+    qemu_plugin_vcpu_ring_cb_t cb;
+    void *userp;
+};
+
+struct qemu_plugin_ring_entry {
+    uint64_t n;
+    struct qemu_plugin_ring_event events[];
+};
+
 /* Internal context for this TranslationBlock */
 struct qemu_plugin_tb {
     GPtrArray *insns;
@@ -169,6 +196,8 @@ void qemu_plugin_vcpu_syscall_ret(CPUState *cpu, int64_t num, int64_t ret);
 void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                              MemOpIdx oi, enum qemu_plugin_mem_rw rw);
 
+void plugin_ring_flush(unsigned int cpu_index, struct qemu_plugin_ring *ring);
+
 void qemu_plugin_flush_cb(void);
 
 void qemu_plugin_atexit_cb(void);
@@ -57,11 +57,16 @@ typedef uint64_t qemu_plugin_id_t;
  * - Remove qemu_plugin_register_vcpu_{tb, insn, mem}_exec_inline.
  *   Those functions are replaced by *_per_vcpu variants, which guarantee
  *   thread-safety for operations.
+ *
+ * version 4:
+ * - added qemu_plugin_ring_{new,flush,free} and
+ *   qemu_plugin_register_vcpu_{insn_exec,mem}_ring, which record events
+ *   inline and hand them over to the plugin in batches.
  */
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 3
+#define QEMU_PLUGIN_VERSION 4
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -228,6 +233,21 @@ struct qemu_plugin_tb;
 struct qemu_plugin_insn;
 /** struct qemu_plugin_scoreboard - Opaque handle for a scoreboard */
 struct qemu_plugin_scoreboard;
+/** struct qemu_plugin_ring - Opaque handle for an event ring */
+struct qemu_plugin_ring;
+
+/**
+ * struct qemu_plugin_ring_event - an event recorded in an event ring
+ * @pc: virtual address of the instruction
+ * @vaddr: virtual address of the memory access, 0 for instruction events
+ * @info: the qemu_plugin_meminfo_t of a memory access, or the value given
+ *        when registering an instruction event
+ */
+struct qemu_plugin_ring_event {
+    uint64_t pc;
+    uint64_t vaddr;
+    uint64_t info;
+};
 
 /**
  * typedef qemu_plugin_u64 - uint64_t member of an entry in a scoreboard
@@ -436,6 +456,74 @@ void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
     qemu_plugin_u64 entry,
     uint64_t imm);
 
+/**
+ * typedef qemu_plugin_vcpu_ring_cb_t - event ring callback
+ * @vcpu_index: the vCPU that recorded the events
+ * @events: the events, oldest first
+ * @n_events: number of events
+ * @userdata: the data given to qemu_plugin_ring_new()
+ *
+ * The callback runs on the thread of the vCPU, and must not access the
+ * registers of the vCPU.
+ */
+typedef void (*qemu_plugin_vcpu_ring_cb_t)(
+    unsigned int vcpu_index,
+    const struct qemu_plugin_ring_event *events,
+    size_t n_events,
+    void *userdata);
+
+/**
+ * qemu_plugin_ring_new() - alloc a new event ring
+ * @n_events: number of events that each vCPU can hold
+ * @cb: callback to call when the ring of a vCPU is full
+ * @userdata: any plugin data to pass to @cb
+ *
+ * Events are recorded by inline code in a per-vCPU ring, and @cb is only
+ * called once @n_events are pending, instead of once per event. Returns
+ * a pointer to a new event ring. It must be freed using
+ * qemu_plugin_ring_free.
+ */
+QEMU_PLUGIN_API
+struct qemu_plugin_ring *qemu_plugin_ring_new(size_t n_events,
+                                              qemu_plugin_vcpu_ring_cb_t cb,
+                                              void *userdata);
+
+/**
+ * qemu_plugin_ring_flush() - hand the pending events of a vCPU to the plugin
+ * @ring: the event ring
+ * @vcpu_index: the vCPU whose events are flushed
+ *
+ * Call the callback of @ring for the pending events of @vcpu_index, if
+ * any. This must be called from the thread of the vCPU, for example from
+ * a vCPU exit callback, or while the vCPU is stopped.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_ring_flush(struct qemu_plugin_ring *ring,
+                            unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_ring_free() - flush and free an event ring
+ * @ring: event ring to free
+ *
+ * The pending events of all vCPUs are flushed first. The vCPUs must not
+ * be running, so this is usually called from the atexit callback.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_ring_free(struct qemu_plugin_ring *ring);
+
+/**
+ * qemu_plugin_register_vcpu_insn_exec_ring() - record insn execution
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @ring: the event ring
+ * @info: value to store in the info field of the events
+ *
+ * Record an event in @ring every time the instruction executes.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_insn_exec_ring(struct qemu_plugin_insn *insn,
+                                              struct qemu_plugin_ring *ring,
+                                              uint64_t info);
+
 /**
  * qemu_plugin_tb_n_insns() - query helper for number of insns in TB
  * @tb: opaque handle to TB passed to callback
@@ -661,6 +749,20 @@ void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
     qemu_plugin_u64 entry,
     uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_mem_ring() - record memory accesses
+ * @insn: handle for instruction to instrument
+ * @rw: apply to reads, writes or both
+ * @ring: the event ring
+ *
+ * Record an event in @ring for every memory access generated by the
+ * instruction.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_mem_ring(struct qemu_plugin_insn *insn,
+                                        enum qemu_plugin_mem_rw rw,
+                                        struct qemu_plugin_ring *ring);
+
 /**
  * qemu_plugin_request_time_control() - request the ability to control time
  *
@@ -0,0 +1,59 @@
+/*
+ * Toeplitz hash, as used for receive side scaling
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef QEMU_TOEPLITZ_H
+#define QEMU_TOEPLITZ_H
+
+/* Hash inputs may be up to TOEPLITZ_KEY_MAX_LEN - 4 bytes long */
+#define TOEPLITZ_KEY_MAX_LEN 40
+
+typedef struct ToeplitzKey {
+    /* Key bits in reverse order, 64 at a time, for carry-less multiply */
+    uint64_t rev[TOEPLITZ_KEY_MAX_LEN / 8 + 1];
+    /* Without carry-less multiply: hash of each byte value at each offset */
+    uint32_t (*table)[256];
+    size_t max_input;
+} ToeplitzKey;
+
+/**
+ * toeplitz_key_init:
+ * @k: the prepared key
+ * @key: the secret key
+ * @len: length of @key, between 4 and TOEPLITZ_KEY_MAX_LEN bytes
+ *
+ * Prepare @key for toeplitz_hash().  @k may be initialized again with a
+ * different key; toeplitz_key_destroy() must be called when it is no
+ * longer needed.
+ */
+void toeplitz_key_init(ToeplitzKey *k, const uint8_t *key, size_t len);
+
+/**
+ * toeplitz_key_destroy:
+ * @k: a prepared key
+ *
+ * Free the resources allocated by toeplitz_key_init().
+ */
+void toeplitz_key_destroy(ToeplitzKey *k);
+
+/**
+ * toeplitz_hash:
+ * @k: a prepared key
+ * @input: the data to hash
+ * @len: length of @input, at most the key length minus 4
+ *
+ * Return the Toeplitz hash of @input, as defined by the Microsoft RSS
+ * specification.  The result is the same as with net_toeplitz_add(),
+ * but all bits of each 64-bit word of @input are processed together.
+ */
+uint32_t toeplitz_hash(const ToeplitzKey *k, const uint8_t *input, size_t len);
+
+/*
+ * For the tests and the benchmark: prepare the following keys for the
+ * next slower implementation, if there is one.
+ */
+bool test_toeplitz_next_accel(void);
+
+#endif
@@ -27,6 +27,7 @@ struct IOThread {
     QemuThread thread;
     AioContext *ctx;
     bool run_gcontext;          /* whether we should run gcontext */
+    bool attach_gcontext;       /* has the gcontext been requested? */
     GMainContext *worker_context;
     GMainLoop *main_loop;
     QemuSemaphore init_done_sem; /* is thread init done? */
@@ -38,6 +39,9 @@ struct IOThread {
     int64_t poll_max_ns;
     int64_t poll_grow;
     int64_t poll_shrink;
+
+    /* AioContext io_uring parameters */
+    bool io_uring_sqpoll;
 };
 typedef struct IOThread IOThread;
 
@@ -30,11 +30,12 @@
  * @tb_size: translation buffer size
  * @splitwx: use separate rw and rx mappings
  * @max_cpus: number of vcpus in system mode
+ * @evict: evict old regions of the JIT buffer instead of flushing it all
  *
  * Allocate and initialize TCG resources, especially the JIT buffer.
  * In user-only mode, @max_cpus is unused.
  */
-void tcg_init(size_t tb_size, int splitwx, unsigned max_cpus);
+void tcg_init(size_t tb_size, int splitwx, unsigned max_cpus, bool evict);
 
 /**
  * tcg_register_thread: Register this thread with the TCG runtime
@@ -486,6 +486,7 @@ struct TCGContext {
     int page_mask;
     uint8_t page_bits;
     uint8_t tlb_dyn_max_bits;
+    uint8_t tlb_ways;
     uint8_t insn_start_words;
     TCGBar guest_mo;
 
@@ -496,6 +497,10 @@ struct TCGContext {
     TCGTemp *frame_temp;
 
     TranslationBlock *gen_tb;     /* tb for which code is being generated */
+    bool gen_host_ptr;            /* code refers to host data outside the
+                                     code buffer */
+    bool gen_speculative;         /* translator thread without a vCPU */
+    const TCGOp *alloc_op;        /* op being register allocated */
     tcg_insn_unit *code_buf;      /* pointer for start of tb */
     tcg_insn_unit *code_ptr;      /* pointer for running end of tb */
 
@@ -519,6 +524,11 @@ struct TCGContext {
     /* Track which vCPU triggers events */
     CPUState *cpu;                      /* *_trans */
 
+    /* Register allocator statistics, read by "info jit" */
+    size_t nb_temp_loads;
+    size_t nb_temp_stores;
+    size_t nb_spills;
+
     /* These structures are private to tcg-target.c.inc.  */
 #ifdef TCG_TARGET_NEED_LDST_LABELS
     QSIMPLEQ_HEAD(, TCGLabelQemuLdst) ldst_labels;
@@ -579,6 +589,9 @@ extern bool tcg_use_softmmu;
 #define tcg_use_softmmu  true
 #endif
 
+/* Experimental spill heuristic, see tcg_reg_alloc */
+extern bool tcg_spill_lookahead;
+
 extern __thread TCGContext *tcg_ctx;
 extern const void *tcg_code_gen_epilogue;
 extern uintptr_t tcg_splitwx_diff;
@@ -759,9 +772,14 @@ void tcg_pool_reset(TCGContext *s);
 TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
+bool tcg_region_evict_begin(size_t *pidx, unsigned *pepoch);
+void tcg_region_evict_end(size_t i, unsigned epoch);
+void tcg_region_foreach_tb(size_t i, GTraverseFunc func, gpointer user_data);
+bool tcg_region_contains(size_t i, const void *p);
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
+void tcg_regalloc_counts(size_t *ploads, size_t *pstores, size_t *pspills);
 
 void tcg_tb_insert(TranslationBlock *tb);
 void tcg_tb_remove(TranslationBlock *tb);
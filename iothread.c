@@ -138,17 +138,31 @@ static void iothread_instance_finalize(Object *obj)
     qemu_sem_destroy(&iothread->init_done_sem);
 }
 
-static void iothread_init_gcontext(IOThread *iothread, const char *thread_name)
+static void iothread_init_gcontext(IOThread *iothread)
 {
+    iothread->worker_context = g_main_context_new();
+    iothread->main_loop = g_main_loop_new(iothread->worker_context, TRUE);
+}
+
+/*
+ * Runs in iothread_run() thread.
+ *
+ * The AioContext is only attached to the GMainContext when someone asks for
+ * it, because that disables io_uring in the AioContext.
+ */
+static void iothread_attach_gcontext_bh(void *opaque)
+{
+    IOThread *iothread = opaque;
     GSource *source;
-    g_autofree char *name = g_strdup_printf("%s aio-context", thread_name);
+    g_autofree char *name = g_strdup_printf("IO %s aio-context",
+                        object_get_canonical_path_component(OBJECT(iothread)));
 
-    iothread->worker_context = g_main_context_new();
-    source = aio_get_g_source(iothread_get_aio_context(iothread));
+    source = aio_get_g_source(iothread->ctx);
     g_source_set_name(source, name);
     g_source_attach(source, iothread->worker_context);
     g_source_unref(source);
-    iothread->main_loop = g_main_loop_new(iothread->worker_context, TRUE);
+
+    qatomic_set(&iothread->run_gcontext, 1);
 }
 
 static void iothread_set_aio_context_params(EventLoopBase *base, Error **errp)
@@ -190,6 +204,13 @@ static void iothread_init(EventLoopBase *base, Error **errp)
         return;
     }
 
+    if (!aio_context_set_io_uring_params(iothread->ctx,
+                                         iothread->io_uring_sqpoll, errp)) {
+        aio_context_unref(iothread->ctx);
+        iothread->ctx = NULL;
+        return;
+    }
+
     thread_name = g_strdup_printf("IO %s",
                         object_get_canonical_path_component(OBJECT(base)));
 
@@ -197,7 +218,7 @@ static void iothread_init(EventLoopBase *base, Error **errp)
      * Init one GMainContext for the iothread unconditionally, even if
      * it's not used
      */
-    iothread_init_gcontext(iothread, thread_name);
+    iothread_init_gcontext(iothread);
 
     iothread_set_aio_context_params(base, &local_error);
     if (local_error) {
@@ -292,6 +313,26 @@ static void iothread_set_poll_param(Object *obj, Visitor *v,
     }
 }
 
+static bool iothread_get_io_uring_sqpoll(Object *obj, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+
+    return iothread->io_uring_sqpoll;
+}
+
+static void iothread_set_io_uring_sqpoll(Object *obj, bool value, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+
+    if (iothread->ctx) {
+        error_setg(errp, "io-uring-sqpoll cannot be changed after the "
+                   "iothread has been created");
+        return;
+    }
+
+    iothread->io_uring_sqpoll = value;
+}
+
 static void iothread_class_init(ObjectClass *klass, void *class_data)
 {
     EventLoopBaseClass *bc = EVENT_LOOP_BASE_CLASS(klass);
@@ -311,6 +352,9 @@ static void iothread_class_init(ObjectClass *klass, void *class_data)
                               iothread_get_poll_param,
                               iothread_set_poll_param,
                               NULL, &poll_shrink_info);
+    object_class_property_add_bool(klass, "io-uring-sqpoll",
+                                   iothread_get_io_uring_sqpoll,
+                                   iothread_set_io_uring_sqpoll);
 }
 
 static const TypeInfo iothread_info = {
@@ -374,8 +418,10 @@ IOThreadInfoList *qmp_query_iothreads(Error **errp)
 
 GMainContext *iothread_get_g_main_context(IOThread *iothread)
 {
-    qatomic_set(&iothread->run_gcontext, 1);
-    aio_notify(iothread->ctx);
+    if (!qatomic_xchg(&iothread->attach_gcontext, true)) {
+        aio_bh_schedule_oneshot(iothread->ctx, iothread_attach_gcontext_bh,
+                                iothread);
+    }
     return iothread->worker_context;
 }
 
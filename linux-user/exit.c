@@ -18,6 +18,7 @@
  */
 #include "qemu/osdep.h"
 #include "tcg/perf.h"
+#include "exec/tb-cache.h"
 #include "gdbstub/syscalls.h"
 #include "qemu.h"
 #include "user-internals.h"
@@ -34,5 +35,6 @@ void preexit_cleanup(CPUArchState *env, int code)
 #endif
         gdb_exit(code);
         qemu_plugin_user_exit();
+        tb_cache_save();
         perf_exit();
 }
@@ -9,6 +9,7 @@
 #include "exec/ramblock.h"
 #include "qemu/cutils.h"
 #include "qemu/error-report.h"
+#include "qemu/thread.h"
 #include "qapi/error.h"
 #include "channel.h"
 #include "file.h"
@@ -25,6 +26,45 @@ static struct FileOutgoingArgs {
     char *fname;
 } outgoing_args;
 
+static struct FileIncomingArgs {
+    char *fname;
+} incoming_args;
+
+/* Maximum number of reads queued to the load threads */
+#define FILE_LOAD_QUEUE_LEN 64
+
+typedef struct {
+    void *host;
+    size_t size;
+    off_t offset;
+} FileLoadJob;
+
+typedef struct {
+    QemuThread thread;
+    /* channel used by this thread, may be shared with the main channel */
+    QIOChannel *ioc;
+} FileLoadThread;
+
+static struct FileLoadState {
+    unsigned int nr_threads;
+    FileLoadThread *threads;
+    /* protects everything below */
+    QemuMutex lock;
+    /* signaled when a job is queued, or when the threads should quit */
+    QemuCond work_cond;
+    /* signaled when a job is dequeued or completed */
+    QemuCond done_cond;
+    /* ring of queued jobs */
+    FileLoadJob queue[FILE_LOAD_QUEUE_LEN];
+    unsigned int head;
+    unsigned int count;
+    /* number of jobs being processed */
+    unsigned int busy;
+    /* first error seen, the following jobs are dropped */
+    Error *err;
+    bool quit;
+} *file_load_state;
+
 /* Remove the offset option from @filespec and return it in @offsetp. */
 
 int file_parse_offset(char *filespec, uint64_t *offsetp, Error **errp)
@@ -50,6 +90,12 @@ void file_cleanup_outgoing_migration(void)
     outgoing_args.fname = NULL;
 }
 
+void file_cleanup_incoming_migration(void)
+{
+    g_free(incoming_args.fname);
+    incoming_args.fname = NULL;
+}
+
 static void file_enable_direct_io(int *flags)
 {
 #ifdef O_DIRECT
@@ -188,6 +234,9 @@ void file_start_incoming_migration(FileMigrationArgs *file_args, Error **errp)
         return;
     }
 
+    g_free(incoming_args.fname);
+    incoming_args.fname = g_strdup(filename);
+
     if (offset &&
         qio_channel_io_seek(QIO_CHANNEL(fioc), offset, SEEK_SET, errp) < 0) {
         object_unref(OBJECT(fioc));
@@ -267,3 +316,217 @@ int multifd_file_recv_data(MultiFDRecvParams *p, Error **errp)
 
     return 0;
 }
+
+/*
+ * Mapped-ram load threads
+ *
+ * With mapped-ram every page has a fixed offset in the file, so when
+ * multifd is not used on the destination the pages can still be read
+ * in parallel: the migration thread parses the stream and queues the
+ * reads of the pages, the load threads perform them.
+ */
+
+static void file_load_free(struct FileLoadState *fls)
+{
+    error_free(fls->err);
+    qemu_cond_destroy(&fls->done_cond);
+    qemu_cond_destroy(&fls->work_cond);
+    qemu_mutex_destroy(&fls->lock);
+    g_free(fls->threads);
+    g_free(fls);
+}
+
+static void *file_load_thread(void *opaque)
+{
+    FileLoadThread *t = opaque;
+    struct FileLoadState *fls = file_load_state;
+
+    qemu_mutex_lock(&fls->lock);
+    while (true) {
+        Error *local_err = NULL;
+        FileLoadJob job;
+        size_t ret;
+
+        while (!fls->count && !fls->quit) {
+            qemu_cond_wait(&fls->work_cond, &fls->lock);
+        }
+        if (!fls->count) {
+            break;
+        }
+
+        job = fls->queue[fls->head];
+        fls->head = (fls->head + 1) % FILE_LOAD_QUEUE_LEN;
+        fls->count--;
+        fls->busy++;
+        qemu_cond_broadcast(&fls->done_cond);
+
+        if (!fls->err) {
+            qemu_mutex_unlock(&fls->lock);
+            ret = qio_channel_pread(t->ioc, job.host, job.size, job.offset,
+                                    &local_err);
+            if (ret != job.size && !local_err) {
+                error_setg(&local_err, "short read at file offset 0x%" PRIx64
+                           ", read 0x%zx, expected 0x%zx",
+                           (uint64_t)job.offset, ret, job.size);
+            }
+            qemu_mutex_lock(&fls->lock);
+            if (local_err) {
+                if (fls->err) {
+                    error_free(local_err);
+                } else {
+                    fls->err = local_err;
+                }
+            }
+        }
+
+        trace_file_load_job_done(job.size, (uint64_t)job.offset);
+        fls->busy--;
+        qemu_cond_broadcast(&fls->done_cond);
+    }
+    qemu_mutex_unlock(&fls->lock);
+
+    return NULL;
+}
+
+bool file_load_setup(QIOChannel *ioc, unsigned int nr_threads, Error **errp)
+{
+    struct FileLoadState *fls;
+    int flags = O_RDONLY;
+    unsigned int i;
+
+    assert(!file_load_state && nr_threads);
+
+    if (migrate_direct_io()) {
+        /*
+         * The load threads would share the main channel, which was not
+         * opened with O_DIRECT, so the reads would silently go through
+         * the page cache.
+         */
+        if (!incoming_args.fname) {
+            error_setg(errp, "direct-io requires a file: URI when loading "
+                       "with mapped-ram-load-threads");
+            return false;
+        }
+
+        /* Only the pages are read by the load threads, they are aligned */
+        file_enable_direct_io(&flags);
+    }
+
+    fls = g_new0(struct FileLoadState, 1);
+    fls->nr_threads = nr_threads;
+    fls->threads = g_new0(FileLoadThread, nr_threads);
+    qemu_mutex_init(&fls->lock);
+    qemu_cond_init(&fls->work_cond);
+    qemu_cond_init(&fls->done_cond);
+
+    for (i = 0; i < nr_threads; i++) {
+        FileLoadThread *t = &fls->threads[i];
+
+        /*
+         * pread() doesn't move the file position, so the main channel can
+         * be shared when the file can't be opened again, e.g. with fd:
+         */
+        if (incoming_args.fname) {
+            QIOChannelFile *fioc =
+                qio_channel_file_new_path(incoming_args.fname, flags, 0,
+                                          errp);
+            if (!fioc) {
+                while (i) {
+                    object_unref(OBJECT(fls->threads[--i].ioc));
+                }
+                file_load_free(fls);
+                return false;
+            }
+            t->ioc = QIO_CHANNEL(fioc);
+        } else {
+            t->ioc = QIO_CHANNEL(object_ref(OBJECT(ioc)));
+        }
+    }
+
+    file_load_state = fls;
+    for (i = 0; i < nr_threads; i++) {
+        qemu_thread_create(&fls->threads[i].thread, "mig/dst/load",
+                           file_load_thread, &fls->threads[i],
+                           QEMU_THREAD_JOINABLE);
+    }
+
+    trace_file_load_setup(nr_threads, !!incoming_args.fname);
+    return true;
+}
+
+bool file_load_enabled(void)
+{
+    return file_load_state;
+}
+
+bool file_load_queue(void *host, size_t size, off_t offset)
+{
+    struct FileLoadState *fls = file_load_state;
+    bool ret;
+
+    qemu_mutex_lock(&fls->lock);
+    while (fls->count == FILE_LOAD_QUEUE_LEN && !fls->err) {
+        qemu_cond_wait(&fls->done_cond, &fls->lock);
+    }
+
+    ret = !fls->err;
+    if (ret) {
+        unsigned int tail = (fls->head + fls->count) % FILE_LOAD_QUEUE_LEN;
+
+        fls->queue[tail] = (FileLoadJob) {
+            .host = host,
+            .size = size,
+            .offset = offset,
+        };
+        fls->count++;
+        qemu_cond_signal(&fls->work_cond);
+    }
+    qemu_mutex_unlock(&fls->lock);
+
+    return ret;
+}
+
+bool file_load_wait(Error **errp)
+{
+    struct FileLoadState *fls = file_load_state;
+    bool ret;
+
+    qemu_mutex_lock(&fls->lock);
+    while (fls->count || fls->busy) {
+        qemu_cond_wait(&fls->done_cond, &fls->lock);
+    }
+
+    ret = !fls->err;
+    if (!ret) {
+        error_propagate(errp, fls->err);
+        fls->err = NULL;
+    }
+    qemu_mutex_unlock(&fls->lock);
+
+    return ret;
+}
+
+void file_load_cleanup(void)
+{
+    struct FileLoadState *fls = file_load_state;
+    unsigned int i;
+
+    if (!fls) {
+        return;
+    }
+
+    qemu_mutex_lock(&fls->lock);
+    fls->quit = true;
+    qemu_cond_broadcast(&fls->work_cond);
+    qemu_mutex_unlock(&fls->lock);
+
+    for (i = 0; i < fls->nr_threads; i++) {
+        FileLoadThread *t = &fls->threads[i];
+
+        qemu_thread_join(&t->thread);
+        object_unref(OBJECT(t->ioc));
+    }
+
+    file_load_free(fls);
+    file_load_state = NULL;
+}
@@ -19,8 +19,16 @@ void file_start_outgoing_migration(MigrationState *s,
                                    FileMigrationArgs *file_args, Error **errp);
 int file_parse_offset(char *filespec, uint64_t *offsetp, Error **errp);
 void file_cleanup_outgoing_migration(void);
+void file_cleanup_incoming_migration(void);
 bool file_send_channel_create(gpointer opaque, Error **errp);
 int file_write_ramblock_iov(QIOChannel *ioc, const struct iovec *iov,
                             int niov, RAMBlock *block, Error **errp);
 int multifd_file_recv_data(MultiFDRecvParams *p, Error **errp);
+
+/* Parallel reads of the pages of a mapped-ram file on the destination */
+bool file_load_setup(QIOChannel *ioc, unsigned int nr_threads, Error **errp);
+bool file_load_enabled(void);
+bool file_load_queue(void *host, size_t size, off_t offset);
+bool file_load_wait(Error **errp);
+void file_load_cleanup(void);
 #endif
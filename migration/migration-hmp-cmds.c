@@ -175,6 +175,19 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->dirty_limit_ring_full_time);
     }
 
+    if (info->switchover_prediction) {
+        SwitchoverPrediction *pred = info->switchover_prediction;
+
+        monitor_printf(mon, "predicted dirty rate: %" PRIu64 " kbytes/s\n",
+                       pred->dirty_rate >> 10);
+        monitor_printf(mon, "predicted working set: %" PRIu64 " kbytes\n",
+                       pred->working_set >> 10);
+        monitor_printf(mon, "predicted downtime: %" PRIu64 " ms after %u "
+                       "more iterations (%s)\n",
+                       pred->expected_downtime, pred->rounds,
+                       pred->converge ? "converges" : "does not converge");
+    }
+
     if (info->has_postcopy_blocktime) {
         monitor_printf(mon, "postcopy blocktime: %u\n",
                        info->postcopy_blocktime);
@@ -303,6 +316,14 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
             MigrationParameter_str(MIGRATION_PARAMETER_ZERO_PAGE_DETECTION),
             qapi_enum_lookup(&ZeroPageDetection_lookup,
                 params->zero_page_detection));
+        assert(params->has_zero_page_detection_threads);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_ZERO_PAGE_DETECTION_THREADS),
+            params->zero_page_detection_threads);
+        assert(params->has_mapped_ram_load_threads);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_MAPPED_RAM_LOAD_THREADS),
+            params->mapped_ram_load_threads);
         monitor_printf(mon, "%s: %" PRIu64 " bytes\n",
             MigrationParameter_str(MIGRATION_PARAMETER_XBZRLE_CACHE_SIZE),
             params->xbzrle_cache_size);
@@ -635,6 +656,14 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_direct_io = true;
         visit_type_bool(v, param, &p->direct_io, &err);
         break;
+    case MIGRATION_PARAMETER_ZERO_PAGE_DETECTION_THREADS:
+        p->has_zero_page_detection_threads = true;
+        visit_type_uint8(v, param, &p->zero_page_detection_threads, &err);
+        break;
+    case MIGRATION_PARAMETER_MAPPED_RAM_LOAD_THREADS:
+        p->has_mapped_ram_load_threads = true;
+        visit_type_uint8(v, param, &p->mapped_ram_load_threads, &err);
+        break;
     default:
         assert(0);
     }
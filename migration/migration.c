@@ -378,6 +378,7 @@ void migration_incoming_state_destroy(void)
     struct MigrationIncomingState *mis = migration_incoming_get_current();
 
     multifd_recv_cleanup();
+    file_cleanup_incoming_migration();
 
     if (mis->to_src_file) {
         /* Tell source that we are done */
@@ -1228,6 +1229,11 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         info->ram->remaining = ram_bytes_remaining();
         info->ram->dirty_pages_rate =
            stat64_get(&mig_stats.dirty_pages_rate);
+
+        if (s->has_switchover_prediction) {
+            info->switchover_prediction = g_new(SwitchoverPrediction, 1);
+            *info->switchover_prediction = s->switchover_prediction;
+        }
     }
 
     if (migrate_dirty_limit() && dirtylimit_in_service()) {
@@ -1715,6 +1721,7 @@ int migrate_init(MigrationState *s, Error **errp)
     s->pages_per_second = 0.0;
     s->downtime = 0;
     s->expected_downtime = 0;
+    s->has_switchover_prediction = false;
     s->setup_time = 0;
     s->start_postcopy = false;
     s->migration_thread_running = false;
@@ -3208,6 +3215,20 @@ static void migration_update_counters(MigrationState *s,
             stat64_get(&mig_stats.dirty_bytes_last_sync) / expected_bw_per_ms;
     }
 
+    if (!migration_in_postcopy()) {
+        SwitchoverPrediction *pred = &s->switchover_prediction;
+
+        s->has_switchover_prediction =
+            ram_predict_switchover(expected_bw_per_ms, s->threshold_size,
+                                   pred);
+        if (s->has_switchover_prediction) {
+            trace_migrate_switchover_prediction(pred->dirty_rate,
+                                                pred->working_set,
+                                                pred->expected_downtime,
+                                                pred->rounds, pred->converge);
+        }
+    }
+
     migration_rate_reset();
 
     update_iteration_initial_status(s);
@@ -3232,6 +3253,42 @@ static bool migration_can_switchover(MigrationState *s)
     return s->switchover_acked;
 }
 
+/*
+ * How far the predicted downtime may exceed downtime-limit, as a multiple
+ * of it, for predictive-switchover to switch over at the plateau
+ */
+#define PREDICTIVE_SWITCHOVER_MAX_OVERSHOOT 4
+
+/*
+ * With predictive-switchover and no other way to make precopy converge,
+ * switch over as soon as the model says that further iterations won't
+ * reduce the downtime any more, provided that the predicted downtime
+ * stays within PREDICTIVE_SWITCHOVER_MAX_OVERSHOOT times downtime-limit.
+ * Otherwise keep iterating as if the capability was off.
+ */
+static bool migration_switchover_predicted(MigrationState *s)
+{
+    SwitchoverPrediction *pred = &s->switchover_prediction;
+
+    if (!migrate_predictive_switchover() || !s->has_switchover_prediction ||
+        migrate_auto_converge() || migrate_dirty_limit() ||
+        migrate_postcopy_ram()) {
+        return false;
+    }
+
+    /*
+     * The first pass over memory only sees pages dirtied after they
+     * were sent, so its history understates the dirty rate.
+     */
+    if (stat64_get(&mig_stats.dirty_sync_count) <= 2) {
+        return false;
+    }
+
+    return !pred->converge && !pred->rounds &&
+           pred->expected_downtime <=
+           PREDICTIVE_SWITCHOVER_MAX_OVERSHOOT * migrate_downtime_limit();
+}
+
 /* Migration thread iteration status */
 typedef enum {
     MIG_ITERATE_RESUME,         /* Resume current iteration */
@@ -3266,6 +3323,13 @@ static MigIterateState migration_iteration_run(MigrationState *s)
         return MIG_ITERATE_BREAK;
     }
 
+    if (!in_postcopy && can_switchover && migration_switchover_predicted(s)) {
+        trace_migration_thread_predicted_switchover(
+            pending_size, s->switchover_prediction.expected_downtime);
+        migration_completion(s);
+        return MIG_ITERATE_BREAK;
+    }
+
     /* Still a significant amount to transfer */
     if (!in_postcopy && must_precopy <= s->threshold_size && can_switchover &&
         qatomic_read(&s->start_postcopy)) {
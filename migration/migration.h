@@ -339,6 +339,12 @@ struct MigrationState {
     int64_t downtime_start;
     int64_t downtime;
     int64_t expected_downtime;
+    /*
+     * Latest output of ram_predict_switchover(), updated by the
+     * migration thread together with expected_downtime.
+     */
+    bool has_switchover_prediction;
+    SwitchoverPrediction switchover_prediction;
     bool capabilities[MIGRATION_CAPABILITY__MAX];
     int64_t setup_time;
 
@@ -0,0 +1,597 @@
+/*
+ * Multifd adaptive compression implementation
+ *
+ * Each normal page of a packet is sent with the encoding that is
+ * expected to give the best ratio for the CPU time spent on it:
+ *
+ *  - pages that were already sent during this migration are delta
+ *    encoded with XBZRLE against the last version that was sent;
+ *  - pages whose content looks random are sent as they are;
+ *  - everything else is compressed with zstd.
+ *
+ * Zero pages are handled by the common multifd zero page detection.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <zstd.h>
+#include "qemu/host-utils.h"
+#include "qemu/rcu.h"
+#include "exec/ramblock.h"
+#include "exec/memory.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "trace.h"
+#include "options.h"
+#include "multifd.h"
+#include "xbzrle.h"
+
+/*
+ * Packet payload layout: one big endian 32-bit descriptor per normal
+ * page, holding the encoding in the top 8 bits and the length of the
+ * encoded data in the low 24 bits, followed by the encoded data of each
+ * page in the same order.
+ */
+#define ADAPTIVE_DESC_LEN_MASK      0xffffff
+#define ADAPTIVE_DESC_ENC_SHIFT     24
+
+enum {
+    ADAPTIVE_ENC_RAW = 0,
+    ADAPTIVE_ENC_ZSTD = 1,
+    ADAPTIVE_ENC_XBZRLE = 2,
+};
+
+/*
+ * Number of bytes sampled to estimate the entropy of a page, and number
+ * of distinct values above which the page is assumed not to compress.
+ * 256 random bytes have about 162 distinct values on average.
+ */
+#define ADAPTIVE_ENTROPY_SAMPLES    256
+#define ADAPTIVE_ENTROPY_DISTINCT   150
+
+/* Number of locks protecting the slots of the delta cache */
+#define ADAPTIVE_CACHE_LOCKS        64
+
+/*
+ * Copy of the last version sent of a page, shared by all the channels.
+ * Within a dirty bitmap round a page is only sent by one channel, and
+ * channels are synchronized between rounds, so the destination applies
+ * the deltas in the order they were computed.
+ */
+typedef struct {
+    /* ram_addr_t of the cached page, RAM_ADDR_INVALID if the slot is free */
+    ram_addr_t addr;
+    /* the last delta of this page did not fit, don't try on next send */
+    bool skip_delta;
+} AdaptiveCacheSlot;
+
+typedef struct {
+    /* number of channels using the cache */
+    unsigned int users;
+    size_t page_size;
+    /* number of slots, a power of 2 */
+    uint64_t num_slots;
+    AdaptiveCacheSlot *slots;
+    uint8_t *data;
+    QemuMutex locks[ADAPTIVE_CACHE_LOCKS];
+} AdaptiveCache;
+
+static AdaptiveCache *adaptive_cache;
+
+struct adaptive_data {
+    /* zstd compression and decompression contexts */
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+    /* stable copy of the page being encoded */
+    uint8_t *page;
+    /* encoded packet payload */
+    uint8_t *zbuff;
+    /* size of encoded packet payload buffer */
+    uint32_t zbuff_len;
+};
+
+static uint32_t adaptive_zbuff_len(uint32_t page_count, uint32_t page_size)
+{
+    return page_count * (sizeof(uint32_t) + page_size);
+}
+
+static uint64_t adaptive_cache_slot(AdaptiveCache *c, ram_addr_t addr)
+{
+    return (addr / c->page_size) & (c->num_slots - 1);
+}
+
+static QemuMutex *adaptive_cache_lock(AdaptiveCache *c, uint64_t slot)
+{
+    return &c->locks[slot % ADAPTIVE_CACHE_LOCKS];
+}
+
+static bool adaptive_cache_get(size_t page_size, Error **errp)
+{
+    AdaptiveCache *c = adaptive_cache;
+    uint64_t size = migrate_xbzrle_cache_size();
+    uint64_t i;
+
+    if (c) {
+        c->users++;
+        return true;
+    }
+
+    c = g_new0(AdaptiveCache, 1);
+    c->page_size = page_size;
+    c->num_slots = pow2floor(MAX(size / page_size, ADAPTIVE_CACHE_LOCKS));
+    c->slots = g_try_new(AdaptiveCacheSlot, c->num_slots);
+    c->data = g_try_malloc(c->num_slots * page_size);
+    if (!c->slots || !c->data) {
+        g_free(c->slots);
+        g_free(c->data);
+        g_free(c);
+        error_setg(errp, "multifd: out of memory for adaptive cache");
+        return false;
+    }
+
+    for (i = 0; i < c->num_slots; i++) {
+        c->slots[i].addr = RAM_ADDR_INVALID;
+        c->slots[i].skip_delta = false;
+    }
+    for (i = 0; i < ADAPTIVE_CACHE_LOCKS; i++) {
+        qemu_mutex_init(&c->locks[i]);
+    }
+    c->users = 1;
+    adaptive_cache = c;
+    return true;
+}
+
+static void adaptive_cache_put(void)
+{
+    AdaptiveCache *c = adaptive_cache;
+    int i;
+
+    if (--c->users) {
+        return;
+    }
+
+    for (i = 0; i < ADAPTIVE_CACHE_LOCKS; i++) {
+        qemu_mutex_destroy(&c->locks[i]);
+    }
+    g_free(c->slots);
+    g_free(c->data);
+    g_free(c);
+    adaptive_cache = NULL;
+}
+
+/**
+ * adaptive_cache_invalidate: forget a page
+ *
+ * Used for pages that reach the destination by other means, e.g. zero
+ * pages, so that the next delta is not computed against stale content.
+ *
+ * @addr: ram_addr_t of the page
+ */
+static void adaptive_cache_invalidate(ram_addr_t addr)
+{
+    AdaptiveCache *c = adaptive_cache;
+    uint64_t slot = adaptive_cache_slot(c, addr);
+    QemuMutex *lock = adaptive_cache_lock(c, slot);
+
+    qemu_mutex_lock(lock);
+    if (c->slots[slot].addr == addr) {
+        c->slots[slot].addr = RAM_ADDR_INVALID;
+    }
+    qemu_mutex_unlock(lock);
+}
+
+/**
+ * adaptive_page_is_incompressible: guess if a page compresses
+ *
+ * Counts the distinct byte values of a sample of the page; random
+ * looking data (encrypted, already compressed) use most of them.
+ *
+ * Returns true if compressing the page is probably a waste of time.
+ *
+ * @buf: page content
+ * @len: page size
+ */
+static bool adaptive_page_is_incompressible(const uint8_t *buf, size_t len)
+{
+    size_t stride = MAX(len / ADAPTIVE_ENTROPY_SAMPLES, 1);
+    uint64_t seen[256 / 64] = { 0 };
+    unsigned int distinct = 0;
+    size_t i;
+
+    for (i = 0; i < len; i += stride) {
+        seen[buf[i] / 64] |= 1ULL << (buf[i] % 64);
+    }
+    for (i = 0; i < ARRAY_SIZE(seen); i++) {
+        distinct += ctpop64(seen[i]);
+    }
+
+    return distinct > ADAPTIVE_ENTROPY_DISTINCT;
+}
+
+/**
+ * adaptive_encode_page: encode one page
+ *
+ * Returns the encoding used; the encoded data is stored at @dst and its
+ * length in @len.
+ *
+ * @p: Params for the channel that we are using
+ * @addr: ram_addr_t of the page
+ * @dst: where to store the encoded data, at least one page long
+ * @len: length of the encoded data
+ * @errp: pointer to an error
+ */
+static int adaptive_encode_page(MultiFDSendParams *p, ram_addr_t addr,
+                                uint8_t *dst, uint32_t *len, Error **errp)
+{
+    struct adaptive_data *z = p->compress_data;
+    AdaptiveCache *c = adaptive_cache;
+    uint64_t slot = adaptive_cache_slot(c, addr);
+    QemuMutex *lock = adaptive_cache_lock(c, slot);
+    uint8_t *cached = c->data + slot * c->page_size;
+    bool hit;
+    size_t ret;
+    int enc = -1;
+
+    qemu_mutex_lock(lock);
+    hit = c->slots[slot].addr == addr;
+
+    /* A page that is being rewritten, send only what changed */
+    if (hit && !c->slots[slot].skip_delta) {
+        int dlen = xbzrle_encode_buffer(cached, z->page, p->page_size,
+                                        dst, p->page_size -
+                                        p->page_size / 4);
+        if (dlen >= 0) {
+            *len = dlen;
+            enc = ADAPTIVE_ENC_XBZRLE;
+        }
+        c->slots[slot].skip_delta = dlen < 0;
+    } else if (hit) {
+        c->slots[slot].skip_delta = false;
+    } else {
+        c->slots[slot].addr = addr;
+        c->slots[slot].skip_delta = false;
+    }
+
+    /*
+     * The destination now has the content of z->page, whatever encoding
+     * ends up being used below.
+     */
+    memcpy(cached, z->page, p->page_size);
+    qemu_mutex_unlock(lock);
+
+    if (enc >= 0) {
+        return enc;
+    }
+
+    if (!adaptive_page_is_incompressible(z->page, p->page_size)) {
+        /* Only keep the compressed version if it saves 1/8 of the page */
+        ret = ZSTD_compressCCtx(z->cctx, dst,
+                                p->page_size - p->page_size / 8,
+                                z->page, p->page_size,
+                                migrate_multifd_zstd_level());
+        if (!ZSTD_isError(ret)) {
+            *len = ret;
+            return ADAPTIVE_ENC_ZSTD;
+        }
+        if (ZSTD_getErrorCode(ret) != ZSTD_error_dstSize_tooSmall) {
+            error_setg(errp, "multifd %u: compressCCtx error %s",
+                       p->id, ZSTD_getErrorName(ret));
+            return -1;
+        }
+    }
+
+    memcpy(dst, z->page, p->page_size);
+    *len = p->page_size;
+    return ADAPTIVE_ENC_RAW;
+}
+
+/* Multifd adaptive compression */
+
+/**
+ * adaptive_send_setup: setup send side
+ *
+ * Setup each channel with a zstd context, and share the delta cache
+ * between them.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int adaptive_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct adaptive_data *z = g_new0(struct adaptive_data, 1);
+
+    z->cctx = ZSTD_createCCtx();
+    if (!z->cctx) {
+        g_free(z);
+        error_setg(errp, "multifd %u: zstd createCCtx failed", p->id);
+        return -1;
+    }
+
+    z->page = g_try_malloc(p->page_size);
+    z->zbuff_len = adaptive_zbuff_len(p->page_count, p->page_size);
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->page || !z->zbuff) {
+        ZSTD_freeCCtx(z->cctx);
+        g_free(z->page);
+        g_free(z->zbuff);
+        g_free(z);
+        error_setg(errp, "multifd %u: out of memory for zbuff", p->id);
+        return -1;
+    }
+
+    if (!adaptive_cache_get(p->page_size, errp)) {
+        ZSTD_freeCCtx(z->cctx);
+        g_free(z->page);
+        g_free(z->zbuff);
+        g_free(z);
+        return -1;
+    }
+    p->compress_data = z;
+
+    /* Needs 2 IOVs, one for packet header and one for encoded data */
+    p->iov = g_new0(struct iovec, 2);
+    return 0;
+}
+
+/**
+ * adaptive_send_cleanup: cleanup send side
+ *
+ * Close the channel and return memory.
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static void adaptive_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct adaptive_data *z = p->compress_data;
+
+    if (!z) {
+        return;
+    }
+
+    ZSTD_freeCCtx(z->cctx);
+    g_free(z->page);
+    g_free(z->zbuff);
+    g_free(p->compress_data);
+    p->compress_data = NULL;
+    adaptive_cache_put();
+
+    g_free(p->iov);
+    p->iov = NULL;
+}
+
+/**
+ * adaptive_send_prepare: prepare date to be able to send
+ *
+ * Encode all the normal pages that we are going to send.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int adaptive_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    MultiFDPages_t *pages = p->pages;
+    struct adaptive_data *z = p->compress_data;
+    uint32_t *desc = (uint32_t *)z->zbuff;
+    uint32_t count[3] = { 0 };
+    uint32_t pos;
+    uint32_t i;
+
+    if (!multifd_send_prepare_common(p)) {
+        goto out;
+    }
+
+    pos = pages->normal_num * sizeof(uint32_t);
+    for (i = 0; i < pages->normal_num; i++) {
+        ram_addr_t offset = pages->offset[i];
+        uint32_t len;
+        int enc;
+
+        /* The guest may still be writing to the page, work on a copy */
+        memcpy(z->page, pages->block->host + offset, p->page_size);
+        enc = adaptive_encode_page(p, pages->block->offset + offset,
+                                   z->zbuff + pos, &len, errp);
+        if (enc < 0) {
+            return -1;
+        }
+        desc[i] = cpu_to_be32((enc << ADAPTIVE_DESC_ENC_SHIFT) | len);
+        pos += len;
+        count[enc]++;
+    }
+    p->iov[p->iovs_num].iov_base = z->zbuff;
+    p->iov[p->iovs_num].iov_len = pos;
+    p->iovs_num++;
+    p->next_packet_size = pos;
+
+out:
+    for (i = pages->normal_num; i < pages->num; i++) {
+        adaptive_cache_invalidate(pages->block->offset + pages->offset[i]);
+    }
+
+    trace_multifd_adaptive_send(p->id, count[ADAPTIVE_ENC_RAW],
+                                count[ADAPTIVE_ENC_ZSTD],
+                                count[ADAPTIVE_ENC_XBZRLE]);
+    p->flags |= MULTIFD_FLAG_ADAPTIVE;
+    multifd_send_fill_packet(p);
+    return 0;
+}
+
+/**
+ * adaptive_recv_setup: setup receive side
+ *
+ * Create the zstd context and buffer.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int adaptive_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct adaptive_data *z = g_new0(struct adaptive_data, 1);
+
+    p->compress_data = z;
+    z->dctx = ZSTD_createDCtx();
+    if (!z->dctx) {
+        g_free(z);
+        error_setg(errp, "multifd %u: zstd createDCtx failed", p->id);
+        return -1;
+    }
+
+    z->zbuff_len = adaptive_zbuff_len(p->page_count, p->page_size);
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->zbuff) {
+        ZSTD_freeDCtx(z->dctx);
+        g_free(z);
+        error_setg(errp, "multifd %u: out of memory for zbuff", p->id);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * adaptive_recv_cleanup: cleanup receive side
+ *
+ * Free the zstd context and buffer.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void adaptive_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct adaptive_data *z = p->compress_data;
+
+    ZSTD_freeDCtx(z->dctx);
+    z->dctx = NULL;
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->compress_data);
+    p->compress_data = NULL;
+}
+
+/**
+ * adaptive_recv: read the data from the channel into actual pages
+ *
+ * Read the encoded buffer, and decode each page with the method it was
+ * encoded with.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int adaptive_recv(MultiFDRecvParams *p, Error **errp)
+{
+    uint32_t in_size = p->next_packet_size;
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    struct adaptive_data *z = p->compress_data;
+    uint32_t *desc = (uint32_t *)z->zbuff;
+    uint32_t pos;
+    size_t ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_ADAPTIVE) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_ADAPTIVE);
+        return -1;
+    }
+
+    multifd_recv_zero_page_process(p);
+
+    if (!p->normal_num) {
+        assert(in_size == 0);
+        return 0;
+    }
+
+    pos = p->normal_num * sizeof(uint32_t);
+    if (in_size < pos || in_size > z->zbuff_len) {
+        error_setg(errp, "multifd %u: received packet size %u is invalid",
+                   p->id, in_size);
+        return -1;
+    }
+
+    if (qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp)) {
+        return -1;
+    }
+
+    for (i = 0; i < p->normal_num; i++) {
+        uint32_t d = be32_to_cpu(desc[i]);
+        uint32_t len = d & ADAPTIVE_DESC_LEN_MASK;
+        uint8_t *page = p->host + p->normal[i];
+
+        if (len > in_size - pos) {
+            error_setg(errp, "multifd %u: page %d overflows the packet",
+                       p->id, i);
+            return -1;
+        }
+
+        ramblock_recv_bitmap_set_offset(p->block, p->normal[i]);
+        switch (d >> ADAPTIVE_DESC_ENC_SHIFT) {
+        case ADAPTIVE_ENC_RAW:
+            if (len != p->page_size) {
+                error_setg(errp, "multifd %u: raw page of %u bytes",
+                           p->id, len);
+                return -1;
+            }
+            memcpy(page, z->zbuff + pos, len);
+            break;
+        case ADAPTIVE_ENC_ZSTD:
+            ret = ZSTD_decompressDCtx(z->dctx, page, p->page_size,
+                                      z->zbuff + pos, len);
+            if (ZSTD_isError(ret)) {
+                error_setg(errp, "multifd %u: decompressDCtx returned %s",
+                           p->id, ZSTD_getErrorName(ret));
+                return -1;
+            }
+            if (ret != p->page_size) {
+                error_setg(errp, "multifd %u: page decompressed to %zu bytes",
+                           p->id, ret);
+                return -1;
+            }
+            break;
+        case ADAPTIVE_ENC_XBZRLE:
+            /* The page still holds the version the delta was computed on */
+            if (len && xbzrle_decode_buffer(z->zbuff + pos, len, page,
+                                            p->page_size) < 0) {
+                error_setg(errp, "multifd %u: failed to decode XBZRLE page",
+                           p->id);
+                return -1;
+            }
+            break;
+        default:
+            error_setg(errp, "multifd %u: unknown page encoding %u",
+                       p->id, d >> ADAPTIVE_DESC_ENC_SHIFT);
+            return -1;
+        }
+        pos += len;
+    }
+
+    if (pos != in_size) {
+        error_setg(errp, "multifd %u: packet size received %u size used %u",
+                   p->id, in_size, pos);
+        return -1;
+    }
+    return 0;
+}
+
+static MultiFDMethods multifd_adaptive_ops = {
+    .send_setup = adaptive_send_setup,
+    .send_cleanup = adaptive_send_cleanup,
+    .send_prepare = adaptive_send_prepare,
+    .recv_setup = adaptive_recv_setup,
+    .recv_cleanup = adaptive_recv_cleanup,
+    .recv = adaptive_recv
+};
+
+static void multifd_adaptive_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_ADAPTIVE, &multifd_adaptive_ops);
+}
+
+migration_init(multifd_adaptive_register);
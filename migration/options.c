@@ -78,6 +78,9 @@
 #define DEFAULT_MIGRATE_VCPU_DIRTY_LIMIT_PERIOD     1000    /* milliseconds */
 #define DEFAULT_MIGRATE_VCPU_DIRTY_LIMIT            1       /* MB/s */
 
+#define MAX_ZERO_PAGE_DETECTION_THREADS 64
+#define MAX_MAPPED_RAM_LOAD_THREADS 64
+
 Property migration_properties[] = {
     DEFINE_PROP_BOOL("store-global-state", MigrationState,
                      store_global_state, true),
@@ -162,6 +165,10 @@ Property migration_properties[] = {
     DEFINE_PROP_ZERO_PAGE_DETECTION("zero-page-detection", MigrationState,
                        parameters.zero_page_detection,
                        ZERO_PAGE_DETECTION_MULTIFD),
+    DEFINE_PROP_UINT8("zero-page-detection-threads", MigrationState,
+                      parameters.zero_page_detection_threads, 0),
+    DEFINE_PROP_UINT8("mapped-ram-load-threads", MigrationState,
+                      parameters.mapped_ram_load_threads, 0),
 
     /* Migration capabilities */
     DEFINE_PROP_MIG_CAP("x-xbzrle", MIGRATION_CAPABILITY_XBZRLE),
@@ -186,6 +193,10 @@ Property migration_properties[] = {
                         MIGRATION_CAPABILITY_SWITCHOVER_ACK),
     DEFINE_PROP_MIG_CAP("x-dirty-limit", MIGRATION_CAPABILITY_DIRTY_LIMIT),
     DEFINE_PROP_MIG_CAP("mapped-ram", MIGRATION_CAPABILITY_MAPPED_RAM),
+    DEFINE_PROP_MIG_CAP("x-predictive-switchover",
+                        MIGRATION_CAPABILITY_PREDICTIVE_SWITCHOVER),
+    DEFINE_PROP_MIG_CAP("x-hot-page-deferral",
+                        MIGRATION_CAPABILITY_HOT_PAGE_DEFERRAL),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -238,6 +249,13 @@ bool migrate_mapped_ram(void)
     return s->capabilities[MIGRATION_CAPABILITY_MAPPED_RAM];
 }
 
+bool migrate_hot_page_deferral(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_HOT_PAGE_DEFERRAL];
+}
+
 bool migrate_ignore_shared(void)
 {
     MigrationState *s = migrate_get_current();
@@ -287,6 +305,13 @@ bool migrate_postcopy_ram(void)
     return s->capabilities[MIGRATION_CAPABILITY_POSTCOPY_RAM];
 }
 
+bool migrate_predictive_switchover(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_PREDICTIVE_SWITCHOVER];
+}
+
 bool migrate_rdma_pin_all(void)
 {
     MigrationState *s = migrate_get_current();
@@ -426,7 +451,8 @@ INITIALIZE_MIGRATE_CAPS_SET(check_caps_background_snapshot,
     MIGRATION_CAPABILITY_XBZRLE,
     MIGRATION_CAPABILITY_X_COLO,
     MIGRATION_CAPABILITY_VALIDATE_UUID,
-    MIGRATION_CAPABILITY_ZERO_COPY_SEND);
+    MIGRATION_CAPABILITY_ZERO_COPY_SEND,
+    MIGRATION_CAPABILITY_HOT_PAGE_DEFERRAL);
 
 static bool migrate_incoming_started(void)
 {
@@ -707,18 +733,20 @@ bool migrate_direct_io(void)
     MigrationState *s = migrate_get_current();
 
     /*
-     * O_DIRECT is only supported with mapped-ram and multifd.
+     * O_DIRECT is only supported with mapped-ram and either multifd or
+     * the mapped-ram load threads.
      *
      * mapped-ram is needed because filesystems impose restrictions on
      * O_DIRECT IO alignment (see MAPPED_RAM_FILE_OFFSET_ALIGNMENT).
      *
-     * multifd is needed to keep the unaligned portion of the stream
-     * isolated to the main migration thread while multifd channels
-     * process the aligned data with O_DIRECT enabled.
+     * multifd or the load threads are needed to keep the unaligned
+     * portion of the stream isolated to the main migration thread while
+     * the other threads process the aligned data with O_DIRECT enabled.
      */
     return s->parameters.direct_io &&
         s->capabilities[MIGRATION_CAPABILITY_MAPPED_RAM] &&
-        s->capabilities[MIGRATION_CAPABILITY_MULTIFD];
+        (s->capabilities[MIGRATION_CAPABILITY_MULTIFD] ||
+         s->parameters.mapped_ram_load_threads);
 }
 
 uint64_t migrate_downtime_limit(void)
@@ -843,6 +871,20 @@ ZeroPageDetection migrate_zero_page_detection(void)
     return s->parameters.zero_page_detection;
 }
 
+uint8_t migrate_zero_page_detection_threads(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.zero_page_detection_threads;
+}
+
+uint8_t migrate_mapped_ram_load_threads(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.mapped_ram_load_threads;
+}
+
 /* parameters helpers */
 
 AnnounceParameters *migrate_announce_params(void)
@@ -926,6 +968,11 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
     params->zero_page_detection = s->parameters.zero_page_detection;
     params->has_direct_io = true;
     params->direct_io = s->parameters.direct_io;
+    params->has_zero_page_detection_threads = true;
+    params->zero_page_detection_threads =
+        s->parameters.zero_page_detection_threads;
+    params->has_mapped_ram_load_threads = true;
+    params->mapped_ram_load_threads = s->parameters.mapped_ram_load_threads;
 
     return params;
 }
@@ -959,6 +1006,8 @@ void migrate_params_init(MigrationParameters *params)
     params->has_mode = true;
     params->has_zero_page_detection = true;
     params->has_direct_io = true;
+    params->has_zero_page_detection_threads = true;
+    params->has_mapped_ram_load_threads = true;
 }
 
 /*
@@ -1137,6 +1186,34 @@ bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+#ifdef CONFIG_ZSTD
+    if (params->has_multifd_compression && params->has_zero_page_detection &&
+        params->multifd_compression == MULTIFD_COMPRESSION_ADAPTIVE &&
+        params->zero_page_detection == ZERO_PAGE_DETECTION_LEGACY) {
+        error_setg(errp, "Adaptive multifd compression is not compatible "
+                   "with legacy zero page detection");
+        return false;
+    }
+#endif
+
+    if (params->has_zero_page_detection_threads &&
+        params->zero_page_detection_threads > MAX_ZERO_PAGE_DETECTION_THREADS) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "zero_page_detection_threads",
+                   "a value between 0 and "
+                   stringify(MAX_ZERO_PAGE_DETECTION_THREADS));
+        return false;
+    }
+
+    if (params->has_mapped_ram_load_threads &&
+        params->mapped_ram_load_threads > MAX_MAPPED_RAM_LOAD_THREADS) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "mapped_ram_load_threads",
+                   "a value between 0 and "
+                   stringify(MAX_MAPPED_RAM_LOAD_THREADS));
+        return false;
+    }
+
     return true;
 }
 
@@ -1247,6 +1324,14 @@ static void migrate_params_test_apply(MigrateSetParameters *params,
     if (params->has_direct_io) {
         dest->direct_io = params->direct_io;
     }
+
+    if (params->has_zero_page_detection_threads) {
+        dest->zero_page_detection_threads = params->zero_page_detection_threads;
+    }
+
+    if (params->has_mapped_ram_load_threads) {
+        dest->mapped_ram_load_threads = params->mapped_ram_load_threads;
+    }
 }
 
 static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
@@ -1376,6 +1461,15 @@ static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
     if (params->has_direct_io) {
         s->parameters.direct_io = params->direct_io;
     }
+
+    if (params->has_zero_page_detection_threads) {
+        s->parameters.zero_page_detection_threads =
+            params->zero_page_detection_threads;
+    }
+
+    if (params->has_mapped_ram_load_threads) {
+        s->parameters.mapped_ram_load_threads = params->mapped_ram_load_threads;
+    }
 }
 
 void qmp_migrate_set_parameters(MigrateSetParameters *params, Error **errp)
@@ -32,6 +32,7 @@
 #include "qemu/bitmap.h"
 #include "qemu/madvise.h"
 #include "qemu/main-loop.h"
+#include "qemu/units.h"
 #include "xbzrle.h"
 #include "ram.h"
 #include "migration.h"
@@ -56,6 +57,8 @@
 #include "savevm.h"
 #include "qemu/iov.h"
 #include "multifd.h"
+#include "file.h"
+#include "zero-page-scan.h"
 #include "sysemu/runstate.h"
 #include "rdma.h"
 #include "options.h"
@@ -351,6 +354,23 @@ struct RAMSrcPageRequest {
     QSIMPLEQ_ENTRY(RAMSrcPageRequest) next_req;
 };
 
+/*
+ * A window of dirty pages of one RAMBlock handed to the zero page
+ * detection helpers
+ */
+struct ZeroScanWindow {
+    RAMBlock *block;
+    /* Target page numbers inside @block, in ascending order */
+    unsigned long page[ZERO_PAGE_SCAN_BATCH_MAX];
+    /* Host addresses and results, indexed as @page */
+    ZeroPageScanBatch batch;
+    /* The dirty_sync_count the window was built for */
+    uint64_t generation;
+    /* Whether the helpers are still working on the window */
+    bool inflight;
+};
+typedef struct ZeroScanWindow ZeroScanWindow;
+
 /* State of RAM for migration */
 struct RAMState {
     /*
@@ -414,6 +434,31 @@ struct RAMState {
      * RAM migration.
      */
     unsigned int postcopy_bmap_sync_requested;
+
+    /* Zero page detection helper threads, NULL if not used */
+    ZeroPageScan *zero_scan;
+    /*
+     * The window being sent by the migration thread, and the one the
+     * helpers are checking meanwhile.  Protected by the bitmap_mutex.
+     */
+    ZeroScanWindow zero_window[2];
+    unsigned int zero_window_cur;
+
+    /*
+     * Length in ms of the sync periods recorded in RAMBlock::dirty_history,
+     * the slot the next period goes to, and how many slots are valid.
+     */
+    int64_t dirty_history_ms[RAMBLOCK_DIRTY_HISTORY];
+    unsigned int dirty_history_idx;
+    unsigned int dirty_history_len;
+
+    /*
+     * hot-page-deferral: chunks with at least this heat are left for the
+     * final round, as long as defer_hot is set.  Both are recomputed on
+     * every bitmap sync.
+     */
+    unsigned int hot_cutoff;
+    bool defer_hot;
 };
 typedef struct RAMState RAMState;
 
@@ -698,6 +743,23 @@ static int save_xbzrle_page(RAMState *rs, PageSearchStatus *pss,
     return 1;
 }
 
+/* Smallest chunk tracked by hot-page-deferral, in target pages */
+#define HOT_CHUNK_SHIFT_MIN 6
+/* Heat saturates here */
+#define HOT_HEAT_MAX 15
+/* Chunks cooler than this are never deferred */
+#define HOT_HEAT_MIN 2
+
+/* Whether @page of @rb should be left for the final round */
+static bool ramblock_page_deferred(RAMBlock *rb, unsigned long page)
+{
+    RAMState *rs = ram_state;
+
+    return rb->heat && rs->defer_hot && !rs->last_stage &&
+           !migration_in_postcopy() &&
+           rb->heat[page >> rb->heat_shift] >= rs->hot_cutoff;
+}
+
 /**
  * pss_find_next_dirty: find the next dirty page of current ramblock
  *
@@ -731,6 +793,14 @@ static void pss_find_next_dirty(PageSearchStatus *pss)
     }
 
     pss->page = find_next_bit(bitmap, size, pss->page);
+
+    /* Skip whole hot chunks, but never split a host page */
+    while (!pss->host_page_sending && pss->page < size &&
+           ramblock_page_deferred(rb, pss->page)) {
+        unsigned long next = ROUND_UP(pss->page + 1, 1UL << rb->heat_shift);
+
+        pss->page = find_next_bit(bitmap, size, next);
+    }
 }
 
 static void migration_clear_memory_region_dirty_bitmap(RAMBlock *rb,
@@ -832,6 +902,9 @@ static inline bool migration_bitmap_clear_dirty(RAMState *rs,
     ret = test_and_clear_bit(page, rb->bmap);
     if (ret) {
         rs->migration_dirty_pages--;
+        if (rb->heat_sent) {
+            set_bit(page >> rb->heat_shift, rb->heat_sent);
+        }
     }
 
     return ret;
@@ -920,6 +993,185 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
 
     rs->migration_dirty_pages += new_dirty_pages;
     rs->num_dirty_pages_period += new_dirty_pages;
+    rb->dirty_pages_period += new_dirty_pages;
+}
+
+/*
+ * Close the current sync period: push the pages each RAMBlock got
+ * dirtied with into its history, for ram_predict_switchover().
+ */
+static void ram_dirty_history_record(RAMState *rs, int64_t period_ms)
+{
+    unsigned int idx = rs->dirty_history_idx;
+    RAMBlock *block;
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            block->dirty_history[idx] = block->dirty_pages_period;
+            block->dirty_pages_period = 0;
+        }
+    }
+
+    rs->dirty_history_ms[idx] = period_ms;
+    rs->dirty_history_idx = (idx + 1) % RAMBLOCK_DIRTY_HISTORY;
+    rs->dirty_history_len = MIN(rs->dirty_history_len + 1,
+                                RAMBLOCK_DIRTY_HISTORY);
+}
+
+/*
+ * Update the heat of every chunk of @rb after a bitmap sync: chunks that
+ * were sent and got dirty again warm up, clean ones cool down.  Adds the
+ * dirty pages of each chunk to @histogram, indexed by heat.
+ */
+static void ramblock_heat_update(RAMBlock *rb, uint64_t *histogram)
+{
+    unsigned long pages = rb->used_length >> TARGET_PAGE_BITS;
+    unsigned long chunk_pages = 1UL << rb->heat_shift;
+    unsigned long chunk, start;
+
+    for (chunk = 0, start = 0; start < pages;
+         chunk++, start += chunk_pages) {
+        unsigned long dirty = bitmap_count_one_with_offset(
+            rb->bmap, start, MIN(chunk_pages, pages - start));
+
+        if (!dirty) {
+            rb->heat[chunk] >>= 1;
+            continue;
+        }
+        if (test_bit(chunk, rb->heat_sent) && rb->heat[chunk] < HOT_HEAT_MAX) {
+            rb->heat[chunk]++;
+        }
+        histogram[rb->heat[chunk]] += dirty;
+    }
+    bitmap_zero(rb->heat_sent, chunk);
+}
+
+/*
+ * Pick the hottest chunks that can be deferred to the final round: at
+ * most half of what can be sent within downtime-limit, so that the
+ * migration can still converge.
+ *
+ * Called with RCU critical section and bitmap_mutex held.
+ */
+static void ram_heat_update(RAMState *rs)
+{
+    uint64_t histogram[HOT_HEAT_MAX + 1] = {};
+    uint64_t budget = migrate_get_current()->threshold_size / 2;
+    uint64_t hot = 0;
+    RAMBlock *block;
+    int heat;
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        if (block->heat) {
+            ramblock_heat_update(block, histogram);
+        }
+    }
+
+    rs->hot_cutoff = HOT_HEAT_MAX + 1;
+    for (heat = HOT_HEAT_MAX; heat >= HOT_HEAT_MIN; heat--) {
+        if (hot + (histogram[heat] << TARGET_PAGE_BITS) > budget) {
+            break;
+        }
+        hot += histogram[heat] << TARGET_PAGE_BITS;
+        rs->hot_cutoff = heat;
+    }
+    rs->defer_hot = true;
+
+    trace_ram_heat_update(rs->hot_cutoff, hot, budget);
+}
+
+/*
+ * Dirty rate (bytes/ms) of @block averaged over its history, and the
+ * most it dirtied within a single period, used as its working set.
+ */
+static void ramblock_dirty_model(RAMState *rs, RAMBlock *block,
+                                 int64_t history_ms,
+                                 double *rate, double *working_set)
+{
+    uint64_t pages = 0, max_pages = 0;
+    unsigned int i;
+
+    for (i = 0; i < rs->dirty_history_len; i++) {
+        pages += block->dirty_history[i];
+        max_pages = MAX(max_pages, block->dirty_history[i]);
+    }
+
+    *rate = (double)(pages << TARGET_PAGE_BITS) / history_ms;
+    *working_set = MIN(max_pages << TARGET_PAGE_BITS, block->used_length);
+}
+
+/* Needs at least this many sync periods before predicting anything */
+#define SWITCHOVER_PREDICT_MIN_HISTORY 2
+/* Don't replay more iterations than this */
+#define SWITCHOVER_PREDICT_MAX_ROUNDS 30
+
+/**
+ * ram_predict_switchover: model how precopy converges from now on
+ *
+ * Replays the next iterations: each one sends what is left at
+ * @bw_per_ms, while every RAMBlock dirties memory at its average rate
+ * but never more than its working set.  Stops once the remainder fits
+ * in @threshold, or when another iteration would shrink it by less
+ * than 10%, i.e. the guest dirties about as much as we can send and
+ * the best switchover point has been reached.
+ *
+ * Returns false if there is not enough dirty history to predict.
+ *
+ * @bw_per_ms: expected bandwidth in bytes per millisecond
+ * @threshold: bytes that can be sent within downtime-limit
+ * @pred: where to store the prediction
+ */
+bool ram_predict_switchover(double bw_per_ms, uint64_t threshold,
+                            SwitchoverPrediction *pred)
+{
+    RAMState *rs = ram_state;
+    RAMBlock *block;
+    double rate, working_set, total_rate = 0, total_set = 0;
+    double remaining;
+    int64_t history_ms = 0;
+    unsigned int i, rounds = 0;
+
+    if (!rs || rs->dirty_history_len < SWITCHOVER_PREDICT_MIN_HISTORY ||
+        bw_per_ms <= 0) {
+        return false;
+    }
+
+    for (i = 0; i < rs->dirty_history_len; i++) {
+        history_ms += rs->dirty_history_ms[i];
+    }
+    remaining = ram_bytes_remaining();
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            ramblock_dirty_model(rs, block, history_ms, &rate, &working_set);
+            total_rate += rate;
+            total_set += working_set;
+        }
+
+        while (remaining > threshold &&
+               rounds < SWITCHOVER_PREDICT_MAX_ROUNDS) {
+            double iteration_ms = remaining / bw_per_ms;
+            double next = 0;
+
+            RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+                ramblock_dirty_model(rs, block, history_ms,
+                                     &rate, &working_set);
+                next += MIN(rate * iteration_ms, working_set);
+            }
+            if (next > remaining * 0.9) {
+                break;
+            }
+            remaining = next;
+            rounds++;
+        }
+    }
+
+    pred->dirty_rate = total_rate * 1000;
+    pred->working_set = total_set;
+    pred->expected_downtime = remaining / bw_per_ms;
+    pred->rounds = rounds;
+    pred->converge = remaining <= threshold;
+    return true;
 }
 
 /**
@@ -985,25 +1237,22 @@ static void migration_update_rates(RAMState *rs, int64_t end_time)
 /*
  * Enable dirty-limit to throttle down the guest
  */
-static void migration_dirty_limit_guest(void)
+static void migration_dirty_limit_guest(int64_t quota)
 {
     /*
-     * dirty page rate quota for all vCPUs fetched from
-     * migration parameter 'vcpu_dirty_limit'
+     * dirty page rate quota for all vCPUs, normally the migration
+     * parameter 'vcpu_dirty_limit'
      */
     static int64_t quota_dirtyrate;
-    MigrationState *s = migrate_get_current();
 
     /*
-     * If dirty limit already enabled and migration parameter
-     * vcpu-dirty-limit untouched.
+     * If dirty limit already enabled and the quota is untouched.
      */
-    if (dirtylimit_in_service() &&
-        quota_dirtyrate == s->parameters.vcpu_dirty_limit) {
+    if (dirtylimit_in_service() && quota_dirtyrate == quota) {
         return;
     }
 
-    quota_dirtyrate = s->parameters.vcpu_dirty_limit;
+    quota_dirtyrate = quota;
 
     /*
      * Set all vCPU a quota dirtyrate, note that the second
@@ -1013,13 +1262,31 @@ static void migration_dirty_limit_guest(void)
     trace_migration_dirty_limit_guest(quota_dirtyrate);
 }
 
+/*
+ * Per-vCPU dirty rate quota (MB/s) with which the switchover prediction
+ * expects precopy to converge: the guest may dirty at most half of what
+ * can be sent.  Never looser than the vcpu-dirty-limit parameter.
+ */
+static int64_t migration_predicted_dirty_limit(MigrationState *s)
+{
+    double bw_per_ms = (double)s->threshold_size /
+                       MAX(migrate_downtime_limit(), 1);
+    int64_t quota = bw_per_ms * 1000 / 2 / MiB / current_machine->smp.cpus;
+
+    return MIN(MAX(quota, 1), s->parameters.vcpu_dirty_limit);
+}
+
 static void migration_trigger_throttle(RAMState *rs)
 {
+    MigrationState *s = migrate_get_current();
     uint64_t threshold = migrate_throttle_trigger_threshold();
     uint64_t bytes_xfer_period =
         migration_transferred_bytes() - rs->bytes_xfer_prev;
     uint64_t bytes_dirty_period = rs->num_dirty_pages_period * TARGET_PAGE_SIZE;
     uint64_t bytes_dirty_threshold = bytes_xfer_period * threshold / 100;
+    bool predicted = migrate_predictive_switchover() &&
+                     s->has_switchover_prediction &&
+                     !s->switchover_prediction.converge;
 
     /*
      * The following detection logic can be refined later. For now:
@@ -1027,16 +1294,23 @@ static void migration_trigger_throttle(RAMState *rs)
      * amount of bytes that just got transferred since the last time
      * we were in this routine reaches the threshold. If that happens
      * twice, start or increase throttling.
+     *
+     * With predictive-switchover, don't wait when the model already
+     * says that precopy will not converge.
      */
-    if ((bytes_dirty_period > bytes_dirty_threshold) &&
-        (++rs->dirty_rate_high_cnt >= 2)) {
+    if (predicted || ((bytes_dirty_period > bytes_dirty_threshold) &&
+                      (++rs->dirty_rate_high_cnt >= 2))) {
         rs->dirty_rate_high_cnt = 0;
         if (migrate_auto_converge()) {
             trace_migration_throttle();
-            mig_throttle_guest_down(bytes_dirty_period,
+            /* tailslow needs a dirty rate above the threshold */
+            mig_throttle_guest_down(MAX(bytes_dirty_period,
+                                        bytes_dirty_threshold + 1),
                                     bytes_dirty_threshold);
         } else if (migrate_dirty_limit()) {
-            migration_dirty_limit_guest();
+            migration_dirty_limit_guest(predicted ?
+                migration_predicted_dirty_limit(s) :
+                s->parameters.vcpu_dirty_limit);
         }
     }
 }
@@ -1061,6 +1335,9 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
                 ramblock_sync_dirty_bitmap(rs, block);
             }
             stat64_set(&mig_stats.dirty_bytes_last_sync, ram_bytes_remaining());
+            if (migrate_hot_page_deferral() && !last_stage) {
+                ram_heat_update(rs);
+            }
         }
     }
 
@@ -1074,6 +1351,7 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
         migration_trigger_throttle(rs);
 
         migration_update_rates(rs, end_time);
+        ram_dirty_history_record(rs, end_time - rs->time_last_bitmap_sync);
 
         rs->target_page_count_prev = rs->target_page_count;
 
@@ -1117,6 +1395,144 @@ void ram_release_page(const char *rbname, uint64_t offset)
     ram_discard_range(rbname, offset, TARGET_PAGE_SIZE);
 }
 
+/*
+ * Zero page detection helpers
+ *
+ * When zero-page-detection-threads is set and multifd is not used, dirty
+ * pages are handed to helper threads in windows of up to
+ * ZERO_PAGE_SCAN_BATCH_MAX pages of the same RAMBlock.  While the
+ * migration thread sends the pages of one window, the helpers check the
+ * next one.  The migration thread still writes every page, in the same
+ * order and format as before.
+ *
+ * The content of a page may only be checked once its dirty log has been
+ * cleared, so that a write racing with the check is caught by the next
+ * bitmap sync and the page is sent again.  For the same reason a window
+ * is only valid for the bitmap sync it was built after.
+ */
+static int zero_scan_window_find(ZeroScanWindow *win, RAMBlock *rb,
+                                 unsigned long page)
+{
+    unsigned int lo = 0, hi = win->batch.num;
+
+    if (win->inflight || win->block != rb || !win->batch.num ||
+        win->generation != stat64_get(&mig_stats.dirty_sync_count)) {
+        return -1;
+    }
+
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+
+        if (win->page[mid] < page) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return (lo < win->batch.num && win->page[lo] == page) ? lo : -1;
+}
+
+static void zero_scan_window_wait(RAMState *rs, ZeroScanWindow *win)
+{
+    if (win->inflight) {
+        zero_page_scan_wait(rs->zero_scan);
+        win->inflight = false;
+    }
+}
+
+/*
+ * Fill @win with the dirty pages of @rb starting at @page, and hand it
+ * to the helpers.  If @first is set, @page is added even though its
+ * dirty bit has already been cleared, because it is being sent.
+ */
+static void zero_scan_window_fill(RAMState *rs, ZeroScanWindow *win,
+                                  RAMBlock *rb, unsigned long page,
+                                  bool first)
+{
+    unsigned long size = rb->used_length >> TARGET_PAGE_BITS;
+    unsigned int num = 0;
+
+    assert(!win->inflight);
+
+    win->block = rb;
+    win->generation = stat64_get(&mig_stats.dirty_sync_count);
+
+    while (num < ZERO_PAGE_SCAN_BATCH_MAX) {
+        if (!first) {
+            page = find_next_bit(rb->bmap, size, page);
+            if (page >= size) {
+                break;
+            }
+        }
+        first = false;
+
+        /* See the comment in migration_bitmap_clear_dirty() */
+        migration_clear_memory_region_dirty_bitmap(rb, page);
+        win->page[num] = page;
+        win->batch.host[num] =
+            rb->host + ((ram_addr_t)page << TARGET_PAGE_BITS);
+        num++;
+        page++;
+    }
+
+    win->batch.num = num;
+    if (num) {
+        zero_page_scan_submit(rs->zero_scan, &win->batch);
+        win->inflight = true;
+    }
+}
+
+static bool zero_scan_page_is_zero(RAMState *rs, RAMBlock *rb,
+                                   unsigned long page)
+{
+    ZeroScanWindow *cur = &rs->zero_window[rs->zero_window_cur];
+    ZeroScanWindow *next = &rs->zero_window[!rs->zero_window_cur];
+    int idx = zero_scan_window_find(cur, rb, page);
+
+    if (idx < 0) {
+        zero_scan_window_wait(rs, next);
+        idx = zero_scan_window_find(next, rb, page);
+        if (idx < 0) {
+            /* Nothing checked in advance for this page, do it now */
+            zero_scan_window_fill(rs, next, rb, page, true);
+            zero_scan_window_wait(rs, next);
+            idx = 0;
+        }
+
+        rs->zero_window_cur = !rs->zero_window_cur;
+        cur = next;
+        next = &rs->zero_window[!rs->zero_window_cur];
+
+        /* Let the helpers check what follows while this window is sent */
+        zero_scan_window_fill(rs, next, rb,
+                              cur->page[cur->batch.num - 1] + 1, false);
+    }
+
+    return cur->batch.zero[idx];
+}
+
+/*
+ * Wait for the helpers to be idle.  Must be called before leaving the RCU
+ * critical section, as they access RAMBlocks.
+ */
+static void zero_scan_drain(RAMState *rs)
+{
+    if (rs->zero_scan) {
+        zero_scan_window_wait(rs, &rs->zero_window[0]);
+        zero_scan_window_wait(rs, &rs->zero_window[1]);
+    }
+}
+
+static bool ram_page_is_zero(RAMState *rs, RAMBlock *rb, ram_addr_t offset)
+{
+    if (rs->zero_scan && !migration_in_postcopy()) {
+        return zero_scan_page_is_zero(rs, rb, offset >> TARGET_PAGE_BITS);
+    }
+
+    return buffer_is_zero(rb->host + offset, TARGET_PAGE_SIZE);
+}
+
 /**
  * save_zero_page: send the zero page to the stream
  *
@@ -1129,7 +1545,6 @@ void ram_release_page(const char *rbname, uint64_t offset)
 static int save_zero_page(RAMState *rs, PageSearchStatus *pss,
                           ram_addr_t offset)
 {
-    uint8_t *p = pss->block->host + offset;
     QEMUFile *file = pss->pss_channel;
     int len = 0;
 
@@ -1137,7 +1552,7 @@ static int save_zero_page(RAMState *rs, PageSearchStatus *pss,
         return 0;
     }
 
-    if (!buffer_is_zero(p, TARGET_PAGE_SIZE)) {
+    if (!ram_page_is_zero(rs, pss->block, offset)) {
         return 0;
     }
 
@@ -1314,6 +1729,16 @@ static int find_dirty_block(RAMState *rs, PageSearchStatus *pss)
          * We've been once around the RAM and haven't found anything.
          * Give up.
          */
+        if (rs->defer_hot &&
+            ram_bytes_remaining() >= migrate_get_current()->threshold_size) {
+            /*
+             * Only hot chunks are left, but too many of them to switch
+             * over.  Send them rather than spin until the next sync.
+             */
+            rs->defer_hot = false;
+            pss->complete_round = false;
+            return PAGE_TRY_AGAIN;
+        }
         return PAGE_ALL_CLEAN;
     }
     if (!offset_in_ramblock(pss->block,
@@ -2327,6 +2752,7 @@ static void xbzrle_load_cleanup(void)
 static void ram_state_cleanup(RAMState **rsp)
 {
     if (*rsp) {
+        zero_page_scan_free((*rsp)->zero_scan);
         migration_page_queue_free(*rsp);
         qemu_mutex_destroy(&(*rsp)->bitmap_mutex);
         qemu_mutex_destroy(&(*rsp)->src_page_req_mutex);
@@ -2362,6 +2788,10 @@ static void ram_bitmaps_destroy(void)
         block->bmap = NULL;
         g_free(block->file_bmap);
         block->file_bmap = NULL;
+        g_free(block->heat);
+        block->heat = NULL;
+        g_free(block->heat_sent);
+        block->heat_sent = NULL;
     }
 }
 
@@ -2400,6 +2830,12 @@ static void ram_state_reset(RAMState *rs)
         rs->pss[i].last_sent_block = NULL;
     }
 
+    /* The windows may point to RAMBlocks that are gone */
+    for (i = 0; i < ARRAY_SIZE(rs->zero_window); i++) {
+        assert(!rs->zero_window[i].inflight);
+        rs->zero_window[i].batch.num = 0;
+    }
+
     rs->last_seen_block = NULL;
     rs->last_page = 0;
     rs->last_version = ram_list.version;
@@ -2711,6 +3147,17 @@ static bool ram_state_init(RAMState **rsp, Error **errp)
     (*rsp)->migration_dirty_pages = (*rsp)->ram_bytes_total >> TARGET_PAGE_BITS;
     ram_state_reset(*rsp);
 
+    /*
+     * Multifd does zero page detection in its own threads, and background
+     * snapshots don't use the dirty log the helpers rely on.
+     */
+    if (migrate_zero_page_detection_threads() && !migrate_multifd() &&
+        !migrate_background_snapshot()) {
+        (*rsp)->zero_scan =
+            zero_page_scan_new(migrate_zero_page_detection_threads(),
+                               TARGET_PAGE_SIZE);
+    }
+
     return true;
 }
 
@@ -2752,6 +3199,16 @@ static void ram_list_init_bitmaps(void)
             }
             block->clear_bmap_shift = shift;
             block->clear_bmap = bitmap_new(clear_bmap_size(pages, shift));
+            block->dirty_pages_period = 0;
+            if (migrate_hot_page_deferral()) {
+                unsigned long chunks;
+
+                block->heat_shift = MAX(HOT_CHUNK_SHIFT_MIN,
+                    ctz64(block->page_size >> TARGET_PAGE_BITS));
+                chunks = DIV_ROUND_UP(pages, 1UL << block->heat_shift);
+                block->heat = g_new0(uint8_t, chunks);
+                block->heat_sent = bitmap_new(chunks);
+            }
         }
     }
 }
@@ -3194,6 +3651,7 @@ static int ram_save_iterate(QEMUFile *f, void *opaque)
                 }
                 i++;
             }
+            zero_scan_drain(rs);
         }
     }
 
@@ -3270,10 +3728,12 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
                 break;
             }
             if (pages < 0) {
+                zero_scan_drain(rs);
                 qemu_mutex_unlock(&rs->bitmap_mutex);
                 return pages;
             }
         }
+        zero_scan_drain(rs);
         qemu_mutex_unlock(&rs->bitmap_mutex);
 
         ret = rdma_registration_stop(f, RAM_CONTROL_FINISH);
@@ -3938,6 +4398,13 @@ static bool read_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
             if (migrate_multifd()) {
                 read = ram_load_multifd_pages(host, size,
                                               block->pages_offset + offset);
+            } else if (file_load_enabled()) {
+                if (!file_load_queue(host, size,
+                                     block->pages_offset + offset)) {
+                    /* The error is reported when waiting for the reads */
+                    return true;
+                }
+                read = size;
             } else {
                 read = qemu_get_buffer_at(f, host, size,
                                           block->pages_offset + offset);
@@ -4201,17 +4668,39 @@ static int ram_load_precopy(QEMUFile *f)
 
         switch (flags & ~RAM_SAVE_FLAG_CONTINUE) {
         case RAM_SAVE_FLAG_MEM_SIZE:
+            if (migrate_mapped_ram() && !migrate_multifd() &&
+                migrate_mapped_ram_load_threads()) {
+                Error *local_err = NULL;
+
+                if (!file_load_setup(qemu_file_get_ioc(f),
+                                     migrate_mapped_ram_load_threads(),
+                                     &local_err)) {
+                    error_report_err(local_err);
+                    ret = -EINVAL;
+                    break;
+                }
+            }
             ret = parse_ramblocks(f, addr);
             /*
              * For mapped-ram migration (to a file) using multifd, we sync
              * once and for all here to make sure all tasks we queued to
              * multifd threads are completed, so that all the ramblocks
              * (including all the guest memory pages within) are fully
-             * loaded after this sync returns.
+             * loaded after this sync returns.  The same goes for the
+             * reads queued to the load threads without multifd.
              */
             if (migrate_mapped_ram()) {
                 multifd_recv_sync_main();
             }
+            if (file_load_enabled()) {
+                Error *local_err = NULL;
+
+                if (!file_load_wait(&local_err)) {
+                    error_report_err(local_err);
+                    ret = -EIO;
+                }
+                file_load_cleanup();
+            }
             break;
 
         case RAM_SAVE_FLAG_ZERO:
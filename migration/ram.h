@@ -48,6 +48,8 @@ int xbzrle_cache_resize(uint64_t new_size, Error **errp);
 uint64_t ram_bytes_remaining(void);
 uint64_t ram_bytes_total(void);
 void mig_throttle_counter_reset(void);
+bool ram_predict_switchover(double bw_per_ms, uint64_t threshold,
+                            SwitchoverPrediction *pred);
 
 uint64_t ram_pagesize_summary(void);
 int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len,
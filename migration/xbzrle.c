@@ -13,153 +13,17 @@
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
 #include "qemu/host-utils.h"
-#include "xbzrle.h"
-
-#if defined(CONFIG_AVX512BW_OPT)
-#include <immintrin.h>
+#include "qemu/bswap.h"
 #include "host/cpuinfo.h"
+#include "xbzrle.h"
 
-static int __attribute__((target("avx512bw")))
-xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                            uint8_t *dst, int dlen)
-{
-    uint32_t zrun_len = 0, nzrun_len = 0;
-    int d = 0, i = 0, num = 0;
-    uint8_t *nzrun_start = NULL;
-    /* add 1 to include residual part in main loop */
-    uint32_t count512s = (slen >> 6) + 1;
-    /* countResidual is tail of data, i.e., countResidual = slen % 64 */
-    uint32_t count_residual = slen & 0b111111;
-    bool never_same = true;
-    uint64_t mask_residual = 1;
-    mask_residual <<= count_residual;
-    mask_residual -= 1;
-    __m512i r = _mm512_set1_epi32(0);
-
-    while (count512s) {
-        int bytes_to_check = 64;
-        uint64_t mask = 0xffffffffffffffff;
-        if (count512s == 1) {
-            bytes_to_check = count_residual;
-            mask = mask_residual;
-        }
-        __m512i old_data = _mm512_mask_loadu_epi8(r,
-                                                  mask, old_buf + i);
-        __m512i new_data = _mm512_mask_loadu_epi8(r,
-                                                  mask, new_buf + i);
-        uint64_t comp = _mm512_cmpeq_epi8_mask(old_data, new_data);
-        count512s--;
-
-        bool is_same = (comp & 0x1);
-        while (bytes_to_check) {
-            if (d + 2 > dlen) {
-                return -1;
-            }
-            if (is_same) {
-                if (nzrun_len) {
-                    d += uleb128_encode_small(dst + d, nzrun_len);
-                    if (d + nzrun_len > dlen) {
-                        return -1;
-                    }
-                    nzrun_start = new_buf + i - nzrun_len;
-                    memcpy(dst + d, nzrun_start, nzrun_len);
-                    d += nzrun_len;
-                    nzrun_len = 0;
-                }
-                /* 64 data at a time for speed */
-                if (count512s && (comp == 0xffffffffffffffff)) {
-                    i += 64;
-                    zrun_len += 64;
-                    break;
-                }
-                never_same = false;
-                num = ctz64(~comp);
-                num = (num < bytes_to_check) ? num : bytes_to_check;
-                zrun_len += num;
-                bytes_to_check -= num;
-                comp >>= num;
-                i += num;
-                if (bytes_to_check) {
-                    /* still has different data after same data */
-                    d += uleb128_encode_small(dst + d, zrun_len);
-                    zrun_len = 0;
-                } else {
-                    break;
-                }
-            }
-            if (never_same || zrun_len) {
-                /*
-                 * never_same only acts if
-                 * data begins with diff in first count512s
-                 */
-                d += uleb128_encode_small(dst + d, zrun_len);
-                zrun_len = 0;
-                never_same = false;
-            }
-            /* has diff, 64 data at a time for speed */
-            if ((bytes_to_check == 64) && (comp == 0x0)) {
-                i += 64;
-                nzrun_len += 64;
-                break;
-            }
-            num = ctz64(comp);
-            num = (num < bytes_to_check) ? num : bytes_to_check;
-            nzrun_len += num;
-            bytes_to_check -= num;
-            comp >>= num;
-            i += num;
-            if (bytes_to_check) {
-                /* mask like 111000 */
-                d += uleb128_encode_small(dst + d, nzrun_len);
-                /* overflow */
-                if (d + nzrun_len > dlen) {
-                    return -1;
-                }
-                nzrun_start = new_buf + i - nzrun_len;
-                memcpy(dst + d, nzrun_start, nzrun_len);
-                d += nzrun_len;
-                nzrun_len = 0;
-                is_same = true;
-            }
-        }
-    }
-
-    if (nzrun_len != 0) {
-        d += uleb128_encode_small(dst + d, nzrun_len);
-        /* overflow */
-        if (d + nzrun_len > dlen) {
-            return -1;
-        }
-        nzrun_start = new_buf + i - nzrun_len;
-        memcpy(dst + d, nzrun_start, nzrun_len);
-        d += nzrun_len;
-    }
-    return d;
-}
-
-static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
-                                    int slen, uint8_t *dst, int dlen);
-
-static int (*accel_func)(uint8_t *, uint8_t *, int, uint8_t *, int);
-
-static void __attribute__((constructor)) init_accel(void)
-{
-    unsigned info = cpuinfo_init();
-    if (info & CPUINFO_AVX512BW) {
-        accel_func = xbzrle_encode_buffer_avx512;
-    } else {
-        accel_func = xbzrle_encode_buffer_int;
-    }
-}
-
-int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                         uint8_t *dst, int dlen)
-{
-    return accel_func(old_buf, new_buf, slen, dst, dlen);
-}
+typedef int (*xbzrle_encode_fn)(uint8_t *, uint8_t *, int, uint8_t *, int);
+typedef int (*xbzrle_decode_fn)(uint8_t *, int, uint8_t *, int);
 
-#define xbzrle_encode_buffer xbzrle_encode_buffer_int
-#endif
+typedef struct XbzrleAccel {
+    xbzrle_encode_fn encode;
+    xbzrle_decode_fn decode;
+} XbzrleAccel;
 
 /*
   page = zrun nzrun
@@ -171,8 +35,8 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
 
   length = uleb128 encoded integer
  */
-int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                         uint8_t *dst, int dlen)
+static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
+                                    int slen, uint8_t *dst, int dlen)
 {
     uint32_t zrun_len = 0, nzrun_len = 0;
     int d = 0, i = 0;
@@ -273,7 +137,8 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
     return d;
 }
 
-int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen)
+static int xbzrle_decode_buffer_int(uint8_t *src, int slen, uint8_t *dst,
+                                    int dlen)
 {
     int i = 0, d = 0;
     int ret;
@@ -321,3 +186,226 @@ int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen)
 
     return d;
 }
+
+/*
+ * Building blocks for the vectorized versions.  @eqmask compares 64 bytes
+ * of both buffers and returns a mask with bit n set if byte n is equal.
+ */
+typedef uint64_t (*xbzrle_eqmask_fn)(const uint8_t *a, const uint8_t *b);
+
+/* @copy copies a short nzrun of @len bytes from @src to @dst. */
+typedef void (*xbzrle_copy_fn)(uint8_t *dst, const uint8_t *src, int len);
+
+/* Inline versions of uleb128_{en,de}code_small() for the hot loops */
+static inline QEMU_ALWAYS_INLINE int xbzrle_uleb_encode(uint8_t *out,
+                                                        uint32_t n)
+{
+    g_assert(n <= 0x3fff);
+    if (n < 0x80) {
+        *out = n;
+        return 1;
+    }
+    out[0] = (n & 0x7f) | 0x80;
+    out[1] = n >> 7;
+    return 2;
+}
+
+static inline QEMU_ALWAYS_INLINE int xbzrle_uleb_decode(const uint8_t *in,
+                                                        uint32_t *n)
+{
+    if (likely(!(in[0] & 0x80))) {
+        *n = in[0];
+        return 1;
+    }
+    /* we exceed 14 bit number */
+    if (in[1] & 0x80) {
+        return -1;
+    }
+    *n = (in[0] & 0x7f) | (in[1] << 7);
+    return 2;
+}
+
+/*
+ * Length of the run of equal (or different, if !@same) bytes at @i.  The
+ * mask of the 64-byte block being looked at is cached in @mask/@base, as
+ * consecutive runs are often within the same block.
+ */
+static inline QEMU_ALWAYS_INLINE int
+xbzrle_run_length(const uint8_t *old_buf, const uint8_t *new_buf, int i,
+                  int slen, bool same, uint64_t *mask, int *base,
+                  xbzrle_eqmask_fn eqmask)
+{
+    int start = i;
+
+    while (i < slen) {
+        int block = i & ~63;
+        uint64_t bits;
+        int len;
+
+        if (block + 64 > slen) {
+            /* tail */
+            while (i < slen && (old_buf[i] == new_buf[i]) == same) {
+                i++;
+            }
+            break;
+        }
+
+        if (block != *base) {
+            *mask = eqmask(old_buf + block, new_buf + block);
+            *base = block;
+        }
+
+        bits = (same ? *mask : ~*mask) >> (i - block);
+        len = ctz64(~bits);
+        i += len;
+        if (i < block + 64) {
+            break;
+        }
+    }
+
+    return i - start;
+}
+
+static inline QEMU_ALWAYS_INLINE int
+xbzrle_encode_vector(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                     uint8_t *dst, int dlen, xbzrle_eqmask_fn eqmask)
+{
+    int d = 0, i = 0, len, base = -1;
+    uint64_t mask = 0;
+
+    while (i < slen) {
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        len = xbzrle_run_length(old_buf, new_buf, i, slen, true,
+                                &mask, &base, eqmask);
+
+        /* buffer unchanged */
+        if (len == slen) {
+            return 0;
+        }
+
+        i += len;
+
+        /* skip last zero run */
+        if (i == slen) {
+            return d;
+        }
+
+        d += xbzrle_uleb_encode(dst + d, len);
+
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        len = xbzrle_run_length(old_buf, new_buf, i, slen, false,
+                                &mask, &base, eqmask);
+        d += xbzrle_uleb_encode(dst + d, len);
+
+        /* overflow */
+        if (d + len > dlen) {
+            return -1;
+        }
+        memcpy(dst + d, new_buf + i, len);
+        d += len;
+        i += len;
+    }
+
+    return d;
+}
+
+/*
+ * Same as xbzrle_decode_buffer_int(), but nzruns of up to @width bytes
+ * are copied inline with @copy instead of calling memcpy().  If @overrun,
+ * @copy may load and store back @width bytes even when copying less, so
+ * it is only used when @width bytes fit in both buffers.
+ */
+static inline QEMU_ALWAYS_INLINE int
+xbzrle_decode_vector(uint8_t *src, int slen, uint8_t *dst, int dlen,
+                     xbzrle_copy_fn copy, int width, bool overrun)
+{
+    int i = 0, d = 0;
+    int ret;
+    uint32_t count = 0;
+
+    while (i < slen) {
+
+        /* zrun */
+        if ((slen - i) < 2) {
+            return -1;
+        }
+
+        ret = xbzrle_uleb_decode(src + i, &count);
+        if (ret < 0 || (i && !count)) {
+            return -1;
+        }
+        i += ret;
+        d += count;
+
+        /* overflow */
+        if (d > dlen) {
+            return -1;
+        }
+
+        /* nzrun */
+        if ((slen - i) < 2) {
+            return -1;
+        }
+
+        ret = xbzrle_uleb_decode(src + i, &count);
+        if (ret < 0 || !count) {
+            return -1;
+        }
+        i += ret;
+
+        /* overflow */
+        if (d + count > dlen || i + count > slen) {
+            return -1;
+        }
+
+        if (count <= width &&
+            (!overrun || (i + width <= slen && d + width <= dlen))) {
+            copy(dst + d, src + i, count);
+        } else {
+            memcpy(dst + d, src + i, count);
+        }
+        d += count;
+        i += count;
+    }
+
+    return d;
+}
+
+#include "host/xbzrle.c.inc"
+
+static const XbzrleAccel *xbzrle_accel;
+static unsigned accel_index;
+
+int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                         uint8_t *dst, int dlen)
+{
+    return xbzrle_accel->encode(old_buf, new_buf, slen, dst, dlen);
+}
+
+int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen)
+{
+    return xbzrle_accel->decode(src, slen, dst, dlen);
+}
+
+bool test_xbzrle_next_accel(void)
+{
+    if (accel_index != 0) {
+        xbzrle_accel = &accel_table[--accel_index];
+        return true;
+    }
+    return false;
+}
+
+static void __attribute__((constructor)) init_accel(void)
+{
+    accel_index = best_accel();
+    xbzrle_accel = &accel_table[accel_index];
+}
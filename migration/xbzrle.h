@@ -19,4 +19,10 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
 
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen);
 
+/*
+ * For tests and benchmarks: switch to the next slower implementation,
+ * return false if the plain C one is already in use.
+ */
+bool test_xbzrle_next_accel(void);
+
 #endif
@@ -0,0 +1,163 @@
+/*
+ * Zero page detection helper threads for precopy migration
+ *
+ * Without multifd every page goes through buffer_is_zero() on the
+ * migration thread before it is written to the stream.  The helpers
+ * below take a batch of dirty pages, split it in contiguous slices and
+ * check them in parallel, so that the migration thread only has to
+ * look up the verdict when it gets to the page.  The stream itself is
+ * still produced by the migration thread, in the same format.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "qemu/thread.h"
+#include "zero-page-scan.h"
+#include "trace.h"
+
+typedef struct ZeroPageScanThread {
+    ZeroPageScan *zps;
+    QemuThread thread;
+    /* Posted when a new slice is ready, or when the thread should quit */
+    QemuSemaphore sem;
+    /* Slice of the current batch owned by this thread, [start, end) */
+    unsigned int start;
+    unsigned int end;
+    char *name;
+} ZeroPageScanThread;
+
+struct ZeroPageScan {
+    size_t page_size;
+    unsigned int nr_threads;
+    ZeroPageScanThread *threads;
+    /* Posted by each helper once its slice is done */
+    QemuSemaphore sem_done;
+    /* Batch in flight, NULL if none */
+    ZeroPageScanBatch *batch;
+    /* Number of helpers working on @batch */
+    unsigned int busy;
+    bool quit;
+};
+
+static void *zero_page_scan_thread(void *opaque)
+{
+    ZeroPageScanThread *t = opaque;
+    ZeroPageScan *zps = t->zps;
+
+    while (true) {
+        ZeroPageScanBatch *batch;
+        unsigned int i;
+
+        qemu_sem_wait(&t->sem);
+        if (qatomic_read(&zps->quit)) {
+            break;
+        }
+
+        /* Pairs with qatomic_store_release() in zero_page_scan_submit() */
+        batch = qatomic_load_acquire(&zps->batch);
+        for (i = t->start; i < t->end; i++) {
+            batch->zero[i] = buffer_is_zero(batch->host[i], zps->page_size);
+        }
+
+        /* qemu_sem_post() implies the barrier that publishes batch->zero */
+        qemu_sem_post(&zps->sem_done);
+    }
+
+    return NULL;
+}
+
+ZeroPageScan *zero_page_scan_new(unsigned int nr_threads, size_t page_size)
+{
+    ZeroPageScan *zps = g_new0(ZeroPageScan, 1);
+    unsigned int i;
+
+    assert(nr_threads);
+
+    zps->page_size = page_size;
+    zps->nr_threads = nr_threads;
+    zps->threads = g_new0(ZeroPageScanThread, nr_threads);
+    qemu_sem_init(&zps->sem_done, 0);
+
+    for (i = 0; i < nr_threads; i++) {
+        ZeroPageScanThread *t = &zps->threads[i];
+
+        t->zps = zps;
+        t->name = g_strdup_printf("mig/src/zero_%u", i);
+        qemu_sem_init(&t->sem, 0);
+        qemu_thread_create(&t->thread, t->name, zero_page_scan_thread, t,
+                           QEMU_THREAD_JOINABLE);
+    }
+
+    trace_zero_page_scan_new(nr_threads);
+    return zps;
+}
+
+void zero_page_scan_free(ZeroPageScan *zps)
+{
+    unsigned int i;
+
+    if (!zps) {
+        return;
+    }
+
+    zero_page_scan_wait(zps);
+
+    qatomic_set(&zps->quit, true);
+    for (i = 0; i < zps->nr_threads; i++) {
+        qemu_sem_post(&zps->threads[i].sem);
+    }
+
+    for (i = 0; i < zps->nr_threads; i++) {
+        ZeroPageScanThread *t = &zps->threads[i];
+
+        qemu_thread_join(&t->thread);
+        qemu_sem_destroy(&t->sem);
+        g_free(t->name);
+    }
+
+    qemu_sem_destroy(&zps->sem_done);
+    g_free(zps->threads);
+    g_free(zps);
+}
+
+void zero_page_scan_submit(ZeroPageScan *zps, ZeroPageScanBatch *batch)
+{
+    unsigned int i, start = 0;
+    unsigned int slice;
+
+    assert(!zps->batch);
+    assert(batch->num && batch->num <= ZERO_PAGE_SCAN_BATCH_MAX);
+
+    /* Don't wake up helpers for slices of less than 8 pages */
+    slice = MAX(DIV_ROUND_UP(batch->num, zps->nr_threads), 8);
+
+    qatomic_store_release(&zps->batch, batch);
+    zps->busy = 0;
+    for (i = 0; i < zps->nr_threads && start < batch->num; i++) {
+        ZeroPageScanThread *t = &zps->threads[i];
+
+        t->start = start;
+        t->end = MIN(start + slice, batch->num);
+        start = t->end;
+        zps->busy++;
+        qemu_sem_post(&t->sem);
+    }
+
+    trace_zero_page_scan_submit(batch->num, zps->busy);
+}
+
+void zero_page_scan_wait(ZeroPageScan *zps)
+{
+    if (!zps->batch) {
+        return;
+    }
+
+    while (zps->busy) {
+        qemu_sem_wait(&zps->sem_done);
+        zps->busy--;
+    }
+    zps->batch = NULL;
+}
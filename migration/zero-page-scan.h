@@ -0,0 +1,64 @@
+/*
+ * Zero page detection helper threads for precopy migration
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_ZERO_PAGE_SCAN_H
+#define QEMU_MIGRATION_ZERO_PAGE_SCAN_H
+
+/* Maximum number of pages checked by the helper threads in one go */
+#define ZERO_PAGE_SCAN_BATCH_MAX 256
+
+typedef struct ZeroPageScan ZeroPageScan;
+
+typedef struct ZeroPageScanBatch {
+    /* Number of valid entries in @host and @zero */
+    unsigned int num;
+    /* Host addresses of the pages to check */
+    void *host[ZERO_PAGE_SCAN_BATCH_MAX];
+    /* Whether the page was found to be zero, valid once the batch completed */
+    bool zero[ZERO_PAGE_SCAN_BATCH_MAX];
+} ZeroPageScanBatch;
+
+/**
+ * zero_page_scan_new: create a pool of zero page detection threads
+ *
+ * Returns the new pool.
+ *
+ * @nr_threads: number of helper threads, must be at least one
+ * @page_size: size of each page handed to the pool
+ */
+ZeroPageScan *zero_page_scan_new(unsigned int nr_threads, size_t page_size);
+
+/**
+ * zero_page_scan_free: stop the helper threads and free the pool
+ *
+ * Any batch still in flight is waited for first.
+ *
+ * @zps: pool to free, may be NULL
+ */
+void zero_page_scan_free(ZeroPageScan *zps);
+
+/**
+ * zero_page_scan_submit: split a batch between the helper threads
+ *
+ * Only one batch can be in flight at a time; the caller must not
+ * touch @batch until zero_page_scan_wait() returned.
+ *
+ * @zps: the pool
+ * @batch: pages to check, with @batch->num > 0
+ */
+void zero_page_scan_submit(ZeroPageScan *zps, ZeroPageScanBatch *batch);
+
+/**
+ * zero_page_scan_wait: wait for the batch in flight to complete
+ *
+ * Returns immediately if nothing was submitted.
+ *
+ * @zps: the pool
+ */
+void zero_page_scan_wait(ZeroPageScan *zps);
+
+#endif
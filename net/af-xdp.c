@@ -28,6 +28,12 @@
 #include "qemu/main-loop.h"
 #include "qemu/memalign.h"
 
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET 70
+#endif
 
 typedef struct AFXDPState {
     NetClientState       nc;
@@ -52,6 +58,8 @@ typedef struct AFXDPState {
     uint32_t             n_queues;
     uint32_t             xdp_flags;
     bool                 inhibit;
+    bool                 busy_poll;
+    AioContext           *ctx;    /* runs the fd handlers */
 } AFXDPState;
 
 #define AF_XDP_BATCH_SIZE 64
@@ -59,13 +67,60 @@ typedef struct AFXDPState {
 static void af_xdp_send(void *opaque);
 static void af_xdp_writable(void *opaque);
 
+static bool af_xdp_ring_empty(struct xsk_ring_cons *r)
+{
+    return qatomic_load_acquire(r->producer) == qatomic_read(r->consumer);
+}
+
+/*
+ * Polling handler, used when the queue is processed by an IOThread of
+ * the peer.  Look at the rings that the fd handlers are waiting for, and
+ * with busy-poll, run the NAPI context of the queue instead of waiting
+ * for an interrupt.
+ */
+static bool af_xdp_io_poll(void *opaque)
+{
+    AFXDPState *s = opaque;
+    int fd = xsk_socket__fd(s->xsk);
+
+    if ((s->read_poll && !af_xdp_ring_empty(&s->rx)) ||
+        (s->write_poll && !af_xdp_ring_empty(&s->cq))) {
+        return true;
+    }
+
+    if (s->busy_poll) {
+        /* Tx is kicked by polling the fd, which is skipped while polling */
+        if (s->write_poll && xsk_ring_prod__needs_wakeup(&s->tx)) {
+            sendto(fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+        }
+        recvfrom(fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+    }
+    return false;
+}
+
+static void af_xdp_io_poll_ready(void *opaque)
+{
+    AFXDPState *s = opaque;
+
+    if (s->write_poll) {
+        af_xdp_writable(s);
+    }
+    if (s->read_poll) {
+        af_xdp_send(s);
+    }
+}
+
 /* Set the event-loop handlers for the af-xdp backend. */
 static void af_xdp_update_fd_handler(AFXDPState *s)
 {
-    qemu_set_fd_handler(xsk_socket__fd(s->xsk),
-                        s->read_poll ? af_xdp_send : NULL,
-                        s->write_poll ? af_xdp_writable : NULL,
-                        s);
+    bool poll = s->read_poll || s->write_poll;
+
+    aio_set_fd_handler(s->ctx, xsk_socket__fd(s->xsk),
+                       s->read_poll ? af_xdp_send : NULL,
+                       s->write_poll ? af_xdp_writable : NULL,
+                       poll ? af_xdp_io_poll : NULL,
+                       poll ? af_xdp_io_poll_ready : NULL,
+                       s);
 }
 
 /* Update the read handler. */
@@ -97,6 +152,21 @@ static void af_xdp_poll(NetClientState *nc, bool enable)
     }
 }
 
+/*
+ * Move the fd handlers to the AioContext where the peer processes this
+ * queue, so that packets go to and from the peer in that thread.
+ */
+static bool af_xdp_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+
+    aio_set_fd_handler(s->ctx, xsk_socket__fd(s->xsk),
+                       NULL, NULL, NULL, NULL, NULL);
+    s->ctx = ctx ?: iohandler_get_aio_context();
+    af_xdp_update_fd_handler(s);
+    return true;
+}
+
 static void af_xdp_complete_tx(AFXDPState *s)
 {
     uint32_t idx = 0;
@@ -393,6 +463,24 @@ static int af_xdp_socket_create(AFXDPState *s,
 
     s->xdp_flags = cfg.xdp_flags;
 
+    if (opts->has_busy_poll && opts->busy_poll) {
+        int fd = xsk_socket__fd(s->xsk);
+        int prefer = 1, usecs = opts->busy_poll, budget = AF_XDP_BATCH_SIZE;
+
+        if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL,
+                       &prefer, sizeof(prefer)) ||
+            setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL,
+                       &usecs, sizeof(usecs)) ||
+            setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET,
+                       &budget, sizeof(budget))) {
+            error_setg_errno(errp, errno,
+                             "failed to enable busy polling for %s "
+                             "queue_id: %d", s->ifname, queue_id);
+            return -1;
+        }
+        s->busy_poll = true;
+    }
+
     return 0;
 }
 
@@ -403,6 +491,7 @@ static NetClientInfo net_af_xdp_info = {
     .receive = af_xdp_receive,
     .poll = af_xdp_poll,
     .cleanup = af_xdp_cleanup,
+    .set_aio_context = af_xdp_set_aio_context,
 };
 
 static int *parse_socket_fds(const char *sock_fds_str,
@@ -470,6 +559,12 @@ int net_init_af_xdp(const Netdev *netdev,
         return -1;
     }
 
+    if (opts->has_busy_poll && opts->busy_poll > INT_MAX) {
+        error_setg(errp, "'busy-poll' must not be more than %d microseconds",
+                   INT_MAX);
+        return -1;
+    }
+
     if (opts->sock_fds) {
         sock_fds = parse_socket_fds(opts->sock_fds, queues, errp);
         if (!sock_fds) {
@@ -491,6 +586,7 @@ int net_init_af_xdp(const Netdev *netdev,
         pstrcpy(s->ifname, sizeof(s->ifname), opts->ifname);
         s->ifindex = ifindex;
         s->n_queues = queues;
+        s->ctx = iohandler_get_aio_context();
 
         if (af_xdp_umem_create(s, sock_fds ? sock_fds[i] : -1, errp)
             || af_xdp_socket_create(s, opts, errp)) {
@@ -499,6 +595,8 @@ int net_init_af_xdp(const Netdev *netdev,
             error_propagate(errp, err);
             goto err;
         }
+
+        af_xdp_read_poll(s, true); /* Initially only poll for reads. */
     }
 
     if (nc0) {
@@ -511,8 +609,6 @@ int net_init_af_xdp(const Netdev *netdev,
         }
     }
 
-    af_xdp_read_poll(s, true); /* Initially only poll for reads. */
-
     return 0;
 
 err:
@@ -164,7 +164,11 @@ static void qemu_announce_self_iter(NICState *nic, void *opaque)
     if (!skip) {
         len = announce_self_create(buf, nic->conf->macaddr.a);
 
-        qemu_send_packet_raw(qemu_get_queue(nic), buf, len);
+        if (nic->ncs->info->send_announce) {
+            nic->ncs->info->send_announce(qemu_get_queue(nic), buf, len);
+        } else {
+            qemu_send_packet_raw(qemu_get_queue(nic), buf, len);
+        }
 
         /* if the NIC provides it's own announcement support, use it as well */
         if (nic->ncs->info->announce) {
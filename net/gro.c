@@ -0,0 +1,448 @@
+/*
+ * Generic receive offload for emulated NICs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/*
+ * Emulated NICs without receive segment coalescing take a DMA transfer,
+ * a descriptor write back and often an interrupt for each frame.  When a
+ * NIC enables GRO with qemu_set_gro(), the TCP segments that arrive in
+ * the same main loop iteration are kept in a small flow table instead,
+ * and the consecutive data segments of each flow are merged into a single
+ * frame, up to the largest frame that the guest accepts.  The frames are
+ * delivered from a bottom half, when the backend is done with its burst.
+ *
+ * Only segments with no flags other than ACK and PSH are merged, and only
+ * if the IP and TCP headers match except for the lengths, sequence number
+ * and checksums.  Any other segment of a flow flushes it first, and other
+ * frames are delivered right away.  UDP datagrams are never merged, since
+ * the guest could not tell them apart again without GSO support.
+ *
+ * The checksums of a merged frame are computed again, so the segments must
+ * have valid checksums, or a virtio-net header that says so.  The virtio-net
+ * header only covers the TCP checksum: the IPv4 header checksum is always
+ * verified.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/iov.h"
+#include "qemu/main-loop.h"
+#include "net/checksum.h"
+#include "net/eth.h"
+#include "net/gro.h"
+#include "standard-headers/linux/virtio_net.h"
+
+#define NET_GRO_MAX_FLOWS 8
+
+#define NET_GRO_MAX_VNET_HDR_LEN sizeof(struct virtio_net_hdr_v1_hash)
+#define NET_GRO_MAX_HDR_LEN (NET_GRO_MAX_VNET_HDR_LEN + ETH_HLEN + \
+                             sizeof(struct ip6_header) + 60)
+
+typedef struct NetGroKey {
+    uint8_t eth[ETH_HLEN];
+    uint8_t addrs[2 * sizeof(struct in6_address)];
+    uint8_t ports[4];
+} NetGroKey;
+
+typedef struct NetGroSegment {
+    NetGroKey key;
+    /* Headers, starting with the virtio-net header */
+    uint8_t hdr[NET_GRO_MAX_HDR_LEN];
+    bool ip6;
+    size_t l3_off;
+    size_t l4_off;
+    size_t payload_off;
+    size_t end;             /* of the IP datagram */
+    uint32_t seq;
+    uint8_t flags;
+    bool mergeable;
+} NetGroSegment;
+
+typedef struct NetGroFlow {
+    NetGroKey key;
+    /* The first frame, followed by the payload of the others */
+    uint8_t *buf;
+    size_t len;
+    bool ip6;
+    size_t l3_off;
+    size_t l4_off;
+    size_t payload_off;
+    size_t end;
+    uint32_t next_seq;
+    unsigned segs;
+} NetGroFlow;
+
+struct NetGro {
+    NetQueueDeliverFunc *deliver;
+    void *opaque;
+    QEMUBH *bh;
+
+    size_t vnet_hdr_len;
+    size_t max_frame;
+
+    /* In the order of their first segment */
+    NetGroFlow flows[NET_GRO_MAX_FLOWS];
+    unsigned n_flows;
+};
+
+static uint16_t net_gro_tcp_checksum(bool ip6, uint8_t *addrs,
+                                     uint8_t *tcp, size_t len)
+{
+    uint32_t sum = net_checksum_add(len, tcp);
+
+    sum += net_checksum_add(ip6 ? 32 : 8, addrs);
+    sum += IP_PROTO_TCP + len;
+    return net_checksum_finish(sum);
+}
+
+static bool net_gro_checksum_ok(NetGro *gro, NetGroSegment *seg,
+                                const struct iovec *iov, int iovcnt)
+{
+    size_t len = seg->end - seg->l4_off;
+    uint32_t sum;
+
+    if (gro->vnet_hdr_len) {
+        struct virtio_net_hdr *vhdr = (struct virtio_net_hdr *)seg->hdr;
+
+        if (vhdr->gso_type != VIRTIO_NET_HDR_GSO_NONE) {
+            return false;
+        }
+        if (vhdr->flags & (VIRTIO_NET_HDR_F_NEEDS_CSUM |
+                           VIRTIO_NET_HDR_F_DATA_VALID)) {
+            return true;
+        }
+    }
+
+    sum = net_checksum_add_iov(iov, iovcnt, seg->l4_off, len, 0);
+    sum += net_checksum_add(seg->ip6 ? 32 : 8, seg->key.addrs);
+    sum += IP_PROTO_TCP + len;
+    return net_checksum_finish(sum) == 0;
+}
+
+/* Returns false if the frame is not a TCP segment */
+static bool net_gro_parse(NetGro *gro, const struct iovec *iov, int iovcnt,
+                          size_t size, NetGroSegment *seg)
+{
+    size_t l3_off = gro->vnet_hdr_len + ETH_HLEN;
+    size_t hdr_len = iov_to_buf(iov, iovcnt, 0, seg->hdr, sizeof(seg->hdr));
+    struct eth_header *eth = (struct eth_header *)(seg->hdr +
+                                                   gro->vnet_hdr_len);
+    tcp_header *tcp;
+    size_t tcp_len;
+    bool ip_csum_ok = true;
+
+    memset(&seg->key, 0, sizeof(seg->key));
+    if (hdr_len < l3_off + sizeof(struct ip_header)) {
+        return false;
+    }
+
+    switch (lduw_be_p(&eth->h_proto)) {
+    case ETH_P_IP: {
+        struct ip_header *ip = (struct ip_header *)(seg->hdr + l3_off);
+
+        /* No options and no fragments */
+        if (ip->ip_ver_len != 0x45 || IP4_IS_FRAGMENT(ip) ||
+            ip->ip_p != IP_PROTO_TCP) {
+            return false;
+        }
+        ip_csum_ok = net_raw_checksum((uint8_t *)ip, sizeof(*ip)) == 0;
+        seg->ip6 = false;
+        seg->l4_off = l3_off + sizeof(*ip);
+        seg->end = l3_off + lduw_be_p(&ip->ip_len);
+        memcpy(seg->key.addrs, &ip->ip_src, 8);
+        break;
+    }
+    case ETH_P_IPV6: {
+        struct ip6_header *ip6 = (struct ip6_header *)(seg->hdr + l3_off);
+
+        /* No extension headers */
+        if (hdr_len < l3_off + sizeof(*ip6) ||
+            (ip6->ip6_ctlun.ip6_un2_vfc >> 4) != IP_HEADER_VERSION_6 ||
+            ip6->ip6_nxt != IP_PROTO_TCP) {
+            return false;
+        }
+        seg->ip6 = true;
+        seg->l4_off = l3_off + sizeof(*ip6);
+        seg->end = seg->l4_off + lduw_be_p(&ip6->ip6_plen);
+        memcpy(seg->key.addrs, &ip6->ip6_src, 32);
+        break;
+    }
+    default:
+        return false;
+    }
+
+    if (hdr_len < seg->l4_off + sizeof(tcp_header) || seg->end > size) {
+        return false;
+    }
+    tcp = (tcp_header *)(seg->hdr + seg->l4_off);
+    tcp_len = TCP_HEADER_DATA_OFFSET(tcp);
+    if (tcp_len < sizeof(tcp_header) ||
+        seg->l4_off + tcp_len > MIN(hdr_len, seg->end)) {
+        return false;
+    }
+
+    memcpy(seg->key.eth, eth, ETH_HLEN);
+    memcpy(seg->key.ports, &tcp->th_sport, 4);
+    seg->l3_off = l3_off;
+    seg->payload_off = seg->l4_off + tcp_len;
+    seg->seq = ldl_be_p(&tcp->th_seq);
+    seg->flags = lduw_be_p(&tcp->th_offset_flags) & 0xff;
+    seg->mergeable = (seg->flags & ~TH_PUSH) == TH_ACK &&
+                     seg->payload_off < seg->end && ip_csum_ok &&
+                     net_gro_checksum_ok(gro, seg, iov, iovcnt);
+    return true;
+}
+
+static bool net_gro_can_merge(NetGro *gro, NetGroFlow *flow,
+                              NetGroSegment *seg)
+{
+    size_t payload = seg->end - seg->payload_off;
+    const uint8_t *l3 = flow->buf + flow->l3_off;
+    const uint8_t *l4 = flow->buf + flow->l4_off;
+
+    if (!seg->mergeable || seg->seq != flow->next_seq ||
+        seg->payload_off != flow->payload_off ||
+        flow->end + payload > gro->vnet_hdr_len + gro->max_frame ||
+        flow->end + payload - flow->l3_off > ETH_MAX_IP_DGRAM_LEN) {
+        return false;
+    }
+
+    if (flow->ip6) {
+        /* Traffic class, flow label and hop limit */
+        if (memcmp(l3, seg->hdr + seg->l3_off, 4) ||
+            l3[7] != seg->hdr[seg->l3_off + 7]) {
+            return false;
+        }
+    } else {
+        const struct ip_header *ip = (const struct ip_header *)l3;
+        const struct ip_header *seg_ip =
+            (const struct ip_header *)(seg->hdr + seg->l3_off);
+
+        if (ip->ip_tos != seg_ip->ip_tos || ip->ip_ttl != seg_ip->ip_ttl ||
+            lduw_he_p(&ip->ip_off) != lduw_he_p(&seg_ip->ip_off)) {
+            return false;
+        }
+    }
+
+    /* Acknowledgment number, window and options */
+    return !memcmp(l4 + offsetof(tcp_header, th_ack),
+                   seg->hdr + seg->l4_off + offsetof(tcp_header, th_ack),
+                   4) &&
+           !memcmp(l4 + offsetof(tcp_header, th_win),
+                   seg->hdr + seg->l4_off + offsetof(tcp_header, th_win),
+                   2) &&
+           !memcmp(l4 + sizeof(tcp_header),
+                   seg->hdr + seg->l4_off + sizeof(tcp_header),
+                   flow->payload_off - flow->l4_off - sizeof(tcp_header));
+}
+
+/* Fix the headers of a merged frame */
+static void net_gro_finish(NetGro *gro, NetGroFlow *flow)
+{
+    uint8_t *l3 = flow->buf + flow->l3_off;
+    uint8_t *l4 = flow->buf + flow->l4_off;
+    tcp_header *tcp = (tcp_header *)l4;
+    size_t l4_len = flow->end - flow->l4_off;
+    uint8_t *addrs;
+
+    if (flow->ip6) {
+        struct ip6_header *ip6 = (struct ip6_header *)l3;
+
+        stw_be_p(&ip6->ip6_plen, l4_len);
+        addrs = (uint8_t *)&ip6->ip6_src;
+    } else {
+        struct ip_header *ip = (struct ip_header *)l3;
+
+        stw_be_p(&ip->ip_len, flow->end - flow->l3_off);
+        stw_he_p(&ip->ip_sum, 0);
+        stw_be_p(&ip->ip_sum, net_raw_checksum(l3, sizeof(*ip)));
+        addrs = (uint8_t *)&ip->ip_src;
+    }
+
+    stw_he_p(&tcp->th_sum, 0);
+    stw_be_p(&tcp->th_sum,
+             net_gro_tcp_checksum(flow->ip6, addrs, l4, l4_len));
+
+    if (gro->vnet_hdr_len) {
+        struct virtio_net_hdr *vhdr = (struct virtio_net_hdr *)flow->buf;
+
+        vhdr->flags = VIRTIO_NET_HDR_F_DATA_VALID;
+        vhdr->csum_start = 0;
+        vhdr->csum_offset = 0;
+    }
+}
+
+static void net_gro_remove(NetGro *gro, unsigned i)
+{
+    uint8_t *buf = gro->flows[i].buf;
+
+    gro->n_flows--;
+    memmove(&gro->flows[i], &gro->flows[i + 1],
+            (gro->n_flows - i) * sizeof(gro->flows[0]));
+    /* Keep the buffer for the next flow */
+    gro->flows[gro->n_flows].buf = buf;
+}
+
+static bool net_gro_flush_flow(NetGro *gro, unsigned i)
+{
+    NetGroFlow *flow = &gro->flows[i];
+    struct iovec iov = { .iov_base = flow->buf, .iov_len = flow->len };
+
+    if (flow->segs > 1) {
+        net_gro_finish(gro, flow);
+    }
+    if (!gro->deliver(NULL, QEMU_NET_PACKET_FLAG_NONE, &iov, 1,
+                      gro->opaque)) {
+        return false;
+    }
+    net_gro_remove(gro, i);
+    return true;
+}
+
+bool net_gro_flush(NetGro *gro)
+{
+    while (gro->n_flows) {
+        if (!net_gro_flush_flow(gro, 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void net_gro_purge(NetGro *gro)
+{
+    gro->n_flows = 0;
+}
+
+static void net_gro_bh(void *opaque)
+{
+    net_gro_flush(opaque);
+}
+
+static NetGroFlow *net_gro_find_flow(NetGro *gro, NetGroSegment *seg,
+                                     unsigned *index)
+{
+    unsigned i;
+
+    for (i = 0; i < gro->n_flows; i++) {
+        if (!memcmp(&gro->flows[i].key, &seg->key, sizeof(seg->key))) {
+            *index = i;
+            return &gro->flows[i];
+        }
+    }
+    return NULL;
+}
+
+ssize_t net_gro_receive(NetGro *gro, NetClientState *sender,
+                        const struct iovec *iov, int iovcnt)
+{
+    size_t size = iov_size(iov, iovcnt);
+    NetGroSegment seg;
+    NetGroFlow *flow;
+    unsigned i;
+
+    if (!net_gro_parse(gro, iov, iovcnt, size, &seg)) {
+        return gro->deliver(sender, QEMU_NET_PACKET_FLAG_NONE, iov, iovcnt,
+                            gro->opaque);
+    }
+
+    flow = net_gro_find_flow(gro, &seg, &i);
+    if (flow) {
+        if (net_gro_can_merge(gro, flow, &seg)) {
+            size_t payload = seg.end - seg.payload_off;
+
+            iov_to_buf(iov, iovcnt, seg.payload_off,
+                       flow->buf + flow->end, payload);
+            flow->end += payload;
+            flow->len = flow->end;
+            flow->next_seq += payload;
+            flow->segs++;
+
+            /* The sender has no more data for now */
+            if (seg.flags & TH_PUSH) {
+                tcp_header *tcp = (tcp_header *)(flow->buf + flow->l4_off);
+
+                stw_be_p(&tcp->th_offset_flags,
+                         lduw_be_p(&tcp->th_offset_flags) | TH_PUSH);
+                net_gro_flush_flow(gro, i);
+            }
+            return size;
+        }
+
+        /* Keep the segments of the flow in order */
+        if (!net_gro_flush_flow(gro, i)) {
+            return 0;
+        }
+    }
+
+    if (!seg.mergeable || (seg.flags & TH_PUSH) ||
+        size > gro->vnet_hdr_len + gro->max_frame) {
+        return gro->deliver(sender, QEMU_NET_PACKET_FLAG_NONE, iov, iovcnt,
+                            gro->opaque);
+    }
+
+    if (gro->n_flows == NET_GRO_MAX_FLOWS && !net_gro_flush_flow(gro, 0)) {
+        return 0;
+    }
+
+    flow = &gro->flows[gro->n_flows++];
+    if (!flow->buf) {
+        flow->buf = g_malloc(gro->vnet_hdr_len + gro->max_frame);
+    }
+    iov_to_buf(iov, iovcnt, 0, flow->buf, size);
+    flow->key = seg.key;
+    flow->len = size;
+    flow->ip6 = seg.ip6;
+    flow->l3_off = seg.l3_off;
+    flow->l4_off = seg.l4_off;
+    flow->payload_off = seg.payload_off;
+    flow->end = seg.end;
+    flow->next_seq = seg.seq + (seg.end - seg.payload_off);
+    flow->segs = 1;
+
+    qemu_bh_schedule(gro->bh);
+    return size;
+}
+
+static void net_gro_free_buffers(NetGro *gro)
+{
+    unsigned i;
+
+    for (i = 0; i < NET_GRO_MAX_FLOWS; i++) {
+        g_free(gro->flows[i].buf);
+        gro->flows[i].buf = NULL;
+    }
+    gro->n_flows = 0;
+}
+
+void net_gro_set_params(NetGro *gro, size_t vnet_hdr_len, size_t max_frame)
+{
+    assert(vnet_hdr_len <= NET_GRO_MAX_VNET_HDR_LEN);
+
+    if (gro->vnet_hdr_len == vnet_hdr_len && gro->max_frame == max_frame) {
+        return;
+    }
+
+    net_gro_flush(gro);
+    net_gro_free_buffers(gro);
+    gro->vnet_hdr_len = vnet_hdr_len;
+    gro->max_frame = max_frame;
+}
+
+NetGro *net_gro_new(NetQueueDeliverFunc *deliver, void *opaque)
+{
+    NetGro *gro = g_new0(NetGro, 1);
+
+    gro->deliver = deliver;
+    gro->opaque = opaque;
+    gro->bh = qemu_bh_new(net_gro_bh, gro);
+    return gro;
+}
+
+void net_gro_free(NetGro *gro)
+{
+    qemu_bh_delete(gro->bh);
+    net_gro_free_buffers(gro);
+    g_free(gro);
+}
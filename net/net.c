@@ -259,6 +259,11 @@ static ssize_t qemu_deliver_packet_iov(NetClientState *sender,
                                        const struct iovec *iov,
                                        int iovcnt,
                                        void *opaque);
+static ssize_t nc_deliver_iov(NetClientState *sender,
+                              unsigned flags,
+                              const struct iovec *iov,
+                              int iovcnt,
+                              void *opaque);
 
 static void qemu_net_client_setup(NetClientState *nc,
                                   NetClientInfo *info,
@@ -395,6 +400,9 @@ static void qemu_free_net_client(NetClientState *nc)
     if (nc->incoming_queue) {
         qemu_del_net_queue(nc->incoming_queue);
     }
+    if (nc->gro) {
+        net_gro_free(nc->gro);
+    }
     if (nc->peer) {
         nc->peer->peer = NULL;
     }
@@ -559,6 +567,30 @@ void qemu_set_vnet_hdr_len(NetClientState *nc, int len)
     nc->info->set_vnet_hdr_len(nc, len);
 }
 
+/*
+ * Merge the TCP segments received by the NIC @nc into frames of up to
+ * @max_frame bytes, or stop doing so if @max_frame is 0.  The frames that
+ * @nc receives start with a virtio-net header of @vnet_hdr_len bytes.
+ */
+void qemu_set_gro(NetClientState *nc, size_t vnet_hdr_len, size_t max_frame)
+{
+    assert(nc->info->type == NET_CLIENT_DRIVER_NIC);
+
+    if (!max_frame) {
+        if (nc->gro) {
+            net_gro_flush(nc->gro);
+            net_gro_free(nc->gro);
+            nc->gro = NULL;
+        }
+        return;
+    }
+
+    if (!nc->gro) {
+        nc->gro = net_gro_new(nc_deliver_iov, nc);
+    }
+    net_gro_set_params(nc->gro, vnet_hdr_len, max_frame);
+}
+
 int qemu_set_vnet_le(NetClientState *nc, bool is_le)
 {
 #if HOST_BIG_ENDIAN
@@ -672,6 +704,11 @@ void qemu_flush_or_purge_queued_packets(NetClientState *nc, bool purge)
 {
     nc->receive_disabled = 0;
 
+    /* The frames kept for GRO were received before the queued ones */
+    if (nc->gro && !net_gro_flush(nc->gro) && purge) {
+        net_gro_purge(nc->gro);
+    }
+
     if (nc->peer && nc->peer->info->type == NET_CLIENT_DRIVER_HUBPORT) {
         if (net_hub_flush(nc->peer)) {
             qemu_notify_event();
@@ -793,11 +830,11 @@ static ssize_t nc_sendv_compat(NetClientState *nc, const struct iovec *iov,
     return ret;
 }
 
-static ssize_t qemu_deliver_packet_iov(NetClientState *sender,
-                                       unsigned flags,
-                                       const struct iovec *iov,
-                                       int iovcnt,
-                                       void *opaque)
+static ssize_t nc_deliver_iov(NetClientState *sender,
+                              unsigned flags,
+                              const struct iovec *iov,
+                              int iovcnt,
+                              void *opaque)
 {
     MemReentrancyGuard *owned_reentrancy_guard;
     NetClientState *nc = opaque;
@@ -847,6 +884,22 @@ static ssize_t qemu_deliver_packet_iov(NetClientState *sender,
     return ret;
 }
 
+static ssize_t qemu_deliver_packet_iov(NetClientState *sender,
+                                       unsigned flags,
+                                       const struct iovec *iov,
+                                       int iovcnt,
+                                       void *opaque)
+{
+    NetClientState *nc = opaque;
+
+    if (nc->gro && !nc->link_down && !nc->receive_disabled &&
+        !(flags & QEMU_NET_PACKET_FLAG_RAW)) {
+        return net_gro_receive(nc->gro, sender, iov, iovcnt);
+    }
+
+    return nc_deliver_iov(sender, flags, iov, iovcnt, opaque);
+}
+
 ssize_t qemu_sendv_packet_async(NetClientState *sender,
                                 const struct iovec *iov, int iovcnt,
                                 NetPacketSent *sent_cb)
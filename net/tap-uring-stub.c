@@ -0,0 +1,32 @@
+/*
+ * Batched tap I/O with Linux io_uring, stubs
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "tap_int.h"
+
+TapUring *tap_uring_new(int fd, TapUringRxFunc *rx, TapUringTxFunc *tx,
+                        void *opaque, Error **errp)
+{
+    error_setg(errp, "io_uring support is disabled in this build");
+    return NULL;
+}
+
+void tap_uring_free(TapUring *u)
+{
+    g_assert_not_reached();
+}
+
+void tap_uring_set_rx(TapUring *u, bool enable)
+{
+    g_assert_not_reached();
+}
+
+ssize_t tap_uring_write(TapUring *u, const struct iovec *iov, int iovcnt)
+{
+    g_assert_not_reached();
+}
@@ -0,0 +1,346 @@
+/*
+ * Batched tap I/O with Linux io_uring
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * A tap device returns one frame per read() and takes one frame per
+ * write(), so the plain tap backend makes a system call per packet in
+ * each direction.  With io-uring=on, a set of reads is kept pending on
+ * the tap fd instead, and all the frames that arrived are reaped from
+ * the completion queue in one go when the ring fd becomes readable.  The
+ * frames of a guest TX burst are copied to TX buffers and submitted
+ * together from a bottom half, once the peer is done with the burst.
+ * The reads that were reposted are submitted together with them.
+ *
+ * The writes of a burst are linked, so that the kernel performs them in
+ * order even if it hands them to its worker threads, and the next burst
+ * is only submitted once the previous one is complete.
+ */
+
+#include "qemu/osdep.h"
+#include <liburing.h>
+#include "qapi/error.h"
+#include "qemu/error-report.h"
+#include "qemu/iov.h"
+#include "qemu/main-loop.h"
+#include "net/net.h"
+#include "tap_int.h"
+
+#define TAP_URING_RX_DEPTH 32
+#define TAP_URING_TX_DEPTH 32
+
+typedef enum {
+    TAP_URING_SLOT_IDLE,
+    TAP_URING_SLOT_BUSY,    /* request in flight */
+    TAP_URING_SLOT_READY,   /* RX only: frame not delivered yet */
+} TapUringSlotState;
+
+typedef struct TapUringSlot {
+    TapUringSlotState state;
+    bool is_tx;
+    int len;
+    uint8_t *buf;
+    uint8_t *big;           /* TX only: copy of a frame too big for buf */
+    struct iovec iov;
+} TapUringSlot;
+
+struct TapUring {
+    struct io_uring ring;
+    int fd;
+    unsigned in_flight;
+    QEMUBH *submit_bh;
+
+    TapUringRxFunc *rx;
+    TapUringTxFunc *tx;
+    void *opaque;
+
+    bool rx_enabled;
+    TapUringSlot rx_slots[TAP_URING_RX_DEPTH];
+    /* Completed reads, in the order the frames were read */
+    unsigned rx_ready[TAP_URING_RX_DEPTH];
+    unsigned rx_ready_head, rx_ready_tail;  /* free running */
+
+    bool tx_blocked;
+    TapUringSlot tx_slots[TAP_URING_TX_DEPTH];
+    unsigned tx_free[TAP_URING_TX_DEPTH];
+    unsigned n_tx_free;
+    /* Frames waiting for the writes in flight, in order */
+    unsigned tx_queue[TAP_URING_TX_DEPTH];
+    unsigned n_tx_queued;
+    unsigned tx_in_flight;
+
+    uint8_t *buffers;
+};
+
+static struct io_uring_sqe *tap_uring_get_sqe(TapUring *u)
+{
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&u->ring);
+
+    if (!sqe) {
+        /* The ring has room for all slots, submit what is queued */
+        io_uring_submit(&u->ring);
+        sqe = io_uring_get_sqe(&u->ring);
+        assert(sqe);
+    }
+    return sqe;
+}
+
+static void tap_uring_read(TapUring *u, TapUringSlot *slot)
+{
+    struct io_uring_sqe *sqe = tap_uring_get_sqe(u);
+
+    slot->iov = (struct iovec) { slot->buf, NET_BUFSIZE };
+    io_uring_prep_readv(sqe, u->fd, &slot->iov, 1, 0);
+    io_uring_sqe_set_data(sqe, slot);
+    slot->state = TAP_URING_SLOT_BUSY;
+    u->in_flight++;
+}
+
+/* Post a read for every RX buffer that is not in use */
+static void tap_uring_read_all(TapUring *u)
+{
+    int i;
+
+    for (i = 0; i < TAP_URING_RX_DEPTH; i++) {
+        if (u->rx_slots[i].state == TAP_URING_SLOT_IDLE) {
+            tap_uring_read(u, &u->rx_slots[i]);
+        }
+    }
+}
+
+/*
+ * Write the queued frames with a chain of linked requests, unless the
+ * previous chain is still in flight.  The ring has room for all slots,
+ * so tap_uring_get_sqe() never has to submit part of the chain.  If a
+ * write fails, the kernel cancels the rest of the chain and those frames
+ * are dropped.
+ */
+static void tap_uring_write_queued(TapUring *u)
+{
+    unsigned i;
+
+    if (u->tx_in_flight || !u->n_tx_queued) {
+        return;
+    }
+
+    for (i = 0; i < u->n_tx_queued; i++) {
+        TapUringSlot *slot = &u->tx_slots[u->tx_queue[i]];
+        struct io_uring_sqe *sqe = tap_uring_get_sqe(u);
+
+        io_uring_prep_writev(sqe, u->fd, &slot->iov, 1, 0);
+        io_uring_sqe_set_data(sqe, slot);
+        if (i + 1 < u->n_tx_queued) {
+            io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK);
+        }
+    }
+    u->in_flight += u->n_tx_queued;
+    u->tx_in_flight = u->n_tx_queued;
+    u->n_tx_queued = 0;
+}
+
+/* Pass the frames that were read to the peer, and reuse their buffers */
+static void tap_uring_deliver(TapUring *u)
+{
+    while (u->rx_enabled && u->rx_ready_head != u->rx_ready_tail) {
+        unsigned i = u->rx_ready[u->rx_ready_head++ % TAP_URING_RX_DEPTH];
+        TapUringSlot *slot = &u->rx_slots[i];
+
+        u->rx(u->opaque, slot->buf, slot->len);
+        tap_uring_read(u, slot);
+    }
+}
+
+static void tap_uring_complete(void *opaque)
+{
+    TapUring *u = opaque;
+    struct io_uring_cqe *cqe;
+    bool tx_done = false;
+
+    while (io_uring_peek_cqe(&u->ring, &cqe) == 0) {
+        TapUringSlot *slot = io_uring_cqe_get_data(cqe);
+        int ret = cqe->res;
+
+        io_uring_cqe_seen(&u->ring, cqe);
+        u->in_flight--;
+
+        if (slot->is_tx) {
+            g_free(slot->big);
+            slot->big = NULL;
+            slot->state = TAP_URING_SLOT_IDLE;
+            u->tx_free[u->n_tx_free++] = slot - u->tx_slots;
+            u->tx_in_flight--;
+            tx_done = true;
+        } else if (ret > 0) {
+            slot->len = ret;
+            slot->state = TAP_URING_SLOT_READY;
+            u->rx_ready[u->rx_ready_tail++ % TAP_URING_RX_DEPTH] =
+                slot - u->rx_slots;
+        } else if (ret == -EAGAIN || ret == -EINTR) {
+            tap_uring_read(u, slot);
+        } else if (ret != -ECANCELED && u->rx_enabled) {
+            /*
+             * Nothing else would post the read again while RX stays
+             * enabled, so report the error and retry rather than losing
+             * the buffer for good.
+             */
+            warn_report_once("tap: io_uring read failed: %s",
+                             ret ? strerror(-ret) : "no data");
+            tap_uring_read(u, slot);
+        } else {
+            /*
+             * The request was canceled, or RX is disabled.  The read is
+             * posted again by tap_uring_set_rx().
+             */
+            slot->state = TAP_URING_SLOT_IDLE;
+        }
+    }
+
+    tap_uring_deliver(u);
+
+    if (tx_done && u->tx_blocked) {
+        u->tx_blocked = false;
+        u->tx(u->opaque);
+    }
+
+    tap_uring_write_queued(u);
+    io_uring_submit(&u->ring);
+}
+
+static void tap_uring_submit_bh(void *opaque)
+{
+    TapUring *u = opaque;
+
+    tap_uring_write_queued(u);
+    io_uring_submit(&u->ring);
+}
+
+ssize_t tap_uring_write(TapUring *u, const struct iovec *iov, int iovcnt)
+{
+    size_t size = iov_size(iov, iovcnt);
+    TapUringSlot *slot;
+    unsigned i;
+
+    if (!u->n_tx_free) {
+        u->tx_blocked = true;
+        return 0;
+    }
+
+    i = u->tx_free[--u->n_tx_free];
+    slot = &u->tx_slots[i];
+    if (size > NET_BUFSIZE) {
+        slot->big = g_malloc(size);
+        slot->iov = (struct iovec) { slot->big, size };
+    } else {
+        slot->iov = (struct iovec) { slot->buf, size };
+    }
+    iov_to_buf(iov, iovcnt, 0, slot->iov.iov_base, size);
+    slot->len = size;
+    slot->state = TAP_URING_SLOT_BUSY;
+    u->tx_queue[u->n_tx_queued++] = i;
+
+    /* Submit the whole burst once the peer is done with it */
+    qemu_bh_schedule(u->submit_bh);
+    return size;
+}
+
+void tap_uring_set_rx(TapUring *u, bool enable)
+{
+    if (u->rx_enabled == enable) {
+        return;
+    }
+
+    u->rx_enabled = enable;
+    if (enable) {
+        tap_uring_deliver(u);
+        tap_uring_read_all(u);
+        qemu_bh_schedule(u->submit_bh);
+    }
+}
+
+TapUring *tap_uring_new(int fd, TapUringRxFunc *rx, TapUringTxFunc *tx,
+                        void *opaque, Error **errp)
+{
+    TapUring *u = g_new0(TapUring, 1);
+    int i, ret;
+
+    ret = io_uring_queue_init(TAP_URING_RX_DEPTH + TAP_URING_TX_DEPTH,
+                              &u->ring, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "failed to init io_uring for tap");
+        g_free(u);
+        return NULL;
+    }
+
+    /*
+     * io_uring returns -EAGAIN for reads of a file with O_NONBLOCK,
+     * instead of waiting for a frame.  All I/O goes through the ring now,
+     * so the main loop never blocks on the fd.  The flag belongs to the
+     * open file, so this also affects any other process holding an fd
+     * passed with fd= or fds=.
+     */
+    if (!g_unix_set_fd_nonblocking(fd, false, NULL)) {
+        error_setg_errno(errp, errno, "failed to make tap fd blocking");
+        io_uring_queue_exit(&u->ring);
+        g_free(u);
+        return NULL;
+    }
+
+    u->fd = fd;
+    u->rx = rx;
+    u->tx = tx;
+    u->opaque = opaque;
+    u->buffers = g_malloc((size_t)NET_BUFSIZE *
+                          (TAP_URING_RX_DEPTH + TAP_URING_TX_DEPTH));
+
+    for (i = 0; i < TAP_URING_RX_DEPTH; i++) {
+        u->rx_slots[i].buf = u->buffers + (size_t)i * NET_BUFSIZE;
+    }
+    for (i = 0; i < TAP_URING_TX_DEPTH; i++) {
+        u->tx_slots[i].is_tx = true;
+        u->tx_slots[i].buf = u->buffers +
+                             (size_t)(TAP_URING_RX_DEPTH + i) * NET_BUFSIZE;
+        u->tx_free[u->n_tx_free++] = TAP_URING_TX_DEPTH - 1 - i;
+    }
+
+    u->submit_bh = qemu_bh_new(tap_uring_submit_bh, u);
+    qemu_set_fd_handler(u->ring.ring_fd, tap_uring_complete, NULL, u);
+    return u;
+}
+
+void tap_uring_free(TapUring *u)
+{
+    struct io_uring_cqe *cqe;
+    int i;
+
+    qemu_set_fd_handler(u->ring.ring_fd, NULL, NULL, NULL);
+    qemu_bh_delete(u->submit_bh);
+
+    /* The kernel must be done with the buffers before they are freed */
+    for (i = 0; i < TAP_URING_RX_DEPTH; i++) {
+        if (u->rx_slots[i].state == TAP_URING_SLOT_BUSY) {
+            struct io_uring_sqe *sqe = tap_uring_get_sqe(u);
+
+            io_uring_prep_cancel(sqe, &u->rx_slots[i], 0);
+            io_uring_sqe_set_data(sqe, NULL);
+        }
+    }
+    io_uring_submit(&u->ring);
+
+    while (u->in_flight && io_uring_wait_cqe(&u->ring, &cqe) == 0) {
+        /* The completions of the cancel requests have no slot */
+        if (io_uring_cqe_get_data(cqe)) {
+            u->in_flight--;
+        }
+        io_uring_cqe_seen(&u->ring, cqe);
+    }
+
+    io_uring_queue_exit(&u->ring);
+    for (i = 0; i < TAP_URING_TX_DEPTH; i++) {
+        g_free(u->tx_slots[i].big);
+    }
+    g_free(u->buffers);
+    g_free(u);
+}
@@ -62,6 +62,8 @@ typedef struct TAPState {
     VHostNetState *vhost_net;
     unsigned host_vnet_hdr_len;
     Notifier exit;
+    TapUring *uring;
+    AioContext *ctx;    /* runs the fd handlers */
 } TAPState;
 
 static void launch_script(const char *setup_script, const char *ifname,
@@ -72,10 +74,15 @@ static void tap_writable(void *opaque);
 
 static void tap_update_fd_handler(TAPState *s)
 {
-    qemu_set_fd_handler(s->fd,
-                        s->read_poll && s->enabled ? tap_send : NULL,
-                        s->write_poll && s->enabled ? tap_writable : NULL,
-                        s);
+    if (s->uring) {
+        tap_uring_set_rx(s->uring, s->read_poll && s->enabled);
+        return;
+    }
+
+    aio_set_fd_handler(s->ctx, s->fd,
+                       s->read_poll && s->enabled ? tap_send : NULL,
+                       s->write_poll && s->enabled ? tap_writable : NULL,
+                       NULL, NULL, s);
 }
 
 static void tap_read_poll(TAPState *s, bool enable)
@@ -103,6 +110,10 @@ static ssize_t tap_write_packet(TAPState *s, const struct iovec *iov, int iovcnt
 {
     ssize_t len;
 
+    if (s->uring) {
+        return tap_uring_write(s->uring, iov, iovcnt);
+    }
+
     len = RETRY_ON_EINTR(writev(s->fd, iov, iovcnt));
 
     if (len == -1 && errno == EAGAIN) {
@@ -156,6 +167,27 @@ static void tap_send_completed(NetClientState *nc, ssize_t len)
     tap_read_poll(s, true);
 }
 
+/* Pass a frame read from the tap to the peer */
+static int tap_send_packet(TAPState *s, uint8_t *buf, int size)
+{
+    uint8_t min_pkt[ETH_ZLEN];
+    size_t min_pktsz = sizeof(min_pkt);
+
+    if (s->host_vnet_hdr_len && !s->using_vnet_hdr) {
+        buf  += s->host_vnet_hdr_len;
+        size -= s->host_vnet_hdr_len;
+    }
+
+    if (net_peer_needs_padding(&s->nc)) {
+        if (eth_pad_short_frame(min_pkt, &min_pktsz, buf, size)) {
+            buf = min_pkt;
+            size = min_pktsz;
+        }
+    }
+
+    return qemu_send_packet_async(&s->nc, buf, size, tap_send_completed);
+}
+
 static void tap_send(void *opaque)
 {
     TAPState *s = opaque;
@@ -163,28 +195,12 @@ static void tap_send(void *opaque)
     int packets = 0;
 
     while (true) {
-        uint8_t *buf = s->buf;
-        uint8_t min_pkt[ETH_ZLEN];
-        size_t min_pktsz = sizeof(min_pkt);
-
         size = tap_read_packet(s->fd, s->buf, sizeof(s->buf));
         if (size <= 0) {
             break;
         }
 
-        if (s->host_vnet_hdr_len && !s->using_vnet_hdr) {
-            buf  += s->host_vnet_hdr_len;
-            size -= s->host_vnet_hdr_len;
-        }
-
-        if (net_peer_needs_padding(&s->nc)) {
-            if (eth_pad_short_frame(min_pkt, &min_pktsz, buf, size)) {
-                buf = min_pkt;
-                size = min_pktsz;
-            }
-        }
-
-        size = qemu_send_packet_async(&s->nc, buf, size, tap_send_completed);
+        size = tap_send_packet(s, s->buf, size);
         if (size == 0) {
             tap_read_poll(s, false);
             break;
@@ -205,6 +221,22 @@ static void tap_send(void *opaque)
     }
 }
 
+static void tap_uring_rx(void *opaque, uint8_t *buf, int size)
+{
+    TAPState *s = opaque;
+
+    if (tap_send_packet(s, buf, size) == 0) {
+        tap_read_poll(s, false);
+    }
+}
+
+static void tap_uring_tx(void *opaque)
+{
+    TAPState *s = opaque;
+
+    qemu_flush_queued_packets(&s->nc);
+}
+
 static bool tap_has_ufo(NetClientState *nc)
 {
     TAPState *s = DO_UPCAST(TAPState, nc, nc);
@@ -303,6 +335,10 @@ static void tap_cleanup(NetClientState *nc)
 
     tap_read_poll(s, false);
     tap_write_poll(s, false);
+    if (s->uring) {
+        tap_uring_free(s->uring);
+        s->uring = NULL;
+    }
     close(s->fd);
     s->fd = -1;
 }
@@ -322,6 +358,22 @@ static bool tap_set_steering_ebpf(NetClientState *nc, int prog_fd)
     return tap_fd_set_steering_ebpf(s->fd, prog_fd) == 0;
 }
 
+static bool tap_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    TAPState *s = DO_UPCAST(TAPState, nc, nc);
+    assert(nc->info->type == NET_CLIENT_DRIVER_TAP);
+
+    /* The completions of the ring are handled in the main loop */
+    if (s->uring) {
+        return false;
+    }
+
+    aio_set_fd_handler(s->ctx, s->fd, NULL, NULL, NULL, NULL, NULL);
+    s->ctx = ctx ?: iohandler_get_aio_context();
+    tap_update_fd_handler(s);
+    return true;
+}
+
 int tap_get_fd(NetClientState *nc)
 {
     TAPState *s = DO_UPCAST(TAPState, nc, nc);
@@ -347,6 +399,7 @@ static NetClientInfo net_tap_info = {
     .set_vnet_le = tap_set_vnet_le,
     .set_vnet_be = tap_set_vnet_be,
     .set_steering_ebpf = tap_set_steering_ebpf,
+    .set_aio_context = tap_set_aio_context,
 };
 
 static TAPState *net_tap_fd_init(NetClientState *peer,
@@ -363,6 +416,7 @@ static TAPState *net_tap_fd_init(NetClientState *peer,
     s = DO_UPCAST(TAPState, nc, nc);
 
     s->fd = fd;
+    s->ctx = iohandler_get_aio_context();
     s->host_vnet_hdr_len = vnet_hdr ? sizeof(struct virtio_net_hdr) : 0;
     s->using_vnet_hdr = false;
     s->has_ufo = tap_probe_has_ufo(s->fd);
@@ -718,6 +772,20 @@ static void net_init_tap_one(const NetdevTapOptions *tap, NetClientState *peer,
         goto failed;
     }
 
+    if (tap->has_io_uring && tap->io_uring) {
+        if (s->vhost_net) {
+            error_setg(errp, "io-uring=on is not valid with vhost");
+            goto failed;
+        }
+
+        s->uring = tap_uring_new(s->fd, tap_uring_rx, tap_uring_tx, s, errp);
+        if (!s->uring) {
+            goto failed;
+        }
+        qemu_set_fd_handler(s->fd, NULL, NULL, NULL);
+        tap_update_fd_handler(s);
+    }
+
     return;
 
 failed:
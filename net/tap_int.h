@@ -47,4 +47,15 @@ int tap_fd_disable(int fd);
 int tap_fd_get_ifname(int fd, char *ifname);
 int tap_fd_set_steering_ebpf(int fd, int prog_fd);
 
+/* Batched I/O with io_uring, see tap-uring.c */
+typedef struct TapUring TapUring;
+typedef void TapUringRxFunc(void *opaque, uint8_t *buf, int size);
+typedef void TapUringTxFunc(void *opaque);
+
+TapUring *tap_uring_new(int fd, TapUringRxFunc *rx, TapUringTxFunc *tx,
+                        void *opaque, Error **errp);
+void tap_uring_free(TapUring *u);
+void tap_uring_set_rx(TapUring *u, bool enable);
+ssize_t tap_uring_write(TapUring *u, const struct iovec *iov, int iovcnt);
+
 #endif /* NET_TAP_INT_H */
@@ -176,6 +176,16 @@ void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
     }
 }
 
+void qemu_plugin_register_vcpu_insn_exec_ring(struct qemu_plugin_insn *insn,
+                                              struct qemu_plugin_ring *ring,
+                                              uint64_t info)
+{
+    if (!tb_is_mem_only()) {
+        plugin_register_ring_on_entry(&insn->insn_cbs, 0, ring,
+                                      insn->vaddr, info);
+    }
+}
+
 
 /*
  * We always plant memory instrumentation because they don't finalise until
@@ -200,6 +210,13 @@ void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
     plugin_register_inline_op_on_entry(&insn->mem_cbs, rw, op, entry, imm);
 }
 
+void qemu_plugin_register_vcpu_mem_ring(struct qemu_plugin_insn *insn,
+                                        enum qemu_plugin_mem_rw rw,
+                                        struct qemu_plugin_ring *ring)
+{
+    plugin_register_ring_on_entry(&insn->mem_cbs, rw, ring, insn->vaddr, 0);
+}
+
 void qemu_plugin_register_vcpu_tb_trans_cb(qemu_plugin_id_t id,
                                            qemu_plugin_vcpu_tb_trans_cb_t cb)
 {
@@ -553,6 +570,25 @@ void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
     return base_ptr + vcpu_index * g_array_get_element_size(score->data);
 }
 
+struct qemu_plugin_ring *qemu_plugin_ring_new(size_t n_events,
+                                              qemu_plugin_vcpu_ring_cb_t cb,
+                                              void *userdata)
+{
+    return plugin_ring_new(n_events, cb, userdata);
+}
+
+void qemu_plugin_ring_flush(struct qemu_plugin_ring *ring,
+                            unsigned int vcpu_index)
+{
+    g_assert(vcpu_index < qemu_plugin_num_vcpus());
+    plugin_ring_flush(vcpu_index, ring);
+}
+
+void qemu_plugin_ring_free(struct qemu_plugin_ring *ring)
+{
+    plugin_ring_free(ring);
+}
+
 static uint64_t *plugin_u64_address(qemu_plugin_u64 entry,
                                     unsigned int vcpu_index)
 {
@@ -348,6 +348,32 @@ void plugin_register_inline_op_on_entry(GArray **arr,
     dyn_cb->inline_insn = inline_cb;
 }
 
+void plugin_register_ring_on_entry(GArray **arr,
+                                   enum qemu_plugin_mem_rw rw,
+                                   struct qemu_plugin_ring *ring,
+                                   uint64_t pc, uint64_t data)
+{
+    static TCGHelperInfo info = {
+        .flags = TCG_CALL_NO_RWG,
+        /*
+         * Match plugin_ring_flush:
+         *   void (*)(uint32_t, void *)
+         */
+        .typemask = (dh_typemask(void, 0) |
+                     dh_typemask(i32, 1) |
+                     dh_typemask(ptr, 2))
+    };
+
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+    struct qemu_plugin_ring_cb ring_cb = { .ring = ring,
+                                           .info = &info,
+                                           .pc = pc,
+                                           .data = data,
+                                           .rw = rw };
+    dyn_cb->type = PLUGIN_CB_RING;
+    dyn_cb->ring = ring_cb;
+}
+
 void plugin_register_dyn_cb__udata(GArray **arr,
                                    qemu_plugin_vcpu_udata_cb_t cb,
                                    enum qemu_plugin_cb_flags flags,
@@ -582,6 +608,46 @@ void exec_inline_op(enum plugin_dyn_cb_type type,
     }
 }
 
+static struct qemu_plugin_ring_entry *
+plugin_ring_entry(struct qemu_plugin_ring *ring, unsigned int cpu_index)
+{
+    GArray *arr = ring->score->data;
+
+    return (struct qemu_plugin_ring_entry *)
+        (arr->data + cpu_index * g_array_get_element_size(arr));
+}
+
+/*
+ * Called from the generated code when the ring of @cpu_index is full.
+ * Disable CFI checks, the callback has been loaded from the plugin.
+ */
+QEMU_DISABLE_CFI
+void plugin_ring_flush(unsigned int cpu_index, struct qemu_plugin_ring *ring)
+{
+    struct qemu_plugin_ring_entry *e = plugin_ring_entry(ring, cpu_index);
+
+    if (e->n) {
+        ring->cb(cpu_index, e->events, e->n, ring->userp);
+        e->n = 0;
+    }
+}
+
+static void exec_ring_op(struct qemu_plugin_ring_cb *cb, int cpu_index,
+                         uint64_t vaddr, uint64_t info)
+{
+    struct qemu_plugin_ring *ring = cb->ring;
+    struct qemu_plugin_ring_entry *e = plugin_ring_entry(ring, cpu_index);
+
+    e->events[e->n++] = (struct qemu_plugin_ring_event) {
+        .pc = cb->pc,
+        .vaddr = vaddr,
+        .info = info,
+    };
+    if (e->n == ring->n_events) {
+        plugin_ring_flush(cpu_index, ring);
+    }
+}
+
 void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                              MemOpIdx oi, enum qemu_plugin_mem_rw rw)
 {
@@ -609,6 +675,12 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                 exec_inline_op(cb->type, &cb->inline_insn, cpu->cpu_index);
             }
             break;
+        case PLUGIN_CB_RING:
+            if (rw & cb->ring.rw) {
+                exec_ring_op(&cb->ring, cpu->cpu_index, vaddr,
+                             make_plugin_meminfo(oi, rw));
+            }
+            break;
         default:
             g_assert_not_reached();
         }
@@ -743,3 +815,32 @@ void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
     g_array_free(score->data, TRUE);
     g_free(score);
 }
+
+struct qemu_plugin_ring *plugin_ring_new(size_t n_events,
+                                         qemu_plugin_vcpu_ring_cb_t cb,
+                                         void *userp)
+{
+    struct qemu_plugin_ring *ring = g_new0(struct qemu_plugin_ring, 1);
+
+    /* Keep the offset of the last event within the range of an i32 */
+    g_assert(n_events > 0 && n_events <= PLUGIN_RING_MAX_EVENTS);
+
+    ring->n_events = n_events;
+    ring->cb = cb;
+    ring->userp = userp;
+    ring->score = plugin_scoreboard_new(
+        sizeof(struct qemu_plugin_ring_entry) +
+        n_events * sizeof(struct qemu_plugin_ring_event));
+    return ring;
+}
+
+void plugin_ring_free(struct qemu_plugin_ring *ring)
+{
+    int i;
+
+    for (i = 0; i < plugin.num_vcpus; i++) {
+        plugin_ring_flush(i, ring);
+    }
+    plugin_scoreboard_free(ring->score);
+    g_free(ring);
+}
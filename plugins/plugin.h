@@ -74,6 +74,11 @@ void plugin_register_inline_op_on_entry(GArray **arr,
                                         qemu_plugin_u64 entry,
                                         uint64_t imm);
 
+void plugin_register_ring_on_entry(GArray **arr,
+                                   enum qemu_plugin_mem_rw rw,
+                                   struct qemu_plugin_ring *ring,
+                                   uint64_t pc, uint64_t data);
+
 void plugin_reset_uninstall(qemu_plugin_id_t id,
                             qemu_plugin_simple_cb_t cb,
                             bool reset);
@@ -118,4 +123,12 @@ struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size);
 
 void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
 
+#define PLUGIN_RING_MAX_EVENTS (1 << 20)
+
+struct qemu_plugin_ring *plugin_ring_new(size_t n_events,
+                                         qemu_plugin_vcpu_ring_cb_t cb,
+                                         void *userp);
+
+void plugin_ring_free(struct qemu_plugin_ring *ring);
+
 #endif /* PLUGIN_H */
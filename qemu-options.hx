@@ -187,10 +187,16 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                one-insn-per-tb=on|off (one guest instruction per TCG translation block)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-evict=on|off (evict old TCG translation blocks instead of flushing them all)\n"
+    "                jmp-cache-l2=on|off (add a second level to the TCG jump cache)\n"
+    "                tier-threshold=n (retranslate TCG translation blocks executed n times, default 0)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                eager-split-size=n (KVM Eager Page Split chunk size, default 0, disabled. ARM only)\n"
     "                notify-vmexit=run|internal-error|disable,notify-window=n (enable notify VM exit and set notify window, x86 only)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n"
+    "                translate-threads=n (translate TCG code ahead of demand in n threads, default 0)\n"
+    "                tlb-ways=1|2|4 (associativity of the TCG softmmu TLB, default 1)\n"
+    "                x-spill-lookahead=on|off (experimental TCG spill heuristic, default off)\n"
     "                device=path (KVM device path, default /dev/kvm)\n", QEMU_ARCH_ALL)
 SRST
 ``-accel name[,prop=value[,...]]``
@@ -230,6 +236,54 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-evict=on|off``
+        When the TCG translation block cache fills up, discard only the
+        oldest part of it, instead of stopping all vCPUs and discarding all
+        translation blocks.  This avoids retranslating the whole working
+        set of guests that run a lot of different code.  The default is
+        off.
+
+    ``jmp-cache-l2=on|off``
+        Adds a 4-way set-associative second level to the per-vCPU cache
+        that maps guest addresses to translation blocks.  It keeps the
+        blocks evicted from the first level, which helps guests whose
+        hot code conflicts in the first level.  The first level also
+        grows by itself when it misses often.  The default is off.
+
+    ``tier-threshold=n``
+        Makes the TCG accelerator retranslate a translation block once it
+        has been executed ``n`` times.  The new translation continues
+        across direct jumps on the same page, if the guest front end
+        supports it, so that longer sequences of guest code are optimized
+        together.  The default is 0, which disables retranslation.
+
+    ``translate-threads=n``
+        Starts ``n`` threads that translate the destinations of the
+        direct jumps of newly translated blocks before the vCPUs need
+        them, so that guests running a lot of cold code, such as
+        JIT compilers, wait less for translation.  Only available with
+        ``thread=multi``.  The default is 0.
+
+    ``tlb-ways=1|2|4``
+        Sets the associativity of the TLB that the TCG accelerator uses to
+        translate guest virtual addresses in system emulation.  With more
+        than one way, guests that use many pages whose addresses conflict
+        in the TLB take the slow path less often; on x86 hosts, the second
+        way is also checked by the generated code.  The TLB hit statistics
+        are shown by ``info jit``.  The default is 1.
+
+    ``x-spill-lookahead=on|off``
+        An experimental heuristic for the TCG register allocator.  When
+        no host register is free, the allocator normally spills the first
+        one in its allocation order.  With this option, it looks up to 64
+        ops ahead in the basic block and spills the register whose value
+        is needed last, preferring values that do not have to be stored
+        back to memory.  It only makes a difference when an op finds all
+        host registers busy, which is rare on hosts with many registers,
+        and it does not change the loads and stores of guest registers
+        at the end of each basic block.  The loads, stores and spills are
+        counted by ``info jit``.  The default is off.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -2831,7 +2885,7 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "-netdev tap,id=str[,fd=h][,fds=x:y:...:z][,ifname=name][,script=file][,downscript=dfile]\n"
     "         [,br=bridge][,helper=helper][,sndbuf=nbytes][,vnet_hdr=on|off][,vhost=on|off]\n"
     "         [,vhostfd=h][,vhostfds=x:y:...:z][,vhostforce=on|off][,queues=n]\n"
-    "         [,poll-us=n]\n"
+    "         [,poll-us=n][,io-uring=on|off]\n"
     "                configure a host TAP network backend with ID 'str'\n"
     "                connected to a bridge (default=" DEFAULT_BRIDGE_INTERFACE ")\n"
     "                use network scripts 'file' (default=" DEFAULT_NETWORK_SCRIPT ")\n"
@@ -2854,6 +2908,8 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                use 'queues=n' to specify the number of queues to be created for multiqueue TAP\n"
     "                use 'poll-us=n' to specify the maximum number of microseconds that could be\n"
     "                spent on busy polling for vhost net\n"
+    "                use io-uring=on to read and write frames in batches with io_uring\n"
+    "                    (not valid with vhost)\n"
     "-netdev bridge,id=str[,br=bridge][,helper=helper]\n"
     "                configure a host TAP network backend with ID 'str' that is\n"
     "                connected to a bridge (default=" DEFAULT_BRIDGE_INTERFACE ")\n"
@@ -2925,6 +2981,7 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
 #ifdef CONFIG_AF_XDP
     "-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off]\n"
     "         [,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z]\n"
+    "         [,busy-poll=us]\n"
     "                attach to the existing network interface 'name' with AF_XDP socket\n"
     "                use 'mode=MODE' to specify an XDP program attach mode\n"
     "                use 'force-copy=on|off' to force XDP copy mode even if device supports zero-copy (default: off)\n"
@@ -2934,6 +2991,7 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                  added to a socket map in XDP program.  One socket per queue.\n"
     "                use 'queues=n' to specify how many queues of a multiqueue interface should be used\n"
     "                use 'start-queue=m' to specify the first queue that should be used\n"
+    "                use 'busy-poll=us' to busy-poll the queues that the peer processes in IOThreads\n"
 #endif
 #ifdef CONFIG_POSIX
     "-netdev vhost-user,id=str,chardev=dev[,vhostforce=on|off]\n"
@@ -3238,6 +3296,12 @@ SRST
     ``fd``\ =h can be used to specify the handle of an already opened
     host TAP interface.
 
+    Without vhost, ``io-uring=on`` reads and writes the frames with Linux
+    io_uring.  Several reads are kept pending, and the frames of a guest
+    burst are written with a single system call.  This clears the
+    ``O_NONBLOCK`` flag of the tap file, which is shared with any other
+    process that holds a descriptor passed with ``fd`` or ``fds``.
+
     Examples:
 
     .. parsed-literal::
@@ -3437,7 +3501,7 @@ SRST
         # launch QEMU instance
         |qemu_system| linux.img -nic vde,sock=/tmp/myswitch
 
-``-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z]``
+``-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z][,busy-poll=us]``
     Configure AF_XDP backend to connect to a network interface 'name'
     using AF_XDP socket.  A specific program attach mode for a default
     XDP program can be forced with 'mode', defaults to best-effort,
@@ -3486,6 +3550,23 @@ SRST
         |qemu_system| linux.img -device virtio-net-pci,netdev=n1 \\
             -netdev af-xdp,id=n1,ifname=eth0,queues=3,inhibit=on,sock-fds=15:16:17
 
+    The queues are processed in the thread of their peer, which is an
+    IOThread for the queue pairs of a ``virtio-net`` device with
+    ``iothread-vq-mapping``.  The IOThreads poll the rings adaptively, as
+    set by their 'poll-max-ns' property.  With 'busy-poll', they also run
+    the NAPI context of the queues for up to 'us' microseconds instead of
+    waiting for interrupts, which needs ``napi_defer_hard_irqs`` and
+    ``gro_flush_timeout`` to be set for the interface.
+
+    .. parsed-literal::
+
+        |qemu_system| linux.img -object iothread,id=io0 \\
+            -object iothread,id=io1 \\
+            -netdev af-xdp,id=n1,ifname=eth0,queues=2,busy-poll=20 \\
+            -device '{"driver": "virtio-net-pci", "netdev": "n1", "mq": true,
+                      "iothread-vq-mapping": [{"iothread": "io0"},
+                                              {"iothread": "io1"}]}'
+
 ``-netdev vhost-user,chardev=id[,vhostforce=on|off][,queues=n]``
     Establish a vhost-user netdev, backed by a chardev id. The chardev
     should be a unix domain socket backed one. The vhost-user uses a
@@ -5843,7 +5924,7 @@ SRST
 
             CN=laptop.example.com,O=Example Home,L=London,ST=London,C=GB
 
-    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,aio-max-batch=aio-max-batch``
+    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,aio-max-batch=aio-max-batch,io-uring-sqpoll=on|off``
         Creates a dedicated event loop thread that devices can be
         assigned to. This is known as an IOThread. By default device
         emulation happens in vCPU threads or the main event loop thread.
@@ -5883,6 +5964,11 @@ SRST
         in a batch for the AIO engine, 0 means that the engine will use
         its default.
 
+        The ``io-uring-sqpoll`` parameter makes a kernel thread poll the
+        IOThread's io_uring submission queue, which avoids system calls
+        for submitting I/O at the cost of a busy host CPU.  Unlike the
+        other parameters it cannot be changed at run-time.
+
         The IOThread parameters can be modified at run-time using the
         ``qom-set`` command (where ``iothread1`` is the IOThread's
         ``id``):
@@ -1430,10 +1430,33 @@ static inline AArch64DecodeFn *lookup_disas_fn(const AArch64DecodeTable *table,
  * match up with those in the manual.
  */
 
+/*
+ * In a superblock, continue translating at the destination of a direct
+ * branch instead of ending the TB.  Since this updates pc_next, a later
+ * DISAS_TOO_MANY exit still goes to the right place.
+ */
+static bool follow_jump(DisasContext *s, int64_t diff)
+{
+    vaddr dest = s->pc_curr + diff;
+    int bound;
+
+    if (s->ss_active || !translator_follow_jump(&s->base, dest)) {
+        return false;
+    }
+
+    /* Do not translate past the end of the page, as in init_disas_context */
+    bound = -(dest | TARGET_PAGE_MASK) / 4;
+    s->base.max_insns = MIN(s->base.max_insns, s->base.num_insns + bound);
+    s->base.pc_next = dest;
+    return true;
+}
+
 static bool trans_B(DisasContext *s, arg_i *a)
 {
     reset_btype(s);
-    gen_goto_tb(s, 0, a->imm);
+    if (!follow_jump(s, a->imm)) {
+        gen_goto_tb(s, 0, a->imm);
+    }
     return true;
 }
 
@@ -1441,7 +1464,9 @@ static bool trans_BL(DisasContext *s, arg_i *a)
 {
     gen_pc_plus_diff(s, cpu_reg(s, 30), curr_insn_len(s));
     reset_btype(s);
-    gen_goto_tb(s, 0, a->imm);
+    if (!follow_jump(s, a->imm)) {
+        gen_goto_tb(s, 0, a->imm);
+    }
     return true;
 }
 
@@ -11896,6 +11921,9 @@ static bool is_guarded_page(CPUARMState *env, DisasContext *s)
     int mmu_idx = arm_to_core_mmu_idx(s->mmu_idx);
     int flags;
 
+    /* The TLB belongs to the vCPU thread */
+    translator_require_vcpu(&s->base);
+
     /*
      * We test this immediately after reading an insn, which means
      * that the TLB entry must be present and valid, and thus this
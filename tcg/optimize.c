@@ -2702,6 +2702,131 @@ static bool fold_xor(OptContext *ctx, TCGOp *op)
     return fold_masks(ctx, op);
 }
 
+/* Stores to env that may still be overwritten, see remove_dead_stores. */
+#define MAX_PENDING_STORES  16
+
+typedef struct PendingStore {
+    TCGOp *op;
+    intptr_t ofs;
+    intptr_t last;
+} PendingStore;
+
+/* Return the number of bytes of env accessed by a load or store @op. */
+static intptr_t env_access_size(TCGOp *op)
+{
+    switch (op->opc) {
+    CASE_OP_32_64(ld8s):
+    CASE_OP_32_64(ld8u):
+    CASE_OP_32_64(st8):
+        return 1;
+    CASE_OP_32_64(ld16s):
+    CASE_OP_32_64(ld16u):
+    CASE_OP_32_64(st16):
+        return 2;
+    case INDEX_op_ld32s_i64:
+    case INDEX_op_ld32u_i64:
+    case INDEX_op_ld_i32:
+    case INDEX_op_st32_i64:
+    case INDEX_op_st_i32:
+        return 4;
+    case INDEX_op_ld_i64:
+    case INDEX_op_st_i64:
+        return 8;
+    case INDEX_op_ld_vec:
+    case INDEX_op_st_vec:
+    case INDEX_op_dupm_vec:
+        return tcg_type_size(TCG_TYPE_V64 + TCGOP_VECL(op));
+    default:
+        g_assert_not_reached();
+    }
+}
+
+/*
+ * Remove the stores to env that are completely overwritten by a later
+ * store before anything can observe them.  The value in env can be
+ * observed by loads from env, by loads and stores through other pointers
+ * (which may point into env), by helpers, by guest memory accesses that
+ * may raise an exception, and by whatever runs after the end of the
+ * basic block; each of these keeps the pending stores.  Stores are never
+ * removed across a branch, and in particular not across goto_tb: the
+ * next TB may exit to the main loop before overwriting anything.
+ */
+static void remove_dead_stores(TCGContext *s)
+{
+    PendingStore pending[MAX_PENDING_STORES];
+    TCGOp *op, *op_next;
+    int i, j, n = 0;
+
+    QTAILQ_FOREACH_SAFE(op, &s->ops, link, op_next) {
+        const TCGOpDef *def = &tcg_op_defs[op->opc];
+        intptr_t ofs, last;
+
+        switch (op->opc) {
+        CASE_OP_32_64(st8):
+        CASE_OP_32_64(st16):
+        case INDEX_op_st32_i64:
+        case INDEX_op_st_i32:
+        case INDEX_op_st_i64:
+        case INDEX_op_st_vec:
+            if (op->args[1] != tcgv_ptr_arg(tcg_env)) {
+                n = 0;
+                break;
+            }
+            ofs = op->args[2];
+            last = ofs + env_access_size(op) - 1;
+            for (i = j = 0; i < n; i++) {
+                if (pending[i].ofs >= ofs && pending[i].last <= last) {
+                    tcg_op_remove(s, pending[i].op);
+                } else {
+                    pending[j++] = pending[i];
+                }
+            }
+            n = j;
+            if (n < MAX_PENDING_STORES) {
+                pending[n++] = (PendingStore){ op, ofs, last };
+            }
+            break;
+
+        CASE_OP_32_64(ld8s):
+        CASE_OP_32_64(ld8u):
+        CASE_OP_32_64(ld16s):
+        CASE_OP_32_64(ld16u):
+        case INDEX_op_ld32s_i64:
+        case INDEX_op_ld32u_i64:
+        case INDEX_op_ld_i32:
+        case INDEX_op_ld_i64:
+        case INDEX_op_ld_vec:
+        case INDEX_op_dupm_vec:
+            if (op->args[1] != tcgv_ptr_arg(tcg_env)) {
+                n = 0;
+                break;
+            }
+            ofs = op->args[2];
+            last = ofs + env_access_size(op) - 1;
+            for (i = j = 0; i < n; i++) {
+                if (pending[i].last < ofs || pending[i].ofs > last) {
+                    pending[j++] = pending[i];
+                }
+            }
+            n = j;
+            break;
+
+        case INDEX_op_call:
+        case INDEX_op_plugin_cb:
+        case INDEX_op_plugin_mem_cb:
+            n = 0;
+            break;
+
+        default:
+            if (def->flags & (TCG_OPF_BB_END | TCG_OPF_BB_EXIT |
+                              TCG_OPF_SIDE_EFFECTS | TCG_OPF_CALL_CLOBBER)) {
+                n = 0;
+            }
+            break;
+        }
+    }
+}
+
 /* Propagate constants and copies, fold constant expressions. */
 void tcg_optimize(TCGContext *s)
 {
@@ -2946,4 +3071,6 @@ void tcg_optimize(TCGContext *s)
             finish_folding(&ctx, op);
         }
     }
+
+    remove_dead_stores(s);
 }
@@ -57,6 +57,12 @@ struct tcg_region_tree {
  * dynamically allocate from as demand dictates. Given appropriate region
  * sizing, this minimizes flushes even when some TCG threads generate a lot
  * more code than others.
+ *
+ * With eviction enabled, the oldest region that is not in use by any
+ * context is evicted when only a few regions are left, instead of waiting
+ * for the buffer to fill up and flushing everything.  The TBs in the
+ * region are invalidated and, once no vCPU can be executing them anymore
+ * (i.e. after an RCU grace period), the region is added to a free list.
  */
 struct tcg_region_state {
     QemuMutex lock;
@@ -68,10 +74,21 @@ struct tcg_region_state {
     size_t size; /* size of one region */
     size_t stride; /* .size + guard size */
     size_t total_size; /* size of entire buffer, >= n * stride */
+    bool evict;
 
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+
+    /* eviction state, also protected by the lock */
+    size_t *fifo; /* allocated regions, oldest first */
+    size_t n_fifo;
+    size_t *free; /* evicted regions */
+    size_t n_free;
+    size_t *size_full; /* contribution of each region to agg_size_full */
+    unsigned epoch; /* incremented by tcg_region_reset_all */
+    bool evicting;
+    bool evict_wanted; /* may be read without the lock */
 };
 
 static struct tcg_region_state region;
@@ -191,10 +208,24 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+/* @p must point into the rw view of code_gen_buffer */
+static size_t tcg_region_idx(const void *p)
 {
-    size_t region_idx;
+    ptrdiff_t offset;
 
+    if (p < region.start_aligned) {
+        return 0;
+    }
+
+    offset = p - region.start_aligned;
+    if (offset > region.stride * (region.n - 1)) {
+        return region.n - 1;
+    }
+    return offset / region.stride;
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -206,18 +237,7 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
         }
     }
 
-    if (p < region.start_aligned) {
-        region_idx = 0;
-    } else {
-        ptrdiff_t offset = p - region.start_aligned;
-
-        if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
-        }
-    }
-    return region_trees + region_idx * tree_size;
+    return region_trees + tcg_region_idx(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -311,6 +331,14 @@ size_t tcg_nb_tbs(void)
     return nb_tbs;
 }
 
+/* Call with rt->lock held */
+static void tcg_region_tree_reset(struct tcg_region_tree *rt)
+{
+    /* Increment the refcount first so that destroy acts as a reset */
+    q_tree_ref(rt->tree);
+    q_tree_destroy(rt->tree);
+}
+
 static void tcg_region_tree_reset_all(void)
 {
     size_t i;
@@ -319,9 +347,7 @@ static void tcg_region_tree_reset_all(void)
     for (i = 0; i < region.n; i++) {
         struct tcg_region_tree *rt = region_trees + i * tree_size;
 
-        /* Increment the refcount first so that destroy acts as a reset */
-        q_tree_ref(rt->tree);
-        q_tree_destroy(rt->tree);
+        tcg_region_tree_reset(rt);
     }
     tcg_region_tree_unlock_all();
 }
@@ -357,13 +383,38 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
     s->code_gen_highwater = end - TCG_HIGHWATER;
 }
 
+/*
+ * With eviction enabled, start evicting the oldest region once no more
+ * than this many regions are left for allocation.
+ */
+#define TCG_REGION_EVICT_LOW 2
+
+static void tcg_region_update_evict_wanted__locked(void)
+{
+    size_t avail = region.n - region.current + region.n_free;
+
+    qatomic_set(&region.evict_wanted,
+                region.evict && !region.evicting &&
+                avail <= TCG_REGION_EVICT_LOW);
+}
+
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
+    size_t i;
+
+    if (region.current < region.n) {
+        i = region.current++;
+    } else if (region.n_free) {
+        i = region.free[--region.n_free];
+    } else {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    tcg_region_assign(s, i);
+
+    if (region.evict) {
+        region.fifo[region.n_fifo++] = i;
+        tcg_region_update_evict_wanted__locked();
+    }
     return false;
 }
 
@@ -376,16 +427,116 @@ bool tcg_region_alloc(TCGContext *s)
     bool err;
     /* read the region size now; alloc__locked will overwrite it on success */
     size_t size_full = s->code_gen_buffer_size;
+    size_t full = tcg_region_idx(s->code_gen_buffer);
 
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
         region.agg_size_full += size_full - TCG_HIGHWATER;
+        if (region.evict) {
+            region.size_full[full] = size_full - TCG_HIGHWATER;
+        }
     }
     qemu_mutex_unlock(&region.lock);
     return err;
 }
 
+/* Return true if region @i is the current region of a TCG context */
+static bool tcg_region_in_use__locked(size_t i)
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    unsigned int j;
+
+    for (j = 0; j < n_ctxs; j++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[j]);
+
+        if (tcg_region_idx(s->code_gen_buffer) == i) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * If few regions are left, pick the oldest region that no context is
+ * translating into and return true.  The caller must invalidate the TBs
+ * in *@pidx (see tcg_region_foreach_tb) and, once no vCPU can be running
+ * them, call tcg_region_evict_end with the same @pidx and @pepoch.
+ */
+bool tcg_region_evict_begin(size_t *pidx, unsigned *pepoch)
+{
+    bool ret = false;
+    size_t i;
+
+    if (!qatomic_read(&region.evict_wanted)) {
+        return false;
+    }
+
+    qemu_mutex_lock(&region.lock);
+    if (!region.evicting) {
+        for (i = 0; i < region.n_fifo; i++) {
+            if (!tcg_region_in_use__locked(region.fifo[i])) {
+                *pidx = region.fifo[i];
+                *pepoch = region.epoch;
+                region.n_fifo--;
+                memmove(&region.fifo[i], &region.fifo[i + 1],
+                        (region.n_fifo - i) * sizeof(region.fifo[0]));
+                region.evicting = true;
+                ret = true;
+                break;
+            }
+        }
+    }
+    tcg_region_update_evict_wanted__locked();
+    qemu_mutex_unlock(&region.lock);
+    return ret;
+}
+
+/*
+ * Make the region passed to tcg_region_evict_begin available again.
+ * Nothing is done if the code buffer was flushed in the meantime.
+ */
+void tcg_region_evict_end(size_t i, unsigned epoch)
+{
+    struct tcg_region_tree *rt = region_trees + i * tree_size;
+
+    qemu_mutex_lock(&region.lock);
+    if (epoch == region.epoch) {
+        qemu_mutex_lock(&rt->lock);
+        tcg_region_tree_reset(rt);
+        qemu_mutex_unlock(&rt->lock);
+
+        region.agg_size_full -= region.size_full[i];
+        region.size_full[i] = 0;
+        region.free[region.n_free++] = i;
+        region.evicting = false;
+        tcg_region_update_evict_wanted__locked();
+    }
+    qemu_mutex_unlock(&region.lock);
+}
+
+/*
+ * Call @func on each TB in region @i.  @func must not take page locks,
+ * because tcg_tb_lookup can be called with them held.
+ */
+void tcg_region_foreach_tb(size_t i, GTraverseFunc func, gpointer user_data)
+{
+    struct tcg_region_tree *rt = region_trees + i * tree_size;
+
+    qemu_mutex_lock(&rt->lock);
+    q_tree_foreach(rt->tree, func, user_data);
+    qemu_mutex_unlock(&rt->lock);
+}
+
+/* Return true if @p points into region @i */
+bool tcg_region_contains(size_t i, const void *p)
+{
+    void *start, *end;
+
+    tcg_region_bounds(i, &start, &end);
+    return p >= start && p < end;
+}
+
 /*
  * Perform a context's first region allocation.
  * This function does _not_ increment region.agg_size_full.
@@ -412,6 +563,13 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    if (region.evict) {
+        region.n_fifo = 0;
+        region.n_free = 0;
+        memset(region.size_full, 0, region.n * sizeof(region.size_full[0]));
+        region.epoch++;
+        region.evicting = false;
+    }
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -748,8 +906,12 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
  * However, this user-mode limitation is unlikely to be a significant problem
  * in practice. Multi-threaded guests share most if not all of their translated
  * code, which makes parallel code generation less appealing than in system-mode
+ *
+ * If @evict is true, a few more regions are created so that there is always
+ * one to evict, also in user-mode.  They are used in turn by the contexts.
  */
-void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
+void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus,
+                     bool evict)
 {
     const size_t page_size = qemu_real_host_page_size();
     size_t region_size;
@@ -788,6 +950,13 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
      * the buffer; we will assign those to the last region.
      */
     region.n = tcg_n_regions(tb_size, max_cpus);
+    if (evict) {
+        region.n += TCG_REGION_EVICT_LOW + 2;
+        region.evict = true;
+        region.fifo = g_new(size_t, region.n);
+        region.free = g_new(size_t, region.n);
+        region.size_full = g_new0(size_t, region.n);
+    }
     region_size = tb_size / region.n;
     region_size = QEMU_ALIGN_DOWN(region_size, page_size);
 
@@ -234,6 +234,7 @@ static TCGAtomAlign atom_and_align_for_opc(TCGContext *s, MemOp opc,
 #ifdef CONFIG_USER_ONLY
 bool tcg_use_softmmu;
 #endif
+bool tcg_spill_lookahead;
 
 TCGContext tcg_init_ctx;
 __thread TCGContext *tcg_ctx;
@@ -1372,10 +1373,28 @@ static void tcg_context_init(unsigned max_cpus)
     tcg_env = temp_tcgv_ptr(ts);
 }
 
-void tcg_init(size_t tb_size, int splitwx, unsigned max_cpus)
+void tcg_init(size_t tb_size, int splitwx, unsigned max_cpus, bool evict)
 {
     tcg_context_init(max_cpus);
-    tcg_region_init(tb_size, splitwx, max_cpus);
+    tcg_region_init(tb_size, splitwx, max_cpus, evict);
+}
+
+void tcg_regalloc_counts(size_t *ploads, size_t *pstores, size_t *pspills)
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    size_t loads = 0, stores = 0, spills = 0;
+    unsigned int i;
+
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[i]);
+
+        loads += qatomic_read(&s->nb_temp_loads);
+        stores += qatomic_read(&s->nb_temp_stores);
+        spills += qatomic_read(&s->nb_spills);
+    }
+    *ploads = loads;
+    *pstores = stores;
+    *pspills = spills;
 }
 
 /*
@@ -1502,6 +1521,8 @@ void tcg_func_start(TCGContext *s)
     s->nb_ops = 0;
     s->nb_labels = 0;
     s->current_frame_offset = s->frame_start;
+    s->gen_host_ptr = false;
+    s->alloc_op = NULL;
 
 #ifdef CONFIG_DEBUG_TCG
     s->goto_tb_issue_mask = 0;
@@ -1896,6 +1917,9 @@ TCGv_i64 tcg_constant_i64(int64_t val)
 
 TCGv_ptr tcg_constant_ptr_int(intptr_t val)
 {
+    if (!in_code_gen_buffer((void *)val)) {
+        tcg_ctx->gen_host_ptr = true;
+    }
     return temp_tcgv_ptr(tcg_constant_internal(TCG_TYPE_PTR, val));
 }
 
@@ -4282,6 +4306,7 @@ static void temp_sync(TCGContext *s, TCGTemp *ts, TCGRegSet allocated_regs,
         case TEMP_VAL_REG:
             tcg_out_st(s, ts->type, ts->reg,
                        ts->mem_base->reg, ts->mem_offset);
+            qatomic_set(&s->nb_temp_stores, s->nb_temp_stores + 1);
             break;
 
         case TEMP_VAL_MEM:
@@ -4307,6 +4332,103 @@ static void tcg_reg_free(TCGContext *s, TCGReg reg, TCGRegSet allocated_regs)
     }
 }
 
+/*
+ * Same as tcg_reg_free(), when the register allocator evicts the temp to
+ * make room for another one.  Only these evictions count as spills in
+ * "info jit", not those done around calls or for fixed registers.
+ */
+static void tcg_reg_spill(TCGContext *s, TCGReg reg, TCGRegSet allocated_regs)
+{
+    if (s->reg_to_temp[reg] != NULL) {
+        qatomic_set(&s->nb_spills, s->nb_spills + 1);
+        tcg_reg_free(s, reg, allocated_regs);
+    }
+}
+
+/*
+ * Ops after the one being allocated that are examined for the next use
+ * of a spill candidate.  Candidates that are not read again within the
+ * window, or before the end of the basic block, are the cheapest.
+ */
+#define TCG_SPILL_WINDOW      64
+
+/* Cost of the store needed to spill a temp whose memory copy is stale */
+#define TCG_SPILL_STORE_COST  (TCG_SPILL_WINDOW / 4)
+
+/*
+ * Return the number of ops from s->alloc_op to the next read of @ts, 0 if
+ * s->alloc_op itself reads it, or TCG_SPILL_WINDOW if it is written first,
+ * or not read at all in the window and in the rest of the basic block.
+ */
+static int temp_next_use(TCGContext *s, TCGTemp *ts)
+{
+    const TCGOp *op = s->alloc_op;
+    int dist;
+
+    if (op == NULL) {
+        return TCG_SPILL_WINDOW;
+    }
+
+    for (dist = 0; dist < TCG_SPILL_WINDOW; dist++) {
+        const TCGOpDef *def;
+        int i, nb_oargs, nb_iargs;
+
+        if (dist) {
+            op = QTAILQ_NEXT(op, link);
+            if (op == NULL) {
+                break;
+            }
+        }
+
+        def = &tcg_op_defs[op->opc];
+        if (op->opc == INDEX_op_call) {
+            nb_oargs = TCGOP_CALLO(op);
+            nb_iargs = TCGOP_CALLI(op);
+        } else {
+            nb_oargs = def->nb_oargs;
+            nb_iargs = def->nb_iargs;
+        }
+
+        for (i = nb_oargs; i < nb_oargs + nb_iargs; i++) {
+            if (arg_temp(op->args[i]) == ts) {
+                return dist;
+            }
+        }
+        for (i = 0; i < nb_oargs; i++) {
+            if (arg_temp(op->args[i]) == ts) {
+                return TCG_SPILL_WINDOW;
+            }
+        }
+        if (def->flags & TCG_OPF_BB_END) {
+            break;
+        }
+    }
+    return TCG_SPILL_WINDOW;
+}
+
+/*
+ * Estimate the cost of spilling @reg: a store if the memory copy of the
+ * temp is stale, plus a reload that is more expensive the sooner it is
+ * needed.  Evicting the temp that is needed last is what minimizes the
+ * number of reloads in straight-line code.  This is only a heuristic for
+ * -accel tcg,x-spill-lookahead=on; it knows nothing about later blocks.
+ */
+static int tcg_reg_spill_cost(TCGContext *s, TCGReg reg)
+{
+    TCGTemp *ts = s->reg_to_temp[reg];
+    int cost;
+
+    if (ts == NULL) {
+        return 0;
+    }
+
+    cost = TCG_SPILL_WINDOW - temp_next_use(s, ts);
+    if (!temp_readonly(ts) && !ts->mem_coherent) {
+        cost += TCG_SPILL_STORE_COST;
+    }
+    return cost;
+}
+
 /**
  * tcg_reg_alloc:
  * @required_regs: Set of registers in which we must allocate.
@@ -4363,13 +4485,32 @@ static TCGReg tcg_reg_alloc(TCGContext *s, TCGRegSet required_regs,
         if (tcg_regset_single(set)) {
             /* One register in the set.  */
             TCGReg reg = tcg_regset_first(set);
-            tcg_reg_free(s, reg, allocated_regs);
+            tcg_reg_spill(s, reg, allocated_regs);
             return reg;
+        } else if (tcg_spill_lookahead) {
+            /* Spill the cheapest register, in allocation order on ties. */
+            TCGReg best = -1;
+            int best_cost = INT_MAX;
+
+            for (i = 0; i < n; i++) {
+                TCGReg reg = order[i];
+                if (tcg_regset_test_reg(set, reg)) {
+                    int cost = tcg_reg_spill_cost(s, reg);
+                    if (cost < best_cost) {
+                        best = reg;
+                        best_cost = cost;
+                    }
+                }
+            }
+            if (best_cost != INT_MAX) {
+                tcg_reg_spill(s, best, allocated_regs);
+                return best;
+            }
         } else {
             for (i = 0; i < n; i++) {
                 TCGReg reg = order[i];
                 if (tcg_regset_test_reg(set, reg)) {
-                    tcg_reg_free(s, reg, allocated_regs);
+                    tcg_reg_spill(s, reg, allocated_regs);
                     return reg;
                 }
             }
@@ -4414,8 +4555,8 @@ static TCGReg tcg_reg_alloc_pair(TCGContext *s, TCGRegSet required_regs,
                 if (tcg_regset_test_reg(set, reg)) {
                     int f = !s->reg_to_temp[reg] + !s->reg_to_temp[reg + 1];
                     if (f >= fmin) {
-                        tcg_reg_free(s, reg, allocated_regs);
-                        tcg_reg_free(s, reg + 1, allocated_regs);
+                        tcg_reg_spill(s, reg, allocated_regs);
+                        tcg_reg_spill(s, reg + 1, allocated_regs);
                         return reg;
                     }
                 }
@@ -4465,6 +4606,7 @@ static void temp_load(TCGContext *s, TCGTemp *ts, TCGRegSet desired_regs,
         reg = tcg_reg_alloc(s, desired_regs, allocated_regs,
                             preferred_regs, ts->indirect_base);
         tcg_out_ld(s, ts->type, reg, ts->mem_base->reg, ts->mem_offset);
+        qatomic_set(&s->nb_temp_loads, s->nb_temp_loads + 1);
         ts->mem_coherent = 1;
         break;
     case TEMP_VAL_DEAD:
@@ -6190,6 +6332,7 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, uint64_t pc_start)
     QTAILQ_FOREACH(op, &s->ops, link) {
         TCGOpcode opc = op->opc;
 
+        s->alloc_op = op;
         switch (opc) {
         case INDEX_op_mov_i32:
         case INDEX_op_mov_i64:
@@ -0,0 +1,89 @@
+/*
+ * QEMU Toeplitz hash speed benchmark
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include "qemu/osdep.h"
+#include "qemu/toeplitz.h"
+#include "net/checksum.h"
+
+/* The key from the Microsoft RSS verification suite */
+static uint8_t key[TOEPLITZ_KEY_MAX_LEN] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+/* IPv4 66.9.149.187:2794 -> 161.142.100.80:1766 */
+static uint8_t input[TOEPLITZ_KEY_MAX_LEN - 4] = {
+    0x42, 0x09, 0x95, 0xbb, 0xa1, 0x8e, 0x64, 0x50, 0x0a, 0xea, 0x06, 0xe6,
+};
+
+static uint32_t reference_hash(const uint8_t *in, size_t len)
+{
+    net_toeplitz_key key_data;
+    uint32_t hash = 0;
+
+    net_toeplitz_key_init(&key_data, key);
+    net_toeplitz_add(&hash, (uint8_t *)in, len, &key_data);
+    return hash;
+}
+
+static void test(const void *opaque)
+{
+    ToeplitzKey k = { };
+    int accel_index = 0;
+
+    g_assert_cmphex(reference_hash(input, 12), ==, 0x51ccc178);
+
+    do {
+        toeplitz_key_init(&k, key, sizeof(key));
+        g_assert_cmphex(toeplitz_hash(&k, input, 12), ==, 0x51ccc178);
+
+        for (int i = 0; i < 10000; i++) {
+            size_t len = g_test_rand_int_range(0, sizeof(input) + 1);
+            uint8_t buf[sizeof(input)];
+
+            for (size_t j = 0; j < len; j++) {
+                buf[j] = g_test_rand_int();
+            }
+            g_assert_cmphex(toeplitz_hash(&k, buf, len), ==,
+                            reference_hash(buf, len));
+        }
+
+        if (accel_index != 0) {
+            g_test_message("%s", "");  /* gnu_printf Werror for simple "" */
+        }
+        /* IPv4 + ports, IPv6 + ports */
+        for (size_t len = 12; len <= sizeof(input); len += 24) {
+            uint8_t buf[sizeof(input)];
+            double total = 0.0;
+
+            memcpy(buf, input, sizeof(input));
+
+            g_test_timer_start();
+            do {
+                for (int i = 0; i < 1000; i++) {
+                    buf[0] ^= toeplitz_hash(&k, buf, len);
+                }
+                total += 1000;
+            } while (g_test_timer_elapsed() < 0.5);
+
+            g_test_message("toeplitz_hash #%d: %2zu bytes %8.2f Mhash/sec",
+                           accel_index, len,
+                           total / 1e6 / g_test_timer_last());
+        }
+        accel_index++;
+    } while (test_toeplitz_next_accel());
+
+    toeplitz_key_destroy(&k);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_data_func("/util/toeplitz/speed", NULL, test);
+    return g_test_run();
+}
@@ -0,0 +1,133 @@
+/*
+ * QEMU XBZRLE encode/decode speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "qemu/units.h"
+#include "../migration/xbzrle.h"
+
+#define PAGE_SIZE 4096
+#define PAGES 256
+
+typedef struct {
+    const char *name;
+    /* number of changed runs per page, and their maximum length */
+    int runs;
+    int run_len;
+    uint8_t *old;
+    uint8_t *new;
+    uint8_t *encoded;
+    int len[PAGES];
+} BenchPattern;
+
+static BenchPattern patterns[] = {
+    { "sparse", 8, 4 },
+    { "scattered", 150, 8 },
+    { "clustered", 16, 128 },
+};
+
+static void pattern_init(BenchPattern *pat)
+{
+    int i, j, k;
+
+    pat->old = g_malloc(PAGES * PAGE_SIZE);
+    pat->new = g_malloc(PAGES * PAGE_SIZE);
+    pat->encoded = g_malloc(PAGES * PAGE_SIZE);
+
+    for (i = 0; i < PAGES * PAGE_SIZE; i++) {
+        pat->old[i] = g_test_rand_int();
+    }
+    memcpy(pat->new, pat->old, PAGES * PAGE_SIZE);
+
+    for (i = 0; i < PAGES; i++) {
+        uint8_t *page = pat->new + i * PAGE_SIZE;
+
+        for (j = 0; j < pat->runs; j++) {
+            int pos = g_test_rand_int_range(0, PAGE_SIZE);
+            int len = g_test_rand_int_range(1, pat->run_len + 1);
+
+            for (k = pos; k < MIN(pos + len, PAGE_SIZE); k++) {
+                page[k] ^= 0xff;
+            }
+        }
+    }
+}
+
+static void pattern_free(BenchPattern *pat)
+{
+    g_free(pat->old);
+    g_free(pat->new);
+    g_free(pat->encoded);
+}
+
+static void bench_pattern(BenchPattern *pat, int accel_index,
+                          uint8_t *buffer)
+{
+    double total = 0.0;
+    int i;
+
+    g_test_timer_start();
+    do {
+        for (i = 0; i < PAGES; i++) {
+            pat->len[i] = xbzrle_encode_buffer(pat->old + i * PAGE_SIZE,
+                                               pat->new + i * PAGE_SIZE,
+                                               PAGE_SIZE,
+                                               pat->encoded + i * PAGE_SIZE,
+                                               PAGE_SIZE);
+        }
+        total += PAGES * PAGE_SIZE;
+    } while (g_test_timer_elapsed() < 0.5);
+    g_test_message("xbzrle #%d %-10s encode %8.0f MB/sec", accel_index,
+                   pat->name, total / MiB / g_test_timer_last());
+
+    total = 0.0;
+    g_test_timer_start();
+    do {
+        for (i = 0; i < PAGES; i++) {
+            if (pat->len[i] > 0) {
+                xbzrle_decode_buffer(pat->encoded + i * PAGE_SIZE,
+                                     pat->len[i], buffer, PAGE_SIZE);
+            }
+        }
+        total += PAGES * PAGE_SIZE;
+    } while (g_test_timer_elapsed() < 0.5);
+    g_test_message("xbzrle #%d %-10s decode %8.0f MB/sec", accel_index,
+                   pat->name, total / MiB / g_test_timer_last());
+}
+
+static void test(const void *opaque)
+{
+    uint8_t *buffer = g_malloc(PAGE_SIZE);
+    int accel_index = 0;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(patterns); i++) {
+        pattern_init(&patterns[i]);
+    }
+
+    do {
+        if (accel_index != 0) {
+            g_test_message("%s", "");  /* gnu_printf Werror for simple "" */
+        }
+        for (i = 0; i < ARRAY_SIZE(patterns); i++) {
+            bench_pattern(&patterns[i], accel_index, buffer);
+        }
+        accel_index++;
+    } while (test_xbzrle_next_accel());
+
+    for (i = 0; i < ARRAY_SIZE(patterns); i++) {
+        pattern_free(&patterns[i]);
+    }
+    g_free(buffer);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_data_func("/migration/xbzrle/speed", NULL, test);
+    return g_test_run();
+}
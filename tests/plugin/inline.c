@@ -18,8 +18,10 @@ typedef struct {
     uint64_t count_tb_inline;
     uint64_t count_insn;
     uint64_t count_insn_inline;
+    uint64_t count_insn_ring;
     uint64_t count_mem;
     uint64_t count_mem_inline;
+    uint64_t count_mem_ring;
     uint64_t tb_cond_num_trigger;
     uint64_t tb_cond_track_count;
     uint64_t insn_cond_num_trigger;
@@ -28,6 +30,10 @@ typedef struct {
 
 static const uint64_t cond_trigger_limit = 100;
 
+/* Not a divisor of the counts, so that some events are left at exit */
+static const size_t ring_size = 97;
+static const uint64_t insn_ring_info = 0x1234;
+
 typedef struct {
     uint64_t data_insn;
     uint64_t data_tb;
@@ -39,8 +45,10 @@ static qemu_plugin_u64 count_tb;
 static qemu_plugin_u64 count_tb_inline;
 static qemu_plugin_u64 count_insn;
 static qemu_plugin_u64 count_insn_inline;
+static qemu_plugin_u64 count_insn_ring;
 static qemu_plugin_u64 count_mem;
 static qemu_plugin_u64 count_mem_inline;
+static qemu_plugin_u64 count_mem_ring;
 static qemu_plugin_u64 tb_cond_num_trigger;
 static qemu_plugin_u64 tb_cond_track_count;
 static qemu_plugin_u64 insn_cond_num_trigger;
@@ -49,6 +57,8 @@ static struct qemu_plugin_scoreboard *data;
 static qemu_plugin_u64 data_insn;
 static qemu_plugin_u64 data_tb;
 static qemu_plugin_u64 data_mem;
+static struct qemu_plugin_ring *insn_ring;
+static struct qemu_plugin_ring *mem_ring;
 
 static uint64_t global_count_tb;
 static uint64_t global_count_insn;
@@ -66,6 +76,7 @@ static void stats_insn(void)
     const uint64_t per_vcpu = qemu_plugin_u64_sum(count_insn);
     const uint64_t inl_per_vcpu =
         qemu_plugin_u64_sum(count_insn_inline);
+    const uint64_t ring = qemu_plugin_u64_sum(count_insn_ring);
     const uint64_t cond_num_trigger =
         qemu_plugin_u64_sum(insn_cond_num_trigger);
     const uint64_t cond_track_left = qemu_plugin_u64_sum(insn_cond_track_count);
@@ -75,10 +86,12 @@ static void stats_insn(void)
     printf("insn: %" PRIu64 " (per vcpu)\n", per_vcpu);
     printf("insn: %" PRIu64 " (per vcpu inline)\n", inl_per_vcpu);
     printf("insn: %" PRIu64 " (cond cb)\n", conditional);
+    printf("insn: %" PRIu64 " (ring)\n", ring);
     g_assert(expected > 0);
     g_assert(per_vcpu == expected);
     g_assert(inl_per_vcpu == expected);
     g_assert(conditional == expected);
+    g_assert(ring == expected);
 }
 
 static void stats_tb(void)
@@ -107,12 +120,15 @@ static void stats_mem(void)
     const uint64_t per_vcpu = qemu_plugin_u64_sum(count_mem);
     const uint64_t inl_per_vcpu =
         qemu_plugin_u64_sum(count_mem_inline);
+    const uint64_t ring = qemu_plugin_u64_sum(count_mem_ring);
     printf("mem: %" PRIu64 "\n", expected);
     printf("mem: %" PRIu64 " (per vcpu)\n", per_vcpu);
     printf("mem: %" PRIu64 " (per vcpu inline)\n", inl_per_vcpu);
+    printf("mem: %" PRIu64 " (ring)\n", ring);
     g_assert(expected > 0);
     g_assert(per_vcpu == expected);
     g_assert(inl_per_vcpu == expected);
+    g_assert(ring == expected);
 }
 
 static void plugin_exit(qemu_plugin_id_t id, void *udata)
@@ -120,6 +136,10 @@ static void plugin_exit(qemu_plugin_id_t id, void *udata)
     const unsigned int num_cpus = qemu_plugin_num_vcpus();
     g_assert(num_cpus == max_cpu_index + 1);
 
+    /* hand over the events left in the rings */
+    qemu_plugin_ring_free(insn_ring);
+    qemu_plugin_ring_free(mem_ring);
+
     for (int i = 0; i < num_cpus ; ++i) {
         const uint64_t tb = qemu_plugin_u64_get(count_tb, i);
         const uint64_t tb_inline = qemu_plugin_u64_get(count_tb_inline, i);
@@ -152,6 +172,8 @@ static void plugin_exit(qemu_plugin_id_t id, void *udata)
         g_assert(tb == tb_inline);
         g_assert(insn == insn_inline);
         g_assert(mem == mem_inline);
+        g_assert(insn == qemu_plugin_u64_get(count_insn_ring, i));
+        g_assert(mem == qemu_plugin_u64_get(count_mem_ring, i));
         g_assert(tb_cond_trigger == tb / cond_trigger_limit);
         g_assert(tb_cond_left == tb % cond_trigger_limit);
         g_assert(insn_cond_trigger == insn / cond_trigger_limit);
@@ -215,6 +237,28 @@ static void vcpu_mem_access(unsigned int cpu_index,
     g_mutex_unlock(&mem_lock);
 }
 
+static void vcpu_insn_ring(unsigned int cpu_index,
+                           const struct qemu_plugin_ring_event *events,
+                           size_t n_events, void *udata)
+{
+    g_assert(udata == &insn_ring);
+    g_assert(n_events > 0 && n_events <= ring_size);
+    for (size_t i = 0; i < n_events; ++i) {
+        g_assert(events[i].vaddr == 0);
+        g_assert(events[i].info == insn_ring_info);
+    }
+    qemu_plugin_u64_add(count_insn_ring, cpu_index, n_events);
+}
+
+static void vcpu_mem_ring(unsigned int cpu_index,
+                          const struct qemu_plugin_ring_event *events,
+                          size_t n_events, void *udata)
+{
+    g_assert(udata == &mem_ring);
+    g_assert(n_events > 0 && n_events <= ring_size);
+    qemu_plugin_u64_add(count_mem_ring, cpu_index, n_events);
+}
+
 static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
 {
     void *tb_store = tb;
@@ -243,6 +287,8 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
             insn, vcpu_insn_exec, QEMU_PLUGIN_CB_NO_REGS, insn_store);
         qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
             insn, QEMU_PLUGIN_INLINE_ADD_U64, count_insn_inline, 1);
+        qemu_plugin_register_vcpu_insn_exec_ring(insn, insn_ring,
+                                                 insn_ring_info);
 
         qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
             insn, QEMU_PLUGIN_INLINE_ADD_U64, insn_cond_track_count, 1);
@@ -262,6 +308,8 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
             insn, QEMU_PLUGIN_MEM_RW,
             QEMU_PLUGIN_INLINE_ADD_U64,
             count_mem_inline, 1);
+        qemu_plugin_register_vcpu_mem_ring(insn, QEMU_PLUGIN_MEM_RW,
+                                           mem_ring);
     }
 }
 
@@ -282,6 +330,10 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
         counts, CPUCount, count_insn_inline);
     count_mem_inline = qemu_plugin_scoreboard_u64_in_struct(
         counts, CPUCount, count_mem_inline);
+    count_insn_ring = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_insn_ring);
+    count_mem_ring = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_mem_ring);
     tb_cond_num_trigger = qemu_plugin_scoreboard_u64_in_struct(
         counts, CPUCount, tb_cond_num_trigger);
     tb_cond_track_count = qemu_plugin_scoreboard_u64_in_struct(
@@ -294,6 +346,8 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
     data_insn = qemu_plugin_scoreboard_u64_in_struct(data, CPUData, data_insn);
     data_tb = qemu_plugin_scoreboard_u64_in_struct(data, CPUData, data_tb);
     data_mem = qemu_plugin_scoreboard_u64_in_struct(data, CPUData, data_mem);
+    insn_ring = qemu_plugin_ring_new(ring_size, vcpu_insn_ring, &insn_ring);
+    mem_ring = qemu_plugin_ring_new(ring_size, vcpu_mem_ring, &mem_ring);
 
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
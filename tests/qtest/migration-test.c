@@ -2301,6 +2301,29 @@ static void test_precopy_file_mapped_ram(void)
     test_file_common(&args, true);
 }
 
+static void *migrate_mapped_ram_load_threads_start(QTestState *from,
+                                                   QTestState *to)
+{
+    migrate_mapped_ram_start(from, to);
+
+    migrate_set_parameter_int(to, "mapped-ram-load-threads", 4);
+
+    return NULL;
+}
+
+static void test_precopy_file_mapped_ram_load_threads(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_mapped_ram_load_threads_start,
+    };
+
+    test_file_common(&args, true);
+}
+
 static void *migrate_multifd_mapped_ram_start(QTestState *from, QTestState *to)
 {
     migrate_mapped_ram_start(from, to);
@@ -2462,6 +2485,52 @@ static void test_precopy_tcp_plain(void)
     test_precopy_common(&args);
 }
 
+static void *test_migrate_zero_page_threads_start(QTestState *from,
+                                                  QTestState *to)
+{
+    migrate_set_parameter_int(from, "zero-page-detection-threads", 4);
+
+    return NULL;
+}
+
+static void test_precopy_tcp_zero_page_threads(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "tcp:127.0.0.1:0",
+        .start_hook = test_migrate_zero_page_threads_start,
+        /*
+         * The helper threads look at guest pages ahead of the migration
+         * thread, make sure pages changing meanwhile are sent again.
+         */
+        .live = true,
+    };
+
+    test_precopy_common(&args);
+}
+
+static void *test_migrate_hot_page_deferral_start(QTestState *from,
+                                                  QTestState *to)
+{
+    migrate_set_capability(from, "hot-page-deferral", true);
+
+    return NULL;
+}
+
+static void test_precopy_tcp_hot_page_deferral(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "tcp:127.0.0.1:0",
+        .start_hook = test_migrate_hot_page_deferral_start,
+        /*
+         * The guest keeps dirtying the same pages, which get deferred:
+         * make sure they still make it to the destination at the end.
+         */
+        .live = true,
+    };
+
+    test_precopy_common(&args);
+}
+
 static void *test_migrate_switchover_ack_start(QTestState *from, QTestState *to)
 {
 
@@ -2921,6 +2990,57 @@ static void test_migrate_auto_converge(void)
     test_migrate_end(from, to, true);
 }
 
+/*
+ * With no way of throttling the guest, predictive-switchover should
+ * give up iterating once the dirty page model shows that precopy
+ * reached its plateau, even though the downtime limit can't be met.
+ * The guest dirties its ~100MB about once per iteration at 30MB/s, so
+ * the plateau is around 3.3s: above downtime-limit, but within the
+ * allowed overshoot of 4 times downtime-limit.
+ */
+static void test_migrate_predictive_switchover(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateStart args = {};
+    QTestState *from, *to;
+    QDict *rsp_return, *pred;
+
+    if (test_migrate_start(&from, &to, uri, &args)) {
+        return;
+    }
+
+    migrate_set_capability(from, "predictive-switchover", true);
+    migrate_set_parameter_int(from, "max-bandwidth", 30 * 1000 * 1000);
+    migrate_set_parameter_int(from, "downtime-limit", 1000);
+
+    /* To check the prediction that made us switch over */
+    migrate_set_capability(from, "pause-before-switchover", true);
+
+    /* Wait for the first serial output from the source */
+    wait_for_serial("src_serial");
+
+    migrate_qmp(from, to, uri, NULL, "{}");
+
+    wait_for_migration_status(from, "pre-switchover", NULL);
+
+    rsp_return = migrate_query_not_failed(from);
+    g_assert(qdict_haskey(rsp_return, "switchover-prediction"));
+    pred = qdict_get_qdict(rsp_return, "switchover-prediction");
+    g_assert_false(qdict_get_bool(pred, "converge"));
+    g_assert_cmpint(qdict_get_int(pred, "rounds"), ==, 0);
+    g_assert_cmpint(qdict_get_int(pred, "dirty-rate"), >, 0);
+    qobject_unref(rsp_return);
+
+    migrate_continue(from, "pre-switchover");
+
+    qtest_qmp_eventwait(to, "RESUME");
+
+    wait_for_serial("dest_serial");
+    wait_for_migration_complete(from);
+
+    test_migrate_end(from, to, true);
+}
+
 static void *
 test_migrate_precopy_tcp_multifd_start_common(QTestState *from,
                                               QTestState *to,
@@ -2990,6 +3110,17 @@ test_migrate_precopy_tcp_multifd_zstd_start(QTestState *from,
 
     return test_migrate_precopy_tcp_multifd_start_common(from, to, "zstd");
 }
+
+static void *
+test_migrate_precopy_tcp_multifd_adaptive_start(QTestState *from,
+                                                QTestState *to)
+{
+    migrate_set_parameter_int(from, "multifd-zstd-level", 2);
+    migrate_set_parameter_int(to, "multifd-zstd-level", 2);
+
+    return test_migrate_precopy_tcp_multifd_start_common(from, to,
+                                                         "adaptive");
+}
 #endif /* CONFIG_ZSTD */
 
 #ifdef CONFIG_QPL
@@ -3087,6 +3218,20 @@ static void test_multifd_tcp_zstd(void)
     };
     test_precopy_common(&args);
 }
+
+static void test_multifd_tcp_adaptive(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_adaptive_start,
+        /*
+         * Pages rewritten by the guest during migration are sent as
+         * XBZRLE deltas, make sure they are applied in order.
+         */
+        .live = true,
+    };
+    test_precopy_common(&args);
+}
 #endif
 
 #ifdef CONFIG_QPL
@@ -3875,6 +4020,8 @@ int main(int argc, char **argv)
                        test_precopy_file_mapped_ram);
     migration_test_add("/migration/precopy/file/mapped-ram/live",
                        test_precopy_file_mapped_ram_live);
+    migration_test_add("/migration/precopy/file/mapped-ram/load-threads",
+                       test_precopy_file_mapped_ram_load_threads);
 
     migration_test_add("/migration/multifd/file/mapped-ram",
                        test_multifd_file_mapped_ram);
@@ -3919,6 +4066,10 @@ int main(int argc, char **argv)
 #endif /* CONFIG_GNUTLS */
 
     migration_test_add("/migration/precopy/tcp/plain", test_precopy_tcp_plain);
+    migration_test_add("/migration/precopy/tcp/plain/zero-page/threads",
+                       test_precopy_tcp_zero_page_threads);
+    migration_test_add("/migration/precopy/tcp/plain/hot-page-deferral",
+                       test_precopy_tcp_hot_page_deferral);
 
     migration_test_add("/migration/precopy/tcp/plain/switchover-ack",
                        test_precopy_tcp_switchover_ack);
@@ -3975,6 +4126,8 @@ int main(int argc, char **argv)
             migration_test_add("/migration/dirty_limit",
                                test_migrate_dirty_limit);
         }
+        migration_test_add("/migration/predictive_switchover",
+                           test_migrate_predictive_switchover);
     }
     migration_test_add("/migration/multifd/tcp/uri/plain/none",
                        test_multifd_tcp_uri_none);
@@ -3991,6 +4144,8 @@ int main(int argc, char **argv)
 #ifdef CONFIG_ZSTD
     migration_test_add("/migration/multifd/tcp/plain/zstd",
                        test_multifd_tcp_zstd);
+    migration_test_add("/migration/multifd/tcp/plain/adaptive",
+                       test_multifd_tcp_adaptive);
 #endif
 #ifdef CONFIG_QPL
     migration_test_add("/migration/multifd/tcp/plain/qpl",
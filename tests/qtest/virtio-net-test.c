@@ -13,6 +13,7 @@
 #include "qemu/module.h"
 #include "qapi/qmp/qdict.h"
 #include "hw/virtio/virtio-net.h"
+#include "standard-headers/linux/virtio_pci.h"
 #include "libqos/qgraph.h"
 #include "libqos/virtio-net.h"
 
@@ -261,6 +262,54 @@ static void announce_self(void *obj, void *data, QGuestAllocator *t_alloc)
     };
 }
 
+/* Reset a virtqueue with VIRTIO_F_RING_RESET, and set it up again */
+static void reset_vq(QVirtioNetPCI *dev, QGuestAllocator *alloc, int index)
+{
+    QVirtioPCIDevice *pdev = &dev->pci_vdev;
+    QVirtioDevice *vdev = &pdev->vdev;
+
+    vdev->bus->queue_select(vdev, index);
+    qpci_io_writew(pdev->pdev, pdev->bar, pdev->common_cfg_offset +
+                   offsetof(struct virtio_pci_modern_common_cfg, queue_reset),
+                   1);
+
+    qvirtqueue_cleanup(vdev->bus, dev->net.queues[index], alloc);
+    dev->net.queues[index] = qvirtqueue_setup(vdev, alloc, index);
+}
+
+/*
+ * The queue pair is processed in an IOThread, and must keep working when
+ * the guest resets and enables its virtqueues one at a time.
+ */
+static void iothread_queue_reset(void *obj, void *data,
+                                 QGuestAllocator *t_alloc)
+{
+    QVirtioNetPCI *dev = obj;
+    QVirtioDevice *vdev = &dev->pci_vdev.vdev;
+    QVirtQueue **vqs = dev->net.queues;
+    int *sv = data;
+    int i;
+
+    if (!(vdev->features & (1ull << VIRTIO_F_RING_RESET))) {
+        g_test_skip("virtqueue reset not negotiated");
+        return;
+    }
+
+    for (i = 0; i < 3; i++) {
+        rx_test(vdev, t_alloc, vqs[0], sv[0]);
+        tx_test(vdev, t_alloc, vqs[1], sv[0]);
+
+        if (i == 0 || i == 2) {
+            reset_vq(dev, t_alloc, 0);
+        }
+        if (i == 1 || i == 2) {
+            reset_vq(dev, t_alloc, 1);
+        }
+    }
+    rx_test(vdev, t_alloc, vqs[0], sv[0]);
+    tx_test(vdev, t_alloc, vqs[1], sv[0]);
+}
+
 static void virtio_net_test_cleanup(void *sockets)
 {
     int *sv = sockets;
@@ -285,6 +334,43 @@ static void *virtio_net_test_setup(GString *cmd_line, void *arg)
     return sv;
 }
 
+/*
+ * iothread-vq-mapping can only be given in JSON, so rewrite the -device
+ * option that qos built for the NIC.
+ */
+static void *virtio_net_test_setup_iothread(GString *cmd_line, void *arg)
+{
+    const char *prefix = "-device virtio-net-pci,";
+    const char *dev = strstr(cmd_line->str, prefix);
+    g_autoptr(GString) json = g_string_new("-device '{\"driver\": "
+                                           "\"virtio-net-pci\"");
+    g_autofree char *opts = NULL;
+    g_auto(GStrv) opt = NULL;
+    size_t pos, len;
+    int i;
+
+    g_assert(dev);
+    pos = dev - cmd_line->str;
+    len = strcspn(dev + strlen(prefix), " ");
+    opts = g_strndup(dev + strlen(prefix), len);
+
+    opt = g_strsplit(opts, ",", 0);
+    for (i = 0; opt[i]; i++) {
+        g_auto(GStrv) kv = g_strsplit(opt[i], "=", 2);
+
+        g_assert(kv[0] && kv[1]);
+        g_string_append_printf(json, ", \"%s\": \"%s\"", kv[0], kv[1]);
+    }
+    g_string_append(json, ", \"iothread-vq-mapping\": "
+                    "[{\"iothread\": \"thread0\"}]}'");
+
+    g_string_erase(cmd_line, pos, strlen(prefix) + len);
+    g_string_insert(cmd_line, pos, json->str);
+    g_string_append(cmd_line, " -object iothread,id=thread0 ");
+
+    return virtio_net_test_setup(cmd_line, arg);
+}
+
 #endif /* _WIN32 */
 
 static void large_tx(void *obj, void *data, QGuestAllocator *t_alloc)
@@ -328,6 +414,10 @@ static void register_virtio_net_test(void)
     qos_add_test("basic", "virtio-net", send_recv_test, &opts);
     qos_add_test("rx_stop_cont", "virtio-net", stop_cont_test, &opts);
     qos_add_test("announce-self", "virtio-net", announce_self, &opts);
+
+    opts.before = virtio_net_test_setup_iothread;
+    qos_add_test("iothread/queue-reset", "virtio-net-pci",
+                 iothread_queue_reset, &opts);
 #endif
 
     /* These tests do not need a loopback backend.  */
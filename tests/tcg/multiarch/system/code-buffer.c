@@ -0,0 +1,59 @@
+/*
+ * Code buffer test
+ *
+ * Call 8192 distinct functions, twice, and check that both passes give
+ * the same result.  This translates a few MB of host code, so with a
+ * small code buffer the translations of the first pass are flushed or
+ * evicted before the second pass runs.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <minilib.h>
+
+/* Each function gets a different constant, so none can be merged */
+#define F(n)                                                            \
+    static __attribute__((noinline)) uint32_t f##n(uint32_t x)          \
+    {                                                                   \
+        return (x ^ 0x##n) * 0x9e3779b1u + (x >> 3);                    \
+    }
+#define F4(n)       F(n##0) F(n##1) F(n##2) F(n##3)
+#define F16(n)      F4(n##0) F4(n##1) F4(n##2) F4(n##3)
+#define F64(n)      F16(n##0) F16(n##1) F16(n##2) F16(n##3)
+#define F256(n)     F64(n##0) F64(n##1) F64(n##2) F64(n##3)
+#define F1024(n)    F256(n##0) F256(n##1) F256(n##2) F256(n##3)
+#define F4096(n)    F1024(n##0) F1024(n##1) F1024(n##2) F1024(n##3)
+
+/* Call each function with the result of the previous one */
+#define C(n)        sum = f##n(sum + 0x##n);
+#define C4(n)       C(n##0) C(n##1) C(n##2) C(n##3)
+#define C16(n)      C4(n##0) C4(n##1) C4(n##2) C4(n##3)
+#define C64(n)      C16(n##0) C16(n##1) C16(n##2) C16(n##3)
+#define C256(n)     C64(n##0) C64(n##1) C64(n##2) C64(n##3)
+#define C1024(n)    C256(n##0) C256(n##1) C256(n##2) C256(n##3)
+#define C4096(n)    C1024(n##0) C1024(n##1) C1024(n##2) C1024(n##3)
+
+F4096(10)
+F4096(11)
+
+static uint32_t call_all(void)
+{
+    uint32_t sum = 0;
+
+    C4096(10)
+    C4096(11)
+    return sum;
+}
+
+int main(void)
+{
+    uint32_t first = call_all();
+    uint32_t second = call_all();
+    bool ok = first == second;
+
+    ml_printf("Results: %x %x\n", first, second);
+    ml_printf("Test complete: %s\n", ok ? "PASSED" : "FAILED");
+    return ok ? 0 : -1;
+}
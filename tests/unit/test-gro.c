@@ -0,0 +1,263 @@
+/*
+ * Generic receive offload unit tests
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/iov.h"
+#include "qemu/main-loop.h"
+#include "net/checksum.h"
+#include "net/eth.h"
+#include "net/gro.h"
+
+#define TEST_PAYLOAD     100
+#define TEST_FRAME_MAX   2048
+#define TEST_MAX_FRAMES  8
+
+#define TEST_HDR_LEN     (ETH_HLEN + sizeof(struct ip_header) + \
+                          sizeof(tcp_header))
+
+static uint8_t delivered[TEST_MAX_FRAMES][TEST_FRAME_MAX];
+static size_t delivered_len[TEST_MAX_FRAMES];
+static int n_delivered;
+
+static ssize_t test_deliver(NetClientState *sender, unsigned flags,
+                            const struct iovec *iov, int iovcnt,
+                            void *opaque)
+{
+    size_t size = iov_size(iov, iovcnt);
+
+    g_assert_cmpint(n_delivered, <, TEST_MAX_FRAMES);
+    g_assert_cmpuint(size, <=, TEST_FRAME_MAX);
+    iov_to_buf(iov, iovcnt, 0, delivered[n_delivered], size);
+    delivered_len[n_delivered++] = size;
+    return size;
+}
+
+/* Build a TCP segment of 10.0.0.1:1234 -> 10.0.0.2:80, filled with @fill */
+static size_t build_segment(uint8_t *buf, uint32_t seq, size_t payload,
+                            uint8_t flags, uint8_t fill)
+{
+    struct eth_header *eth = (struct eth_header *)buf;
+    struct ip_header *ip = (struct ip_header *)(buf + ETH_HLEN);
+    tcp_header *tcp = (tcp_header *)(ip + 1);
+    size_t ip_len = sizeof(*ip) + sizeof(*tcp) + payload;
+
+    memset(buf, 0, ETH_HLEN + ip_len);
+    memset(eth->h_dest, 0x52, ETH_ALEN);
+    memset(eth->h_source, 0x54, ETH_ALEN);
+    stw_be_p(&eth->h_proto, ETH_P_IP);
+
+    ip->ip_ver_len = 0x45;
+    stw_be_p(&ip->ip_len, ip_len);
+    ip->ip_ttl = 64;
+    ip->ip_p = IP_PROTO_TCP;
+    stl_be_p(&ip->ip_src, 0x0a000001);
+    stl_be_p(&ip->ip_dst, 0x0a000002);
+
+    stw_be_p(&tcp->th_sport, 1234);
+    stw_be_p(&tcp->th_dport, 80);
+    stl_be_p(&tcp->th_seq, seq);
+    stl_be_p(&tcp->th_ack, 1);
+    stw_be_p(&tcp->th_offset_flags, (sizeof(*tcp) / 4) << 12 | flags);
+    stw_be_p(&tcp->th_win, 1024);
+    memset(tcp + 1, fill, payload);
+
+    net_checksum_calculate(buf, ETH_HLEN + ip_len, CSUM_IP | CSUM_TCP);
+    return ETH_HLEN + ip_len;
+}
+
+static ssize_t receive(NetGro *gro, uint8_t *buf, size_t len)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = len };
+
+    return net_gro_receive(gro, NULL, &iov, 1);
+}
+
+static NetGro *gro_new(void)
+{
+    NetGro *gro = net_gro_new(test_deliver, NULL);
+
+    net_gro_set_params(gro, 0, ETH_HLEN + ETH_MTU);
+    n_delivered = 0;
+    return gro;
+}
+
+/* Check the headers of a delivered frame, and return its TCP flags */
+static uint8_t check_frame(int i, uint32_t seq, size_t payload)
+{
+    uint8_t frame[TEST_FRAME_MAX];
+    struct ip_header *ip = (struct ip_header *)(frame + ETH_HLEN);
+    tcp_header *tcp = (tcp_header *)(ip + 1);
+    uint16_t ip_sum, tcp_sum;
+
+    g_assert_cmpuint(delivered_len[i], ==, TEST_HDR_LEN + payload);
+    memcpy(frame, delivered[i], delivered_len[i]);
+    g_assert_cmpuint(lduw_be_p(&ip->ip_len), ==,
+                     delivered_len[i] - ETH_HLEN);
+    g_assert_cmpuint(ldl_be_p(&tcp->th_seq), ==, seq);
+
+    /* Both checksums must be valid */
+    ip_sum = lduw_he_p(&ip->ip_sum);
+    tcp_sum = lduw_he_p(&tcp->th_sum);
+    net_checksum_calculate(frame, delivered_len[i], CSUM_IP | CSUM_TCP);
+    g_assert_cmphex(lduw_he_p(&ip->ip_sum), ==, ip_sum);
+    g_assert_cmphex(lduw_he_p(&tcp->th_sum), ==, tcp_sum);
+
+    return lduw_be_p(&tcp->th_offset_flags) & 0xff;
+}
+
+static void test_merge(void)
+{
+    NetGro *gro = gro_new();
+    uint8_t buf[TEST_FRAME_MAX];
+    size_t len;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        len = build_segment(buf, 1000 + i * TEST_PAYLOAD, TEST_PAYLOAD,
+                            TH_ACK, i + 1);
+        g_assert_cmpint(receive(gro, buf, len), ==, len);
+    }
+    g_assert_cmpint(n_delivered, ==, 0);
+
+    g_assert_true(net_gro_flush(gro));
+    g_assert_cmpint(n_delivered, ==, 1);
+    g_assert_cmpuint(check_frame(0, 1000, 3 * TEST_PAYLOAD), ==, TH_ACK);
+    for (i = 0; i < 3; i++) {
+        g_assert_cmpuint(delivered[0][TEST_HDR_LEN + i * TEST_PAYLOAD], ==,
+                         i + 1);
+    }
+
+    net_gro_free(gro);
+}
+
+/* A segment that does not follow the previous one flushes the flow */
+static void test_seq_gap(void)
+{
+    NetGro *gro = gro_new();
+    uint8_t buf[TEST_FRAME_MAX];
+    size_t len;
+
+    len = build_segment(buf, 1000, TEST_PAYLOAD, TH_ACK, 1);
+    receive(gro, buf, len);
+    len = build_segment(buf, 1000 + TEST_PAYLOAD + 1, TEST_PAYLOAD, TH_ACK, 2);
+    receive(gro, buf, len);
+    g_assert_cmpint(n_delivered, ==, 1);
+    check_frame(0, 1000, TEST_PAYLOAD);
+
+    net_gro_flush(gro);
+    g_assert_cmpint(n_delivered, ==, 2);
+    check_frame(1, 1000 + TEST_PAYLOAD + 1, TEST_PAYLOAD);
+
+    net_gro_free(gro);
+}
+
+/* PSH is merged, and delivers the flow right away */
+static void test_push(void)
+{
+    NetGro *gro = gro_new();
+    uint8_t buf[TEST_FRAME_MAX];
+    size_t len;
+
+    len = build_segment(buf, 1000, TEST_PAYLOAD, TH_ACK, 1);
+    receive(gro, buf, len);
+    len = build_segment(buf, 1000 + TEST_PAYLOAD, TEST_PAYLOAD,
+                        TH_ACK | TH_PUSH, 2);
+    receive(gro, buf, len);
+    g_assert_cmpint(n_delivered, ==, 1);
+    g_assert_cmpuint(check_frame(0, 1000, 2 * TEST_PAYLOAD), ==,
+                     TH_ACK | TH_PUSH);
+
+    net_gro_flush(gro);
+    g_assert_cmpint(n_delivered, ==, 1);
+
+    net_gro_free(gro);
+}
+
+/* Frames that cannot be parsed or merged are passed through unchanged */
+static void check_passthrough(uint8_t *buf, size_t len)
+{
+    NetGro *gro = gro_new();
+    uint8_t first[TEST_FRAME_MAX];
+    size_t first_len;
+
+    /* Keep a segment of the same flow, to check that it is not merged */
+    first_len = build_segment(first, 1000 - TEST_PAYLOAD, TEST_PAYLOAD,
+                              TH_ACK, 1);
+    receive(gro, first, first_len);
+
+    g_assert_cmpint(receive(gro, buf, len), ==, len);
+    net_gro_flush(gro);
+    g_assert_cmpint(n_delivered, ==, 2);
+    g_assert_cmpuint(delivered_len[0] + delivered_len[1], ==, first_len + len);
+    g_assert_true((delivered_len[0] == len &&
+                   !memcmp(delivered[0], buf, len)) ||
+                  (delivered_len[1] == len &&
+                   !memcmp(delivered[1], buf, len)));
+
+    net_gro_free(gro);
+}
+
+static void test_truncated(void)
+{
+    uint8_t buf[TEST_FRAME_MAX];
+    size_t len;
+
+    /* Shorter than the IP and TCP headers */
+    len = build_segment(buf, 1000, TEST_PAYLOAD, TH_ACK, 2);
+    check_passthrough(buf, ETH_HLEN + sizeof(struct ip_header) + 4);
+
+    /* IP length past the end of the frame */
+    check_passthrough(buf, len - 1);
+}
+
+static void test_ip_options(void)
+{
+    uint8_t buf[TEST_FRAME_MAX];
+    struct ip_header *ip = (struct ip_header *)(buf + ETH_HLEN);
+    size_t len;
+
+    len = build_segment(buf, 1000, TEST_PAYLOAD, TH_ACK, 2);
+    ip->ip_ver_len = 0x46;
+    net_checksum_calculate(buf, len, CSUM_IP);
+    check_passthrough(buf, len);
+}
+
+static void test_bad_ip_checksum(void)
+{
+    uint8_t buf[TEST_FRAME_MAX];
+    struct ip_header *ip = (struct ip_header *)(buf + ETH_HLEN);
+    size_t len;
+
+    len = build_segment(buf, 1000, TEST_PAYLOAD, TH_ACK, 2);
+    stw_he_p(&ip->ip_sum, lduw_he_p(&ip->ip_sum) ^ 1);
+    check_passthrough(buf, len);
+}
+
+static void test_bad_tcp_checksum(void)
+{
+    uint8_t buf[TEST_FRAME_MAX];
+    size_t len;
+
+    len = build_segment(buf, 1000, TEST_PAYLOAD, TH_ACK, 2);
+    buf[len - 1] ^= 1;
+    check_passthrough(buf, len);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    qemu_init_main_loop(&error_abort);
+
+    g_test_add_func("/net/gro/merge", test_merge);
+    g_test_add_func("/net/gro/seq-gap", test_seq_gap);
+    g_test_add_func("/net/gro/push", test_push);
+    g_test_add_func("/net/gro/truncated", test_truncated);
+    g_test_add_func("/net/gro/ip-options", test_ip_options);
+    g_test_add_func("/net/gro/bad-ip-checksum", test_bad_ip_checksum);
+    g_test_add_func("/net/gro/bad-tcp-checksum", test_bad_tcp_checksum);
+
+    return g_test_run();
+}
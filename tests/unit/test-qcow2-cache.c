@@ -0,0 +1,138 @@
+/*
+ * qcow2 metadata cache unit tests
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include "qemu/osdep.h"
+#include "block/block_int.h"
+#include "block/graph-lock.h"
+#include "qapi/error.h"
+#include "qapi/qmp/qdict.h"
+#include "qemu/main-loop.h"
+#include "qemu/thread.h"
+#include "qemu/units.h"
+#include "sysemu/block-backend.h"
+#include "../block/qcow2.h"
+
+/*
+ * The tables are 512 byte slices past the end of the qcow2 metadata, each
+ * starting with its own offset.  A cache of 256 of them has 8 shards.
+ */
+#define TEST_TABLE_SIZE     512
+#define TEST_CACHE_TABLES   256
+#define TEST_TABLES         1024
+#define TEST_BASE           (1 * MiB)
+#define TEST_READERS        4
+#define TEST_GETS           20000
+
+static bool done;
+static int hits;
+
+static uint64_t table_offset(int i)
+{
+    return TEST_BASE + (uint64_t)i * TEST_TABLE_SIZE;
+}
+
+static char *create_image(void)
+{
+    char *path = NULL;
+    uint64_t buf[TEST_TABLE_SIZE / sizeof(uint64_t)] = { };
+    int fd, i;
+
+    fd = g_file_open_tmp("qemu-tst-qcow2-cache.XXXXXX", &path, NULL);
+    g_assert(fd >= 0);
+    close(fd);
+    bdrv_img_create(path, "qcow2", NULL, NULL, NULL, 64 * MiB, BDRV_O_RDWR,
+                    true, &error_abort);
+
+    fd = open(path, O_WRONLY);
+    g_assert(fd >= 0);
+    for (i = 0; i < TEST_TABLES; i++) {
+        buf[0] = table_offset(i);
+        g_assert_cmpint(pwrite(fd, buf, sizeof(buf), buf[0]), ==,
+                        sizeof(buf));
+    }
+    close(fd);
+    return path;
+}
+
+/* Look up random tables without s->lock, as qcow2_get_host_offset_cached() */
+static void *reader_thread(void *opaque)
+{
+    Qcow2Cache *c = opaque;
+    g_autoptr(GRand) rand = g_rand_new();
+
+    while (!qatomic_read(&done)) {
+        uint64_t offset = table_offset(g_rand_int_range(rand, 0, TEST_TABLES));
+        uint64_t *table;
+
+        if (qcow2_cache_get_cached(c, offset, (void **)&table)) {
+            g_assert_cmphex(table[0], ==, offset);
+            qcow2_cache_put_cached(c, (void **)&table);
+            qatomic_inc(&hits);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Lockless lookups in all shards must only ever return the table that was
+ * asked for, while the entries are evicted and reused under them.
+ */
+static void test_concurrent_lookups(void)
+{
+    g_autofree char *path = create_image();
+    QemuThread threads[TEST_READERS];
+    QDict *options = qdict_new();
+    BlockDriverState *bs;
+    BlockBackend *blk;
+    Qcow2Cache *c;
+    int i;
+
+    qdict_put_str(options, "driver", "qcow2");
+    blk = blk_new_open(path, NULL, options, BDRV_O_RDWR, &error_abort);
+    bs = blk_bs(blk);
+    c = qcow2_cache_create(bs, TEST_CACHE_TABLES, TEST_TABLE_SIZE);
+    g_assert(c);
+
+    done = false;
+    hits = 0;
+    for (i = 0; i < TEST_READERS; i++) {
+        qemu_thread_create(&threads[i], "reader", reader_thread, c,
+                           QEMU_THREAD_JOINABLE);
+    }
+
+    GRAPH_RDLOCK_GUARD_MAINLOOP();
+    for (i = 0; i < TEST_GETS; i++) {
+        uint64_t offset = table_offset(g_test_rand_int_range(0, TEST_TABLES));
+        uint64_t *table;
+
+        g_assert_cmpint(qcow2_cache_get(bs, c, offset, (void **)&table), ==,
+                        0);
+        g_assert_cmphex(table[0], ==, offset);
+        qcow2_cache_put(c, (void **)&table);
+    }
+    g_assert_cmpint(qcow2_cache_empty(bs, c), ==, 0);
+
+    qatomic_set(&done, true);
+    for (i = 0; i < TEST_READERS; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+    g_assert_cmpint(hits, >, 0);
+
+    qcow2_cache_destroy(c);
+    blk_unref(blk);
+    unlink(path);
+}
+
+int main(int argc, char **argv)
+{
+    bdrv_init();
+    qemu_init_main_loop(&error_abort);
+
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/qcow2/cache/concurrent-lookups",
+                    test_concurrent_lookups);
+
+    return g_test_run();
+}
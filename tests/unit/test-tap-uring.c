@@ -0,0 +1,165 @@
+/*
+ * Batched tap I/O with io_uring unit tests
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/main-loop.h"
+#include "net/net.h"
+#include "../net/tap_int.h"
+
+/*
+ * A SOCK_SEQPACKET socket pair stands in for the tap device: like tap,
+ * it returns one frame per read and takes one frame per write.
+ */
+#define TEST_FRAMES     8
+#define TEST_FRAME_LEN  100
+#define TEST_BIG_LEN    (NET_BUFSIZE + 100)
+
+typedef struct TestTap {
+    int fds[2];
+    TapUring *u;
+    int n_rx;
+    int rx_len[TEST_FRAMES];
+    uint8_t rx_first[TEST_FRAMES];
+    bool tx_ready;
+} TestTap;
+
+static void test_rx(void *opaque, uint8_t *buf, int size)
+{
+    TestTap *t = opaque;
+
+    g_assert_cmpint(t->n_rx, <, TEST_FRAMES);
+    t->rx_len[t->n_rx] = size;
+    t->rx_first[t->n_rx++] = buf[0];
+}
+
+static void test_tx(void *opaque)
+{
+    TestTap *t = opaque;
+
+    t->tx_ready = true;
+}
+
+static void test_tap_init(TestTap *t)
+{
+    memset(t, 0, sizeof(*t));
+    g_assert_cmpint(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, t->fds), ==, 0);
+    t->u = tap_uring_new(t->fds[0], test_rx, test_tx, t, &error_abort);
+}
+
+static void test_tap_cleanup(TestTap *t)
+{
+    tap_uring_free(t->u);
+    close(t->fds[0]);
+    close(t->fds[1]);
+}
+
+static ssize_t write_frame(TestTap *t, uint8_t *buf, size_t len, int i)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = len };
+
+    memset(buf, i, len);
+    return tap_uring_write(t->u, &iov, 1);
+}
+
+/*
+ * Read a frame from the other end, and return its first byte.  The main
+ * loop keeps running meanwhile, to submit the writes and reap them.
+ */
+static int read_frame(TestTap *t, uint8_t *buf, size_t len)
+{
+    ssize_t ret;
+
+    while ((ret = recv(t->fds[1], buf, TEST_BIG_LEN, MSG_DONTWAIT)) < 0 &&
+           errno == EAGAIN) {
+        main_loop_wait(false);
+    }
+    g_assert_cmpint(ret, ==, len);
+    return buf[0];
+}
+
+/* Frames reach the device in order, including those too big for a slot */
+static void test_write_order(void)
+{
+    g_autofree uint8_t *buf = g_malloc(TEST_BIG_LEN);
+    TestTap t;
+    int i;
+
+    test_tap_init(&t);
+    for (i = 0; i < TEST_FRAMES; i++) {
+        size_t len = i == TEST_FRAMES / 2 ? TEST_BIG_LEN : TEST_FRAME_LEN;
+
+        g_assert_cmpint(write_frame(&t, buf, len, i), ==, len);
+    }
+
+    for (i = 0; i < TEST_FRAMES; i++) {
+        size_t len = i == TEST_FRAMES / 2 ? TEST_BIG_LEN : TEST_FRAME_LEN;
+
+        g_assert_cmpint(read_frame(&t, buf, len), ==, i);
+    }
+    test_tap_cleanup(&t);
+}
+
+/* Once all TX slots are busy, the peer is told when it can send again */
+static void test_write_blocked(void)
+{
+    g_autofree uint8_t *buf = g_malloc(TEST_BIG_LEN);
+    TestTap t;
+    int i, n;
+
+    test_tap_init(&t);
+    for (n = 0; write_frame(&t, buf, TEST_FRAME_LEN, n) > 0; n++) {
+        g_assert_cmpint(n, <, 256);
+    }
+    g_assert_cmpint(n, >, 0);
+
+    while (!t.tx_ready) {
+        main_loop_wait(false);
+    }
+    for (i = 0; i < n; i++) {
+        g_assert_cmpint(read_frame(&t, buf, TEST_FRAME_LEN), ==, i);
+    }
+    g_assert_cmpint(write_frame(&t, buf, TEST_FRAME_LEN, n), ==,
+                    TEST_FRAME_LEN);
+    g_assert_cmpint(read_frame(&t, buf, TEST_FRAME_LEN), ==, n);
+    test_tap_cleanup(&t);
+}
+
+/* Frames are delivered in the order they were read, once RX is enabled */
+static void test_read(void)
+{
+    uint8_t buf[TEST_FRAME_LEN];
+    TestTap t;
+    int i;
+
+    test_tap_init(&t);
+    for (i = 0; i < TEST_FRAMES; i++) {
+        memset(buf, i, sizeof(buf));
+        g_assert_cmpint(send(t.fds[1], buf, sizeof(buf) - i, 0), ==,
+                        sizeof(buf) - i);
+    }
+
+    tap_uring_set_rx(t.u, true);
+    while (t.n_rx < TEST_FRAMES) {
+        main_loop_wait(false);
+    }
+    for (i = 0; i < TEST_FRAMES; i++) {
+        g_assert_cmpint(t.rx_len[i], ==, sizeof(buf) - i);
+        g_assert_cmpint(t.rx_first[i], ==, i);
+    }
+    test_tap_cleanup(&t);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    qemu_init_main_loop(&error_abort);
+
+    g_test_add_func("/net/tap-uring/write-order", test_write_order);
+    g_test_add_func("/net/tap-uring/write-blocked", test_write_blocked);
+    g_test_add_func("/net/tap-uring/read", test_read);
+
+    return g_test_run();
+}
@@ -0,0 +1,143 @@
+/*
+ * Toeplitz hash unit tests
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include "qemu/osdep.h"
+#include "qemu/toeplitz.h"
+#include "net/checksum.h"
+
+/* The key from the Microsoft RSS verification suite */
+static uint8_t key[TOEPLITZ_KEY_MAX_LEN] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+/*
+ * Source address, destination address, source port, destination port,
+ * and the hashes with and without the ports
+ */
+typedef struct ToeplitzVector {
+    uint8_t src[16];
+    uint8_t dst[16];
+    uint16_t sport;
+    uint16_t dport;
+    uint32_t hash_ip;
+    uint32_t hash_tcp;
+} ToeplitzVector;
+
+static const ToeplitzVector ipv4_vectors[] = {
+    {
+        { 66, 9, 149, 187 }, { 161, 142, 100, 80 }, 2794, 1766,
+        0x323e8fc2, 0x51ccc178,
+    }, {
+        { 199, 92, 111, 2 }, { 65, 69, 140, 83 }, 14230, 4739,
+        0xd718262a, 0xc626b0ea,
+    }, {
+        { 24, 19, 198, 95 }, { 12, 22, 207, 184 }, 12898, 38024,
+        0xd2d0a5de, 0x5c2b394a,
+    }, {
+        { 38, 27, 205, 30 }, { 209, 142, 163, 6 }, 48228, 2217,
+        0x82989176, 0xafc7327f,
+    }, {
+        { 153, 39, 163, 191 }, { 202, 188, 127, 2 }, 44251, 1303,
+        0x5d1809c5, 0x10e828a2,
+    },
+};
+
+static const ToeplitzVector ipv6_vectors[] = {
+    {
+        /* 3ffe:2501:200:1fff::7 -> 3ffe:2501:200:3::1 */
+        { 0x3f, 0xfe, 0x25, 0x01, 0x02, 0x00, 0x1f, 0xff,
+          0, 0, 0, 0, 0, 0, 0, 0x07 },
+        { 0x3f, 0xfe, 0x25, 0x01, 0x02, 0x00, 0x00, 0x03,
+          0, 0, 0, 0, 0, 0, 0, 0x01 },
+        2794, 1766, 0x2cc18cd5, 0x40207d3d,
+    }, {
+        /* 3ffe:501:8::260:97ff:fe40:efab -> ff02::1 */
+        { 0x3f, 0xfe, 0x05, 0x01, 0x00, 0x08, 0x00, 0x00,
+          0x02, 0x60, 0x97, 0xff, 0xfe, 0x40, 0xef, 0xab },
+        { 0xff, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01 },
+        14230, 4739, 0x0f0c461c, 0xdde51bbf,
+    }, {
+        /* 3ffe:1900:4545:3:200:f8ff:fe21:67cf -> fe80::200:f8ff:fe21:67cf */
+        { 0x3f, 0xfe, 0x19, 0x00, 0x45, 0x45, 0x00, 0x03,
+          0x02, 0x00, 0xf8, 0xff, 0xfe, 0x21, 0x67, 0xcf },
+        { 0xfe, 0x80, 0, 0, 0, 0, 0, 0,
+          0x02, 0x00, 0xf8, 0xff, 0xfe, 0x21, 0x67, 0xcf },
+        44251, 38024, 0x4b61e985, 0x02d1feef,
+    },
+};
+
+static void check_vectors(const ToeplitzKey *k, const ToeplitzVector *v,
+                          int n, size_t addr_len)
+{
+    uint8_t input[TOEPLITZ_KEY_MAX_LEN - 4];
+    int i;
+
+    for (i = 0; i < n; i++) {
+        memcpy(input, v[i].src, addr_len);
+        memcpy(input + addr_len, v[i].dst, addr_len);
+        stw_be_p(input + addr_len * 2, v[i].sport);
+        stw_be_p(input + addr_len * 2 + 2, v[i].dport);
+
+        g_assert_cmphex(toeplitz_hash(k, input, addr_len * 2), ==,
+                        v[i].hash_ip);
+        g_assert_cmphex(toeplitz_hash(k, input, addr_len * 2 + 4), ==,
+                        v[i].hash_tcp);
+    }
+}
+
+/* Compare with net_toeplitz_add() for all lengths and random data */
+static void check_reference(const ToeplitzKey *k)
+{
+    net_toeplitz_key key_data;
+    uint8_t input[TOEPLITZ_KEY_MAX_LEN - 4];
+    size_t len;
+    int i;
+
+    for (i = 0; i < 100; i++) {
+        for (len = 0; len <= sizeof(input); len++) {
+            uint32_t hash = 0;
+            size_t j;
+
+            for (j = 0; j < len; j++) {
+                input[j] = g_test_rand_int();
+            }
+            /* net_toeplitz_add() consumes the key */
+            net_toeplitz_key_init(&key_data, key);
+            net_toeplitz_add(&hash, input, len, &key_data);
+            g_assert_cmphex(toeplitz_hash(k, input, len), ==, hash);
+        }
+    }
+}
+
+/*
+ * Every implementation must give the hashes of the verification suite,
+ * and the same results as the generic code in net/checksum.h.
+ */
+static void test_hash(void)
+{
+    ToeplitzKey k = {};
+
+    do {
+        toeplitz_key_init(&k, key, sizeof(key));
+        check_vectors(&k, ipv4_vectors, ARRAY_SIZE(ipv4_vectors), 4);
+        check_vectors(&k, ipv6_vectors, ARRAY_SIZE(ipv6_vectors), 16);
+        check_reference(&k);
+    } while (test_toeplitz_next_accel());
+
+    toeplitz_key_destroy(&k);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    /* Leaves the slowest implementation selected */
+    g_test_add_func("/toeplitz/hash", test_hash);
+
+    return g_test_run();
+}
@@ -21,6 +21,7 @@
 #include "qemu/rcu_queue.h"
 #include "qemu/sockets.h"
 #include "qemu/cutils.h"
+#include "qapi/error.h"
 #include "trace.h"
 #include "aio-posix.h"
 
@@ -422,6 +423,7 @@ void aio_dispatch(AioContext *ctx)
     qemu_lockcnt_inc(&ctx->list_lock);
     aio_bh_poll(ctx);
     aio_dispatch_handlers(ctx);
+    fdmon_io_uring_dispatch(ctx);
     aio_free_deleted_handlers(ctx);
     qemu_lockcnt_dec(&ctx->list_lock);
 
@@ -721,6 +723,7 @@ bool aio_poll(AioContext *ctx, bool blocking)
 
     progress |= aio_bh_poll(ctx);
     progress |= aio_dispatch_ready_handlers(ctx, &ready_list);
+    progress |= fdmon_io_uring_dispatch(ctx);
 
     aio_free_deleted_handlers(ctx);
 
@@ -777,6 +780,20 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
     aio_notify(ctx);
 }
 
+bool aio_context_set_io_uring_params(AioContext *ctx, bool sqpoll,
+                                     Error **errp)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    return fdmon_io_uring_set_sqpoll(ctx, sqpoll, errp);
+#else
+    if (sqpoll) {
+        error_setg(errp, "io_uring is not supported by this build");
+        return false;
+    }
+    return true;
+#endif
+}
+
 void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch)
 {
     /*
@@ -68,6 +68,8 @@ static inline void fdmon_epoll_disable(AioContext *ctx)
 #ifdef CONFIG_LINUX_IO_URING
 bool fdmon_io_uring_setup(AioContext *ctx);
 void fdmon_io_uring_destroy(AioContext *ctx);
+bool fdmon_io_uring_dispatch(AioContext *ctx);
+bool fdmon_io_uring_set_sqpoll(AioContext *ctx, bool sqpoll, Error **errp);
 #else
 static inline bool fdmon_io_uring_setup(AioContext *ctx)
 {
@@ -77,6 +79,11 @@ static inline bool fdmon_io_uring_setup(AioContext *ctx)
 static inline void fdmon_io_uring_destroy(AioContext *ctx)
 {
 }
+
+static inline bool fdmon_io_uring_dispatch(AioContext *ctx)
+{
+    return false;
+}
 #endif /* !CONFIG_LINUX_IO_URING */
 
 #endif /* AIO_POSIX_H */
@@ -441,3 +441,13 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
 void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch)
 {
 }
+
+bool aio_context_set_io_uring_params(AioContext *ctx, bool sqpoll,
+                                     Error **errp)
+{
+    if (sqpoll) {
+        error_setg(errp, "io_uring is not supported on Windows");
+        return false;
+    }
+    return true;
+}
@@ -19,9 +19,15 @@
  * 4. Nanosecond timeouts are supported so it requires fewer syscalls than
  *    epoll(7).
  *
- * This code only monitors file descriptors and does not do asynchronous disk
- * I/O.  Implementing disk I/O efficiently has other requirements and should
- * use a separate io_uring so it does not make sense to unify the code.
+ * Other code can submit its own requests (e.g. disk I/O) to the same ring with
+ * aio_add_sqe().  They are submitted together with the file descriptor
+ * monitoring changes the next time aio_poll() runs and their completion
+ * callbacks are invoked by aio_poll(), so the event loop needs only one
+ * io_uring_enter(2) call per iteration, or none at all in SQPOLL mode where a
+ * kernel thread consumes the sq ring.
+ *
+ * Guest RAM can be registered as fixed buffers with aio_register_fixed_buf()
+ * so that requests on it do not need to map and pin pages each time.
  *
  * File descriptor monitoring is implemented using the following operations:
  *
@@ -37,8 +43,9 @@
  * io_uring calls the submission queue the "sq ring" and the completion queue
  * the "cq ring".  Ring entries are called "sqe" and "cqe", respectively.
  *
- * The code is structured so that sq/cq rings are only modified within
- * fdmon_io_uring_wait().  Changes to AioHandlers are made by enqueuing them on
+ * The code is structured so that the cq ring is only consumed within
+ * fdmon_io_uring_wait() and the sq ring is only touched by the AioContext's
+ * home thread.  Changes to AioHandlers are made by enqueuing them on
  * ctx->submit_list so that fdmon_io_uring_wait() can submit IORING_OP_POLL_ADD
  * and/or IORING_OP_POLL_REMOVE sqes for them.
  */
@@ -46,17 +53,63 @@
 #include "qemu/osdep.h"
 #include <poll.h>
 #include "qemu/rcu_queue.h"
+#include "qemu/lockable.h"
+#include "qapi/error.h"
 #include "aio-posix.h"
 
 enum {
-    FDMON_IO_URING_ENTRIES  = 128, /* sq/cq ring size */
+    FDMON_IO_URING_ENTRIES  = 512, /* sq/cq ring size */
 
     /* AioHandler::flags */
     FDMON_IO_URING_PENDING  = (1 << 0),
     FDMON_IO_URING_ADD      = (1 << 1),
     FDMON_IO_URING_REMOVE   = (1 << 2),
+
+    /* Tag in the user_data of sqes added by aio_add_sqe() */
+    FDMON_IO_URING_CQE_HANDLER = (1 << 0),
+
+    /* Number of fixed buffer slots in each ring */
+    FDMON_IO_URING_FIXED_BUFS = 1024,
 };
 
+/* The kernel limits fixed buffers to 1 GiB each */
+#define FIXED_BUF_SHIFT 30
+#define FIXED_BUF_MAX_SIZE (1ULL << FIXED_BUF_SHIFT)
+
+/*
+ * Memory registered with aio_register_fixed_buf().  It is split into @nr
+ * chunks of at most FIXED_BUF_MAX_SIZE, and chunk i is registered at buffer
+ * index @first + i in every ring on fixed_buf_rings.
+ */
+typedef struct {
+    void *host;
+    size_t size;
+    unsigned first;
+    unsigned nr;
+    unsigned refcnt;
+} FixedBufRegion;
+
+typedef struct {
+    struct rcu_head rcu;
+    unsigned nr_regions;
+    FixedBufRegion regions[]; /* sorted by first */
+} FixedBufTable;
+
+/* Protects fixed_buf_rings and updates of fixed_buf_table */
+static QemuMutex fixed_buf_lock;
+
+/* Read with RCU by aio_fixed_buf_index() */
+static FixedBufTable *fixed_buf_table;
+
+/* AioContexts whose ring has all regions of fixed_buf_table registered */
+static QLIST_HEAD(, AioContext) fixed_buf_rings =
+    QLIST_HEAD_INITIALIZER(fixed_buf_rings);
+
+static void __attribute__((constructor)) fixed_buf_init(void)
+{
+    qemu_mutex_init(&fixed_buf_lock);
+}
+
 static inline int poll_events_from_pfd(int pfd_events)
 {
     return (pfd_events & G_IO_IN ? POLLIN : 0) |
@@ -74,8 +127,8 @@ static inline int pfd_events_from_poll(int poll_events)
 }
 
 /*
- * Returns an sqe for submitting a request.  Only be called within
- * fdmon_io_uring_wait().
+ * Returns an sqe for submitting a request.  Must only be called from the
+ * AioContext's home thread.
  */
 static struct io_uring_sqe *get_sqe(AioContext *ctx)
 {
@@ -226,14 +279,28 @@ static bool process_cqe(AioContext *ctx,
                         AioHandlerList *ready_list,
                         struct io_uring_cqe *cqe)
 {
-    AioHandler *node = io_uring_cqe_get_data(cqe);
+    uintptr_t data = (uintptr_t)io_uring_cqe_get_data(cqe);
+    AioHandler *node;
     unsigned flags;
 
     /* poll_timeout and poll_remove have a zero user_data field */
-    if (!node) {
+    if (!data) {
         return false;
     }
 
+    /* Invoked later by fdmon_io_uring_dispatch() */
+    if (data & FDMON_IO_URING_CQE_HANDLER) {
+        CqeHandler *cqe_handler =
+            (CqeHandler *)(data & ~(uintptr_t)FDMON_IO_URING_CQE_HANDLER);
+
+        cqe_handler->cqe = *cqe;
+        QSIMPLEQ_INSERT_TAIL(&ctx->cqe_handler_ready_list, cqe_handler, next);
+        ctx->cqe_handlers_in_flight--;
+        return true;
+    }
+
+    node = (AioHandler *)data;
+
     /*
      * Deletion can only happen when IORING_OP_POLL_ADD completes.  If we race
      * with enqueue() here then we can safely clear the FDMON_IO_URING_REMOVE
@@ -321,6 +388,322 @@ static const FDMonOps fdmon_io_uring_ops = {
     .need_wait = fdmon_io_uring_need_wait,
 };
 
+bool aio_has_io_uring(AioContext *ctx)
+{
+    return ctx->fdmon_ops == &fdmon_io_uring_ops;
+}
+
+void aio_add_sqe(void (*prep_sqe)(struct io_uring_sqe *sqe, void *opaque),
+                 void *opaque, CqeHandler *cqe_handler)
+{
+    AioContext *ctx = qemu_get_current_aio_context();
+    struct io_uring_sqe *sqe;
+
+    assert(aio_has_io_uring(ctx));
+
+    sqe = get_sqe(ctx);
+    prep_sqe(sqe, opaque);
+    io_uring_sqe_set_data(sqe, (void *)((uintptr_t)cqe_handler |
+                                        FDMON_IO_URING_CQE_HANDLER));
+    ctx->cqe_handlers_in_flight++;
+}
+
+bool fdmon_io_uring_dispatch(AioContext *ctx)
+{
+    CqeHandlerSimpleQ *ready_list = &ctx->cqe_handler_ready_list;
+    bool progress = false;
+
+    /* Handlers may add new sqes or even run a nested event loop */
+    while (!QSIMPLEQ_EMPTY(ready_list)) {
+        CqeHandler *cqe_handler = QSIMPLEQ_FIRST(ready_list);
+
+        QSIMPLEQ_REMOVE_HEAD(ready_list, next);
+        cqe_handler->cb(cqe_handler);
+        progress = true;
+    }
+
+    return progress;
+}
+
+#ifdef HAVE_IO_URING_REGISTER_BUFFERS_SPARSE
+/* Register (or unregister if @add is false) @region with @ctx's ring */
+static int fixed_buf_ring_update(AioContext *ctx,
+                                 const FixedBufRegion *region, bool add)
+{
+    g_autofree struct iovec *iov = g_new0(struct iovec, region->nr);
+    unsigned i;
+    int ret;
+
+    for (i = 0; add && i < region->nr; i++) {
+        size_t offset = (size_t)i << FIXED_BUF_SHIFT;
+
+        iov[i].iov_base = region->host + offset;
+        iov[i].iov_len = MIN(region->size - offset, FIXED_BUF_MAX_SIZE);
+    }
+
+    ret = io_uring_register_buffers_update_tag(&ctx->fdmon_io_uring,
+                                               region->first, iov, NULL,
+                                               region->nr);
+    return ret < 0 ? ret : 0;
+}
+
+/* Set up fixed buffers for a new ring, if supported by the kernel */
+static void fixed_buf_ring_add(AioContext *ctx)
+{
+    FixedBufTable *table;
+    unsigned i;
+
+    QEMU_LOCK_GUARD(&fixed_buf_lock);
+
+    if (io_uring_register_buffers_sparse(&ctx->fdmon_io_uring,
+                                         FDMON_IO_URING_FIXED_BUFS) < 0) {
+        return; /* requests will use normal buffers */
+    }
+
+    table = fixed_buf_table;
+    for (i = 0; table && i < table->nr_regions; i++) {
+        if (fixed_buf_ring_update(ctx, &table->regions[i], true) < 0) {
+            io_uring_unregister_buffers(&ctx->fdmon_io_uring);
+            return;
+        }
+    }
+
+    ctx->fdmon_io_uring_fixed_bufs = true;
+    QLIST_INSERT_HEAD(&fixed_buf_rings, ctx, fdmon_io_uring_next);
+}
+
+static void fixed_buf_ring_remove(AioContext *ctx)
+{
+    QEMU_LOCK_GUARD(&fixed_buf_lock);
+
+    if (ctx->fdmon_io_uring_fixed_bufs) {
+        ctx->fdmon_io_uring_fixed_bufs = false;
+        QLIST_REMOVE(ctx, fdmon_io_uring_next);
+    }
+}
+
+/*
+ * Publish a copy of @old with @region inserted at @pos or, if @region is NULL,
+ * with the region at @pos removed.  Called with fixed_buf_lock held.
+ */
+static void fixed_buf_table_replace(FixedBufTable *old, unsigned pos,
+                                    const FixedBufRegion *region)
+{
+    unsigned old_nr = old ? old->nr_regions : 0;
+    unsigned nr = region ? old_nr + 1 : old_nr - 1;
+    FixedBufTable *new = NULL;
+
+    if (nr) {
+        new = g_malloc(sizeof(*new) + nr * sizeof(new->regions[0]));
+        new->nr_regions = nr;
+        if (pos) {
+            memcpy(new->regions, old->regions, pos * sizeof(old->regions[0]));
+        }
+        if (region) {
+            new->regions[pos] = *region;
+            memcpy(&new->regions[pos + 1], &old->regions[pos],
+                   (old_nr - pos) * sizeof(old->regions[0]));
+        } else {
+            memcpy(&new->regions[pos], &old->regions[pos + 1],
+                   (old_nr - pos - 1) * sizeof(old->regions[0]));
+        }
+    }
+
+    qatomic_rcu_set(&fixed_buf_table, new);
+    if (old) {
+        g_free_rcu(old, rcu);
+    }
+}
+
+bool aio_register_fixed_buf(void *host, size_t size, Error **errp)
+{
+    FixedBufTable *table;
+    FixedBufRegion region = {
+        .host = host,
+        .size = size,
+        .nr = DIV_ROUND_UP(size, FIXED_BUF_MAX_SIZE),
+        .refcnt = 1,
+    };
+    AioContext *ctx, *undo;
+    unsigned i, nr_regions;
+    int ret;
+
+    QEMU_LOCK_GUARD(&fixed_buf_lock);
+
+    table = fixed_buf_table;
+    nr_regions = table ? table->nr_regions : 0;
+
+    /* Several block nodes register the same guest RAM */
+    for (i = 0; i < nr_regions; i++) {
+        if (table->regions[i].host == host && table->regions[i].size == size) {
+            table->regions[i].refcnt++;
+            return true;
+        }
+    }
+
+    /* First fit */
+    for (i = 0; i < nr_regions; i++) {
+        if (table->regions[i].first - region.first >= region.nr) {
+            break;
+        }
+        region.first = table->regions[i].first + table->regions[i].nr;
+    }
+    if (region.first + region.nr > FDMON_IO_URING_FIXED_BUFS) {
+        error_setg(errp, "Out of io_uring fixed buffer slots");
+        return false;
+    }
+
+    QLIST_FOREACH(ctx, &fixed_buf_rings, fdmon_io_uring_next) {
+        ret = fixed_buf_ring_update(ctx, &region, true);
+        if (ret < 0) {
+            QLIST_FOREACH(undo, &fixed_buf_rings, fdmon_io_uring_next) {
+                if (undo == ctx) {
+                    break;
+                }
+                fixed_buf_ring_update(undo, &region, false);
+            }
+            error_setg_errno(errp, -ret,
+                             "Failed to register io_uring fixed buffers");
+            return false;
+        }
+    }
+
+    /* Only visible to aio_fixed_buf_index() once all rings have it */
+    fixed_buf_table_replace(table, i, &region);
+    return true;
+}
+
+void aio_unregister_fixed_buf(void *host, size_t size)
+{
+    FixedBufTable *table;
+    FixedBufRegion region;
+    AioContext *ctx;
+    unsigned i;
+
+    QEMU_LOCK_GUARD(&fixed_buf_lock);
+
+    table = fixed_buf_table;
+    for (i = 0; table && i < table->nr_regions; i++) {
+        if (table->regions[i].host == host && table->regions[i].size == size) {
+            break;
+        }
+    }
+    if (!table || i == table->nr_regions ||
+        --table->regions[i].refcnt > 0) {
+        return;
+    }
+
+    region = table->regions[i];
+    fixed_buf_table_replace(table, i, NULL);
+
+    /*
+     * Requests that looked up the region just before it was removed fail
+     * with -EFAULT and are retried with normal buffers by their submitter.
+     */
+    QLIST_FOREACH(ctx, &fixed_buf_rings, fdmon_io_uring_next) {
+        fixed_buf_ring_update(ctx, &region, false);
+    }
+}
+
+int aio_fixed_buf_index(AioContext *ctx, const void *buf, size_t len)
+{
+    FixedBufTable *table;
+    uintptr_t start = (uintptr_t)buf;
+    unsigned i;
+
+    if (!ctx->fdmon_io_uring_fixed_bufs || !len) {
+        return -1;
+    }
+
+    RCU_READ_LOCK_GUARD();
+
+    table = qatomic_rcu_read(&fixed_buf_table);
+    for (i = 0; table && i < table->nr_regions; i++) {
+        FixedBufRegion *region = &table->regions[i];
+        uintptr_t host = (uintptr_t)region->host;
+        uint64_t offset;
+
+        if (start < host || start - host >= region->size ||
+            len > region->size - (start - host)) {
+            continue;
+        }
+
+        /* The buffer must not cross a chunk boundary */
+        offset = start - host;
+        if ((offset >> FIXED_BUF_SHIFT) !=
+            ((offset + len - 1) >> FIXED_BUF_SHIFT)) {
+            return -1;
+        }
+        return region->first + (offset >> FIXED_BUF_SHIFT);
+    }
+
+    return -1;
+}
+#else /* !HAVE_IO_URING_REGISTER_BUFFERS_SPARSE */
+static void fixed_buf_ring_add(AioContext *ctx)
+{
+}
+
+static void fixed_buf_ring_remove(AioContext *ctx)
+{
+}
+
+bool aio_register_fixed_buf(void *host, size_t size, Error **errp)
+{
+    error_setg(errp, "io_uring fixed buffers are not supported by this build");
+    return false;
+}
+
+void aio_unregister_fixed_buf(void *host, size_t size)
+{
+}
+
+int aio_fixed_buf_index(AioContext *ctx, const void *buf, size_t len)
+{
+    return -1;
+}
+#endif /* !HAVE_IO_URING_REGISTER_BUFFERS_SPARSE */
+
+bool fdmon_io_uring_set_sqpoll(AioContext *ctx, bool sqpoll, Error **errp)
+{
+    struct io_uring ring;
+    int ret;
+
+    if (!aio_has_io_uring(ctx)) {
+        if (sqpoll) {
+            error_setg(errp, "io_uring is not available, cannot use SQPOLL");
+            return false;
+        }
+        return true;
+    }
+
+    if (ctx->fdmon_io_uring_sqpoll == sqpoll) {
+        return true;
+    }
+
+    /*
+     * The event loop has not run yet, so nothing has been submitted to the
+     * old ring and pending AioHandlers on ctx->submit_list will simply be
+     * submitted to the new one.
+     */
+    assert(ctx->cqe_handlers_in_flight == 0);
+
+    ret = io_uring_queue_init(FDMON_IO_URING_ENTRIES, &ring,
+                              sqpoll ? IORING_SETUP_SQPOLL : 0);
+    if (ret != 0) {
+        error_setg_errno(errp, -ret, "Failed to set up io_uring%s",
+                         sqpoll ? " with SQPOLL" : "");
+        return false;
+    }
+
+    fixed_buf_ring_remove(ctx);
+    io_uring_queue_exit(&ctx->fdmon_io_uring);
+    ctx->fdmon_io_uring = ring;
+    ctx->fdmon_io_uring_sqpoll = sqpoll;
+    fixed_buf_ring_add(ctx);
+    return true;
+}
+
 bool fdmon_io_uring_setup(AioContext *ctx)
 {
     int ret;
@@ -331,7 +714,11 @@ bool fdmon_io_uring_setup(AioContext *ctx)
     }
 
     QSLIST_INIT(&ctx->submit_list);
+    QSIMPLEQ_INIT(&ctx->cqe_handler_ready_list);
+    ctx->cqe_handlers_in_flight = 0;
+    ctx->fdmon_io_uring_sqpoll = false;
     ctx->fdmon_ops = &fdmon_io_uring_ops;
+    fixed_buf_ring_add(ctx);
     return true;
 }
 
@@ -340,6 +727,29 @@ void fdmon_io_uring_destroy(AioContext *ctx)
     if (ctx->fdmon_ops == &fdmon_io_uring_ops) {
         AioHandler *node;
 
+        /*
+         * Requests from aio_add_sqe() cannot be moved to another ring, so wait
+         * for them.  Their handlers stay on ctx->cqe_handler_ready_list and
+         * are invoked by the next aio_poll().  Ready AioHandlers are dropped,
+         * the fd monitoring implementation that takes over will see them
+         * again.
+         */
+        while (ctx->cqe_handlers_in_flight > 0) {
+            AioHandlerList ready_list = QLIST_HEAD_INITIALIZER(ready_list);
+            int ret;
+
+            do {
+                ret = io_uring_submit_and_wait(&ctx->fdmon_io_uring, 1);
+            } while (ret == -EINTR);
+            assert(ret >= 0);
+
+            process_cq_ring(ctx, &ready_list);
+        }
+        if (!QSIMPLEQ_EMPTY(&ctx->cqe_handler_ready_list)) {
+            aio_notify(ctx);
+        }
+
+        fixed_buf_ring_remove(ctx);
         io_uring_queue_exit(&ctx->fdmon_io_uring);
 
         /* Move handlers due to be removed onto the deleted list */
@@ -0,0 +1,128 @@
+/*
+ * Toeplitz hash, as used for receive side scaling
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/*
+ * Bit i of the hash input, counting from the most significant bit of the
+ * first byte, selects the 32 key bits starting at bit i.  The hash is the
+ * XOR of the selected windows, which is a carry-less product of input and
+ * key once both are taken least significant bit first: bits 63 to 94 of
+ * the product of reversed key word q and input word q (plus the high half
+ * of the product with key word q + 1) are the contribution of that input
+ * word, in reverse order.  This makes two carry-less multiplications per
+ * 8 bytes of input, instead of a loop over all 64 bits.
+ *
+ * Without an accelerated carry-less multiply, the window XORs are instead
+ * precomputed for each byte value at each input offset, which is one
+ * table lookup per byte of input.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/host-utils.h"
+#include "qemu/toeplitz.h"
+#include "crypto/clmul.h"
+
+static bool toeplitz_use_clmul = true;
+
+/* The 32 key bits starting at bit @i; @key is padded to 8 more bytes */
+static uint32_t toeplitz_window(const uint8_t *key, size_t i)
+{
+    return ldq_be_p(key + i / 8) << (i % 8) >> 32;
+}
+
+void toeplitz_key_init(ToeplitzKey *k, const uint8_t *key, size_t len)
+{
+    uint8_t buf[sizeof(k->rev)] = { 0 };
+    size_t i, j;
+
+    assert(len >= 4 && len <= TOEPLITZ_KEY_MAX_LEN);
+    memcpy(buf, key, len);
+
+    for (i = 0; i < ARRAY_SIZE(k->rev); i++) {
+        k->rev[i] = revbit64(ldq_be_p(buf + i * 8));
+    }
+    k->max_input = len - 4;
+
+    g_free(k->table);
+    k->table = NULL;
+    if (HAVE_CLMUL_ACCEL && toeplitz_use_clmul) {
+        return;
+    }
+
+    k->table = g_malloc_n(k->max_input, sizeof(*k->table));
+    for (j = 0; j < k->max_input; j++) {
+        k->table[j][0] = 0;
+        for (i = 1; i < 256; i++) {
+            /* Add the window of the least significant bit set in i */
+            k->table[j][i] = k->table[j][i & (i - 1)] ^
+                             toeplitz_window(buf, j * 8 + 7 - ctz32(i));
+        }
+    }
+}
+
+void toeplitz_key_destroy(ToeplitzKey *k)
+{
+    g_free(k->table);
+    k->table = NULL;
+}
+
+static uint32_t toeplitz_hash_table(const ToeplitzKey *k,
+                                    const uint8_t *input, size_t len)
+{
+    uint32_t hash = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= k->table[i][input[i]];
+    }
+    return hash;
+}
+
+static uint32_t ATTR_CLMUL_ACCEL
+toeplitz_hash_clmul(const ToeplitzKey *k, const uint8_t *input, size_t len)
+{
+    Int128 lo = int128_zero(), hi = int128_zero();
+    uint64_t r;
+    size_t i;
+
+    for (i = 0; i * 8 < len; i++) {
+        uint64_t w;
+
+        if (len - i * 8 >= 8) {
+            w = ldq_be_p(input + i * 8);
+        } else {
+            uint8_t tail[8] = { 0 };
+
+            memcpy(tail, input + i * 8, len - i * 8);
+            w = ldq_be_p(tail);
+        }
+        lo = int128_xor(lo, clmul_64(w, k->rev[i]));
+        hi = int128_xor(hi, clmul_64(w, k->rev[i + 1]));
+    }
+
+    r = (int128_getlo(lo) >> 63) |
+        ((int128_gethi(lo) ^ int128_getlo(hi)) << 1);
+    return revbit32(r);
+}
+
+uint32_t toeplitz_hash(const ToeplitzKey *k, const uint8_t *input, size_t len)
+{
+    assert(len <= k->max_input);
+
+    if (k->table) {
+        return toeplitz_hash_table(k, input, len);
+    }
+    return toeplitz_hash_clmul(k, input, len);
+}
+
+bool test_toeplitz_next_accel(void)
+{
+    if (HAVE_CLMUL_ACCEL && toeplitz_use_clmul) {
+        toeplitz_use_clmul = false;
+        return true;
+    }
+    return false;
+}